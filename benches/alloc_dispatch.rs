@@ -0,0 +1,55 @@
+//! `GlobalMiMalloc` dispatch vs. always going through `mi_malloc_aligned`
+use std::{alloc::GlobalAlloc, alloc::Layout, ffi::c_void, hint::black_box};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use mimalloc_rust::{
+    raw::{aligned_allocation::mi_malloc_aligned, basic_allocation::mi_free},
+    GlobalMiMalloc,
+};
+
+const BATCH: usize = 1024;
+
+const LAYOUTS: &[(usize, usize)] = &[
+    (8, 8),
+    (16, 8),
+    (24, 8),
+    (32, 16),
+    (64, 8),
+    (256, 8),
+    (4096, 16),
+    (64, 64),
+];
+
+fn alloc_free(c: &mut Criterion) {
+    let mut group = c.benchmark_group("alloc_free");
+    group.throughput(Throughput::Elements(BATCH as u64));
+    let mut ptrs = vec![core::ptr::null_mut::<u8>(); BATCH];
+    for &(size, align) in LAYOUTS {
+        let layout = Layout::from_size_align(size, align).unwrap();
+        let param = format!("{}/{}", size, align);
+        group.bench_with_input(BenchmarkId::new("mi_malloc_aligned", &param), &layout, |b, l| {
+            b.iter(|| unsafe {
+                for p in ptrs.iter_mut() {
+                    *p = mi_malloc_aligned(black_box(l.size()), black_box(l.align())) as *mut u8;
+                }
+                for p in ptrs.iter() {
+                    mi_free(*p as *mut c_void);
+                }
+            })
+        });
+        group.bench_with_input(BenchmarkId::new("GlobalMiMalloc", &param), &layout, |b, l| {
+            b.iter(|| unsafe {
+                for p in ptrs.iter_mut() {
+                    *p = GlobalMiMalloc.alloc(black_box(*l));
+                }
+                for p in ptrs.iter() {
+                    GlobalMiMalloc.dealloc(*p, *l);
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, alloc_free);
+criterion_main!(benches);
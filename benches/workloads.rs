@@ -0,0 +1,664 @@
+//! Allocation workloads on `GlobalMiMalloc`, `MiMallocHeap` (with the `unstable` feature) and the
+//! system allocator. Criterion measures the throughput; after each benchmark a separate pass times
+//! every operation on its own and prints the p50/p99 latencies (which include the cost of `Instant::now`).
+//!
+//! `cargo bench --bench workloads [--features unstable]`
+//!
+//! The hardening features (`secure` or any of `secure-guard-pages`, `secure-encoded-freelist`,
+//! `secure-random-extend` and `secure-double-free`) are appended to the names of the mimalloc rows, e.g.
+//! `GlobalMiMalloc+secure-double-free`, so that a run per feature gives a row per feature next to the
+//! unhardened one:
+//! `for f in secure-guard-pages secure-encoded-freelist secure-random-extend secure-double-free secure;
+//! do cargo bench --bench workloads --features $f -- workloads; done`
+//!
+//! The `arena_backing` group compares heaps in arenas over anonymous memory and over mapped files.
+//! The `page_extend` group measures bursts of small allocations that build the free lists of new pages.
+#![cfg_attr(feature = "unstable", feature(allocator_api))]
+use std::{
+    alloc::{GlobalAlloc, Layout, System},
+    hint::black_box,
+    ptr::null_mut,
+    sync::atomic::{AtomicPtr, Ordering},
+    thread,
+    time::Instant,
+};
+
+use criterion::{
+    criterion_group, criterion_main, measurement::WallTime, BenchmarkGroup, BenchmarkId, Criterion,
+    Throughput,
+};
+use mimalloc_rust::{
+    heap::{HeapVisitor, MiMallocHeap, OwnedHeap, ScopedHeap},
+    raw::{
+        heap::{mi_heap_area_t, mi_heap_collect},
+        types::mi_heap_t,
+    },
+    GlobalMiMalloc,
+};
+
+const THREADS: usize = 4;
+const SMALL_SIZES: &[usize] = &[8, 16, 24, 32, 48, 64, 96, 128, 256, 512];
+
+/// `MiMallocHeap` through the allocator API, with a heap per thread
+#[cfg(feature = "unstable")]
+struct ThreadHeap;
+
+#[cfg(feature = "unstable")]
+thread_local! {
+    static HEAP: MiMallocHeap<OwnedHeap> = MiMallocHeap::new(OwnedHeap::new());
+}
+
+#[cfg(feature = "unstable")]
+unsafe impl GlobalAlloc for ThreadHeap {
+    #[inline]
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        use std::alloc::Allocator;
+        HEAP.with(|heap| {
+            heap.allocate(layout)
+                .map_or(null_mut(), |p| p.as_ptr() as *mut u8)
+        })
+    }
+
+    #[inline]
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        use std::alloc::Allocator;
+        HEAP.with(|heap| heap.deallocate(std::ptr::NonNull::new_unchecked(ptr), layout))
+    }
+
+    #[inline]
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        use std::alloc::Allocator;
+        let ptr = std::ptr::NonNull::new_unchecked(ptr);
+        let new_layout = Layout::from_size_align_unchecked(new_size, layout.align());
+        HEAP.with(|heap| {
+            if new_size >= layout.size() {
+                heap.grow(ptr, layout, new_layout)
+            } else {
+                heap.shrink(ptr, layout, new_layout)
+            }
+            .map_or(null_mut(), |p| p.as_ptr() as *mut u8)
+        })
+    }
+}
+
+/// the hardening features mimalloc is built with, as a suffix of the names of its rows
+fn hardening() -> String {
+    let features = [
+        (cfg!(feature = "secure"), "secure"),
+        (cfg!(feature = "secure-guard-pages"), "secure-guard-pages"),
+        (
+            cfg!(feature = "secure-encoded-freelist"),
+            "secure-encoded-freelist",
+        ),
+        (
+            cfg!(feature = "secure-random-extend"),
+            "secure-random-extend",
+        ),
+        (cfg!(feature = "secure-double-free"), "secure-double-free"),
+    ];
+    // `secure` enables all the others
+    let enabled = features.iter().filter(|(on, _)| *on).map(|(_, name)| *name);
+    match enabled.clone().next() {
+        Some("secure") => "+secure".to_string(),
+        _ => enabled.map(|name| format!("+{}", name)).collect(),
+    }
+}
+
+/// run `$bench` (a generic `fn(&A, &mut Latency)`) on each allocator, then print its latencies
+macro_rules! bench_allocators {
+    ($group: expr, $name: literal, $ops: expr, $bench: ident) => {{
+        bench_allocator($group, $name, "System", $ops, |lat| $bench(&System, lat));
+        bench_allocator(
+            $group,
+            $name,
+            &format!("GlobalMiMalloc{}", hardening()),
+            $ops,
+            |lat| $bench(&GlobalMiMalloc, lat),
+        );
+        #[cfg(feature = "unstable")]
+        bench_allocator(
+            $group,
+            $name,
+            &format!("MiMallocHeap{}", hardening()),
+            $ops,
+            |lat| $bench(&ThreadHeap, lat),
+        );
+    }};
+}
+
+fn bench_allocator(
+    group: &mut BenchmarkGroup<'_, WallTime>,
+    name: &str,
+    allocator: &str,
+    ops: u64,
+    mut run: impl FnMut(&mut Latency),
+) {
+    group.throughput(Throughput::Elements(ops));
+    group.bench_function(BenchmarkId::new(name, allocator), |b| {
+        b.iter(|| run(&mut Latency::off()))
+    });
+    let mut lat = Latency::on(ops as usize);
+    run(&mut lat);
+    lat.report(name, allocator);
+}
+
+/// per operation durations in nanoseconds, only recorded in the latency pass
+struct Latency(Option<Vec<u32>>);
+
+impl Latency {
+    fn off() -> Self {
+        Self(None)
+    }
+
+    fn on(capacity: usize) -> Self {
+        Self(Some(Vec::with_capacity(capacity)))
+    }
+
+    #[inline(always)]
+    fn time<R>(&mut self, op: impl FnOnce() -> R) -> R {
+        match &mut self.0 {
+            None => op(),
+            Some(samples) => {
+                let start = Instant::now();
+                let res = op();
+                samples.push(start.elapsed().as_nanos().min(u32::MAX as u128) as u32);
+                res
+            }
+        }
+    }
+
+    fn merge(&mut self, other: Latency) {
+        if let (Some(samples), Some(other)) = (&mut self.0, other.0) {
+            samples.extend(other);
+        }
+    }
+
+    fn fork(&self, capacity: usize) -> Self {
+        match self.0 {
+            None => Self::off(),
+            Some(_) => Self::on(capacity),
+        }
+    }
+
+    fn report(self, name: &str, allocator: &str) {
+        let mut samples = self.0.unwrap_or_default();
+        if samples.is_empty() {
+            return;
+        }
+        samples.sort_unstable();
+        let at = |q: f64| samples[((samples.len() - 1) as f64 * q) as usize];
+        println!(
+            "{}/{}: latency p50 {}ns p99 {}ns ({} ops)",
+            name,
+            allocator,
+            at(0.50),
+            at(0.99),
+            samples.len()
+        );
+    }
+}
+
+/// xorshift64*, deterministic per seed so every allocator sees the same sequence
+struct Rng(u64);
+
+impl Rng {
+    fn new(seed: u64) -> Self {
+        Self(seed.wrapping_mul(0x9E3779B97F4A7C15) | 1)
+    }
+
+    #[inline]
+    fn below(&mut self, n: usize) -> usize {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        (self.0.wrapping_mul(0x2545F4914F6CDD1D) >> 32) as usize % n
+    }
+
+    #[inline]
+    fn small_layout(&mut self) -> Layout {
+        Layout::from_size_align(SMALL_SIZES[self.below(SMALL_SIZES.len())], 8).unwrap()
+    }
+}
+
+/// a slot array of live blocks; the blocks are allocated and freed by different threads
+struct Slots(Vec<(*mut u8, Layout)>);
+
+unsafe impl Send for Slots {}
+
+impl Slots {
+    fn new(len: usize) -> Self {
+        Self(vec![(null_mut(), Layout::new::<u8>()); len])
+    }
+
+    /// free the block in a random slot and allocate a new one in its place
+    #[inline]
+    fn replace<A: GlobalAlloc>(&mut self, a: &A, rng: &mut Rng, lat: &mut Latency) {
+        let slot = rng.below(self.0.len());
+        let (old, old_layout) = self.0[slot];
+        let layout = rng.small_layout();
+        let p = lat.time(|| unsafe {
+            if !old.is_null() {
+                a.dealloc(old, old_layout);
+            }
+            a.alloc(layout)
+        });
+        unsafe { p.write(slot as u8) };
+        self.0[slot] = (p, layout);
+    }
+
+    fn free_all<A: GlobalAlloc>(self, a: &A) {
+        for (p, layout) in self.0 {
+            if !p.is_null() {
+                unsafe { a.dealloc(p, layout) };
+            }
+        }
+    }
+}
+
+const CHURN_LIVE: usize = 1024;
+const CHURN_OPS: usize = 100_000;
+
+/// single thread, small objects: random replacement in a working set of `CHURN_LIVE` blocks
+fn churn<A: GlobalAlloc>(a: &A, lat: &mut Latency) {
+    let mut rng = Rng::new(1);
+    let mut slots = Slots::new(CHURN_LIVE);
+    for _ in 0..CHURN_OPS {
+        slots.replace(a, &mut rng, lat);
+    }
+    slots.free_all(a);
+}
+
+const LARSON_ROUNDS: usize = 4;
+const LARSON_LIVE: usize = 1000;
+const LARSON_OPS: usize = 10_000;
+
+/// larson: each round new threads take over the slot arrays of the previous round
+/// and replace their blocks, so most frees are of blocks of a thread that has terminated
+fn larson<A: GlobalAlloc + Sync>(a: &A, lat: &mut Latency) {
+    let mut all: Vec<Slots> = (0..THREADS).map(|_| Slots::new(LARSON_LIVE)).collect();
+    for round in 0..LARSON_ROUNDS {
+        let results: Vec<(Slots, Latency)> = thread::scope(|s| {
+            let workers: Vec<_> = all
+                .drain(..)
+                .enumerate()
+                .map(|(t, mut slots)| {
+                    let mut lat = lat.fork(LARSON_OPS);
+                    s.spawn(move || {
+                        let mut rng = Rng::new((round * THREADS + t) as u64 + 1);
+                        for _ in 0..LARSON_OPS {
+                            slots.replace(a, &mut rng, &mut lat);
+                        }
+                        (slots, lat)
+                    })
+                })
+                .collect();
+            workers.into_iter().map(|w| w.join().unwrap()).collect()
+        });
+        for (slots, thread_lat) in results {
+            all.push(slots);
+            lat.merge(thread_lat);
+        }
+    }
+    for slots in all {
+        slots.free_all(a);
+    }
+}
+
+const MSTRESS_TRANSFER: usize = 1024;
+const MSTRESS_OPS: usize = 25_000;
+
+/// mstress: threads allocate blocks and swap them into a shared transfer array,
+/// freeing whatever block (of another thread) they get back
+fn mstress<A: GlobalAlloc + Sync>(a: &A, lat: &mut Latency) {
+    // the size is stored in the first word of each block, for the `Layout` of the free
+    let layout_of =
+        |p: *mut u8| unsafe { Layout::from_size_align_unchecked(*(p as *mut usize), 8) };
+    let transfer: Vec<AtomicPtr<u8>> = (0..MSTRESS_TRANSFER)
+        .map(|_| AtomicPtr::new(null_mut()))
+        .collect();
+    let transfer = &transfer;
+    let lats: Vec<Latency> = thread::scope(|s| {
+        let workers: Vec<_> = (0..THREADS)
+            .map(|t| {
+                let mut lat = lat.fork(MSTRESS_OPS);
+                s.spawn(move || {
+                    let mut rng = Rng::new(t as u64 + 1);
+                    let mut local = Slots::new(64);
+                    for i in 0..MSTRESS_OPS {
+                        if i % 2 == 0 {
+                            local.replace(a, &mut rng, &mut lat);
+                            continue;
+                        }
+                        let layout = rng.small_layout();
+                        let slot = rng.below(MSTRESS_TRANSFER);
+                        lat.time(|| unsafe {
+                            let p = a.alloc(layout);
+                            *(p as *mut usize) = layout.size();
+                            let old = transfer[slot].swap(p, Ordering::AcqRel);
+                            if !old.is_null() {
+                                a.dealloc(old, layout_of(old));
+                            }
+                        });
+                    }
+                    local.free_all(a);
+                    lat
+                })
+            })
+            .collect();
+        workers.into_iter().map(|w| w.join().unwrap()).collect()
+    });
+    for thread_lat in lats {
+        lat.merge(thread_lat);
+    }
+    for p in transfer {
+        let p = p.swap(null_mut(), Ordering::Acquire);
+        if !p.is_null() {
+            unsafe { a.dealloc(p, layout_of(p)) };
+        }
+    }
+}
+
+const VEC_GROWTH_FROM: usize = 16;
+const VEC_GROWTH_TO: usize = 1 << 22;
+const VEC_GROWTH_REPEAT: usize = 16;
+
+/// the reallocations of a `Vec<u8>` that grows (by doubling) from 16 bytes to 4MiB
+fn vec_growth<A: GlobalAlloc>(a: &A, lat: &mut Latency) {
+    for _ in 0..VEC_GROWTH_REPEAT {
+        let mut layout = Layout::from_size_align(VEC_GROWTH_FROM, 1).unwrap();
+        let mut p = unsafe { a.alloc(layout) };
+        while layout.size() < VEC_GROWTH_TO {
+            let new_size = layout.size() * 2;
+            p = lat.time(|| unsafe { a.realloc(p, layout, new_size) });
+            layout = Layout::from_size_align(new_size, 1).unwrap();
+            unsafe { p.add(new_size - 1).write(1) };
+        }
+        unsafe { a.dealloc(p, layout) };
+    }
+}
+
+const ALIGNED_LAYOUTS: &[(usize, usize)] = &[
+    (16, 32),
+    (64, 64),
+    (100, 128),
+    (256, 256),
+    (1000, 1024),
+    (8, 4096),
+    (4096, 4096),
+    (70000, 65536),
+];
+const ALIGNED_BATCH: usize = 256;
+
+/// allocate a batch of each aligned layout, then free it
+fn aligned<A: GlobalAlloc>(a: &A, lat: &mut Latency) {
+    let mut blocks = [null_mut::<u8>(); ALIGNED_BATCH];
+    for &(size, align) in ALIGNED_LAYOUTS {
+        let layout = Layout::from_size_align(size, align).unwrap();
+        for p in blocks.iter_mut() {
+            *p = lat.time(|| unsafe { a.alloc(layout) });
+            assert_eq!(*p as usize % align, 0);
+        }
+        for &p in blocks.iter() {
+            lat.time(|| unsafe { a.dealloc(p, layout) });
+        }
+    }
+}
+
+fn workloads(c: &mut Criterion) {
+    let mut group = c.benchmark_group("workloads");
+    group.sample_size(20);
+    bench_allocators!(&mut group, "churn", CHURN_OPS as u64, churn);
+    bench_allocators!(
+        &mut group,
+        "larson",
+        (LARSON_ROUNDS * THREADS * LARSON_OPS) as u64,
+        larson
+    );
+    bench_allocators!(
+        &mut group,
+        "mstress",
+        (THREADS * MSTRESS_OPS) as u64,
+        mstress
+    );
+    let reallocs = (VEC_GROWTH_TO / VEC_GROWTH_FROM).trailing_zeros() as usize * VEC_GROWTH_REPEAT;
+    bench_allocators!(&mut group, "vec_growth", reallocs as u64, vec_growth);
+    bench_allocators!(
+        &mut group,
+        "aligned",
+        (2 * ALIGNED_LAYOUTS.len() * ALIGNED_BATCH) as u64,
+        aligned
+    );
+    group.finish();
+}
+
+const HEAP_BLOCKS: usize = 1000;
+const HEAP_CYCLES: usize = 16;
+
+/// a heap used as an arena: allocate `HEAP_BLOCKS` blocks and release them all at once
+fn heap_lifecycle(c: &mut Criterion) {
+    let mut group = c.benchmark_group("heap_lifecycle");
+    group.throughput(Throughput::Elements((HEAP_CYCLES * HEAP_BLOCKS) as u64));
+    let layout = Layout::from_size_align(64, 8).unwrap();
+    let mut blocks = vec![null_mut::<u8>(); HEAP_BLOCKS];
+    let mut cycles = |name: &str, cycle: &mut dyn FnMut(&mut [*mut u8], &mut Latency)| {
+        group.bench_function(name, |b| {
+            b.iter(|| {
+                for _ in 0..HEAP_CYCLES {
+                    cycle(&mut blocks, &mut Latency::off());
+                }
+            })
+        });
+        let mut lat = Latency::on(HEAP_CYCLES);
+        for _ in 0..HEAP_CYCLES {
+            cycle(&mut blocks, &mut lat);
+        }
+        lat.report("heap_lifecycle", name);
+    };
+    // the system allocator has no heaps: free each block
+    cycles("System", &mut |blocks, lat| {
+        lat.time(|| unsafe {
+            for p in blocks.iter_mut() {
+                *p = System.alloc(layout);
+            }
+            for &p in blocks.iter() {
+                System.dealloc(p, layout);
+            }
+        })
+    });
+    cycles("OwnedHeap", &mut |blocks, lat| {
+        lat.time(|| {
+            let heap = MiMallocHeap::new(OwnedHeap::new());
+            assert_eq!(heap.allocate_batch(layout, blocks), blocks.len());
+            unsafe { heap.deallocate_batch(blocks) };
+        })
+    });
+    cycles("ScopedHeap", &mut |blocks, lat| {
+        lat.time(|| {
+            let heap = MiMallocHeap::new(ScopedHeap::new());
+            assert_eq!(heap.allocate_batch(layout, blocks), blocks.len());
+            // dropping the heap frees all blocks at once
+        })
+    });
+    group.finish();
+}
+
+enum CountAreas {}
+
+#[derive(Default)]
+struct AreaCounter {
+    areas: usize,
+    used: usize,
+}
+
+impl<T: std::ops::Deref<Target = *mut mi_heap_t>> HeapVisitor<CountAreas, T> for AreaCounter {
+    fn visitor(
+        &mut self,
+        _heap: &mi_heap_t,
+        area: &mi_heap_area_t,
+        _block: *mut std::ffi::c_void,
+        _size: usize,
+    ) -> bool {
+        self.areas += 1;
+        self.used += area.used;
+        true
+    }
+}
+
+const VISIT_BLOCKS: usize = 100_000;
+
+/// walk the areas of a heap with `VISIT_BLOCKS` live blocks of mixed sizes
+fn heap_visit(c: &mut Criterion) {
+    let mut group = c.benchmark_group("heap_visit");
+    let heap = MiMallocHeap::new(OwnedHeap::new());
+    let mut rng = Rng::new(1);
+    let mut blocks = vec![null_mut::<u8>(); 1];
+    for _ in 0..VISIT_BLOCKS {
+        heap.allocate_batch(rng.small_layout(), &mut blocks);
+    }
+    let mut counter = AreaCounter::default();
+    HeapVisitor::<CountAreas, _>::visit(&mut counter, &heap);
+    group.throughput(Throughput::Elements(counter.areas as u64));
+    group.bench_function("HeapVisitor", |b| {
+        b.iter(|| {
+            let mut counter = AreaCounter::default();
+            HeapVisitor::<CountAreas, _>::visit(&mut counter, &heap);
+            black_box(counter.used)
+        })
+    });
+    let mut lat = Latency::on(1000);
+    for _ in 0..1000 {
+        lat.time(|| HeapVisitor::<CountAreas, _>::visit(&mut AreaCounter::default(), &heap));
+    }
+    lat.report("heap_visit", "HeapVisitor");
+    group.finish();
+    // the blocks are freed with the heap
+    unsafe { heap.heap.destroy() };
+}
+
+const ARENA_SIZE: usize = 64 << 20;
+const ARENA_BLOCKS: usize = 4096;
+
+/// a heap in an exclusive arena over anonymous memory and over mapped files: a file in the temporary
+/// directory, on `/dev/shm` and with `MIMALLOC_BENCH_HUGETLBFS=<dir>` on hugetlbfs (2MiB pages);
+/// each cycle allocates and writes `ARENA_BLOCKS` pages of 4KiB and destroys the heap
+#[cfg(target_os = "linux")]
+fn arena_backing(c: &mut Criterion) {
+    use mimalloc_rust::arena::{Arena, ArenaOptions};
+    use std::{ffi::CString, path::Path};
+    let mut group = c.benchmark_group("arena_backing");
+    group.sample_size(20);
+    let layout = Layout::from_size_align(4096, 8).unwrap();
+    group.throughput(Throughput::Bytes((ARENA_BLOCKS * layout.size()) as u64));
+    let mut arenas = vec![(
+        "anonymous",
+        Arena::reserve(ARENA_SIZE, &ArenaOptions::default()).unwrap(),
+    )];
+    let mut map_file = |name, dir: &Path, options: ArenaOptions| {
+        let path = dir.join(format!("mimalloc-bench-{}", std::process::id()));
+        let cpath = CString::new(path.to_str().unwrap()).unwrap();
+        match unsafe { Arena::map_file(&cpath, ARENA_SIZE, &options) } {
+            Ok(arena) => arenas.push((name, arena)),
+            Err(err) => println!(
+                "arena_backing/{}: cannot map {:?} (errno {})",
+                name, path, err
+            ),
+        }
+        let _ = std::fs::remove_file(&path);
+    };
+    let fresh = ArenaOptions {
+        is_zero: true,
+        ..ArenaOptions::default()
+    };
+    map_file("file", &std::env::temp_dir(), fresh);
+    if Path::new("/dev/shm").is_dir() {
+        map_file("shm", Path::new("/dev/shm"), fresh);
+    }
+    if let Some(dir) = std::env::var_os("MIMALLOC_BENCH_HUGETLBFS") {
+        let options = ArenaOptions {
+            is_zero: true,
+            ..ArenaOptions::hugetlbfs(2 << 20)
+        };
+        map_file("hugetlbfs", Path::new(&dir), options);
+    }
+    let mut blocks = vec![null_mut::<u8>(); ARENA_BLOCKS];
+    let cycle = |heap: MiMallocHeap<OwnedHeap>, blocks: &mut [*mut u8]| {
+        assert_eq!(heap.allocate_batch(layout, blocks), blocks.len());
+        for &p in blocks.iter() {
+            unsafe { p.write_bytes(1, layout.size()) };
+        }
+        unsafe { heap.heap.destroy() };
+    };
+    // the regular heap of the thread, on memory of the OS
+    group.bench_function("os", |b| {
+        b.iter(|| cycle(MiMallocHeap::new(OwnedHeap::new()), &mut blocks))
+    });
+    for (name, arena) in arenas {
+        group.bench_function(name, |b| {
+            b.iter(|| cycle(arena.new_heap().unwrap(), &mut blocks))
+        });
+        let mut lat = Latency::on(HEAP_CYCLES);
+        for _ in 0..HEAP_CYCLES {
+            lat.time(|| cycle(arena.new_heap().unwrap(), &mut blocks));
+        }
+        lat.report("arena_backing", name);
+    }
+    group.finish();
+}
+
+#[cfg(not(target_os = "linux"))]
+fn arena_backing(_c: &mut Criterion) {}
+
+const EXTEND_BLOCKS: usize = 16 * 1024;
+
+/// a burst of `EXTEND_BLOCKS` small allocations, each extending the free lists of pages: in a new heap
+/// (fresh pages, including the page faults) and again after freeing all blocks and a forced collect,
+/// which gives the pages back so that the next burst has to rebuild their free lists in cold memory
+fn page_extend(c: &mut Criterion) {
+    let mut group = c.benchmark_group("page_extend");
+    group.throughput(Throughput::Elements(EXTEND_BLOCKS as u64));
+    let mut blocks = vec![null_mut::<u8>(); EXTEND_BLOCKS];
+    for &size in &[8, 16, 32, 64] {
+        let layout = Layout::from_size_align(size, 8).unwrap();
+        let fresh = |blocks: &mut [*mut u8], lat: &mut Latency| {
+            let heap = MiMallocHeap::new(OwnedHeap::new());
+            lat.time(|| assert_eq!(heap.allocate_batch(layout, blocks), blocks.len()));
+            unsafe { heap.heap.destroy() };
+        };
+        group.bench_function(BenchmarkId::new("fresh", size), |b| {
+            b.iter(|| fresh(&mut blocks, &mut Latency::off()))
+        });
+        let mut lat = Latency::on(HEAP_CYCLES);
+        for _ in 0..HEAP_CYCLES {
+            fresh(&mut blocks, &mut lat);
+        }
+        lat.report("page_extend", &format!("fresh/{}", size));
+
+        let heap = MiMallocHeap::new(OwnedHeap::new());
+        let after_collect = |blocks: &mut [*mut u8], lat: &mut Latency| {
+            lat.time(|| assert_eq!(heap.allocate_batch(layout, blocks), blocks.len()));
+            unsafe {
+                heap.deallocate_batch(blocks);
+                mi_heap_collect(*heap.heap, true);
+            }
+        };
+        group.bench_function(BenchmarkId::new("after_collect", size), |b| {
+            b.iter(|| after_collect(&mut blocks, &mut Latency::off()))
+        });
+        let mut lat = Latency::on(HEAP_CYCLES);
+        for _ in 0..HEAP_CYCLES {
+            after_collect(&mut blocks, &mut lat);
+        }
+        lat.report("page_extend", &format!("after_collect/{}", size));
+    }
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    workloads,
+    heap_lifecycle,
+    heap_visit,
+    arena_backing,
+    page_extend
+);
+criterion_main!(benches);
@@ -28,6 +28,26 @@ fn main() {
         build.define("MI_SECURE", "4");
     }
 
+    #[cfg(feature = "secure-guard-pages")]
+    {
+        build.define("MI_SECURE_GUARD_PAGES", "2");
+    }
+
+    #[cfg(feature = "secure-encoded-freelist")]
+    {
+        build.define("MI_SECURE_ENCODED_FREELIST", "1");
+    }
+
+    #[cfg(feature = "secure-random-extend")]
+    {
+        build.define("MI_SECURE_RANDOM_EXTEND", "2");
+    }
+
+    #[cfg(feature = "secure-double-free")]
+    {
+        build.define("MI_SECURE_DOUBLE_FREE", "1");
+    }
+
     #[cfg(feature = "asm")]
     {
         build.flag_if_supported("-save-temps");
@@ -38,6 +58,46 @@ fn main() {
         build.define("MI_SKIP_COLLECT_ON_EXIT", "1");
     }
 
+    #[cfg(feature = "remote-free-buffer")]
+    {
+        build.define("MI_REMOTE_FREE_BUFFER", "1");
+    }
+
+    #[cfg(feature = "percpu")]
+    {
+        build.define("MI_PERCPU", "1");
+    }
+
+    #[cfg(feature = "stats")]
+    {
+        build.define("MI_STAT", "2");
+    }
+
+    #[cfg(feature = "latency-histograms")]
+    {
+        build.define("MI_STAT_LATENCY", "1");
+    }
+
+    #[cfg(feature = "sampling")]
+    {
+        build.define("MI_SAMPLE", "1");
+    }
+
+    #[cfg(feature = "lazy-init")]
+    {
+        build.define("MI_LAZY_INIT", "1");
+    }
+
+    #[cfg(feature = "arena-backend")]
+    {
+        build.define("MI_ARENA_BACKEND", "1");
+    }
+
+    #[cfg(feature = "aligned-pages")]
+    {
+        build.define("MI_ALIGNED_PAGES", "1");
+    }
+
     if target_family == "unix" && target_os != "haiku" {
         #[cfg(feature = "local-dynamic-tls")]
         {
@@ -57,6 +117,15 @@ fn main() {
         _ => build.define("MI_DEBUG_FUL", "3"),
     };
 
+    // with `MI_DEBUG` on, every block carries a `mi_padding_t` the rust side must account for
+    println!("cargo:rustc-check-cfg=cfg(mi_padding)");
+    if profile != "release" {
+        println!("cargo:rustc-cfg=mi_padding");
+    }
+
+    // `cc` emits `rerun-if-env-changed`, which turns off cargo's default scan of the package sources
+    println!("cargo:rerun-if-changed=mimalloc");
+
     if build.get_compiler().is_like_msvc() {
         build.cpp(true);
     }
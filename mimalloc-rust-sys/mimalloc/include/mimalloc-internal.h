@@ -63,6 +63,7 @@ void       _mi_random_init(mi_random_ctx_t* ctx);
 void       _mi_random_init_weak(mi_random_ctx_t* ctx);
 void       _mi_random_reinit_if_weak(mi_random_ctx_t * ctx);
 void       _mi_random_split(mi_random_ctx_t* ctx, mi_random_ctx_t* new_ctx);
+void       _mi_random_derive(const mi_random_ctx_t* seed, uint64_t nonce, mi_random_ctx_t* new_ctx);
 uintptr_t  _mi_random_next(mi_random_ctx_t* ctx);
 uintptr_t  _mi_heap_random_next(mi_heap_t* heap);
 uintptr_t  _mi_os_random_weak(uintptr_t extra_seed);
@@ -79,18 +80,38 @@ bool       _mi_preloading(void);  // true while the C runtime is not ready
 size_t     _mi_os_page_size(void);
 void       _mi_os_init(void);                                      // called from process init
 void*      _mi_os_alloc(size_t size, mi_stats_t* stats);           // to allocate thread local data
+bool       _mi_os_numa_bind(void* p, size_t size, int numa_node);  // prefer memory of `numa_node` (Linux only)
 void       _mi_os_free(void* p, size_t size, mi_stats_t* stats);   // to free thread local data
 size_t     _mi_os_good_alloc_size(size_t size);
 bool       _mi_os_has_overcommit(void);
 bool       _mi_os_reset(void* addr, size_t size, mi_stats_t* tld_stats);
+bool       _mi_os_thp_advise(void* p, size_t size, bool huge);  // (dis)allow transparent huge pages (Linux only)
+void*      _mi_os_remap(void* p, size_t oldsize, size_t newsize, size_t alignment, mi_stats_t* stats);  // grow without copying (Linux only)
+size_t     _mi_os_current_rss(void);
+int        _mi_os_rss_pressure(void);  // one of the `MI_RSS_` levels below (see `os.c`)
+void       _mi_os_rss_reset(void);
+
+#define MI_RSS_UNDER     (0)   // no RSS target, or well under it
+#define MI_RSS_NEAR      (1)   // over 7/8 of the target
+#define MI_RSS_OVER      (2)   // over the target
+#define MI_RSS_FAR_OVER  (3)   // over 9/8 of the target
 
 void*      _mi_os_alloc_aligned_offset(size_t size, size_t alignment, size_t align_offset, bool commit, bool* large, mi_stats_t* tld_stats);
 void       _mi_os_free_aligned(void* p, size_t size, size_t alignment, size_t align_offset, bool was_committed, mi_stats_t* tld_stats);
 
 
 // memory.c
-void*      _mi_mem_alloc_aligned(size_t size, size_t alignment, size_t offset, bool* commit, bool* large, bool* is_pinned, bool* is_zero, size_t* id, mi_os_tld_t* tld);
+void*      _mi_mem_alloc_aligned(size_t size, size_t alignment, size_t offset, mi_arena_id_t req_arena_id, bool* commit, bool* large, bool* is_pinned, bool* is_zero, size_t* id, mi_os_tld_t* tld);
 void       _mi_mem_free(void* p, size_t size, size_t alignment, size_t align_offset, size_t id, bool fully_committed, bool any_reset, mi_os_tld_t* tld);
+bool       _mi_mem_is_suitable(size_t id, mi_arena_id_t req_arena_id);  // can a heap of `req_arena_id` use this memory?
+mi_arena_id_t _mi_mem_arena_id(size_t id);                              // arena of the memory (0 if none)
+bool       _mi_mem_is_os(size_t id);                                    // direct OS memory (not in a region or arena)?
+
+// arena.c
+mi_arena_id_t _mi_arena_id_none(void);
+mi_arena_id_t _mi_arena_memid_arena_id(size_t arena_memid);
+void       _mi_arena_limit_add(mi_arena_id_t arena_id, size_t size, bool increase);
+bool       _mi_arena_limit_check(mi_arena_id_t arena_id, size_t size, mi_heap_t* heap);  // `false` if `size` more bytes go over the hard limit
 
 bool       _mi_mem_reset(void* p, size_t size, mi_os_tld_t* tld);
 bool       _mi_mem_unreset(void* p, size_t size, bool* is_zero, mi_os_tld_t* tld);
@@ -112,10 +133,16 @@ void       _mi_segment_huge_page_free(mi_segment_t* segment, mi_page_t* page, mi
 #else
 void       _mi_segment_huge_page_reset(mi_segment_t* segment, mi_page_t* page, mi_block_t* block);
 #endif
+mi_page_t* _mi_segment_huge_page_grow(mi_page_t* page, size_t block_size, mi_segments_tld_t* tld);  // grow without copying (the page moves along)
 
 void       _mi_segment_thread_collect(mi_segments_tld_t* tld);
 void       _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld);
+void       _mi_segment_transfer(mi_segment_t* segment, mi_segments_tld_t* from, mi_segments_tld_t* tld);
 void       _mi_abandoned_await_readers(void);
+size_t     _mi_segment_purge_run(void);  // reset the pages queued for the background thread
+
+// "purge.c"
+bool       _mi_purge_thread_is_active(void);
 
 
 
@@ -137,6 +164,9 @@ void       _mi_deferred_free(mi_heap_t* heap, bool force);
 
 void       _mi_page_free_collect(mi_page_t* page,bool force);
 void       _mi_page_reclaim(mi_heap_t* heap, mi_page_t* page);   // callback from segments
+mi_page_t* _mi_page_huge_grow(mi_heap_t* heap, mi_page_t* page, size_t size);       // grow a huge page without copying (see `mi_realloc`)
+void       _mi_page_limit_transfer(const mi_page_t* page, mi_heap_t* from, mi_heap_t* to);  // page changes heap (or is released)
+void       _mi_limit_exceeded(mi_heap_t* heap, mi_arena_id_t arena_id, size_t used, size_t limit);  // call the limit handler
 
 size_t     _mi_bin_size(uint8_t bin);           // for stats
 uint8_t    _mi_bin(size_t size);                // for stats
@@ -159,9 +189,17 @@ void*       _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t size, bool
 void*       _mi_heap_malloc_zero(mi_heap_t* heap, size_t size, bool zero) mi_attr_noexcept;
 void*       _mi_heap_malloc_zero_ex(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept;     // called from `_mi_heap_malloc_aligned`
 void*       _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept;
+size_t      _mi_usable_size_fresh(const void* p) mi_attr_noexcept;  // of a block that was just allocated
 mi_block_t* _mi_page_ptr_unalign(const mi_segment_t* segment, const mi_page_t* page, const void* p);
 bool        _mi_free_delayed_block(mi_block_t* block);
 void        _mi_free_generic(const mi_segment_t* segment, mi_page_t* page, bool is_local, void* p) mi_attr_noexcept;  // for runtime integration
+void        _mi_remote_free_flush(bool all_sandboxes);  // if MI_REMOTE_FREE_BUFFER
+
+// "sample.c" (if MI_SAMPLE)
+extern mi_decl_thread int64_t _mi_sample_countdown;   // bytes left until the next sample
+void        _mi_sample_record(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size) mi_attr_noexcept;
+void        _mi_sample_free(const mi_block_t* block) mi_attr_noexcept;
+void        _mi_sample_page_destroy(const mi_segment_t* segment, const mi_page_t* page) mi_attr_noexcept;
 
 #if MI_DEBUG>1
 bool        _mi_page_is_valid(mi_page_t* page);
@@ -528,6 +566,8 @@ static inline mi_heap_t* mi_page_heap(const mi_page_t* page) {
 
 static inline void mi_page_set_heap(mi_page_t* page, mi_heap_t* heap) {
   mi_assert_internal(mi_page_thread_free_flag(page) != MI_DELAYED_FREEING);
+  mi_heap_t* const from = mi_page_heap(page);
+  if (from != heap) { _mi_page_limit_transfer(page, from, heap); }
   mi_atomic_store_release(&page->xheap,(uintptr_t)heap);
 }
 
@@ -599,6 +639,14 @@ static inline void mi_page_set_has_aligned(mi_page_t* page, bool has_aligned) {
   page->flags.x.has_aligned = has_aligned;
 }
 
+static inline bool mi_page_has_sampled(const mi_page_t* page) {
+  return page->flags.x.has_sampled;
+}
+
+static inline void mi_page_set_has_sampled(mi_page_t* page, bool has_sampled) {
+  page->flags.x.has_sampled = has_sampled;
+}
+
 
 /* -------------------------------------------------------------------
 Encoding/Decoding the free list next pointers
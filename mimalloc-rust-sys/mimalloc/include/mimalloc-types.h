@@ -45,6 +45,27 @@ terms of the MIT license. A copy of the license can be found in the file
 #define MI_SECURE 0
 #endif
 
+// The mitigations can also be enabled one by one, each defaults to what the MI_SECURE level implies
+// (the remaining hardening of MI_SECURE, like randomized OS addresses, stays with MI_SECURE>0)
+// #define MI_SECURE_GUARD_PAGES 1       // guard page around metadata and at the end of each segment
+// #define MI_SECURE_GUARD_PAGES 2       // guard page around each mimalloc page
+// #define MI_SECURE_ENCODED_FREELIST 1  // encode free lists (detect corrupted free list (buffer overflow), and invalid pointer free)
+// #define MI_SECURE_RANDOM_EXTEND 1     // extend the free list of a page in random order
+// #define MI_SECURE_RANDOM_EXTEND 2     // + extend pages with free blocks half the time
+// #define MI_SECURE_DOUBLE_FREE 1       // checks for double free and invalid pointers (implies encoded free lists)
+#if !defined(MI_SECURE_GUARD_PAGES)
+#define MI_SECURE_GUARD_PAGES       (MI_SECURE>=2 ? 2 : MI_SECURE)
+#endif
+#if !defined(MI_SECURE_ENCODED_FREELIST)
+#define MI_SECURE_ENCODED_FREELIST  (MI_SECURE>=3)
+#endif
+#if !defined(MI_SECURE_RANDOM_EXTEND)
+#define MI_SECURE_RANDOM_EXTEND     (MI_SECURE>=3 ? 2 : (MI_SECURE>0))
+#endif
+#if !defined(MI_SECURE_DOUBLE_FREE)
+#define MI_SECURE_DOUBLE_FREE       (MI_SECURE>=4)
+#endif
+
 // Define MI_DEBUG for debug mode
 // #define MI_DEBUG 1  // basic assertion checks and statistics, check double free, corrupted free list, and invalid pointer free.
 // #define MI_DEBUG 2  // + internal assertion checks
@@ -66,10 +87,66 @@ terms of the MIT license. A copy of the license can be found in the file
 
 // Encoded free lists allow detection of corrupted free lists
 // and can detect buffer overflows, modify after free, and double `free`s.
-#if (MI_SECURE>=3 || MI_DEBUG>=1)
+#if (MI_SECURE_ENCODED_FREELIST || MI_SECURE_DOUBLE_FREE || MI_DEBUG>=1)
 #define MI_ENCODE_FREELIST  1
 #endif
 
+// Collect frees of blocks in pages owned by other threads in a small thread-local buffer
+// and push the blocks of each page with a single CAS on `xthread_free`, either when the buffer
+// of that page is full, when it is evicted for another page, or at the heartbeat (the allocation slow
+// path and `mi_collect`) and thread exit. While other threads still buffer frees into the segments of
+// a heap, `mi_heap_destroy` deletes the heap instead, as the buffered frees point into its pages.
+// #define MI_REMOTE_FREE_BUFFER 1
+#if !defined(MI_REMOTE_FREE_BUFFER)
+#define MI_REMOTE_FREE_BUFFER 0
+#endif
+#define MI_REMOTE_FREE_SLOTS  (8)    // pages with buffered frees per thread
+#define MI_REMOTE_FREE_BATCH  (32)   // buffered frees per page before pushing them
+
+// Provide heaps per CPU (instead of per thread) through `mi_percpu_heap_acquire` (Linux only)
+// #define MI_PERCPU 1
+#if !defined(MI_PERCPU)
+#define MI_PERCPU 0
+#endif
+#define MI_PERCPU_MAX  (1024)        // CPU ids beyond this use the thread-local heap
+
+// Make process and thread initialization cheap for short-lived processes and bursts of threads:
+// options are read from the environment on first use only, the random keys of thread heaps are
+// derived from a process seed without a system call (unless a secure mitigation that uses the keys
+// is enabled: the encoded free lists, double free detection or random extension), and the metadata of
+// terminated threads is kept pre-initialized in a larger pool (see `mi_thread_data_reserve`).
+// #define MI_LAZY_INIT 1
+#if !defined(MI_LAZY_INIT)
+#define MI_LAZY_INIT 0
+#endif
+
+// Manage the OS memory of segments and huge blocks in arenas only, instead of the fixed map of 256MiB
+// regions in `region.c` (which runs out at 256GiB, and where objects over 64MiB are not reused): when all
+// arenas are full a new one is reserved, twice the size of the previous one (from 256MiB up to 64GiB).
+// #define MI_ARENA_BACKEND 1
+#if !defined(MI_ARENA_BACKEND)
+#define MI_ARENA_BACKEND 0
+#endif
+
+// Sample about one allocation per `mi_option_sample_interval` bytes and record its stack trace,
+// see `mi_sample_print_out` for a (pprof compatible) profile of the live sampled blocks.
+// #define MI_SAMPLE 1
+#if !defined(MI_SAMPLE)
+#define MI_SAMPLE 0
+#endif
+#define MI_SAMPLE_MAX_DEPTH  (32)          // frames recorded per sample
+#define MI_SAMPLE_SLOTS_SHIFT (14)
+#define MI_SAMPLE_SLOTS      (1UL << MI_SAMPLE_SLOTS_SHIFT)   // table of the live samples, at most 3/4 is used
+
+// Serve aligned allocations up to MI_ALIGNMENT_MAX from the size class of the size rounded up to the alignment
+// instead of over-allocating by the alignment: large pages start at the largest power of two dividing their
+// block size (if that does not cost a block), like the small and medium pages already do, so all their blocks
+// are aligned (see `_mi_segment_page_start`).
+// #define MI_ALIGNED_PAGES 1
+#if !defined(MI_ALIGNED_PAGES)
+#define MI_ALIGNED_PAGES 0
+#endif
+
 
 // We used to abandon huge pages but to eagerly deallocate if freed from another thread,
 // but that makes it not possible to visit them during a heap walk or include them in a
@@ -205,23 +282,25 @@ typedef enum mi_delayed_e {
 } mi_delayed_t;
 
 
-// The `in_full` and `has_aligned` page flags are put in a union to efficiently
-// test if both are false (`full_aligned == 0`) in the `mi_free` routine.
+// The `in_full`, `has_aligned` and `has_sampled` page flags are put in a union to efficiently
+// test if all are false (`full_aligned == 0`) in the `mi_free` routine.
 #if !MI_TSAN
 typedef union mi_page_flags_s {
   uint8_t full_aligned;
   struct {
     uint8_t in_full : 1;
     uint8_t has_aligned : 1;
+    uint8_t has_sampled : 1;   // contains (or contained) a sampled block (if MI_SAMPLE)
   } x;
 } mi_page_flags_t;
 #else
 // under thread sanitizer, use a byte for each flag to suppress warning, issue #130
 typedef union mi_page_flags_s {
-  uint16_t full_aligned;
+  uint32_t full_aligned;
   struct {
     uint8_t in_full;
     uint8_t has_aligned;
+    uint8_t has_sampled;
   } x;
 } mi_page_flags_t;
 #endif
@@ -269,11 +348,12 @@ typedef struct mi_page_s {
   uint8_t               is_reset:1;        // `true` if the page memory was reset
   uint8_t               is_committed:1;    // `true` if the page virtual memory is committed
   uint8_t               is_zero_init:1;    // `true` if the page was zero initialized
+  uint8_t               is_purge_pending:1;// `true` if the page was handed to the background purge thread (see `segment.c:mi_purge_sync`)
 
   // layout like this to optimize access in `mi_malloc` and `mi_free`
   uint16_t              capacity;          // number of blocks committed, must be the first field, see `segment.c:page_clear`
   uint16_t              reserved;          // number of blocks reserved in memory
-  mi_page_flags_t       flags;             // `in_full` and `has_aligned` flags (8 bits)
+  mi_page_flags_t       flags;             // `in_full`, `has_aligned` and `has_sampled` flags (8 bits)
   uint8_t               is_zero:1;         // `true` if the blocks in the free list are zero initialized
   uint8_t               retire_expire:7;   // expiration count for retired blocks
 
@@ -310,6 +390,8 @@ typedef struct mi_segment_s {
   size_t               memid;            // id for the os-level memory manager
   bool                 mem_is_pinned;    // `true` if we cannot decommit/reset/protect in this memory (i.e. when allocated using large OS pages)
   bool                 mem_is_committed; // `true` if the whole segment is eagerly committed
+  int16_t              numa_node;        // NUMA node of the thread that allocated the segment
+  bool                 mem_is_thp;       // `true` if the segment is advised to use transparent huge pages (see `mi_option_thp_aware`)
   size_t               mem_alignment;    // page alignment for huge pages (only used for alignment > MI_ALIGNMENT_MAX)
   size_t               mem_align_offset; // offset for huge page alignment (only used for alignment > MI_ALIGNMENT_MAX)
 
@@ -320,6 +402,9 @@ typedef struct mi_segment_s {
 
   size_t               abandoned;        // abandoned pages (i.e. the original owning thread stopped) (`abandoned <= used`)
   size_t               abandoned_visits; // count how often this segment is visited in the abandoned list (to force reclaim if it is too long)
+  #if MI_REMOTE_FREE_BUFFER
+  _Atomic(size_t)      remote_buffered;  // count of the runs of frees that other threads buffer into its pages (see `mi_heap_destroy`)
+  #endif
 
   size_t               used;             // count of pages in use (`used <= capacity`)
   size_t               capacity;         // count of available pages (`#free + used`)
@@ -351,6 +436,11 @@ typedef struct mi_segment_s {
 // Thread local data
 typedef struct mi_tld_s mi_tld_t;
 
+// Number of heap tags per thread (including the untagged tag 0), see `mi_heap_tagged`
+#if !defined(MI_HEAP_TAGS)
+#define MI_HEAP_TAGS  (8)
+#endif
+
 // Pages of a certain block size are held in a queue.
 typedef struct mi_page_queue_s {
   mi_page_t* first;
@@ -396,10 +486,17 @@ struct mi_heap_s {
   uintptr_t             keys[2];                             // two random keys used to encode the `thread_delayed_free` list
   mi_random_ctx_t       random;                              // random number context used for secure allocation
   size_t                page_count;                          // total number of pages in the `pages` queues.
+  size_t                page_removed;                        // number of pages ever removed from the `pages` queues (validates a `mi_heap_cursor_t`)
   size_t                page_retired_min;                    // smallest retired index (retired pages are fully free, but still in the page queues)
   size_t                page_retired_max;                    // largest retired index into the `pages` array.
   mi_heap_t*            next;                                // list of heaps per thread
   bool                  no_reclaim;                          // `true` if this heap should not reclaim abandoned pages
+  bool                  movable;                             // `true` if this heap owns its segments and can move between threads
+  mi_arena_id_t         arena_id;                            // if not 0, the heap only allocates in this arena
+  size_t                limit_used;                          // bytes of the pages owned by this heap (see `mi_heap_set_limit`)
+  size_t                limit_soft;                          // call the limit handler when a fresh page goes over this (0 = no limit)
+  size_t                limit_hard;                          // fail allocation when a fresh page goes over this (0 = no limit)
+  uint8_t               tag;                                 // the tag of this heap (see `mi_heap_tagged`), 0 if untagged
 };
 
 
@@ -462,6 +559,36 @@ typedef struct mi_stat_counter_s {
   int64_t count;
 } mi_stat_counter_t;
 
+#define MI_STAT_NUMA_NODES  (8)   // nodes with separate statistics, higher nodes are counted with the last one
+
+// Define MI_STAT_LATENCY to record histograms of the latencies of the allocation slow path and
+// of its stages (also in release builds); each recording costs two reads of the monotonic clock.
+// #define MI_STAT_LATENCY 1
+#if !defined(MI_STAT_LATENCY)
+#define MI_STAT_LATENCY 0
+#endif
+
+typedef enum mi_stat_latency_e {
+  MI_STAT_LATENCY_GENERIC,        // `_mi_malloc_generic`: the whole slow path of an allocation
+  MI_STAT_LATENCY_DEFERRED_FREE,  // the deferred free callback and the delayed frees of other threads
+  MI_STAT_LATENCY_PAGE_SEARCH,    // `mi_find_page`: a page with free blocks, or a fresh one
+  MI_STAT_LATENCY_RECLAIM,        // reclaiming an abandoned segment
+  MI_STAT_LATENCY_SEGMENT_ALLOC,  // `mi_segment_os_alloc`: a segment from the cache, the arenas or the OS
+  MI_STAT_LATENCY_OS_COMMIT,      // committing OS memory
+  MI_STAT_LATENCY_STAGES
+} mi_stat_latency_t;
+
+// bucket 0 counts the latencies below 1ns, bucket `i` those in [2^(i-1), 2^i) ns and the last one all longer ones
+#define MI_STAT_LATENCY_BUCKETS  (32)
+
+typedef struct mi_stat_histogram_s {
+  int64_t count;   // entries of the stage
+  int64_t total;   // nanoseconds spent in it
+  int64_t buckets[MI_STAT_LATENCY_BUCKETS];
+} mi_stat_histogram_t;
+
+typedef int64_t  mi_nsecs_t;
+
 typedef struct mi_stats_s {
   mi_stat_count_t segments;
   mi_stat_count_t pages;
@@ -477,6 +604,7 @@ typedef struct mi_stats_s {
   mi_stat_count_t giant;
   mi_stat_count_t malloc;
   mi_stat_count_t segments_cache;
+  mi_stat_count_t segments_thp;      // segments on transparent huge pages
   mi_stat_counter_t pages_extended;
   mi_stat_counter_t mmap_calls;
   mi_stat_counter_t commit_calls;
@@ -485,6 +613,11 @@ typedef struct mi_stats_s {
   mi_stat_counter_t normal_count;
   mi_stat_counter_t huge_count;
   mi_stat_counter_t giant_count;
+  mi_stat_counter_t purge_resets;    // bytes reset by the background purge thread
+  mi_stat_count_t node_committed[MI_STAT_NUMA_NODES];  // committed segment memory per NUMA node
+#if MI_STAT_LATENCY
+  mi_stat_histogram_t latency[MI_STAT_LATENCY_STAGES];
+#endif
 #if MI_STAT>1
   mi_stat_count_t normal_bins[MI_BIN_HUGE+1];
 #endif
@@ -494,6 +627,8 @@ typedef struct mi_stats_s {
 void _mi_stat_increase(mi_stat_count_t* stat, size_t amount);
 void _mi_stat_decrease(mi_stat_count_t* stat, size_t amount);
 void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount);
+void _mi_stat_latency_record(mi_stats_t* stats, mi_stat_latency_t stage, mi_nsecs_t start);
+mi_nsecs_t _mi_clock_ns(void);
 
 #if (MI_STAT)
 #define mi_stat_increase(stat,amount)         _mi_stat_increase( &(stat), amount)
@@ -505,9 +640,21 @@ void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount);
 #define mi_stat_counter_increase(stat,amount) (void)0
 #endif
 
-#define mi_heap_stat_counter_increase(heap,stat,amount)  mi_stat_counter_increase( (heap)->tld->stats.stat, amount)
-#define mi_heap_stat_increase(heap,stat,amount)  mi_stat_increase( (heap)->tld->stats.stat, amount)
-#define mi_heap_stat_decrease(heap,stat,amount)  mi_stat_decrease( (heap)->tld->stats.stat, amount)
+#if MI_STAT_LATENCY
+#define mi_stat_latency_start()               _mi_clock_ns()
+#define mi_stat_latency(stats,stage,start)    _mi_stat_latency_record(stats, stage, start)
+#else
+#define mi_stat_latency_start()               ((mi_nsecs_t)0)
+#define mi_stat_latency(stats,stage,start)    MI_UNUSED(start)
+#endif
+
+// the statistics of a heap: those of its thread, or the main statistics (updated atomically) for the
+// shared per-CPU heaps (see `percpu.c`)
+#define mi_heap_stats(heap)                               ((heap)->tld->segments.stats)
+
+#define mi_heap_stat_counter_increase(heap,stat,amount)  mi_stat_counter_increase( mi_heap_stats(heap)->stat, amount)
+#define mi_heap_stat_increase(heap,stat,amount)  mi_stat_increase( mi_heap_stats(heap)->stat, amount)
+#define mi_heap_stat_decrease(heap,stat,amount)  mi_stat_decrease( mi_heap_stats(heap)->stat, amount)
 
 // ------------------------------------------------------
 // Thread Local data
@@ -522,9 +669,13 @@ typedef struct mi_segment_queue_s {
 } mi_segment_queue_t;
 
 // OS thread local data
+#define MI_SEGMENT_TLD_CACHE_MAX  (8)  // upper bound of `mi_option_segment_thread_cache`
+
 typedef struct mi_os_tld_s {
   size_t                region_idx;   // start point for next allocation
   mi_stats_t*           stats;        // points to tld stats
+  size_t                segment_cache_count;                          // segments in `segment_cache`
+  struct mi_segment_s*  segment_cache[MI_SEGMENT_TLD_CACHE_MAX];      // recently freed segments of this thread (LIFO, see `segment.c`)
 } mi_os_tld_t;
 
 // Segments thread local data
@@ -538,6 +689,7 @@ typedef struct mi_segments_tld_s {
   size_t              peak_size;    // peak size of all segments
   mi_stats_t*         stats;        // points to tld stats
   mi_os_tld_t*        os;           // points to os stats
+  bool                shared;       // segments are shared between threads (per-CPU heaps) and have no owning thread
 } mi_segments_tld_t;
 
 // Thread local data
@@ -549,6 +701,7 @@ struct mi_tld_s {
   mi_segments_tld_t   segments;      // segment tld
   mi_os_tld_t         os;            // os tld
   mi_stats_t          stats;         // statistics
+  mi_heap_t*          heap_tagged[MI_HEAP_TAGS]; // heaps of this thread per tag, created on first use (0 is the backing heap)
 };
 
 #endif
@@ -144,6 +144,7 @@ mi_decl_nodiscard mi_decl_export mi_decl_restrict char* mi_realpath(const char*
 #define MI_SMALL_SIZE_MAX   (MI_SMALL_WSIZE_MAX*sizeof(void*))
 
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_malloc_small(size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(1);
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_malloc_small_wsize(size_t wsize) mi_attr_noexcept mi_attr_malloc;
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_zalloc_small(size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(1);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_zalloc(size_t size)       mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(1);
 
@@ -175,10 +176,29 @@ mi_decl_export void mi_stats_merge(void)      mi_attr_noexcept;
 mi_decl_export void mi_stats_print(void* out) mi_attr_noexcept;  // backward compatibility: `out` is ignored and should be NULL
 mi_decl_export void mi_stats_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept;
 
+// Copy the merged statistics into `stats` without formatting. `stats_size` is the `sizeof(mi_stats_t)`
+// the caller sees, as the per-bin counts only exist with `MI_STAT>1` (a larger `stats` is zero filled).
+struct mi_stats_s;
+mi_decl_export void mi_stats_get(size_t stats_size, struct mi_stats_s* stats) mi_attr_noexcept;
+
+// Print the live sampled blocks (if built with MI_SAMPLE) as a heap profile in the legacy text format of pprof
+mi_decl_export void mi_sample_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept;
+
+// Background thread that does the delayed page resets (every `mi_option_purge_interval` milli-seconds)
+// instead of the allocating threads; `start` returns `true` if the thread runs (also if it already did)
+mi_decl_export bool mi_purge_thread_start(void) mi_attr_noexcept;
+mi_decl_export void mi_purge_thread_stop(void)  mi_attr_noexcept;
+
+// Nanoseconds of the monotonic clock mimalloc uses for its statistics (at least milli-second resolution)
+mi_decl_export long long mi_clock_ns(void) mi_attr_noexcept;
+
 mi_decl_export void mi_process_init(void)     mi_attr_noexcept;
 mi_decl_export void mi_thread_init(void)      mi_attr_noexcept;
 mi_decl_export void mi_thread_done(void)      mi_attr_noexcept;
 mi_decl_export void mi_thread_stats_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept;
+// pre-allocate the metadata of up to `count` threads (bounded by the thread metadata cache) so that
+// threads created next do not allocate it; returns the number of cached thread metadata blocks
+mi_decl_export size_t mi_thread_data_reserve(size_t count) mi_attr_noexcept;
 
 mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, size_t* system_msecs,
                                     size_t* current_rss, size_t* peak_rss,
@@ -215,11 +235,26 @@ mi_decl_export mi_heap_t* mi_heap_get_default(void);
 mi_decl_export mi_heap_t* mi_heap_get_backing(void);
 mi_decl_export void       mi_heap_collect(mi_heap_t* heap, bool force) mi_attr_noexcept;
 
+// Movable heaps own their segments and can be handed to another thread: detach it on the owning thread,
+// attach it on the receiving thread, and delete, destroy or absorb it there.
+mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_movable(void);
+mi_decl_export bool       mi_heap_detach(mi_heap_t* heap);
+mi_decl_export bool       mi_heap_attach(mi_heap_t* heap);
+mi_decl_export bool       mi_heap_absorb_movable(mi_heap_t* heap, mi_heap_t* from);
+
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc(mi_heap_t* heap, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(2);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_zalloc(mi_heap_t* heap, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(2);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_calloc(mi_heap_t* heap, size_t count, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size2(2, 3);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_mallocn(mi_heap_t* heap, size_t count, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size2(2, 3);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc_small(mi_heap_t* heap, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(2);
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc_small_wsize(mi_heap_t* heap, size_t wsize) mi_attr_noexcept mi_attr_malloc;
+mi_decl_nodiscard mi_decl_export size_t mi_heap_malloc_batch(mi_heap_t* heap, size_t size, void** blocks, size_t count) mi_attr_noexcept;
+
+// Per-CPU heaps (if built with MI_PERCPU): acquire the heap of the current CPU for one operation,
+// or the thread-local default heap if that one is held by another thread.
+mi_decl_nodiscard mi_decl_export mi_heap_t* mi_percpu_heap_acquire(void) mi_attr_noexcept;
+mi_decl_export void mi_percpu_heap_release(mi_heap_t* heap) mi_attr_noexcept;
+mi_decl_export void mi_percpu_free(void* p) mi_attr_noexcept;
 
 mi_decl_nodiscard mi_decl_export void* mi_heap_realloc(mi_heap_t* heap, void* p, size_t newsize)              mi_attr_noexcept mi_attr_alloc_size(3);
 mi_decl_nodiscard mi_decl_export void* mi_heap_reallocn(mi_heap_t* heap, void* p, size_t count, size_t size)  mi_attr_noexcept mi_attr_alloc_size2(3,4);
@@ -263,6 +298,20 @@ mi_decl_nodiscard mi_decl_export void* mi_heap_recalloc_aligned(mi_heap_t* heap,
 mi_decl_nodiscard mi_decl_export void* mi_heap_recalloc_aligned_at(mi_heap_t* heap, void* p, size_t newcount, size_t size, size_t alignment, size_t offset) mi_attr_noexcept mi_attr_alloc_size2(3,4);
 
 
+// ------------------------------------------------------
+// Allocation that also returns the usable size of the block (`mi_usable_size`, 0 on failure),
+// all of which the caller may use; no `alloc_size` attribute for that reason.
+// ------------------------------------------------------
+
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc_usable(mi_heap_t* heap, size_t size, size_t* usable) mi_attr_noexcept mi_attr_malloc;
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc_aligned_usable(mi_heap_t* heap, size_t size, size_t alignment, size_t* usable) mi_attr_noexcept mi_attr_malloc;
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_zalloc_aligned_usable(mi_heap_t* heap, size_t size, size_t alignment, size_t* usable) mi_attr_noexcept mi_attr_malloc;
+mi_decl_nodiscard mi_decl_export void* mi_heap_realloc_aligned_usable(mi_heap_t* heap, void* p, size_t newsize, size_t alignment, size_t* usable) mi_attr_noexcept;
+// `oldsize` is the size the caller used of `p`: everything from it up to the new usable size is zero,
+// also the slack of `p` the caller may have written to
+mi_decl_nodiscard mi_decl_export void* mi_heap_rezalloc_aligned_usable(mi_heap_t* heap, void* p, size_t oldsize, size_t newsize, size_t alignment, size_t* usable) mi_attr_noexcept;
+
+
 // ------------------------------------------------------
 // Analysis
 // ------------------------------------------------------
@@ -285,6 +334,16 @@ typedef bool (mi_cdecl mi_block_visit_fun)(const mi_heap_t* heap, const mi_heap_
 
 mi_decl_export bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_all_blocks, mi_block_visit_fun* visitor, void* arg);
 
+// Position in the pages of a heap to resume a visit; start with all zeros.
+typedef struct mi_heap_cursor_s {
+  size_t      bin;      // page queue to visit next
+  size_t      index;    // number of pages of that queue visited already
+  const void* page;     // page of that queue to visit next (NULL at the start of the queue)
+  size_t      removed;  // pages the heap had removed when `page` was saved (see `mi_heap_visit_pages_from`)
+} mi_heap_cursor_t;
+
+mi_decl_export bool mi_heap_visit_blocks_from(const mi_heap_t* heap, mi_heap_cursor_t* cursor, size_t max_areas, bool visit_all_blocks, mi_block_visit_fun* visitor, void* arg);
+
 // Experimental
 mi_decl_nodiscard mi_decl_export bool mi_is_in_heap_region(const void* p) mi_attr_noexcept;
 mi_decl_nodiscard mi_decl_export bool mi_is_redirected(void) mi_attr_noexcept;
@@ -302,10 +361,23 @@ mi_decl_export int   mi_reserve_huge_os_pages_at_ex(size_t pages, int numa_node,
 mi_decl_export int   mi_reserve_os_memory_ex(size_t size, bool commit, bool allow_large, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept;
 mi_decl_export bool  mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept;
 
-#if MI_MALLOC_VERSION >= 200
 // Create a heap that only allocates in the specified arena
 mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_in_arena(mi_arena_id_t arena_id);
-#endif
+
+// Experimental: tagged heaps of the current thread (created on first use), so that blocks of different
+// tags never share a page. Tag 0 is the backing heap; returns NULL for tags from `MI_HEAP_TAGS` (8) on.
+mi_decl_export mi_heap_t* mi_heap_tagged(int tag);
+mi_decl_export int        mi_heap_get_tag(const mi_heap_t* heap);
+
+// Experimental: byte budgets of the pages of a heap or arena (0 is no limit). When a fresh page would go over
+// the soft limit the limit handler is called (with `arena_id` 0 for the limit of the heap itself),
+// and over the hard limit the allocation fails.
+typedef void (mi_cdecl mi_limit_fun)(mi_heap_t* heap, mi_arena_id_t arena_id, size_t used, size_t limit, void* arg);
+mi_decl_export void   mi_register_limit_handler(mi_limit_fun* fun, void* arg) mi_attr_noexcept;
+mi_decl_export void   mi_heap_set_limit(mi_heap_t* heap, size_t soft_limit, size_t hard_limit) mi_attr_noexcept;
+mi_decl_export size_t mi_heap_limit_used(const mi_heap_t* heap) mi_attr_noexcept;
+mi_decl_export bool   mi_arena_set_limit(mi_arena_id_t arena_id, size_t soft_limit, size_t hard_limit) mi_attr_noexcept;
+mi_decl_export size_t mi_arena_limit_used(mi_arena_id_t arena_id) mi_attr_noexcept;
 
 // deprecated
 mi_decl_export int  mi_reserve_huge_os_pages(size_t pages, double max_secs, size_t* pages_reserved) mi_attr_noexcept;
@@ -360,6 +432,12 @@ typedef enum mi_option_e {
   mi_option_max_warnings,
   mi_option_max_segment_reclaim,
   mi_option_destroy_on_exit,
+  mi_option_sample_interval,          // sample about one allocation per N bytes (if built with MI_SAMPLE), 0 = no sampling
+  mi_option_numa_strict,              // only use arenas of the current NUMA node, and only reclaim abandoned segments of it
+  mi_option_purge_interval,           // milli-seconds between the runs of the background purge thread (see `mi_purge_thread_start`)
+  mi_option_rss_target,               // try to keep the resident set under N MiB by giving back free memory more eagerly, 0 = no target
+  mi_option_thp_aware,                // put small and medium page segments on transparent huge pages (fully committed), and the others explicitly not
+  mi_option_segment_thread_cache,     // number of freed segments each thread keeps for reuse (at most 8)
   _mi_option_last
 } mi_option_t;
 
@@ -407,6 +485,7 @@ mi_decl_export int mi_wdupenv_s(unsigned short** buf, size_t* size, const unsign
 mi_decl_export void mi_free_size(void* p, size_t size)                           mi_attr_noexcept;
 mi_decl_export void mi_free_size_aligned(void* p, size_t size, size_t alignment) mi_attr_noexcept;
 mi_decl_export void mi_free_aligned(void* p, size_t alignment)                   mi_attr_noexcept;
+mi_decl_export void mi_free_batch(void* const* blocks, size_t count)           mi_attr_noexcept;
 
 // The `mi_new` wrappers implement C++ semantics on out-of-memory instead of directly returning `NULL`.
 // (and call `std::get_new_handler` and potentially raise a `std::bad_alloc` exception).
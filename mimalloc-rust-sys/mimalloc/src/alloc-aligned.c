@@ -30,6 +30,20 @@ static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_fallback(mi_heap_t*
     return p;
   }
 
+  #if MI_ALIGNED_PAGES
+  // the blocks of a size class that is a multiple of the alignment are aligned (see `_mi_segment_page_start`),
+  // so allocate the size rounded up to the alignment instead of over-allocating
+  if (offset == 0 && alignment <= MI_ALIGNMENT_MAX) {
+    const size_t asize = _mi_align_up(padsize, alignment);
+    if (asize <= MI_LARGE_OBJ_SIZE_MAX && (_mi_bin_size(_mi_bin(asize)) & align_mask) == 0) {
+      void* p = _mi_heap_malloc_zero(heap, asize - MI_PADDING_SIZE, zero);
+      if (p == NULL || ((uintptr_t)p & align_mask) == 0) return p;
+      // the page could not be aligned without losing a block (e.g. with guard pages)
+      mi_free(p);
+    }
+  }
+  #endif
+
   void* p;
   size_t oversize;
   if mi_unlikely(alignment > MI_ALIGNMENT_MAX) {
@@ -284,6 +298,49 @@ mi_decl_nodiscard void* mi_heap_rezalloc_aligned(mi_heap_t* heap, void* p, size_
   return mi_heap_realloc_zero_aligned(heap, p, newsize, alignment, true);
 }
 
+// ------------------------------------------------------
+// Aligned (re-)allocation that also returns the usable size
+// ------------------------------------------------------
+
+static void* mi_usable_size_out(void* p, size_t* usable) {
+  if (usable != NULL) { *usable = (p == NULL ? 0 : _mi_usable_size_fresh(p)); }
+  return p;
+}
+
+mi_decl_nodiscard mi_decl_restrict void* mi_heap_malloc_aligned_usable(mi_heap_t* heap, size_t size, size_t alignment, size_t* usable) mi_attr_noexcept {
+  return mi_usable_size_out(mi_heap_malloc_aligned(heap, size, alignment), usable);
+}
+
+// the whole usable size is zero initialized
+mi_decl_nodiscard mi_decl_restrict void* mi_heap_zalloc_aligned_usable(mi_heap_t* heap, size_t size, size_t alignment, size_t* usable) mi_attr_noexcept {
+  return mi_usable_size_out(mi_heap_zalloc_aligned(heap, size, alignment), usable);
+}
+
+mi_decl_nodiscard void* mi_heap_realloc_aligned_usable(mi_heap_t* heap, void* p, size_t newsize, size_t alignment, size_t* usable) mi_attr_noexcept {
+  return mi_usable_size_out(mi_heap_realloc_aligned(heap, p, newsize, alignment), usable);
+}
+
+// as `mi_heap_rezalloc_aligned` but a grown block is zero initialized up to its usable size (instead of `newsize`)
+mi_decl_nodiscard void* mi_heap_rezalloc_aligned_usable(mi_heap_t* heap, void* p, size_t oldsize, size_t newsize, size_t alignment, size_t* usable) mi_attr_noexcept {
+  const size_t size = mi_usable_size(p);
+  size_t newusable;
+  void* newp = mi_usable_size_out(mi_heap_rezalloc_aligned(heap, p, newsize, alignment), &newusable);
+  if (newp != NULL) {
+    // the slack `[oldsize, size)` is kept in place or copied as is, beyond it `mi_heap_rezalloc_aligned`
+    // zeroes up to `newsize`, and the rest of the new usable size is cleared here
+    const size_t slack_end = (size < newusable ? size : newusable);
+    if (oldsize < slack_end) {
+      memset((uint8_t*)newp + oldsize, 0, slack_end - oldsize);
+    }
+    const size_t zero_end = (newsize > size ? newsize : size);
+    if (newusable > zero_end) {
+      memset((uint8_t*)newp + zero_end, 0, newusable - zero_end);
+    }
+  }
+  if (usable != NULL) { *usable = newusable; }
+  return newp;
+}
+
 mi_decl_nodiscard void* mi_heap_recalloc_aligned_at(mi_heap_t* heap, void* p, size_t newcount, size_t size, size_t alignment, size_t offset) mi_attr_noexcept {
   size_t total;
   if (mi_count_size_overflow(newcount, size, &total)) return NULL;
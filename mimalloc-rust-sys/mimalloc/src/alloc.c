@@ -54,8 +54,9 @@ extern inline void* _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t siz
   if (!page->is_zero && !zero && !mi_page_is_huge(page)) {
     memset(block, MI_DEBUG_UNINIT, mi_page_usable_block_size(page));
   }
-#elif (MI_SECURE!=0)
-  if (!zero) { block->next = 0; } // don't leak internal data
+  else if (!zero) { block->next = 0; } // don't leak the (encoded) free list link
+#elif (MI_ENCODE_FREELIST || MI_SECURE!=0)
+  if (!zero) { block->next = 0; } // don't leak internal data, an encoded link exposes the page keys
 #endif
 
 #if (MI_STAT>0)
@@ -86,6 +87,14 @@ extern inline void* _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t siz
   }
 #endif
 
+#if MI_SAMPLE
+  // a single thread-local subtraction; `_mi_sample_record` runs about once per sample interval
+  _mi_sample_countdown -= (int64_t)size;
+  if mi_unlikely(_mi_sample_countdown < 0) {
+    _mi_sample_record(heap, page, block, size - MI_PADDING_SIZE);
+  }
+#endif
+
   return block;
 }
 
@@ -123,6 +132,32 @@ mi_decl_nodiscard extern inline mi_decl_restrict void* mi_malloc_small(size_t si
   return mi_heap_malloc_small(mi_get_default_heap(), size);
 }
 
+// allocate a small block of `wsize` words where the caller already computed the size class
+// (`wsize = max(1, _mi_wsize_from_size(size))`, e.g. at compile time): this indexes the direct
+// page array without the size computations of `mi_heap_malloc_small`.
+mi_decl_nodiscard extern inline mi_decl_restrict void* mi_heap_malloc_small_wsize(mi_heap_t* heap, size_t wsize) mi_attr_noexcept {
+  mi_assert(heap != NULL);
+  mi_assert(heap->thread_id == 0 || heap->thread_id == _mi_thread_id()); // heaps are thread local
+  mi_assert(wsize > 0 && wsize <= MI_SMALL_WSIZE_MAX);
+  mi_assert_internal(MI_PADDING_SIZE == MI_PADDING_WSIZE * MI_INTPTR_SIZE);
+  const size_t size = wsize * MI_INTPTR_SIZE;
+  mi_page_t* page = heap->pages_free_direct[wsize + MI_PADDING_WSIZE];
+  void* p = _mi_page_malloc(heap, page, size + MI_PADDING_SIZE, false);
+  mi_assert_internal(p == NULL || mi_usable_size(p) >= size);
+#if MI_STAT>1
+  if (p != NULL) {
+    if (!mi_heap_is_initialized(heap)) { heap = mi_get_default_heap(); }
+    mi_heap_stat_increase(heap, malloc, mi_usable_size(p));
+  }
+#endif
+  mi_track_malloc(p,size,false);
+  return p;
+}
+
+mi_decl_nodiscard extern inline mi_decl_restrict void* mi_malloc_small_wsize(size_t wsize) mi_attr_noexcept {
+  return mi_heap_malloc_small_wsize(mi_get_default_heap(), wsize);
+}
+
 // The main allocation function
 extern inline void* _mi_heap_malloc_zero_ex(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept {
   if mi_likely(size <= MI_SMALL_SIZE_MAX) {
@@ -170,13 +205,61 @@ mi_decl_nodiscard mi_decl_restrict void* mi_zalloc(size_t size) mi_attr_noexcept
   return mi_heap_zalloc(mi_get_default_heap(),size);
 }
 
+// Allocate `count` blocks of `size` bytes into `blocks` and return how many were allocated
+// (which is less than `count` only if we ran out of memory).
+// Small blocks are popped from the free list of the current page until it is exhausted, so the
+// size class and page lookup is done once per page instead of once per block.
+mi_decl_nodiscard size_t mi_heap_malloc_batch(mi_heap_t* heap, size_t size, void** blocks, size_t count) mi_attr_noexcept {
+  mi_assert(heap != NULL);
+  mi_assert(blocks != NULL || count == 0);
+  if mi_unlikely(!mi_heap_is_initialized(heap)) {
+    // initialize here as the small block loop below would otherwise take the generic path for every block
+    mi_thread_init();
+    heap = mi_get_default_heap();
+    if mi_unlikely(!mi_heap_is_initialized(heap)) { return 0; }
+  }
+  size_t n = 0;
+  if mi_likely(size <= MI_SMALL_SIZE_MAX) {
+    #if (MI_PADDING)
+    if (size == 0) {
+      size = sizeof(void*);
+    }
+    #endif
+    while (n < count) {
+      mi_page_t* const page = _mi_heap_get_free_small_page(heap, size + MI_PADDING_SIZE);
+      while (n < count && page->free != NULL) {
+        void* const p = _mi_page_malloc(heap, page, size + MI_PADDING_SIZE, false);
+        #if MI_STAT>1
+        mi_heap_stat_increase(heap, malloc, mi_usable_size(p));
+        #endif
+        mi_track_malloc(p,size,false);
+        blocks[n++] = p;
+      }
+      if (n < count) {
+        // the free list is exhausted: take the generic path which collects or finds a fresh page
+        void* const p = mi_heap_malloc_small_zero(heap, size, false);
+        if mi_unlikely(p == NULL) break;
+        blocks[n++] = p;
+      }
+    }
+  }
+  else {
+    while (n < count) {
+      void* const p = mi_heap_malloc(heap, size);
+      if mi_unlikely(p == NULL) break;
+      blocks[n++] = p;
+    }
+  }
+  return n;
+}
+
 
 // ------------------------------------------------------
 // Check for double free in secure and debug mode
-// This is somewhat expensive so only enabled for secure mode 4
+// This is somewhat expensive so only enabled for secure mode 4 (or `MI_SECURE_DOUBLE_FREE`)
 // ------------------------------------------------------
 
-#if (MI_ENCODE_FREELIST && (MI_SECURE>=4 || MI_DEBUG!=0))
+#if (MI_ENCODE_FREELIST && (MI_SECURE_DOUBLE_FREE || MI_DEBUG!=0))
 // linear check if the free list contains a specific element
 static bool mi_list_contains(const mi_page_t* page, const mi_block_t* list, const mi_block_t* elem) {
   while (list != NULL) {
@@ -298,6 +381,15 @@ static void mi_padding_shrink(const mi_page_t* page, const mi_block_t* block, co
   mi_padding_t* padding = (mi_padding_t*)((uint8_t*)block + bsize);
   padding->delta = (uint32_t)new_delta;
 }
+
+// Set up the padding of a huge block for `size` bytes (including the padding) after its page grew (as in `_mi_page_malloc`)
+static void mi_padding_init_huge(const mi_page_t* page, const mi_block_t* block, const size_t size) {
+  mi_padding_t* const padding = (mi_padding_t*)((uint8_t*)block + mi_page_usable_block_size(page));
+  const ptrdiff_t delta = ((uint8_t*)padding - (uint8_t*)block - (size - MI_PADDING_SIZE));
+  mi_assert_internal(delta >= 0);
+  padding->canary = (uint32_t)(mi_ptr_encode(page,block,page->keys));
+  padding->delta  = (uint32_t)(delta);
+}
 #else
 static void mi_check_padding(const mi_page_t* page, const mi_block_t* block) {
   MI_UNUSED(page);
@@ -314,6 +406,12 @@ static void mi_padding_shrink(const mi_page_t* page, const mi_block_t* block, co
   MI_UNUSED(block);
   MI_UNUSED(min_size);
 }
+
+static void mi_padding_init_huge(const mi_page_t* page, const mi_block_t* block, const size_t size) {
+  MI_UNUSED(page);
+  MI_UNUSED(block);
+  MI_UNUSED(size);
+}
 #endif
 
 // only maintain stats for smaller objects if requested
@@ -376,6 +474,114 @@ static void mi_stat_huge_free(const mi_page_t* page) {
 // Free
 // ------------------------------------------------------
 
+// Push a chain of blocks from `first` to `last` that belong to a page owned by another thread
+// onto the `xthread_free` list of that page (or the delayed free list of its heap) at once.
+static mi_decl_noinline void mi_free_run_mt(mi_page_t* page, mi_block_t* first, mi_block_t* last)
+{
+  mi_thread_free_t tfreex;
+  bool use_delayed;
+  mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
+  do {
+    use_delayed = (mi_tf_delayed(tfree) == MI_USE_DELAYED_FREE);
+    if mi_unlikely(use_delayed) {
+      tfreex = mi_tf_set_delayed(tfree,MI_DELAYED_FREEING);
+    }
+    else {
+      mi_block_set_next(page, last, mi_tf_block(tfree));
+      tfreex = mi_tf_set_block(tfree,first);
+    }
+  } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
+
+  if mi_unlikely(use_delayed) {
+    // as in `_mi_free_block_mt`, but the whole chain goes on the heap delayed free list;
+    // the links are encoded with the page keys so re-encode them with the heap keys first
+    mi_heap_t* const heap = (mi_heap_t*)(mi_atomic_load_acquire(&page->xheap));
+    mi_assert_internal(heap != NULL);
+    if (heap != NULL) {
+      for (mi_block_t* block = first; block != last; ) {
+        mi_block_t* const next = mi_block_next(page, block);
+        mi_block_set_nextx(heap, block, next, heap->keys);
+        block = next;
+      }
+      mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
+      do {
+        mi_block_set_nextx(heap, last, dfree, heap->keys);
+      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, first));
+    }
+
+    // and reset the MI_DELAYED_FREEING flag
+    tfree = mi_atomic_load_relaxed(&page->xthread_free);
+    do {
+      mi_assert_internal(mi_tf_delayed(tfree) == MI_DELAYED_FREEING);
+      tfreex = mi_tf_set_delayed(tfree,MI_NO_DELAYED_FREE);
+    } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
+  }
+}
+
+#if MI_REMOTE_FREE_BUFFER
+// A run of buffered frees in a page owned by another thread, linked through the page free list encoding
+typedef struct mi_remote_free_s {
+  mi_page_t*  page;
+  mi_block_t* first;
+  mi_block_t* last;
+  size_t      count;
+} mi_remote_free_t;
+
+// buffers are per sandbox as the pages may only be accessible under the `cur_pkey` they were freed with
+static mi_decl_thread mi_remote_free_t mi_remote_free[MAX_SANDBOX_NUM][MI_REMOTE_FREE_SLOTS];
+static mi_decl_thread size_t           mi_remote_free_evict[MAX_SANDBOX_NUM];
+
+static void mi_remote_free_push_slot(mi_remote_free_t* slot) {
+  if (slot->page == NULL) return;
+  mi_segment_t* const segment = _mi_page_segment(slot->page);
+  mi_free_run_mt(slot->page, slot->first, slot->last);
+  // the page may be freed from here on, but `mi_segment_free` waits for the count to drop
+  mi_atomic_decrement_acq_rel(&segment->remote_buffered);
+  slot->page  = NULL;
+  slot->first = NULL;
+  slot->last  = NULL;
+  slot->count = 0;
+}
+
+// Buffer a free in a page owned by another thread.
+// note: buffered blocks still count as `used` so their page (and segment) stay valid until pushed.
+static void mi_remote_free_buffer(mi_page_t* page, mi_block_t* block) {
+  mi_remote_free_t* const slots = mi_remote_free[cur_pkey];
+  mi_remote_free_t* slot = NULL;
+  for (size_t i = 0; i < MI_REMOTE_FREE_SLOTS; i++) {
+    if (slots[i].page == page) { slot = &slots[i]; break; }
+    if (slot == NULL && slots[i].page == NULL) { slot = &slots[i]; }
+  }
+  if mi_unlikely(slot == NULL) {
+    // all slots are in use for other pages; push one of them (round robin)
+    slot = &slots[mi_remote_free_evict[cur_pkey]++ % MI_REMOTE_FREE_SLOTS];
+    mi_remote_free_push_slot(slot);
+  }
+  if (slot->page == NULL) {
+    // count the run so the heap of the page is not destroyed over it (until it is pushed)
+    mi_atomic_increment_acq_rel(&_mi_page_segment(page)->remote_buffered);
+    slot->page = page;
+    slot->last = block;
+  }
+  mi_block_set_next(page, block, slot->first);
+  slot->first = block;
+  if mi_unlikely(++slot->count >= MI_REMOTE_FREE_BATCH) {
+    mi_remote_free_push_slot(slot);
+  }
+}
+
+// Push all buffered frees of this thread, for the current sandbox or for all sandboxes (at thread exit)
+void _mi_remote_free_flush(bool all_sandboxes) {
+  const size_t lo = (all_sandboxes ? 0 : cur_pkey);
+  const size_t hi = (all_sandboxes ? MAX_SANDBOX_NUM : cur_pkey + 1);
+  for (size_t pkey = lo; pkey < hi; pkey++) {
+    for (size_t i = 0; i < MI_REMOTE_FREE_SLOTS; i++) {
+      mi_remote_free_push_slot(&mi_remote_free[pkey][i]);
+    }
+  }
+}
+#endif
+
 // multi-threaded free (or free in huge block if compiled with MI_HUGE_PAGE_ABANDON)
 static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* block)
 {
@@ -404,6 +610,13 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
   memset(block, MI_DEBUG_FREED, mi_usable_size(block));
   #endif
 
+  #if MI_REMOTE_FREE_BUFFER
+  if (segment->page_kind != MI_PAGE_HUGE) {
+    mi_remote_free_buffer(page, block);
+    return;
+  }
+  #endif
+
   // Try to put the block on either the page-local thread free list, or the heap delayed free list.
   mi_thread_free_t tfreex;
   bool use_delayed;
@@ -482,6 +695,11 @@ mi_block_t* _mi_page_ptr_unalign(const mi_segment_t* segment, const mi_page_t* p
 
 void mi_decl_noinline _mi_free_generic(const mi_segment_t* segment, mi_page_t* page, bool is_local, void* p) mi_attr_noexcept {
   mi_block_t* const block = (mi_page_has_aligned(page) ? _mi_page_ptr_unalign(segment, page, p) : (mi_block_t*)p);
+  #if MI_SAMPLE
+  if mi_unlikely(mi_page_has_sampled(page)) {
+    _mi_sample_free(block);  // before the block can be allocated again
+  }
+  #endif
   mi_stat_free(page, block);                 // stat_free may access the padding
   mi_track_free(p);
   _mi_free_block(page, is_local, block);
@@ -514,7 +732,7 @@ static inline mi_segment_t* mi_checked_ptr_segment(const void* p, const char* ms
     }
   }
 #endif
-#if (MI_DEBUG>0 || MI_SECURE>=4)
+#if (MI_DEBUG>0 || MI_SECURE_DOUBLE_FREE)
   if mi_unlikely(_mi_ptr_cookie(segment) != segment->cookie) {
     _mi_error_message(EINVAL, "%s: pointer does not point to a valid heap space: %p\n", msg, p);
     return NULL;
@@ -524,15 +742,11 @@ static inline mi_segment_t* mi_checked_ptr_segment(const void* p, const char* ms
   return segment;
 }
 
-// Free a block
+// Free a block in a known segment and page
 // fast path written carefully to prevent spilling on the stack
-void mi_free(void* p) mi_attr_noexcept
+static inline void mi_free_in_page(mi_segment_t* const segment, mi_page_t* const page, void* p) mi_attr_noexcept
 {
-  if mi_unlikely(p == NULL) return;
-  mi_segment_t* const segment = mi_checked_ptr_segment(p,"mi_free");
-  const bool          is_local= (_mi_thread_id() == mi_atomic_load_relaxed(&segment->thread_id));
-  mi_page_t* const    page    = _mi_segment_page_of(segment, p);
-
+  const bool is_local = (_mi_thread_id() == mi_atomic_load_relaxed(&segment->thread_id));
   if mi_likely(is_local) {                       // thread-local free?
     if mi_likely(page->flags.full_aligned == 0)  // and it is not a full page (full pages need to move from the full bin), nor has aligned blocks (aligned blocks need to be unaligned)
     {
@@ -561,13 +775,89 @@ void mi_free(void* p) mi_attr_noexcept
   }
 }
 
+// Free a block
+void mi_free(void* p) mi_attr_noexcept
+{
+  if mi_unlikely(p == NULL) return;
+  mi_segment_t* const segment = mi_checked_ptr_segment(p,"mi_free");
+  mi_page_t* const    page    = _mi_segment_page_of(segment, p);
+  mi_free_in_page(segment, page, p);
+}
+
+// Free `count` blocks (`NULL` entries are skipped).
+// Consecutive blocks in the same page are freed as a run: a thread-local run is pushed on
+// `local_free` with a single update of `page->used`, while a run in a page of another thread
+// is linked up first and pushed on `xthread_free` with a single CAS.
+void mi_free_batch(void* const* blocks, size_t count) mi_attr_noexcept
+{
+  mi_assert(blocks != NULL || count == 0);
+  size_t i = 0;
+  while (i < count) {
+    void* const p = blocks[i];
+    if mi_unlikely(p == NULL) { i++; continue; }
+    mi_segment_t* const segment = mi_checked_ptr_segment(p,"mi_free_batch");
+    mi_page_t* const    page    = _mi_segment_page_of(segment, p);
+    size_t end = i + 1;
+    while (end < count && blocks[end] != NULL && _mi_ptr_page(blocks[end]) == page) { end++; }
+
+    const bool is_local = (_mi_thread_id() == mi_atomic_load_relaxed(&segment->thread_id));
+    if mi_likely(is_local && page->flags.full_aligned == 0) {
+      // the same steps as the `mi_free` fast path, deferring the `used` update to the end of the run
+      size_t freed = 0;
+      for (; i < end; i++) {
+        mi_block_t* const block = (mi_block_t*)blocks[i];
+        if mi_unlikely(mi_check_is_double_free(page, block)) continue;
+        mi_check_padding(page, block);
+        mi_stat_free(page, block);
+        #if (MI_DEBUG!=0) && !MI_TRACK_ENABLED
+        memset(block, MI_DEBUG_FREED, mi_page_block_size(page));
+        #endif
+        mi_track_free(blocks[i]);
+        mi_block_set_next(page, block, page->local_free);
+        page->local_free = block;
+        freed++;
+      }
+      mi_assert_internal(page->used >= freed);
+      page->used -= (uint32_t)freed;
+      if mi_unlikely(page->used == 0) {
+        _mi_page_retire(page);
+      }
+    }
+    else if (!is_local && segment->page_kind != MI_PAGE_HUGE && !mi_page_has_sampled(page)) {
+      // the same steps as `_mi_free_generic` and `_mi_free_block_mt`, linking the blocks as we go
+      mi_block_t* first = NULL;
+      mi_block_t* last  = NULL;
+      for (; i < end; i++) {
+        mi_block_t* const block = (mi_page_has_aligned(page) ? _mi_page_ptr_unalign(segment, page, blocks[i]) : (mi_block_t*)blocks[i]);
+        mi_stat_free(page, block);
+        mi_track_free(blocks[i]);
+        mi_check_padding(page, block);
+        mi_padding_shrink(page, block, sizeof(mi_block_t));
+        #if (MI_DEBUG!=0) && !MI_TRACK_ENABLED
+        memset(block, MI_DEBUG_FREED, mi_usable_size(block));
+        #endif
+        mi_block_set_next(page, block, first);
+        first = block;
+        if (last == NULL) { last = block; }
+      }
+      mi_free_run_mt(page, first, last);
+    }
+    else {
+      // full or aligned local pages (which may change state on each free), huge pages, and pages with sampled blocks
+      for (; i < end; i++) {
+        mi_free_in_page(segment, page, blocks[i]);
+      }
+    }
+  }
+}
+
 // return true if successful
 bool _mi_free_delayed_block(mi_block_t* block) {
   // get segment and page
   const mi_segment_t* const segment = _mi_ptr_segment(block);
   mi_assert_internal(_mi_ptr_cookie(segment) == segment->cookie);
-  mi_assert_internal(_mi_thread_id() == segment->thread_id);
   mi_page_t* const page = _mi_segment_page_of(segment, block);
+  mi_assert_internal(_mi_thread_id() == segment->thread_id || (segment->thread_id == 0 && mi_page_heap(page)->tld->segments.shared));
 
   // Clear the no-delayed flag so delayed freeing is used again for this page.
   // This must be done before collecting the free lists on this page -- otherwise
@@ -613,15 +903,43 @@ mi_decl_nodiscard size_t mi_usable_size(const void* p) mi_attr_noexcept {
   return _mi_usable_size(p, "mi_usable_size");
 }
 
+// Usable size of a block that was just allocated: the pointer is known to be valid so it skips
+// the checks of `mi_usable_size`, the page is found from the (aligned) segment address.
+size_t _mi_usable_size_fresh(const void* p) mi_attr_noexcept {
+  mi_assert_internal(p != NULL);
+  const mi_segment_t* const segment = _mi_ptr_segment(p);
+  const mi_page_t* const page = _mi_segment_page_of(segment, p);
+  if mi_likely(!mi_page_has_aligned(page)) {
+    return mi_page_usable_size_of(page, (const mi_block_t*)p);
+  }
+  else {
+    return mi_page_usable_aligned_size_of(segment, page, p);
+  }
+}
+
+// Allocate and also return the usable size of the block (`mi_usable_size`, 0 when out of memory),
+// so a caller can use the rounding up to the size class without looking up the block again.
+mi_decl_nodiscard mi_decl_restrict void* mi_heap_malloc_usable(mi_heap_t* heap, size_t size, size_t* usable) mi_attr_noexcept {
+  void* p = mi_heap_malloc(heap, size);
+  if (usable != NULL) { *usable = (p == NULL ? 0 : _mi_usable_size_fresh(p)); }
+  return p;
+}
+
 
 // ------------------------------------------------------
 // Allocation extensions
 // ------------------------------------------------------
 
+// Free a block of which the caller knows the size (at most `mi_usable_size(p)`, as for C++ sized delete).
+// A block can only ever grow beyond `MI_MEDIUM_OBJ_SIZE_MAX` in a large or huge page, and those segments
+// hold a single page; so for such sizes we can skip the page index computation through `segment->page_shift`.
 void mi_free_size(void* p, size_t size) mi_attr_noexcept {
-  MI_UNUSED_RELEASE(size);
   mi_assert(p == NULL || size <= _mi_usable_size(p,"mi_free_size"));
-  mi_free(p);
+  if mi_unlikely(p == NULL) return;
+  mi_segment_t* const segment = mi_checked_ptr_segment(p,"mi_free_size");
+  mi_page_t* const    page    = (size > MI_MEDIUM_OBJ_SIZE_MAX ? &segment->pages[0] : _mi_segment_page_of(segment, p));
+  mi_assert_internal(page == _mi_segment_page_of(segment, p));
+  mi_free_in_page(segment, page, p);
 }
 
 void mi_free_size_aligned(void* p, size_t size, size_t alignment) mi_attr_noexcept {
@@ -671,6 +989,30 @@ void* mi_expand(void* p, size_t newsize) mi_attr_noexcept {
   #endif
 }
 
+// Grow a huge block without copying by growing its segment (see `_mi_page_huge_grow`)
+static void* mi_heap_realloc_huge(mi_heap_t* heap, void* p, size_t size, size_t newsize, bool zero) {
+  mi_page_t* page = _mi_ptr_page(p);
+  if (_mi_page_segment(page)->page_kind != MI_PAGE_HUGE || mi_page_has_aligned(page) || mi_page_has_sampled(page)) return NULL;
+  if (newsize > PTRDIFF_MAX - MI_PADDING_SIZE) return NULL;
+  const size_t bsize = mi_page_usable_block_size(page);
+  page = _mi_page_huge_grow(heap, page, newsize + MI_PADDING_SIZE);
+  if (page == NULL) return NULL;
+  mi_block_t* const block = (mi_block_t*)_mi_page_start(_mi_page_segment(page), page, NULL);
+  if (zero) {
+    // the memory beyond the old block and its padding is fresh from the OS (and zero)
+    const size_t start = (size >= sizeof(intptr_t) ? size - sizeof(intptr_t) : 0);
+    memset((uint8_t*)block + start, 0, bsize + MI_PADDING_SIZE - start);
+  }
+  mi_padding_init_huge(page, block, newsize + MI_PADDING_SIZE);
+  #if (MI_STAT>1)
+  mi_heap_stat_decrease(heap, malloc, size);
+  mi_heap_stat_increase(heap, malloc, mi_usable_size(block));
+  #endif
+  mi_track_free_size(p, size);
+  mi_track_malloc(block, newsize, zero);
+  return block;
+}
+
 void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept {
   // if p == NULL then behave as malloc.
   // else if size == 0 then reallocate to a zero-sized block (and don't return NULL, just as mi_malloc(0)).
@@ -682,6 +1024,10 @@ void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero)
     mi_track_malloc(p,newsize,true);
     return p;  // reallocation still fits and not more than 50% waste
   }
+  if mi_unlikely(newsize > size && size > MI_LARGE_OBJ_SIZE_MAX) {
+    void* grown = mi_heap_realloc_huge(heap, p, size, newsize, zero);  // huge blocks grow without copying if possible
+    if (grown != NULL) return grown;
+  }
   void* newp = mi_heap_malloc(heap,newsize);
   if mi_likely(newp != NULL) {
     if (zero && newsize > size) {
@@ -1016,10 +1362,12 @@ void* _mi_externs[] = {
   (void*)&_mi_heap_malloc_zero_ex,
   (void*)&mi_malloc,
   (void*)&mi_malloc_small,
+  (void*)&mi_malloc_small_wsize,
   (void*)&mi_zalloc_small,
   (void*)&mi_heap_malloc,
   (void*)&mi_heap_zalloc,
   (void*)&mi_heap_malloc_small,
+  (void*)&mi_heap_malloc_small_wsize,
   (void*)&mi_heap_alloc_new,
   (void*)&mi_heap_alloc_new_n
 };
@@ -7,7 +7,9 @@ terms of the MIT license. A copy of the license can be found in the file
 
 /* ----------------------------------------------------------------------------
 "Arenas" are fixed area's of OS memory from which we can allocate
-large blocks (>= MI_ARENA_BLOCK_SIZE, 32MiB).
+large blocks (>= MI_ARENA_BLOCK_SIZE, 32MiB). Exclusive arenas (and the ones
+grown by `MI_ARENA_BACKEND`) use blocks of one segment (`MI_ARENA_SEGMENT_BLOCK_SIZE`,
+4MiB) instead, so a heap bound to a small arena can allocate single segments.
 In contrast to the rest of mimalloc, the arenas are shared between
 threads and need to be accessed using atomic operations.
 
@@ -18,6 +20,11 @@ which is sometimes needed for embedded devices or shared memory for example.
 (We can also employ this with WASI or `sbrk` systems to reserve large arenas
  on demand and be able to reuse them efficiently).
 
+With `MI_ARENA_BACKEND` the arenas replace the regions of `region.c`: when
+no arena has room, `mi_arena_grow` reserves a new (uncommitted) one of twice
+the size of the previous grown arena. Its blocks stay committed when freed
+(unless segments are reset) and `_mi_arena_collect` decommits the free ones.
+
 The arena allocation needs to be thread safe and we use an atomic bitmap to allocate.
 -----------------------------------------------------------------------------*/
 #include "mimalloc.h"
@@ -45,22 +52,44 @@ bool  _mi_os_decommit(void* addr, size_t size, mi_stats_t* stats);
   Arena allocation
 ----------------------------------------------------------- */
 
-#define MI_ARENA_BLOCK_SIZE   (4*MI_SEGMENT_ALIGN)     // 32MiB
-#define MI_ARENA_MIN_OBJ_SIZE (MI_ARENA_BLOCK_SIZE/2)  // 16MiB
-#define MI_MAX_ARENAS         (64)                     // not more than 126 (since we use 7 bits in the memid and an arena index + 1)
+#define MI_ARENA_BLOCK_SIZE         (4*MI_SEGMENT_ALIGN)     // 32MiB
+#define MI_ARENA_SEGMENT_BLOCK_SIZE (MI_SEGMENT_ALIGN)       // 4MiB (blocks of exclusive and grown arenas)
+#if MI_ARENA_BACKEND
+#define MI_ARENA_MIN_OBJ_SIZE       (MI_ARENA_SEGMENT_BLOCK_SIZE/2)  // 2MiB (segments are allocated in the grown arenas)
+#else
+#define MI_ARENA_MIN_OBJ_SIZE       (MI_ARENA_BLOCK_SIZE/2)  // 16MiB
+#endif
+#define MI_MAX_ARENAS               (64)                     // not more than 126 (since we use 7 bits in the memid and an arena index + 1)
+#define MI_ARENA_PKEY_ANY           (~(size_t)0)             // memory supplied by the user is accessible under any protection key
+
+// With `MI_ARENA_BACKEND` arenas are reserved on demand, each twice the size of the previous one
+#define MI_ARENA_GROW_MIN       (MI_ARENA_SEGMENT_BLOCK_SIZE * MI_BITMAP_FIELD_BITS)  // 256MiB (as a region)
+#if (MI_INTPTR_SIZE > 4)
+#define MI_ARENA_GROW_SHIFT_MAX (8)                                   // up to 64GiB
+#else
+#define MI_ARENA_GROW_SHIFT_MAX (3)                                   // up to 512MiB (with 64MiB regions)
+#endif
+#define MI_ARENA_GROW_MAX       (MI_ARENA_GROW_MIN << MI_ARENA_GROW_SHIFT_MAX)
+#define MI_ARENA_GROW_COUNT_MAX (MI_MAX_ARENAS/2)                     // leave the other arenas to the user
 
 // A memory arena descriptor
 typedef struct mi_arena_s {
   mi_arena_id_t id;                       // arena id; 0 for non-specific
   bool     exclusive;                     // only allow allocations if specifically for this arena
   _Atomic(uint8_t*) start;                // the start of the memory area
-  size_t   block_count;                   // size of the area in arena blocks (of `MI_ARENA_BLOCK_SIZE`)
+  size_t   block_size;                    // `MI_ARENA_BLOCK_SIZE`, or `MI_ARENA_SEGMENT_BLOCK_SIZE` for exclusive and grown arenas
+  size_t   block_count;                   // size of the area in arena blocks (of `block_size`)
   size_t   field_count;                   // number of bitmap fields (where `field_count * MI_BITMAP_FIELD_BITS >= block_count`)
   int      numa_node;                     // associated NUMA node
   bool     is_zero_init;                  // is the arena zero initialized?
   bool     allow_decommit;                // is decommit allowed? if true, is_large should be false and blocks_committed != NULL
   bool     is_large;                      // large- or huge OS pages (always committed)
+  bool     is_grown;                      // reserved on demand (`MI_ARENA_BACKEND`): the blocks stay committed on free, as in regions
+  size_t   pkey;                          // the protection key of the memory (or `MI_ARENA_PKEY_ANY`)
   _Atomic(size_t) search_idx;             // optimization to start the search for free blocks
+  _Atomic(size_t) limit_used;             // bytes of the heap pages in this arena (see `mi_arena_set_limit`)
+  _Atomic(size_t) limit_soft;             // call the limit handler when a fresh page goes over this (0 = no limit)
+  _Atomic(size_t) limit_hard;             // fail allocation when a fresh page goes over this (0 = no limit)
   mi_bitmap_field_t* blocks_dirty;        // are the blocks potentially non-zero?
   mi_bitmap_field_t* blocks_committed;    // are the blocks committed? (can be NULL for memory that cannot be decommitted)
   mi_bitmap_field_t  blocks_inuse[1];     // in-place bitmap of in-use blocks (of size `field_count`)
@@ -71,6 +100,12 @@ typedef struct mi_arena_s {
 static mi_decl_cache_align _Atomic(mi_arena_t*) mi_arenas[MI_MAX_ARENAS];
 static mi_decl_cache_align _Atomic(size_t)      mi_arena_count; // = 0
 
+#if MI_ARENA_BACKEND
+static _Atomic(uintptr_t) mi_arena_grow_lock;   // = 0, one thread grows at a time
+static size_t             mi_arena_grown_count; // = 0 (under the lock)
+static bool mi_arena_grow(size_t size, int numa_node, size_t* arena_count, mi_os_tld_t* tld);
+#endif
+
 
 /* -----------------------------------------------------------
   Arena id's
@@ -123,14 +158,22 @@ static bool mi_arena_memid_indices(size_t arena_memid, size_t* arena_index, mi_b
 }
 
 bool _mi_arena_memid_is_suitable(size_t arena_memid, mi_arena_id_t request_arena_id) {
-  mi_assert_internal(arena_memid != MI_MEMID_OS);
+  if (arena_memid == MI_MEMID_OS) return (request_arena_id == _mi_arena_id_none());
   mi_arena_id_t id = (int)(arena_memid & 0x7F);
   bool exclusive = ((arena_memid & 0x80) != 0);
   return mi_arena_id_is_suitable(id, exclusive, request_arena_id);
 }
 
-static size_t mi_block_count_of_size(size_t size) {
-  return _mi_divide_up(size, MI_ARENA_BLOCK_SIZE);
+bool _mi_arena_memid_is_os(size_t arena_memid) {
+  return (arena_memid == MI_MEMID_OS);
+}
+
+mi_arena_id_t _mi_arena_memid_arena_id(size_t arena_memid) {
+  return (arena_memid == MI_MEMID_OS ? _mi_arena_id_none() : (int)(arena_memid & 0x7F));
+}
+
+static size_t mi_block_count_of_size(const mi_arena_t* arena, size_t size) {
+  return _mi_divide_up(size, arena->block_size);
 }
 
 /* -----------------------------------------------------------
@@ -151,19 +194,22 @@ static bool mi_arena_alloc(mi_arena_t* arena, size_t blocks, mi_bitmap_index_t*
   Arena Allocation
 ----------------------------------------------------------- */
 
-static void* mi_arena_alloc_from(mi_arena_t* arena, size_t arena_index, size_t needed_bcount,
+static void* mi_arena_alloc_from(mi_arena_t* arena, size_t arena_index, size_t size,
                                  bool* commit, bool* large, bool* is_pinned, bool* is_zero,
                                  mi_arena_id_t req_arena_id, size_t* memid, mi_os_tld_t* tld)
 {
   MI_UNUSED(arena_index);
   mi_assert_internal(mi_arena_id_index(arena->id) == arena_index);
   if (!mi_arena_id_is_suitable(arena->id, arena->exclusive, req_arena_id)) return NULL;
+  if (arena->pkey != MI_ARENA_PKEY_ANY && arena->pkey != cur_pkey) return NULL; // not accessible
+  if (req_arena_id == _mi_arena_id_none() && size < arena->block_size/2) return NULL; // too small for its blocks
 
+  const size_t needed_bcount = mi_block_count_of_size(arena, size);
   mi_bitmap_index_t bitmap_index;
   if (!mi_arena_alloc(arena, needed_bcount, &bitmap_index)) return NULL;
 
   // claimed it! set the dirty bits (todo: no need for an atomic op here?)
-  void* p    = arena->start + (mi_bitmap_index_bit(bitmap_index)*MI_ARENA_BLOCK_SIZE);
+  void* p    = arena->start + (mi_bitmap_index_bit(bitmap_index)*arena->block_size);
   *memid     = mi_arena_memid_create(arena->id, arena->exclusive, bitmap_index);
   *is_zero   = _mi_bitmap_claim_across(arena->blocks_dirty, arena->field_count, needed_bcount, bitmap_index, NULL);
   *large     = arena->is_large;
@@ -178,7 +224,7 @@ static void* mi_arena_alloc_from(mi_arena_t* arena, size_t arena_index, size_t n
     _mi_bitmap_claim_across(arena->blocks_committed, arena->field_count, needed_bcount, bitmap_index, &any_uncommitted);
     if (any_uncommitted) {
       bool commit_zero;
-      _mi_os_commit(p, needed_bcount * MI_ARENA_BLOCK_SIZE, &commit_zero, tld->stats);
+      _mi_os_commit(p, needed_bcount * arena->block_size, &commit_zero, tld->stats);
       if (commit_zero) *is_zero = true;
     }
   }
@@ -197,19 +243,15 @@ static mi_decl_noinline void* mi_arena_allocate(int numa_node, size_t size, size
   MI_UNUSED_RELEASE(alignment);
   mi_assert_internal(alignment <= MI_SEGMENT_ALIGN);
   const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
-  const size_t bcount = mi_block_count_of_size(size);
   if mi_likely(max_arena == 0) return NULL;
-  mi_assert_internal(size <= bcount * MI_ARENA_BLOCK_SIZE);
 
   size_t arena_index = mi_arena_id_index(req_arena_id);
   if (arena_index < MI_MAX_ARENAS) {
-    // try a specific arena if requested
+    // try a specific arena if requested; a heap bound to an arena cannot go anywhere else,
+    // so use it from any numa node and even if large OS pages are not asked for (as for the first segments of a thread)
     mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[arena_index]);
-    if ((arena != NULL) &&
-        (arena->numa_node < 0 || arena->numa_node == numa_node) && // numa local?
-        (*large || !arena->is_large)) // large OS pages allowed, or arena is not large OS pages
-    {
-      void* p = mi_arena_alloc_from(arena, arena_index, bcount, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
+    if (arena != NULL) {
+      void* p = mi_arena_alloc_from(arena, arena_index, size, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
       mi_assert_internal((uintptr_t)p % alignment == 0);
       if (p != NULL) return p;
     }
@@ -222,20 +264,22 @@ static mi_decl_noinline void* mi_arena_allocate(int numa_node, size_t size, size
       if ((arena->numa_node < 0 || arena->numa_node == numa_node) && // numa local?
           (*large || !arena->is_large)) // large OS pages allowed, or arena is not large OS pages
       {
-        void* p = mi_arena_alloc_from(arena, i, bcount, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
+        void* p = mi_arena_alloc_from(arena, i, size, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
         mi_assert_internal((uintptr_t)p % alignment == 0);
         if (p != NULL) return p;
       }
     }
 
-    // try from another numa node instead..
+    // try from another numa node instead.. (unless NUMA-strict, then we rather allocate fresh (bound) OS memory;
+    // an explicitly requested arena is still used though)
+    if (req_arena_id == _mi_arena_id_none() && mi_option_is_enabled(mi_option_numa_strict)) return NULL;
     for (size_t i = 0; i < max_arena; i++) {
       mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[i]);
       if (arena == NULL) break; // end reached
       if ((arena->numa_node >= 0 && arena->numa_node != numa_node) && // not numa local!
           (*large || !arena->is_large)) // large OS pages allowed, or arena is not large OS pages
       {
-        void* p = mi_arena_alloc_from(arena, i, bcount, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
+        void* p = mi_arena_alloc_from(arena, i, size, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
         mi_assert_internal((uintptr_t)p % alignment == 0);
         if (p != NULL) return p;
       }
@@ -258,9 +302,22 @@ void* _mi_arena_alloc_aligned(size_t size, size_t alignment, size_t align_offset
   const int numa_node = _mi_os_numa_node(tld); // current numa node
 
   // try to allocate in an arena if the alignment is small enough and the object is not too small (as for heap meta data)
-  if (size >= MI_ARENA_MIN_OBJ_SIZE && alignment <= MI_SEGMENT_ALIGN && align_offset == 0) {
+  if ((size >= MI_ARENA_MIN_OBJ_SIZE || req_arena_id != _mi_arena_id_none()) && alignment <= MI_SEGMENT_ALIGN && align_offset == 0) {
+    #if MI_ARENA_BACKEND
+    size_t arena_count = mi_atomic_load_acquire(&mi_arena_count);
+    #endif
     void* p = mi_arena_allocate(numa_node, size, alignment, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
     if (p != NULL) return p;
+    #if MI_ARENA_BACKEND
+    // all arenas are full: reserve a new one (unless the object is too large to be reused anyway),
+    // or retry in the arenas that other threads added since
+    while (req_arena_id == _mi_arena_id_none() && size <= MI_ARENA_GROW_MAX && !mi_option_is_enabled(mi_option_limit_os_alloc) &&
+           mi_arena_grow(size, numa_node, &arena_count, tld))
+    {
+      p = mi_arena_allocate(numa_node, size, alignment, commit, large, is_pinned, is_zero, req_arena_id, memid, tld);
+      if (p != NULL) return p;
+    }
+    #endif
   }
 
   // finally, fall back to the OS
@@ -271,7 +328,12 @@ void* _mi_arena_alloc_aligned(size_t size, size_t alignment, size_t align_offset
   *is_zero = true;
   *memid   = MI_MEMID_OS;
   void* p = _mi_os_alloc_aligned_offset(size, alignment, align_offset, *commit, large, tld->stats);
-  if (p != NULL) { *is_pinned = *large; }
+  if (p != NULL) {
+    *is_pinned = *large;
+    if (mi_option_is_enabled(mi_option_numa_strict) && _mi_os_numa_node_count() > 1) {
+      _mi_os_numa_bind(p, size, numa_node);  // (already touched pages stay where they are)
+    }
+  }
   return p;
 }
 
@@ -287,10 +349,68 @@ void* mi_arena_area(mi_arena_id_t arena_id, size_t* size) {
   if (arena_index >= MI_MAX_ARENAS) return NULL;
   mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[arena_index]);
   if (arena == NULL) return NULL;
-  if (size != NULL) *size = arena->block_count * MI_ARENA_BLOCK_SIZE;
+  if (size != NULL) *size = arena->block_count * arena->block_size;
   return arena->start;
 }
 
+
+bool _mi_arena_contains(const void* p) {
+  const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
+  for (size_t i = 0; i < max_arena; i++) {
+    mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[i]);
+    if (arena == NULL) break;
+    if (arena->start <= (const uint8_t*)p && arena->start + (arena->block_count * arena->block_size) > (const uint8_t*)p) return true;
+  }
+  return false;
+}
+
+
+/* -----------------------------------------------------------
+  Arena limits
+  The pages that heaps own in an arena count against its limits
+  (see `_mi_page_limit_transfer` in `page.c`).
+----------------------------------------------------------- */
+
+static mi_arena_t* mi_arena_from_id(mi_arena_id_t arena_id) {
+  const size_t arena_index = mi_arena_id_index(arena_id);
+  if (arena_index >= MI_MAX_ARENAS) return NULL;
+  return mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[arena_index]);
+}
+
+void _mi_arena_limit_add(mi_arena_id_t arena_id, size_t size, bool increase) {
+  mi_arena_t* const arena = mi_arena_from_id(arena_id);
+  if (arena == NULL) return;
+  if (increase) { mi_atomic_add_relaxed(&arena->limit_used, size); }
+           else { mi_atomic_sub_relaxed(&arena->limit_used, size); }
+}
+
+bool _mi_arena_limit_check(mi_arena_id_t arena_id, size_t size, mi_heap_t* heap) {
+  mi_arena_t* const arena = mi_arena_from_id(arena_id);
+  if (arena == NULL) return true;
+  const size_t soft = mi_atomic_load_relaxed(&arena->limit_soft);
+  const size_t hard = mi_atomic_load_relaxed(&arena->limit_hard);
+  if (soft == 0 && hard == 0) return true;
+  size_t used = mi_atomic_load_relaxed(&arena->limit_used) + size;
+  if (soft != 0 && used > soft) {
+    _mi_limit_exceeded(heap, arena_id, used, soft);
+    used = mi_atomic_load_relaxed(&arena->limit_used) + size;  // the handler may have collected
+  }
+  return (hard == 0 || used <= hard);
+}
+
+bool mi_arena_set_limit(mi_arena_id_t arena_id, size_t soft_limit, size_t hard_limit) mi_attr_noexcept {
+  mi_arena_t* const arena = mi_arena_from_id(arena_id);
+  if (arena == NULL) return false;
+  mi_atomic_store_relaxed(&arena->limit_soft, soft_limit);
+  mi_atomic_store_relaxed(&arena->limit_hard, hard_limit);
+  return true;
+}
+
+size_t mi_arena_limit_used(mi_arena_id_t arena_id) mi_attr_noexcept {
+  mi_arena_t* const arena = mi_arena_from_id(arena_id);
+  return (arena == NULL ? 0 : mi_atomic_load_relaxed(&arena->limit_used));
+}
+
 /* -----------------------------------------------------------
   Arena free
 ----------------------------------------------------------- */
@@ -312,12 +432,12 @@ void _mi_arena_free(void* p, size_t size, size_t alignment, size_t align_offset,
     mi_assert_internal(arena_idx < MI_MAX_ARENAS);
     mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t,&mi_arenas[arena_idx]);
     mi_assert_internal(arena != NULL);
-    const size_t blocks = mi_block_count_of_size(size);
     // checks
     if (arena == NULL) {
       _mi_error_message(EINVAL, "trying to free from non-existent arena: %p, size %zu, memid: 0x%zx\n", p, size, memid);
       return;
     }
+    const size_t blocks = mi_block_count_of_size(arena, size);
     mi_assert_internal(arena->field_count > mi_bitmap_index_field(bitmap_idx));
     if (arena->field_count <= mi_bitmap_index_field(bitmap_idx)) {
       _mi_error_message(EINVAL, "trying to free from non-existent arena block: %p, size %zu, memid: 0x%zx\n", p, size, memid);
@@ -327,9 +447,15 @@ void _mi_arena_free(void* p, size_t size, size_t alignment, size_t align_offset,
     if (!arena->allow_decommit || arena->blocks_committed == NULL) {
       mi_assert_internal(all_committed); // note: may be not true as we may "pretend" to be not committed (in segment.c)
     }
+    else if (arena->is_grown && all_committed &&
+             !mi_option_is_enabled(mi_option_segment_reset) && _mi_os_rss_pressure() < MI_RSS_OVER) {
+      // keep the blocks committed for the next segment, as regions do (see `_mi_arena_collect`)
+      _mi_bitmap_claim_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx, NULL);
+    }
     else {
+      if (arena->is_grown) { _mi_abandoned_await_readers(); } // ensure no more pending reads of the segment
       mi_assert_internal(arena->blocks_committed != NULL);
-      _mi_os_decommit(p, blocks * MI_ARENA_BLOCK_SIZE, stats); // ok if this fails
+      _mi_os_decommit(p, blocks * arena->block_size, stats); // ok if this fails
       // todo: use reset instead of decommit on windows?
       _mi_bitmap_unclaim_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx);
     }
@@ -363,17 +489,18 @@ static bool mi_arena_add(mi_arena_t* arena, mi_arena_id_t* arena_id) {
   return true;
 }
 
-bool mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept
+static bool mi_arena_create(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node, bool exclusive, bool is_grown, mi_arena_id_t* arena_id)
 {
   if (arena_id != NULL) *arena_id = _mi_arena_id_none();
-  if (size < MI_ARENA_BLOCK_SIZE) return false;
+  const size_t block_size = (exclusive || is_grown ? MI_ARENA_SEGMENT_BLOCK_SIZE : MI_ARENA_BLOCK_SIZE);
+  if (size < block_size) return false;
 
   if (is_large) {
     mi_assert_internal(is_committed);
     is_committed = true;
   }
 
-  const size_t bcount = size / MI_ARENA_BLOCK_SIZE;
+  const size_t bcount = size / block_size;
   const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
   const size_t bitmaps = (is_committed ? 2 : 3);
   const size_t asize  = sizeof(mi_arena_t) + (bitmaps*fields*sizeof(mi_bitmap_field_t));
@@ -382,6 +509,7 @@ bool mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is
 
   arena->id = _mi_arena_id_none();
   arena->exclusive = exclusive;
+  arena->block_size  = block_size;
   arena->block_count = bcount;
   arena->field_count = fields;
   arena->start = (uint8_t*)start;
@@ -389,6 +517,8 @@ bool mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is
   arena->is_large     = is_large;
   arena->is_zero_init = is_zero;
   arena->allow_decommit = !is_large && !is_committed; // only allow decommit for initially uncommitted memory
+  arena->is_grown     = is_grown;
+  arena->pkey         = (is_grown ? cur_pkey : MI_ARENA_PKEY_ANY);
   arena->search_idx   = 0;
   arena->blocks_dirty = &arena->blocks_inuse[fields]; // just after inuse bitmap
   arena->blocks_committed = (!arena->allow_decommit ? NULL : &arena->blocks_inuse[2*fields]); // just after dirty bitmap
@@ -410,11 +540,84 @@ bool mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is
 
 }
 
+bool mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept
+{
+  return mi_arena_create(start, size, is_committed, is_large, is_zero, numa_node, exclusive, false, arena_id);
+}
+
+#if MI_ARENA_BACKEND
+// Reserve a fresh arena of uncommitted memory for at least `size` bytes; the `n`-th arena has
+// `MI_ARENA_GROW_MIN << n` bytes, up to `MI_ARENA_GROW_MAX`. Called under the grow lock.
+static bool mi_arena_grow_locked(size_t size, int numa_node, mi_os_tld_t* tld) {
+  const size_t count = mi_arena_grown_count;
+  if (count >= MI_ARENA_GROW_COUNT_MAX) return false;
+  size_t asize = MI_ARENA_GROW_MIN << (count < MI_ARENA_GROW_SHIFT_MAX ? count : MI_ARENA_GROW_SHIFT_MAX);
+  if (asize < size) { asize = _mi_align_up(size, MI_ARENA_SEGMENT_BLOCK_SIZE); }
+  bool large = false;
+  void* start = _mi_os_alloc_aligned(asize, MI_SEGMENT_ALIGN, false, &large, tld->stats);
+  if (start == NULL) return false;
+  if (_mi_os_numa_node_count() <= 1) { numa_node = -1; }
+  if (!mi_arena_create(start, asize, false, false, true, numa_node, false, true, NULL)) {
+    _mi_os_free_ex(start, asize, false, tld->stats);
+    return false;
+  }
+  mi_arena_grown_count = count + 1;
+  _mi_verbose_message("reserved arena %zu of %zu MiB\n", count, asize / MI_MiB);
+  return true;
+}
+
+// Called when an allocation found no room in the `*arena_count` arenas there were before it: grow by one
+// arena, unless another thread added one since, as all threads that miss at once would grow otherwise.
+// Returns `true` if the allocation should be retried, and updates `*arena_count` for the next miss.
+static bool mi_arena_grow(size_t size, int numa_node, size_t* arena_count, mi_os_tld_t* tld) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_arena_grow_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+  bool retry = (mi_atomic_load_acquire(&mi_arena_count) != *arena_count);
+  if (!retry) {
+    retry = mi_arena_grow_locked(size, numa_node, tld);
+  }
+  *arena_count = mi_atomic_load_acquire(&mi_arena_count);
+  mi_atomic_store_release(&mi_arena_grow_lock, (uintptr_t)0);
+  return retry;
+}
+#endif
+
+// Decommit the free blocks of the grown arenas (as `_mi_mem_collect` releases the unused regions)
+void _mi_arena_collect(mi_stats_t* stats) {
+  const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
+  for (size_t i = 0; i < max_arena; i++) {
+    mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[i]);
+    if (arena == NULL || !arena->is_grown) continue;
+    for (size_t f = 0; f < arena->field_count; f++) {
+      // claim the free committed blocks of the field so they are not allocated meanwhile
+      size_t in_use = mi_atomic_load_relaxed(&arena->blocks_inuse[f]);
+      size_t claimed;
+      do {
+        claimed = ~in_use & mi_atomic_load_relaxed(&arena->blocks_committed[f]);
+      } while (claimed != 0 && !mi_atomic_cas_weak_acq_rel(&arena->blocks_inuse[f], &in_use, in_use | claimed));
+      if (claimed == 0) continue;
+      _mi_abandoned_await_readers(); // ensure no pending reads
+      for (size_t bit = 0; bit < MI_BITMAP_FIELD_BITS; bit++) {
+        if ((claimed & ((size_t)1 << bit)) == 0) continue;
+        size_t n = 1;  // decommit runs of blocks at once
+        while (bit + n < MI_BITMAP_FIELD_BITS && (claimed & ((size_t)1 << (bit + n))) != 0) { n++; }
+        _mi_os_decommit(arena->start + ((f * MI_BITMAP_FIELD_BITS) + bit) * arena->block_size, n * arena->block_size, stats);
+        bit += n - 1;
+      }
+      mi_atomic_and_acq_rel(&arena->blocks_committed[f], ~claimed);
+      mi_atomic_and_acq_rel(&arena->blocks_inuse[f], ~claimed);
+    }
+  }
+}
+
 // Reserve a range of regular OS memory
 int mi_reserve_os_memory_ex(size_t size, bool commit, bool allow_large, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept
 {
   if (arena_id != NULL) *arena_id = _mi_arena_id_none();
-  size = _mi_align_up(size, MI_ARENA_BLOCK_SIZE); // at least one block
+  size = _mi_align_up(size, (exclusive ? MI_ARENA_SEGMENT_BLOCK_SIZE : MI_ARENA_BLOCK_SIZE)); // at least one block
   bool large = allow_large;
   void* start = _mi_os_alloc_aligned(size, MI_SEGMENT_ALIGN, commit, &large, &_mi_stats_main);
   if (start==NULL) return ENOMEM;
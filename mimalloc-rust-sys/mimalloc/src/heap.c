@@ -55,7 +55,7 @@ static bool mi_heap_page_is_valid(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   MI_UNUSED(pq);
   mi_assert_internal(mi_page_heap(page) == heap);
   mi_segment_t* segment = _mi_page_segment(page);
-  mi_assert_internal(segment->thread_id == heap->thread_id);
+  mi_assert_internal(segment->thread_id == heap->thread_id || segment->thread_id == 0);
   mi_assert_expensive(_mi_page_is_valid(page));
   return true;
 }
@@ -167,7 +167,14 @@ void mi_heap_collect(mi_heap_t* heap, bool force) mi_attr_noexcept {
 }
 
 void mi_collect(bool force) mi_attr_noexcept {
-  mi_heap_collect(mi_get_default_heap(), force);
+  mi_heap_t* heap = mi_get_default_heap();
+  mi_heap_collect(heap, force);
+  // and the tagged heaps of the thread
+  if (!mi_heap_is_initialized(heap)) return;
+  for (size_t tag = 1; tag < MI_HEAP_TAGS; tag++) {
+    mi_heap_t* theap = heap->tld->heap_tagged[tag];
+    if (theap != NULL && theap != heap) { mi_heap_collect(theap, force); }
+  }
 }
 
 
@@ -189,7 +196,7 @@ mi_heap_t* mi_heap_get_backing(void) {
   return bheap;
 }
 
-mi_decl_nodiscard mi_heap_t* mi_heap_new(void) {
+mi_decl_nodiscard mi_heap_t* mi_heap_new_in_arena(mi_arena_id_t arena_id) {
   mi_heap_t* bheap = mi_heap_get_backing();
   mi_heap_t* heap = mi_heap_malloc_tp(bheap, mi_heap_t);  // todo: OS allocate in secure mode?
   if (heap==NULL) return NULL;
@@ -201,12 +208,116 @@ mi_decl_nodiscard mi_heap_t* mi_heap_new(void) {
   heap->keys[0] = _mi_heap_random_next(heap);
   heap->keys[1] = _mi_heap_random_next(heap);
   heap->no_reclaim = true;  // don't reclaim abandoned pages or otherwise destroy is unsafe
+  heap->arena_id = arena_id;
   // push on the thread local heaps list
   heap->next = heap->tld->heaps;
   heap->tld->heaps = heap;
   return heap;
 }
 
+mi_decl_nodiscard mi_heap_t* mi_heap_new(void) {
+  return mi_heap_new_in_arena(_mi_arena_id_none());
+}
+
+/* -----------------------------------------------------------
+  Tagged heaps
+
+  Blocks with different lifetimes (say cache entries and request buffers)
+  should not share pages, or a few long-lived blocks keep the pages of many
+  short-lived ones alive. A tagged heap is a regular heap of the thread (it
+  shares the segments of the thread) that is kept per tag in the tld, so
+  each tag has its own pages. Like other heaps a tagged heap does not reclaim
+  abandoned pages; its pages go to the backing heap when the thread terminates.
+----------------------------------------------------------- */
+
+mi_heap_t* mi_heap_tagged(int tag) {
+  if (tag < 0 || tag >= MI_HEAP_TAGS) return NULL;
+  mi_heap_t* bheap = mi_heap_get_backing();
+  if (tag == 0) return bheap;
+  mi_heap_t* heap = bheap->tld->heap_tagged[tag];
+  if mi_likely(heap != NULL) return heap;
+  heap = mi_heap_new();
+  if (heap == NULL) return NULL;
+  heap->tag = (uint8_t)tag;
+  bheap->tld->heap_tagged[tag] = heap;
+  return heap;
+}
+
+int mi_heap_get_tag(const mi_heap_t* heap) {
+  return (heap == NULL ? 0 : heap->tag);
+}
+
+void mi_heap_set_limit(mi_heap_t* heap, size_t soft_limit, size_t hard_limit) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  heap->limit_soft = soft_limit;
+  heap->limit_hard = hard_limit;
+}
+
+size_t mi_heap_limit_used(const mi_heap_t* heap) mi_attr_noexcept {
+  return (heap==NULL ? 0 : heap->limit_used);
+}
+
+
+/* -----------------------------------------------------------
+  Movable heaps
+
+  The heaps of a thread share the segments of that thread (through its tld),
+  so their pages can never leave it. A movable heap has a private tld instead
+  (like the per-CPU heaps); its segments are only used by this heap and have
+  no owning thread (`tld->segments.shared` is set). Any thread can therefore
+  allocate from it, as long as only one thread does so at a time; all frees
+  into it take the `xthread_free` path. The thread holding the heap detaches
+  it and the receiving thread attaches it, after which the receiver can delete
+  or destroy it, or absorb its pages (and segments) into one of its own heaps.
+  Movable heaps are not in the heap list of a thread and outlive their threads.
+----------------------------------------------------------- */
+
+typedef struct mi_heap_movable_s {
+  mi_heap_t heap;
+  mi_tld_t  tld;
+} mi_heap_movable_t;
+
+mi_decl_nodiscard mi_heap_t* mi_heap_new_movable(void) {
+  mi_heap_t* bheap = mi_heap_get_backing();
+  // use `_mi_os_alloc` to allocate directly from the OS (so it is zero initialized)
+  mi_heap_movable_t* m = (mi_heap_movable_t*)_mi_os_alloc(sizeof(mi_heap_movable_t), &_mi_stats_main);
+  if (m == NULL) return NULL;
+  mi_heap_t* heap = &m->heap;
+  mi_tld_t*  tld  = &m->tld;
+  _mi_memcpy_aligned(heap, &_mi_heap_empty, sizeof(mi_heap_t));
+  heap->tld = tld;
+  heap->thread_id = _mi_thread_id();
+  _mi_random_split(&bheap->random, &heap->random);
+  heap->cookie  = _mi_heap_random_next(heap) | 1;
+  heap->keys[0] = _mi_heap_random_next(heap);
+  heap->keys[1] = _mi_heap_random_next(heap);
+  heap->no_reclaim = true;  // destroy must be safe
+  heap->movable = true;
+  tld->heap_backing = heap;
+  tld->heaps = heap;
+  tld->segments.stats = &tld->stats;
+  tld->segments.os = &tld->os;
+  tld->segments.shared = true;
+  tld->os.stats = &tld->stats;
+  return heap;
+}
+
+// Release a movable heap from the current thread so another thread can attach it.
+bool mi_heap_detach(mi_heap_t* heap) {
+  mi_assert(heap != NULL);
+  if (heap==NULL || !heap->movable || heap->thread_id != _mi_thread_id()) return false;
+  heap->thread_id = 0;
+  return true;
+}
+
+// Attach a detached movable heap to the current thread.
+bool mi_heap_attach(mi_heap_t* heap) {
+  mi_assert(heap != NULL);
+  if (heap==NULL || !heap->movable || heap->thread_id != 0) return false;
+  heap->thread_id = _mi_thread_id();
+  return true;
+}
+
 uintptr_t _mi_heap_random_next(mi_heap_t* heap) {
   return _mi_random_next(&heap->random);
 }
@@ -223,6 +334,7 @@ static void mi_heap_reset_pages(mi_heap_t* heap) {
   _mi_memcpy_aligned(&heap->pages, &_mi_heap_empty.pages, sizeof(heap->pages));
   heap->thread_delayed_free = NULL;
   heap->page_count = 0;
+  heap->page_removed++;  // the pages now belong to another heap, or are freed
 }
 
 // called from `mi_heap_destroy` and `mi_heap_delete` to free the internal heap resources.
@@ -230,7 +342,18 @@ static void mi_heap_free(mi_heap_t* heap) {
   mi_assert(heap != NULL);
   mi_assert_internal(mi_heap_is_initialized(heap));
   if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  if (heap->movable) {
+    // not a default heap nor in a thread local heaps list; free the heap together with its tld
+    mi_assert_internal(heap->page_count == 0);
+    _mi_segment_thread_collect(&heap->tld->segments);  // release its cached segments
+    _mi_stats_done(&heap->tld->stats);
+    _mi_os_free(heap, sizeof(mi_heap_movable_t), &_mi_stats_main);
+    return;
+  }
   if (mi_heap_is_backing(heap)) return; // dont free the backing heap
+  if (heap->tag != 0 && heap->tld->heap_tagged[heap->tag] == heap) {
+    heap->tld->heap_tagged[heap->tag] = NULL;  // the tag gets a new heap on next use
+  }
 
   // reset default
   if (mi_heap_is_default(heap)) {
@@ -270,6 +393,14 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   // ensure no more thread_delayed_free will be added
   _mi_page_use_delayed_free(page, MI_NEVER_DELAYED_FREE, false);
 
+  #if MI_SAMPLE
+  // the sampled blocks of the page are released without being freed
+  if mi_unlikely(mi_page_has_sampled(page)) {
+    _mi_sample_page_destroy(_mi_page_segment(page), page);
+    mi_page_set_has_sampled(page, false);
+  }
+  #endif
+
   // stats
   const size_t bsize = mi_page_block_size(page);
   if (bsize > MI_LARGE_OBJ_SIZE_MAX) {
@@ -300,6 +431,7 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   // mi_page_free(page,false);
   page->next = NULL;
   page->prev = NULL;
+  mi_page_set_heap(page, NULL);  // release it from the heap and arena limits
   _mi_segment_page_free(page,false /* no force? */, &heap->tld->segments);
 
   return true; // keep going
@@ -310,6 +442,13 @@ void _mi_heap_destroy_pages(mi_heap_t* heap) {
   mi_heap_reset_pages(heap);
 }
 
+#if MI_REMOTE_FREE_BUFFER
+static bool mi_heap_page_is_not_remote_buffered(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* arg1, void* arg2) {
+  MI_UNUSED(heap); MI_UNUSED(pq); MI_UNUSED(arg1); MI_UNUSED(arg2);
+  return (mi_atomic_load_acquire(&_mi_page_segment(page)->remote_buffered) == 0);
+}
+#endif
+
 void mi_heap_destroy(mi_heap_t* heap) {
   mi_assert(heap != NULL);
   mi_assert(mi_heap_is_initialized(heap));
@@ -320,6 +459,13 @@ void mi_heap_destroy(mi_heap_t* heap) {
     // don't free in case it may contain reclaimed pages
     mi_heap_delete(heap);
   }
+  #if MI_REMOTE_FREE_BUFFER
+  else if (heap->page_count > 0 && !mi_heap_visit_pages(heap, &mi_heap_page_is_not_remote_buffered, NULL, NULL)) {
+    // other threads still hold frees of blocks in its segments in their buffers, which they push later:
+    // keep the pages alive in the backing heap (the blocks still in use are not freed)
+    mi_heap_delete(heap);
+  }
+  #endif
   else {
     // free all pages
     _mi_heap_destroy_pages(heap);
@@ -380,6 +526,44 @@ static void mi_heap_absorb(mi_heap_t* heap, mi_heap_t* from) {
   mi_heap_reset_pages(from);
 }
 
+static bool mi_heap_page_transfer_segment(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* arg1, void* arg2) {
+  MI_UNUSED(pq);
+  MI_UNUSED(arg2);
+  mi_segment_t* const segment = _mi_page_segment(page);
+  if (mi_atomic_load_relaxed(&segment->thread_id) == 0) {  // not yet transferred through another page
+    _mi_segment_transfer(segment, &heap->tld->segments, (mi_segments_tld_t*)arg1);
+  }
+  return true; // don't break
+}
+
+// Absorb the movable heap `from` (attached to the current thread) into `heap` of the current thread:
+// its segments are transferred to this thread and its pages are appended, after which `from` is freed.
+bool mi_heap_absorb_movable(mi_heap_t* heap, mi_heap_t* from) {
+  mi_assert(heap != NULL && from != NULL);
+  if (heap==NULL || !mi_heap_is_initialized(heap) || heap->movable || heap->thread_id != _mi_thread_id()) return false;
+  if (from==NULL || !from->movable || from->thread_id != _mi_thread_id()) return false;
+
+  // first stop and finish the thread delayed frees into `from`, as those can free a page
+  // (and segment) through the tld of the heap of the page which must match the segment
+  mi_heap_visit_pages(from, &mi_heap_page_never_delayed_free, NULL, NULL);
+  _mi_heap_delayed_free_all(from);
+
+  // transfer the segments; each one has a page in the queues of `from` as empty segments are freed
+  mi_heap_visit_pages(from, &mi_heap_page_transfer_segment, &heap->tld->segments, NULL);
+
+  // append the pages and, as for reclaimed pages, allow thread delayed free again once the heap is set
+  for (size_t i = 0; i <= MI_BIN_FULL; i++) {
+    mi_page_t* page = from->pages[i].first;
+    heap->page_count += _mi_page_queue_append(heap, &heap->pages[i], &from->pages[i]);
+    for (; page != NULL; page = page->next) {
+      _mi_page_use_delayed_free(page, MI_USE_DELAYED_FREE, true);
+    }
+  }
+  mi_heap_reset_pages(from);
+  mi_heap_free(from);
+  return true;
+}
+
 // Safe delete a heap without freeing any still allocated blocks in that heap.
 void mi_heap_delete(mi_heap_t* heap)
 {
@@ -388,6 +572,11 @@ void mi_heap_delete(mi_heap_t* heap)
   mi_assert_expensive(mi_heap_is_valid(heap));
   if (heap==NULL || !mi_heap_is_initialized(heap)) return;
 
+  if (heap->movable) {
+    // transfer still used pages to the backing heap of the current thread
+    mi_heap_absorb_movable(mi_heap_get_backing(), heap);
+    return;
+  }
   if (!mi_heap_is_backing(heap)) {
     // tranfer still used pages to the backing heap
     mi_heap_absorb(heap->tld->heap_backing, heap);
@@ -404,6 +593,8 @@ mi_heap_t* mi_heap_set_default(mi_heap_t* heap) {
   mi_assert(heap != NULL);
   mi_assert(mi_heap_is_initialized(heap));
   if (heap==NULL || !mi_heap_is_initialized(heap)) return NULL;
+  mi_assert(!heap->movable);
+  if (heap->movable) return NULL;  // the thread would keep using it after a handoff
   mi_assert_expensive(mi_heap_is_valid(heap));
   mi_heap_t* old = mi_get_default_heap();
   _mi_heap_set_default_direct(heap);
@@ -464,6 +655,59 @@ bool mi_check_owned(const void* p) {
         enable visiting all blocks of all heaps across threads
 ----------------------------------------------------------- */
 
+// The page of `pq` to resume a visit at. While the heap removed no page since the cursor was saved, its
+// page is still a page of the heap and can be checked directly; otherwise it may be freed, so it is only
+// compared while walking the queue, and if it left the queue the visit skips the pages visited before.
+static mi_page_t* mi_heap_cursor_page(mi_heap_t* heap, mi_page_queue_t* pq, const mi_heap_cursor_t* cursor) {
+  mi_page_t* const saved = (mi_page_t*)cursor->page;
+  if (saved == NULL) return pq->first;
+  if (cursor->removed == heap->page_removed && mi_page_heap(saved) == heap &&
+      (mi_page_is_in_full(saved) ? MI_BIN_FULL : _mi_bin(saved->xblock_size)) == cursor->bin) {
+    return saved;
+  }
+  mi_page_t* page = pq->first;
+  while (page != NULL && page != saved) {
+    page = page->next;
+  }
+  if (page != NULL) return page;
+  page = pq->first;
+  for (size_t i = 0; i < cursor->index && page != NULL; i++) {
+    page = page->next;
+  }
+  return page;
+}
+
+// Visit at most `max_pages` pages of a heap starting at `cursor` and advance the cursor past the visited pages;
+// returns `false` if break was called (the cursor stays at that page) or the maximum was reached.
+// Pages that move to another queue between two visits may be skipped or visited twice.
+static bool mi_heap_visit_pages_from(mi_heap_t* heap, mi_heap_cursor_t* cursor, size_t max_pages, heap_page_visitor_fun* fn, void* arg1, void* arg2)
+{
+  if (heap==NULL || heap->page_count==0) {
+    cursor->bin   = MI_BIN_FULL + 1;
+    cursor->index = 0;
+    cursor->page  = NULL;
+    return true;
+  }
+  size_t count = 0;
+  for (; cursor->bin <= MI_BIN_FULL; cursor->bin++, cursor->index = 0, cursor->page = NULL) {
+    mi_page_queue_t* pq = &heap->pages[cursor->bin];
+    mi_page_t* page = mi_heap_cursor_page(heap, pq, cursor);
+    while (page != NULL) {
+      mi_page_t* next = page->next;
+      mi_assert_internal(mi_page_heap(page) == heap);
+      if (count >= max_pages || !fn(heap, pq, page, arg1, arg2)) {
+        cursor->page = page;
+        cursor->removed = heap->page_removed;
+        return false;
+      }
+      count++;
+      cursor->index++;
+      page = next;
+    }
+  }
+  return true;
+}
+
 // Separate struct to keep `mi_page_t` out of the public interface
 typedef struct mi_heap_area_ex_s {
   mi_heap_area_t area;
@@ -493,10 +737,11 @@ static bool mi_heap_area_visit_blocks(const mi_heap_area_ex_t* xarea, mi_block_v
     return visitor(mi_page_heap(page), area, pstart, ubsize, arg);
   }
 
-  // create a bitmap of free blocks.
+  // create a bitmap of free blocks (only clearing the words covering the capacity)
   #define MI_MAX_BLOCKS   (MI_SMALL_PAGE_SIZE / sizeof(void*))
-  uintptr_t free_map[MI_MAX_BLOCKS / sizeof(uintptr_t)];
-  memset(free_map, 0, sizeof(free_map));
+  uintptr_t free_map[MI_MAX_BLOCKS / MI_INTPTR_BITS];
+  mi_assert_internal(page->capacity <= MI_MAX_BLOCKS);
+  memset(free_map, 0, _mi_divide_up(page->capacity, MI_INTPTR_BITS) * sizeof(uintptr_t));
 
   size_t free_count = 0;
   for (mi_block_t* block = page->free; block != NULL; block = mi_block_next(page,block)) {
@@ -506,8 +751,8 @@ static bool mi_heap_area_visit_blocks(const mi_heap_area_ex_t* xarea, mi_block_v
     mi_assert_internal(offset % bsize == 0);
     size_t blockidx = offset / bsize;  // Todo: avoid division?
     mi_assert_internal( blockidx < MI_MAX_BLOCKS);
-    size_t bitidx = (blockidx / sizeof(uintptr_t));
-    size_t bit = blockidx - (bitidx * sizeof(uintptr_t));
+    size_t bitidx = (blockidx / MI_INTPTR_BITS);
+    size_t bit = blockidx - (bitidx * MI_INTPTR_BITS);
     free_map[bitidx] |= ((uintptr_t)1 << bit);
   }
   mi_assert_internal(page->capacity == (free_count + page->used));
@@ -515,11 +760,11 @@ static bool mi_heap_area_visit_blocks(const mi_heap_area_ex_t* xarea, mi_block_v
   // walk through all blocks skipping the free ones
   size_t used_count = 0;
   for (size_t i = 0; i < page->capacity; i++) {
-    size_t bitidx = (i / sizeof(uintptr_t));
-    size_t bit = i - (bitidx * sizeof(uintptr_t));
+    size_t bitidx = (i / MI_INTPTR_BITS);
+    size_t bit = i - (bitidx * MI_INTPTR_BITS);
     uintptr_t m = free_map[bitidx];
     if (bit == 0 && m == UINTPTR_MAX) {
-      i += (sizeof(uintptr_t) - 1); // skip a run of free blocks
+      i += (MI_INTPTR_BITS - 1); // skip a run of free blocks
     }
     else if ((m & ((uintptr_t)1 << bit)) == 0) {
       used_count++;
@@ -580,3 +825,13 @@ bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_blocks, mi_block_vis
   mi_visit_blocks_args_t args = { visit_blocks, visitor, arg };
   return mi_heap_visit_areas(heap, &mi_heap_area_visitor, &args);
 }
+
+// Visit the blocks of at most `max_areas` areas in a heap, starting at `cursor`; returns `true` when all
+// areas were visited, and `false` if the visitor broke off or the maximum was reached: calling it again
+// with the same cursor resumes the visit. Like `mi_heap_visit_blocks` only the owning thread can visit a heap.
+bool mi_heap_visit_blocks_from(const mi_heap_t* heap, mi_heap_cursor_t* cursor, size_t max_areas, bool visit_blocks, mi_block_visit_fun* visitor, void* arg) {
+  if (visitor == NULL || cursor == NULL) return false;
+  mi_visit_blocks_args_t args = { visit_blocks, visitor, arg };
+  mi_heap_area_visit_fun* fun = &mi_heap_area_visitor;
+  return mi_heap_visit_pages_from((mi_heap_t*)heap, cursor, max_areas, &mi_heap_visit_areas_page, (void*)fun, &args);
+}
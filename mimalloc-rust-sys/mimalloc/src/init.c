@@ -16,7 +16,7 @@ terms of the MIT license. A copy of the license can be found in the file
 
 // Empty page used to initialize the small free pages array
 const mi_page_t _mi_page_empty = {
-  0, false, false, false, false,
+  0, false, false, false, false, false,
   0,       // capacity
   0,       // reserved capacity
   { 0 },   // flags
@@ -69,6 +69,11 @@ const mi_page_t _mi_page_empty = {
 #else
 #define MI_STAT_COUNT_END_NULL()
 #endif
+#if MI_STAT_LATENCY
+#define MI_STAT_LATENCY_NULL()    , { {0, 0, {0}}, {0, 0, {0}}, {0, 0, {0}}, {0, 0, {0}}, {0, 0, {0}}, {0, 0, {0}} }
+#else
+#define MI_STAT_LATENCY_NULL()
+#endif
 
 #define MI_STATS_NULL  \
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
@@ -78,8 +83,12 @@ const mi_page_t _mi_page_empty = {
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
+  MI_STAT_COUNT_NULL(), \
   { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },     \
-  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } \
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
+  { 0, 0 },                               \
+  { MI_INIT8(MI_STAT_COUNT_NULL) }        \
+  MI_STAT_LATENCY_NULL()                  \
   MI_STAT_COUNT_END_NULL()
 
 // --------------------------------------------------------
@@ -101,9 +110,14 @@ mi_decl_cache_align const mi_heap_t _mi_heap_empty = {
   { 0, 0 },         // keys
   { {0}, {0}, 0, true }, // random
   0,                // page count
+  0,                // pages removed
   MI_BIN_FULL, 0,   // page retired min/max
   NULL,             // next
-  false
+  false,
+  false,
+  0,                // arena id
+  0, 0, 0,          // limit used/soft/hard
+  0                 // tag
 };
 
 
@@ -138,10 +152,11 @@ static mi_tld_t tld_main = {
   &_mi_heap_main, &_mi_heap_main,
   { { NULL, NULL }, {NULL ,NULL}, {NULL ,NULL, 0},
     0, 0, 0, 0,
-    &tld_main.stats, &tld_main.os
+    &tld_main.stats, &tld_main.os, false
   }, // segments
-  { 0, &tld_main.stats },  // os
-  { MI_STATS_NULL }       // stats
+  { 0, &tld_main.stats, 0, { NULL } },  // os
+  { MI_STATS_NULL },      // stats
+  { NULL }                // tagged heaps
 };
 
 mi_heap_t _mi_heap_main = {
@@ -154,15 +169,30 @@ mi_heap_t _mi_heap_main = {
   { 0, 0 },         // the key of the main heap can be fixed (unlike page keys that need to be secure!)
   { {0x846ca68b}, {0}, 0, true },  // random
   0,                // page count
+  0,                // pages removed
   MI_BIN_FULL, 0,   // page retired min/max
   NULL,             // next heap
-  false             // can reclaim
+  false,            // can reclaim
+  false,            // not movable
+  0,                // any arena
+  0, 0, 0,          // no limits
+  0                 // untagged
 };
 
 bool _mi_process_is_initialized = false;  // set to `true` in `mi_process_init`.
 
 mi_stats_t _mi_stats_main = { MI_STATS_NULL };
 
+#if MI_LAZY_INIT && !MI_SECURE && !MI_SECURE_ENCODED_FREELIST && !MI_SECURE_DOUBLE_FREE && !MI_SECURE_RANDOM_EXTEND
+// The random contexts of the thread heaps are derived from this seed (split once from the
+// main heap), with a unique nonce per thread, instead of being seeded from the OS.
+#define MI_RANDOM_DERIVED 1
+static mi_random_ctx_t     mi_thread_random_seed;
+static _Atomic(uintptr_t)  mi_thread_random_nonce;  // = 0
+#else
+#define MI_RANDOM_DERIVED 0
+#endif
+
 
 static void mi_heap_main_init(void) {
   if (_mi_heap_main.cookie == 0) {
@@ -170,15 +200,30 @@ static void mi_heap_main_init(void) {
     _mi_heap_main.cookie = 1;
     #if defined(_WIN32) && !defined(MI_SHARED_LIB)
       _mi_random_init_weak(&_mi_heap_main.random);    // prevent allocation failure during bcrypt dll initialization with static linking
+    #elif MI_RANDOM_DERIVED
+      _mi_random_init_weak(&_mi_heap_main.random);    // no system call: seeded from the time and (ASLR) addresses only
     #else
       _mi_random_init(&_mi_heap_main.random);
     #endif
     _mi_heap_main.cookie  = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[0] = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[1] = _mi_heap_random_next(&_mi_heap_main);
+    #if MI_RANDOM_DERIVED
+    _mi_random_split(&_mi_heap_main.random, &mi_thread_random_seed);
+    #endif
   }
 }
 
+// Initialize the random context of a thread heap
+static void mi_thread_random_init(mi_random_ctx_t* ctx) {
+  #if MI_RANDOM_DERIVED
+  const uintptr_t nonce = mi_atomic_increment_relaxed(&mi_thread_random_nonce);
+  _mi_random_derive(&mi_thread_random_seed, nonce, ctx);
+  #else
+  _mi_random_init(ctx);
+  #endif
+}
+
 mi_heap_t* _mi_heap_main_get(void) {
   mi_heap_main_init();
   return &_mi_heap_main;
@@ -193,6 +238,7 @@ mi_heap_t* _mi_heap_main_get(void) {
 typedef struct mi_thread_data_s {
   mi_heap_t  heap;  // must come first due to cast in `_mi_heap_done`
   mi_tld_t   tld;
+  bool       ready; // pre-initialized by `mi_thread_data_reset` (if MI_LAZY_INIT)
 } mi_thread_data_t;
 
 
@@ -200,10 +246,32 @@ typedef struct mi_thread_data_s {
 // some programs that do not use thread pools and allocate and
 // destroy many OS threads, this may causes too much overhead
 // per thread so we maintain a small cache of recently freed metadata.
+// With MI_LAZY_INIT the cache is larger and holds the metadata in
+// its initial state, so a new thread only needs to claim it.
 
+#if MI_LAZY_INIT
+#define TD_CACHE_SIZE (64)
+#else
 #define TD_CACHE_SIZE (8)
+#endif
 static _Atomic(mi_thread_data_t*) td_cache[TD_CACHE_SIZE];
 
+// Put the metadata in the state of a fresh thread, except for the thread specific
+// fields (the thread id and the random context and keys of the heap)
+static void mi_thread_data_reset(mi_thread_data_t* td) {
+  mi_tld_t*  tld  = &td->tld;
+  mi_heap_t* heap = &td->heap;
+  memset(tld, 0, sizeof(*tld));
+  _mi_memcpy_aligned(heap, &_mi_heap_empty, sizeof(*heap));
+  heap->tld = tld;
+  tld->heap_backing = heap;
+  tld->heaps = heap;
+  tld->segments.stats = &tld->stats;
+  tld->segments.os = &tld->os;
+  tld->os.stats = &tld->stats;
+  td->ready = true;
+}
+
 static mi_thread_data_t* mi_thread_data_alloc(void) {
   // try to find thread metadata in the cache
   mi_thread_data_t* td;
@@ -230,6 +298,11 @@ static mi_thread_data_t* mi_thread_data_alloc(void) {
 }
 
 static void mi_thread_data_free( mi_thread_data_t* tdfree ) {
+  #if MI_LAZY_INIT
+  mi_thread_data_reset(tdfree);  // by the terminating thread, instead of the next one
+  #else
+  tdfree->ready = false;
+  #endif
   // try to add the thread metadata to the cache
   for (int i = 0; i < TD_CACHE_SIZE; i++) {
     mi_thread_data_t* td = mi_atomic_load_ptr_relaxed(mi_thread_data_t, &td_cache[i]);
@@ -257,6 +330,27 @@ static void mi_thread_data_collect(void) {
   }
 }
 
+// Fill the cache with up to `count` pre-initialized thread metadata blocks ahead of a burst of new threads;
+// returns how many the cache holds now (at most `TD_CACHE_SIZE`).
+size_t mi_thread_data_reserve(size_t count) mi_attr_noexcept {
+  size_t cached = 0;
+  for (int i = 0; i < TD_CACHE_SIZE; i++) {
+    mi_thread_data_t* td = mi_atomic_load_ptr_relaxed(mi_thread_data_t, &td_cache[i]);
+    if (td == NULL && cached < count) {
+      td = (mi_thread_data_t*)_mi_os_alloc(sizeof(mi_thread_data_t), &_mi_stats_main);
+      if (td == NULL) break;
+      mi_thread_data_reset(td);
+      mi_thread_data_t* expected = NULL;
+      if (!mi_atomic_cas_ptr_strong_acq_rel(mi_thread_data_t, &td_cache[i], &expected, td)) {
+        _mi_os_free(td, sizeof(mi_thread_data_t), &_mi_stats_main);  // another thread filled the slot first
+        td = expected;
+      }
+    }
+    if (td != NULL) { cached++; }
+  }
+  return cached;
+}
+
 // Initialize the thread local default heap, called from `mi_thread_init`
 static bool _mi_heap_init(void) {
   if (mi_heap_is_initialized(mi_get_default_heap())) return true;
@@ -272,21 +366,16 @@ static bool _mi_heap_init(void) {
     mi_thread_data_t* td = mi_thread_data_alloc();
     if (td == NULL) return false;
 
-    // OS allocated so already zero initialized
-    mi_tld_t*  tld = &td->tld;
+    // OS allocated so already zero initialized (but a cached `td` still has the state of its previous thread,
+    // unless it was reset when it was cached)
+    if (!td->ready) { mi_thread_data_reset(td); }
+    td->ready = false;
     mi_heap_t* heap = &td->heap;
-    _mi_memcpy_aligned(heap, &_mi_heap_empty, sizeof(*heap));
     heap->thread_id = _mi_thread_id();
-    _mi_random_init(&heap->random);
+    mi_thread_random_init(&heap->random);
     heap->cookie  = _mi_heap_random_next(heap) | 1;
     heap->keys[0] = _mi_heap_random_next(heap);
     heap->keys[1] = _mi_heap_random_next(heap);
-    heap->tld = tld;
-    tld->heap_backing = heap;
-    tld->heaps = heap;
-    tld->segments.stats = &tld->stats;
-    tld->segments.os = &tld->os;
-    tld->os.stats = &tld->stats;
     _mi_heap_set_default_direct(heap);
   }
   return false;
@@ -321,6 +410,11 @@ static bool _mi_heap_done(mi_heap_t* heap) {
     _mi_heap_collect_abandon(heap);
   }
 
+  // release segments cached since the collect (by the frees of the deleted heaps)
+  if (heap != &_mi_heap_main) {
+    _mi_segment_thread_collect(&heap->tld->segments);
+  }
+
   // merge stats
   _mi_stats_done(&heap->tld->stats);
 
@@ -449,6 +543,11 @@ static void _mi_thread_done(mi_heap_t* heap) {
    */
   wrpkru(0);  
 
+  #if MI_REMOTE_FREE_BUFFER
+  // push the frees this thread buffered for pages of other threads
+  _mi_remote_free_flush(true);
+  #endif
+
   mi_atomic_decrement_relaxed(&thread_count);
   _mi_stat_decrease(&_mi_stats_main.threads, 1);
 
@@ -569,8 +668,10 @@ static void mi_process_load(void) {
     _mi_fputs(NULL,NULL,NULL,msg);
   }
 
-  // reseed random
+  // reseed random (lazily initialized heaps stay with the weak seed unless their keys or extension are hardened)
+  #if !MI_RANDOM_DERIVED
   _mi_random_reinit_if_weak(&_mi_heap_main.random);
+  #endif
 }
 
 #if defined(_WIN32) && (defined(_M_IX86) || defined(_M_X64))
@@ -597,13 +698,16 @@ void mi_process_init(void) mi_attr_noexcept {
   _mi_process_is_initialized = true;
   mi_process_setup_auto_thread_done();
 
+  // the empty page is positionally initialized, make sure no field was missed
+  mi_assert_internal(mi_mem_is_zero((void*)&_mi_page_empty, sizeof(mi_page_t)));
   mi_detect_cpu_features();
   _mi_os_init();
   mi_heap_main_init();
   #if (MI_DEBUG)
   _mi_verbose_message("debug level : %d\n", MI_DEBUG);
   #endif
-  _mi_verbose_message("secure level: %d\n", MI_SECURE);
+  _mi_verbose_message("secure level: %d (guard pages: %d, encoded free lists: %d, random extend: %d, double free checks: %d)\n", MI_SECURE,
+                      MI_SECURE_GUARD_PAGES, MI_SECURE_ENCODED_FREELIST, MI_SECURE_RANDOM_EXTEND, MI_SECURE_DOUBLE_FREE);
   _mi_verbose_message("mem tracking: %s\n", MI_TRACK_TOOL);
   mi_thread_init();
 
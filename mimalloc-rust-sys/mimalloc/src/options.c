@@ -94,7 +94,13 @@ static mi_option_desc_t options[_mi_option_last] =
   { 16,  UNINIT, MI_OPTION(max_errors) },        // maximum errors that are output
   { 16,  UNINIT, MI_OPTION(max_warnings) },      // maximum warnings that are output
   { 8,   UNINIT, MI_OPTION(max_segment_reclaim)},// max. number of segment reclaims from the abandoned segments per try.
-  { 0,   UNINIT, MI_OPTION(destroy_on_exit)}     // release all OS memory on process exit; careful with dangling pointer or after-exit frees!
+  { 0,   UNINIT, MI_OPTION(destroy_on_exit)},    // release all OS memory on process exit; careful with dangling pointer or after-exit frees!
+  { 512*1024, UNINIT, MI_OPTION(sample_interval)},// mean bytes between sampled allocations (if MI_SAMPLE)
+  { 0,   UNINIT, MI_OPTION(numa_strict)},        // NUMA-strict: no arenas of other nodes (OS memory is bound instead) nor reclaim of their abandoned segments
+  { 10,  UNINIT, MI_OPTION(purge_interval)},     // milli-seconds between runs of the background purge thread
+  { 0,   UNINIT, MI_OPTION(rss_target)},         // RSS target in MiB: the nearer, the more eager free memory is given back (0 = none)
+  { 0,   UNINIT, MI_OPTION(thp_aware)},          // THP-aware segment placement: dense segments on transparent huge pages, sparse ones not
+  { 2,   UNINIT, MI_OPTION(segment_thread_cache)}// freed segments each thread keeps for reuse (up to `MI_SEGMENT_TLD_CACHE_MAX`)
 };
 
 static void mi_option_init(mi_option_desc_t* desc);
@@ -103,7 +109,13 @@ void _mi_options_init(void) {
   // called on process load; should not be called before the CRT is initialized!
   // (e.g. do not call this from process_init as that may run before CRT initialization)
   mi_add_stderr_output(); // now it safe to use stderr for output
-  for(int i = 0; i < _mi_option_last; i++ ) {
+  #if MI_LAZY_INIT
+  // only read all options to show them, otherwise each is read from the environment on first use (and cached as usual)
+  const bool read_all = mi_option_is_enabled(mi_option_verbose);
+  #else
+  const bool read_all = true;
+  #endif
+  for(int i = 0; read_all && i < _mi_option_last; i++ ) {
     mi_option_t option = (mi_option_t)i;
     long l = mi_option_get(option); MI_UNUSED(l); // initialize
     // if (option != mi_option_verbose)
@@ -139,6 +151,7 @@ void mi_option_set(mi_option_t option, long value) {
   mi_assert(desc->option == option);  // index should match the option
   desc->value = value;
   desc->init = INITIALIZED;
+  if (option == mi_option_rss_target) { _mi_os_rss_reset(); }
 }
 
 void mi_option_set_default(mi_option_t option, long value) {
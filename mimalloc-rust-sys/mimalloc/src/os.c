@@ -943,7 +943,7 @@ static void* mi_os_page_align_area_conservative(void* addr, size_t size, size_t*
 }
 
 static void mi_mprotect_hint(int err) {
-#if defined(MI_OS_USE_MMAP) && (MI_SECURE>=2) // guard page around every mimalloc page
+#if defined(MI_OS_USE_MMAP) && (MI_SECURE_GUARD_PAGES>=2) // guard page around every mimalloc page
   if (err == ENOMEM) {
     _mi_warning_message("the previous warning may have been caused by a low memory map limit.\n"
                         "  On Linux this is controlled by the vm.max_map_count. For example:\n"
@@ -1030,7 +1030,10 @@ static bool mi_os_commitx(void* addr, size_t size, bool commit, bool conservativ
 bool _mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* tld_stats) {
   MI_UNUSED(tld_stats);
   mi_stats_t* stats = &_mi_stats_main;
-  return mi_os_commitx(addr, size, true, false /* liberal */, is_zero, stats);
+  const mi_nsecs_t start = mi_stat_latency_start();
+  const bool ok = mi_os_commitx(addr, size, true, false /* liberal */, is_zero, stats);
+  mi_stat_latency(stats, MI_STAT_LATENCY_OS_COMMIT, start);
+  return ok;
 }
 
 bool _mi_os_decommit(void* addr, size_t size, mi_stats_t* tld_stats) {
@@ -1041,7 +1044,93 @@ bool _mi_os_decommit(void* addr, size_t size, mi_stats_t* tld_stats) {
 }
 
 bool _mi_os_commit_unreset(void* addr, size_t size, bool* is_zero, mi_stats_t* stats) {
-  return mi_os_commitx(addr, size, true, true /* conservative */, is_zero, stats);
+  const mi_nsecs_t start = mi_stat_latency_start();
+  const bool ok = mi_os_commitx(addr, size, true, true /* conservative */, is_zero, stats);
+  mi_stat_latency(stats, MI_STAT_LATENCY_OS_COMMIT, start);
+  return ok;
+}
+
+/* -----------------------------------------------------------
+  Transparent huge pages
+----------------------------------------------------------- */
+
+bool _mi_os_thp_advise(void* p, size_t size, bool huge) {
+  #if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+  size_t csize;
+  void* start = mi_os_page_align_area_conservative(p, size, &csize);
+  if (csize == 0) return false;
+  return (mi_madvise(start, csize, (huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE)) == 0);
+  #else
+  MI_UNUSED(p); MI_UNUSED(size); MI_UNUSED(huge);
+  return false;
+  #endif
+}
+
+/* -----------------------------------------------------------
+  RSS target (`mi_option_rss_target`, in MiB)
+
+  With an RSS target the way free memory is given back to the OS depends
+  on how close the resident set is to the target, cheapest first:
+  - under 7/8 of it:  reset with `MADV_FREE`; the OS reclaims those pages lazily
+                      but they still count as resident until it does.
+  - near it:          reset with `MADV_DONTNEED`, which lowers the RSS right away.
+  - over it:          free pages are reset without `mi_option_reset_delay` and
+                      freed segments are reset too (as with `mi_option_segment_reset`).
+  - over 9/8 of it:   unused regions are released to the OS on every segment free.
+  The RSS is sampled at most every `MI_RSS_CHECK_MSECS` milli-seconds.
+----------------------------------------------------------- */
+
+#define MI_RSS_CHECK_MSECS  (10)
+
+static _Atomic(size_t) mi_rss_checked;    // clock of the last sample
+static _Atomic(size_t) mi_rss_level;      // = MI_RSS_UNDER
+
+size_t _mi_os_current_rss(void) {
+  #if defined(__linux__)
+  // the second field of statm is the resident set in pages
+  int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    char buf[128];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n > 0) {
+      buf[n] = 0;
+      const char* s = buf;
+      while (*s >= '0' && *s <= '9') s++;
+      while (*s == ' ') s++;
+      size_t pages = 0;
+      while (*s >= '0' && *s <= '9') { pages = 10*pages + (size_t)(*s - '0'); s++; }
+      return pages * _mi_os_page_size();
+    }
+  }
+  #endif
+  size_t rss = 0;
+  mi_process_info(NULL, NULL, NULL, &rss, NULL, NULL, NULL, NULL);
+  return rss;
+}
+
+int _mi_os_rss_pressure(void) {
+  const long target = mi_option_get(mi_option_rss_target);
+  if mi_likely(target <= 0) return MI_RSS_UNDER;
+  const size_t now  = (size_t)_mi_clock_now();
+  size_t checked = mi_atomic_load_relaxed(&mi_rss_checked);
+  if (now - checked >= MI_RSS_CHECK_MSECS && mi_atomic_cas_strong_acq_rel(&mi_rss_checked, &checked, now)) {
+    // we won the race to sample the RSS
+    const size_t rss  = _mi_os_current_rss();
+    const size_t high = (size_t)target * MI_MiB;
+    size_t level = MI_RSS_UNDER;
+    if (rss > high + high/8)      level = MI_RSS_FAR_OVER;
+    else if (rss > high)          level = MI_RSS_OVER;
+    else if (rss > high - high/8) level = MI_RSS_NEAR;
+    mi_atomic_store_relaxed(&mi_rss_level, level);
+  }
+  return (int)mi_atomic_load_relaxed(&mi_rss_level);
+}
+
+// called when the target changes: forget the level of the previous one and sample on the next check
+void _mi_os_rss_reset(void) {
+  mi_atomic_store_relaxed(&mi_rss_level, MI_RSS_UNDER);
+  mi_atomic_store_relaxed(&mi_rss_checked, 0);
 }
 
 // Signal to the OS that the address range is no longer in use
@@ -1058,7 +1147,7 @@ static bool mi_os_resetx(void* addr, size_t size, bool reset, mi_stats_t* stats)
   if (!reset) return true; // nothing to do on unreset!
 
   #if (MI_DEBUG>1) && !MI_TRACK_ENABLED
-  if (MI_SECURE==0) {
+  if (MI_SECURE_GUARD_PAGES==0) {
     memset(start, 0, csize); // pretend it is eagerly reset
   }
   #endif
@@ -1077,6 +1166,9 @@ static bool mi_os_resetx(void* addr, size_t size, bool reset, mi_stats_t* stats)
 #if defined(MADV_FREE)
   static _Atomic(size_t) advice = MI_ATOMIC_VAR_INIT(MADV_FREE);
   int oadvice = (int)mi_atomic_load_relaxed(&advice);
+  if (oadvice == MADV_FREE && _mi_os_rss_pressure() >= MI_RSS_NEAR) {
+    oadvice = MADV_DONTNEED;  // close to the RSS target: lower the RSS right away
+  }
   int err;
   while ((err = mi_madvise(start, csize, oadvice)) != 0 && errno == EAGAIN) { errno = 0;  };
   if (err != 0 && errno == EINVAL && oadvice == MADV_FREE) {
@@ -1176,6 +1268,45 @@ bool _mi_os_shrink(void* p, size_t oldsize, size_t newsize, mi_stats_t* stats) {
 }
 
 
+// Grow committed OS memory at `p` from `oldsize` to `newsize` bytes without copying: in place if the address
+// space after it is free, or otherwise moved (by `mremap`) to a fresh `alignment` aligned address.
+// Returns the (possibly moved) start, or NULL if it cannot grow (and the memory is unchanged). Linux only.
+void* _mi_os_remap(void* p, size_t oldsize, size_t newsize, size_t alignment, mi_stats_t* tld_stats) {
+  MI_UNUSED(tld_stats);
+  mi_assert_internal(p != NULL && newsize > oldsize);
+  mi_assert_internal((oldsize % _mi_os_page_size()) == 0 && (newsize % _mi_os_page_size()) == 0);
+  mi_assert_internal(((uintptr_t)p % alignment) == 0);
+#if defined(__linux__) && defined(MREMAP_MAYMOVE) && defined(MREMAP_FIXED) && !defined(MI_USE_SBRK)
+  mi_stats_t* stats = &_mi_stats_main;
+  void* newp = mremap(p, oldsize, newsize, 0);
+  if (newp == MAP_FAILED) {
+    // reserve an aligned area and move the memory on top of it
+    if (newsize >= (SIZE_MAX - alignment)) return NULL; // overflow
+    const size_t over_size = newsize + alignment;
+    void* base = mmap(NULL, over_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+    uint8_t* aligned_p = (uint8_t*)mi_align_up_ptr(base, alignment);
+    const size_t pre_size  = aligned_p - (uint8_t*)base;
+    const size_t post_size = over_size - pre_size - newsize;
+    if (pre_size > 0)  munmap(base, pre_size);
+    if (post_size > 0) munmap(aligned_p + newsize, post_size);
+    newp = mremap(p, oldsize, newsize, MREMAP_MAYMOVE | MREMAP_FIXED, aligned_p);
+    if (newp == MAP_FAILED) {
+      munmap(aligned_p, newsize);
+      return NULL;
+    }
+  }
+  mi_assert_internal(((uintptr_t)newp % alignment) == 0);
+  _mi_stat_counter_increase(&stats->mmap_calls, 1);
+  _mi_stat_increase(&stats->reserved, newsize - oldsize);
+  _mi_stat_increase(&stats->committed, newsize - oldsize);
+  return newp;
+#else
+  MI_UNUSED(p); MI_UNUSED(oldsize); MI_UNUSED(newsize); MI_UNUSED(alignment);
+  return NULL;
+#endif
+}
+
 /* ----------------------------------------------------------------------------
 Support for allocating huge OS pages (1Gib) that are reserved up-front
 and possibly associated with a specific NUMA node. (use `numa_node>=0`)
@@ -1226,6 +1357,11 @@ static void* mi_os_alloc_huge_os_pagesx(void* addr, size_t size, int numa_node)
   return VirtualAlloc(addr, size, flags, PAGE_READWRITE);
 }
 
+bool _mi_os_numa_bind(void* p, size_t size, int numa_node) {
+  MI_UNUSED(p); MI_UNUSED(size); MI_UNUSED(numa_node);
+  return false;  // (`VirtualAllocExNuma` can only be used at allocation)
+}
+
 #elif defined(MI_OS_USE_MMAP) && (MI_INTPTR_SIZE >= 8) && !defined(__HAIKU__)
 #include <sys/syscall.h>
 #ifndef MPOL_PREFERRED
@@ -1258,11 +1394,23 @@ static void* mi_os_alloc_huge_os_pagesx(void* addr, size_t size, int numa_node)
   }
   return p;
 }
+
+// prefer the memory of `numa_node` for the pages of `p` that are not yet touched
+bool _mi_os_numa_bind(void* p, size_t size, int numa_node) {
+  if (numa_node < 0 || numa_node >= 8*MI_INTPTR_SIZE) return false;
+  const unsigned long numa_mask = (1UL << numa_node);
+  return (mi_os_mbind(p, size, MPOL_PREFERRED, &numa_mask, 8*MI_INTPTR_SIZE, 0) == 0);
+}
 #else
 static void* mi_os_alloc_huge_os_pagesx(void* addr, size_t size, int numa_node) {
   MI_UNUSED(addr); MI_UNUSED(size); MI_UNUSED(numa_node);
   return NULL;
 }
+
+bool _mi_os_numa_bind(void* p, size_t size, int numa_node) {
+  MI_UNUSED(p); MI_UNUSED(size); MI_UNUSED(numa_node);
+  return false;
+}
 #endif
 
 #if (MI_INTPTR_SIZE >= 8)
@@ -105,7 +105,7 @@ static bool mi_page_is_valid_init(mi_page_t* page) {
 
 bool _mi_page_is_valid(mi_page_t* page) {
   mi_assert_internal(mi_page_is_valid_init(page));
-  #if MI_SECURE
+  #if MI_SECURE_ENCODED_FREELIST
   mi_assert_internal(page->keys[0] != 0);
   #endif
   if (mi_page_heap(page)!=NULL) {
@@ -257,12 +257,63 @@ void _mi_page_reclaim(mi_heap_t* heap, mi_page_t* page) {
 }
 
 // allocate a fresh page from a segment
+/* -----------------------------------------------------------
+  Heap and arena limits
+  Every page that a heap owns counts against the limits of the heap,
+  and of the arena its memory is in, with the size of the page (or of
+  the segment for a huge page). The limits are checked when a fresh
+  page is allocated.
+----------------------------------------------------------- */
+
+static size_t mi_page_limit_size(const mi_page_t* page) {
+  const mi_segment_t* const segment = _mi_page_segment(page);
+  return (segment->page_kind == MI_PAGE_HUGE ? segment->segment_size : ((size_t)1 << segment->page_shift));
+}
+
+// the size of a fresh page for `block_size` (a lower bound for huge pages)
+static size_t mi_page_limit_size_of(size_t block_size, size_t page_alignment) {
+  if (page_alignment > MI_ALIGNMENT_MAX)              return block_size + page_alignment;
+  else if (block_size <= MI_SMALL_OBJ_SIZE_MAX)       return MI_SMALL_PAGE_SIZE;
+  else if (block_size <= MI_MEDIUM_OBJ_SIZE_MAX)      return MI_MEDIUM_PAGE_SIZE;
+  else if (block_size <= MI_LARGE_OBJ_SIZE_MAX)       return MI_LARGE_PAGE_SIZE;
+  else return block_size;
+}
+
+void _mi_page_limit_transfer(const mi_page_t* page, mi_heap_t* from, mi_heap_t* to) {
+  mi_assert_internal(from != to);
+  const size_t size = mi_page_limit_size(page);
+  if (from != NULL) {
+    mi_assert_internal(from->limit_used >= size);
+    from->limit_used -= size;
+  }
+  if (to != NULL) {
+    to->limit_used += size;
+  }
+  if (from == NULL || to == NULL) {
+    // the page is taken or released: count it in its arena
+    const mi_arena_id_t arena_id = _mi_mem_arena_id(_mi_page_segment(page)->memid);
+    if (arena_id != _mi_arena_id_none()) { _mi_arena_limit_add(arena_id, size, to != NULL); }
+  }
+}
+
+// can the heap take a fresh page of `size` bytes? (calls the limit handler over a soft limit)
+static bool mi_heap_limit_check(mi_heap_t* heap, size_t size) {
+  if (heap->limit_soft != 0 && heap->limit_used + size > heap->limit_soft) {
+    _mi_limit_exceeded(heap, _mi_arena_id_none(), heap->limit_used + size, heap->limit_soft);
+  }
+  if (heap->limit_hard != 0 && heap->limit_used + size > heap->limit_hard) return false;
+  return (heap->arena_id == _mi_arena_id_none() || _mi_arena_limit_check(heap->arena_id, size, heap));
+}
+
 static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size_t block_size, size_t page_alignment) {
   #if !MI_HUGE_PAGE_ABANDON
   mi_assert_internal(pq != NULL);
   mi_assert_internal(mi_heap_contains_queue(heap, pq));
   mi_assert_internal(page_alignment > 0 || block_size > MI_LARGE_OBJ_SIZE_MAX || block_size == pq->block_size);
   #endif
+  if mi_unlikely(heap->limit_soft != 0 || heap->limit_hard != 0 || heap->arena_id != _mi_arena_id_none()) {
+    if (!mi_heap_limit_check(heap, mi_page_limit_size_of(block_size, page_alignment))) return NULL;  // over a hard limit
+  }
   mi_page_t* page = _mi_segment_page_alloc(heap, block_size, page_alignment, &heap->tld->segments, &heap->tld->os);
   if (page == NULL) {
     // this may be out-of-memory, or an abandoned page was reclaimed (and in our queue)
@@ -400,8 +451,9 @@ void _mi_page_free(mi_page_t* page, mi_page_queue_t* pq, bool force) {
   mi_assert_internal(mi_page_all_free(page));
   mi_assert_internal(mi_page_thread_free_flag(page)!=MI_DELAYED_FREEING);
 
-  // no more aligned blocks in here
+  // no more aligned or sampled blocks in here
   mi_page_set_has_aligned(page, false);
+  mi_page_set_has_sampled(page, false);
 
   // remove from the page list
   // (no need to do _mi_heap_delayed_free first as all blocks are already free)
@@ -428,6 +480,7 @@ void _mi_page_retire(mi_page_t* page) mi_attr_noexcept {
   mi_assert_internal(mi_page_all_free(page));
 
   mi_page_set_has_aligned(page, false);
+  mi_page_set_has_sampled(page, false);  // all sampled blocks are freed (and removed from the samples)
 
   // don't retire too often..
   // (or we end up retiring and re-allocating most of the time)
@@ -496,7 +549,7 @@ void _mi_heap_collect_retired(mi_heap_t* heap, bool force) {
 
 static void mi_page_free_list_extend_secure(mi_heap_t* const heap, mi_page_t* const page, const size_t bsize, const size_t extend, mi_stats_t* const stats) {
   MI_UNUSED(stats);
-  #if (MI_SECURE<=2)
+  #if (MI_SECURE_RANDOM_EXTEND<=1)
   mi_assert_internal(page->free == NULL);
   mi_assert_internal(page->local_free == NULL);
   #endif
@@ -551,10 +604,18 @@ static void mi_page_free_list_extend_secure(mi_heap_t* const heap, mi_page_t* co
   page->free = free_start;
 }
 
+#define MI_EXTEND_PREFETCH    (4)           // blocks of a cache line or more to prefetch ahead
+
+#if defined(__GNUC__) || defined(__clang__)
+#define mi_prefetch_write(p)  __builtin_prefetch((p),1)
+#else
+#define mi_prefetch_write(p)  ((void)(p))
+#endif
+
 static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, const size_t bsize, const size_t extend, mi_stats_t* const stats)
 {
   MI_UNUSED(stats);
-  #if (MI_SECURE <= 2)
+  #if (MI_SECURE_RANDOM_EXTEND <= 1)
   mi_assert_internal(page->free == NULL);
   mi_assert_internal(page->local_free == NULL);
   #endif
@@ -563,14 +624,39 @@ static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, co
   void* const page_area = _mi_page_start(_mi_page_segment(page), page, NULL );
 
   mi_block_t* const start = mi_page_block_at(page, page_area, bsize, page->capacity);
-
-  // initialize a sequential free list
   mi_block_t* const last = mi_page_block_at(page, page_area, bsize, page->capacity + extend - 1);
-  mi_block_t* block = start;
-  while(block <= last) {
-    mi_block_t* next = (mi_block_t*)((uint8_t*)block + bsize);
-    mi_block_set_next(page,block,next);
-    block = next;
+
+  // initialize a sequential free list: each link is just the address of the following block, so the
+  // stores do not depend on each other and are written four at a time (or as a plain vectorizable
+  // sequence for word sized blocks). Blocks of a cache line or more each touch a line of their own,
+  // of which a few are prefetched ahead; non-temporal stores would only evict the blocks that are
+  // about to be allocated.
+  #if !defined(MI_ENCODE_FREELIST) && !MI_TRACK_ENABLED
+  if (bsize == sizeof(mi_block_t)) {
+    mi_block_t* const blocks = start;
+    const size_t count = extend - 1;
+    for (size_t i = 0; i < count; i++) {
+      blocks[i].next = (mi_encoded_t)&blocks[i+1];
+    }
+  }
+  else
+  #endif
+  {
+    uint8_t* block = (uint8_t*)start;
+    uint8_t* const end = (uint8_t*)last;
+    const bool prefetch = (bsize >= MI_CACHE_LINE);
+    while (block + 4*bsize <= end) {
+      if (prefetch) { mi_prefetch_write(block + (4 + MI_EXTEND_PREFETCH)*bsize); }
+      mi_block_set_next(page, (mi_block_t*)block, (mi_block_t*)(block + bsize));
+      mi_block_set_next(page, (mi_block_t*)(block + bsize), (mi_block_t*)(block + 2*bsize));
+      mi_block_set_next(page, (mi_block_t*)(block + 2*bsize), (mi_block_t*)(block + 3*bsize));
+      mi_block_set_next(page, (mi_block_t*)(block + 3*bsize), (mi_block_t*)(block + 4*bsize));
+      block += 4*bsize;
+    }
+    while (block < end) {
+      mi_block_set_next(page, (mi_block_t*)block, (mi_block_t*)(block + bsize));
+      block += bsize;
+    }
   }
   // prepend to free list (usually `NULL`)
   mi_block_set_next(page, last, page->free);
@@ -581,9 +667,15 @@ static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, co
   Page initialize and extend the capacity
 ----------------------------------------------------------- */
 
-#define MI_MAX_EXTEND_SIZE    (4*1024)      // heuristic, one OS page seems to work well.
+// heuristic, one OS page seems to work well: extending is cheap compared to touching fresh memory,
+// so extending further mostly adds to the rss (the `lean` benchmark tests this)
+#if !defined(MI_MAX_EXTEND_SIZE)
+#define MI_MAX_EXTEND_SIZE    (4*1024)
+#endif
 #if (MI_SECURE>0)
 #define MI_MIN_EXTEND         (8*MI_SECURE) // extend at least by this many
+#elif (MI_SECURE_RANDOM_EXTEND>0)
+#define MI_MIN_EXTEND         (16*MI_SECURE_RANDOM_EXTEND) // enough blocks to randomize over
 #else
 #define MI_MIN_EXTEND         (1)
 #endif
@@ -595,7 +687,7 @@ static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, co
 // extra test in malloc? or cache effects?)
 static void mi_page_extend_free(mi_heap_t* heap, mi_page_t* page, mi_tld_t* tld) {
   mi_assert_expensive(mi_page_is_valid_init(page));
-  #if (MI_SECURE<=2)
+  #if (MI_SECURE_RANDOM_EXTEND<=1)
   mi_assert(page->free == NULL);
   mi_assert(page->local_free == NULL);
   if (page->free != NULL) return;
@@ -605,7 +697,7 @@ static void mi_page_extend_free(mi_heap_t* heap, mi_page_t* page, mi_tld_t* tld)
   size_t page_size;
   //uint8_t* page_start =
   _mi_page_start(_mi_page_segment(page), page, &page_size);
-  mi_stat_counter_increase(tld->stats.pages_extended, 1);
+  mi_stat_counter_increase(tld->segments.stats->pages_extended, 1);
 
   // calculate the extend count
   const size_t bsize = (page->xblock_size < MI_HUGE_BLOCK_SIZE ? page->xblock_size : page_size);
@@ -626,15 +718,15 @@ static void mi_page_extend_free(mi_heap_t* heap, mi_page_t* page, mi_tld_t* tld)
   mi_assert_internal(extend < (1UL<<16));
 
   // and append the extend the free list
-  if (extend < MI_MIN_SLICES || MI_SECURE==0) { //!mi_option_is_enabled(mi_option_secure)) {
-    mi_page_free_list_extend(page, bsize, extend, &tld->stats );
+  if (extend < MI_MIN_SLICES || MI_SECURE_RANDOM_EXTEND==0) { //!mi_option_is_enabled(mi_option_secure)) {
+    mi_page_free_list_extend(page, bsize, extend, tld->segments.stats );
   }
   else {
-    mi_page_free_list_extend_secure(heap, page, bsize, extend, &tld->stats);
+    mi_page_free_list_extend_secure(heap, page, bsize, extend, tld->segments.stats);
   }
   // enable the new free list
   page->capacity += (uint16_t)extend;
-  mi_stat_increase(tld->stats.page_committed, extend * bsize);
+  mi_stat_increase(tld->segments.stats->page_committed, extend * bsize);
 
   // extension into zero initialized memory preserves the zero'd free list
   if (!page->is_zero_init) {
@@ -752,7 +844,7 @@ static inline mi_page_t* mi_find_free_page(mi_heap_t* heap, size_t size) {
   mi_page_queue_t* pq = mi_page_queue(heap,size);
   mi_page_t* page = pq->first;
   if (page != NULL) {
-   #if (MI_SECURE>=3) // in secure mode, we extend half the time to increase randomness
+   #if (MI_SECURE_RANDOM_EXTEND>=2) // in secure mode, we extend half the time to increase randomness
     if (page->capacity < page->reserved && ((_mi_heap_random_next(heap) & 1) == 1)) {
       mi_page_extend_free(heap, page, heap->tld);
       mi_assert_internal(mi_page_immediate_available(page));
@@ -784,6 +876,10 @@ static _Atomic(void*) deferred_arg; // = NULL
 
 void _mi_deferred_free(mi_heap_t* heap, bool force) {
   heap->tld->heartbeat++;
+  #if MI_REMOTE_FREE_BUFFER
+  // push the frees buffered for pages of other threads at least every heartbeat
+  _mi_remote_free_flush(false);
+  #endif
   if (deferred_free != NULL && !heap->tld->recurse) {
     heap->tld->recurse = true;
     deferred_free(force, heap->tld->heartbeat, mi_atomic_load_ptr_relaxed(void,&deferred_arg));
@@ -797,10 +893,68 @@ void mi_register_deferred_free(mi_deferred_free_fun* fn, void* arg) mi_attr_noex
 }
 
 
+/* -----------------------------------------------------------
+  Users can register a limit handler that is called when a
+  fresh page of a heap would go over a soft limit of the heap
+  or of its arena, so the application can shed load or collect.
+----------------------------------------------------------- */
+
+static mi_limit_fun* volatile limit_handler = NULL;
+static _Atomic(void*) limit_arg; // = NULL
+
+void _mi_limit_exceeded(mi_heap_t* heap, mi_arena_id_t arena_id, size_t used, size_t limit) {
+  if (limit_handler != NULL && !heap->tld->recurse) {
+    heap->tld->recurse = true;
+    limit_handler(heap, arena_id, used, limit, mi_atomic_load_ptr_relaxed(void,&limit_arg));
+    heap->tld->recurse = false;
+  }
+}
+
+void mi_register_limit_handler(mi_limit_fun* fn, void* arg) mi_attr_noexcept {
+  limit_handler = fn;
+  mi_atomic_store_ptr_release(void,&limit_arg, arg);
+}
+
+
 /* -----------------------------------------------------------
   General allocation
 ----------------------------------------------------------- */
 
+/* -----------------------------------------------------------
+  Huge page growth, for `mi_realloc`: the page is unlinked from its
+  queue while its segment is remapped as the page moves along.
+  Heaps with limits or an arena take a fresh page instead (so the
+  limits are only checked for fresh pages).
+----------------------------------------------------------- */
+
+mi_page_t* _mi_page_huge_grow(mi_heap_t* heap, mi_page_t* page, size_t size) {
+  mi_assert_internal(_mi_page_segment(page)->page_kind == MI_PAGE_HUGE);
+  const size_t block_size = _mi_os_good_alloc_size(size);
+  if (mi_page_heap(page) != heap) return NULL;  // only the owner of the page can move it
+  if (heap->limit_soft != 0 || heap->limit_hard != 0 || heap->arena_id != _mi_arena_id_none()) return NULL;
+  const size_t bsize = mi_page_block_size(page);
+  const size_t limit_size = mi_page_limit_size(page);
+  mi_page_queue_t* pq = mi_page_queue_of(page);
+  mi_page_queue_remove(pq, page);
+  mi_page_t* grown = _mi_segment_huge_page_grow(page, block_size, &heap->tld->segments);
+  if (grown == NULL) {
+    mi_page_queue_push(heap, pq, page);
+    return NULL;
+  }
+  mi_page_queue_push(heap, pq, grown);
+  heap->limit_used += mi_page_limit_size(grown) - limit_size;
+
+  // as in `mi_huge_page_alloc`
+  const size_t newbsize = mi_page_block_size(grown);
+  mi_assert_internal(newbsize >= block_size);
+  if (bsize > MI_HUGE_OBJ_SIZE_MAX) { mi_heap_stat_decrease(heap, giant, bsize); }
+                               else { mi_heap_stat_decrease(heap, huge, bsize); }
+  if (newbsize > MI_HUGE_OBJ_SIZE_MAX) { mi_heap_stat_increase(heap, giant, newbsize); }
+                                  else { mi_heap_stat_increase(heap, huge, newbsize); }
+  return grown;
+}
+
+
 // A huge page is allocated directly without being in a queue.
 // Because huge pages contain just one block, and the segment contains
 // just that page, we always treat them as abandoned and any thread
@@ -861,38 +1015,37 @@ static mi_page_t* mi_find_page(mi_heap_t* heap, size_t size, size_t huge_alignme
   }
 }
 
-// Generic allocation routine if the fast path (`alloc.c:mi_page_malloc`) does not succeed.
-// Note: in debug mode the size includes MI_PADDING_SIZE and might have overflowed.
-// The `huge_alignment` is normally 0 but is set to a multiple of MI_SEGMENT_SIZE for
-// very large requested alignments in which case we use a huge segment.
-void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+// The slow path of an allocation in an initialized heap
+static inline void* mi_heap_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
 {
-  mi_assert_internal(heap != NULL);
-
-  // initialize if necessary
-  if mi_unlikely(!mi_heap_is_initialized(heap)) {
-    mi_thread_init(); // calls `_mi_heap_init` in turn
-    heap = mi_get_default_heap();
-    if mi_unlikely(!mi_heap_is_initialized(heap)) { return NULL; }
-  }
   mi_assert_internal(mi_heap_is_initialized(heap));
+  mi_stats_t* const stats = mi_heap_stats(heap); MI_UNUSED(stats);
 
   // call potential deferred free routines
+  mi_nsecs_t start = mi_stat_latency_start();
   _mi_deferred_free(heap, false);
 
   // free delayed frees from other threads (but skip contended ones)
   _mi_heap_delayed_free_partial(heap);
+  mi_stat_latency(stats, MI_STAT_LATENCY_DEFERRED_FREE, start);
 
   // find (or allocate) a page of the right size
+  start = mi_stat_latency_start();
   mi_page_t* page = mi_find_page(heap, size, huge_alignment);
   if mi_unlikely(page == NULL) { // first time out of memory, try to collect and retry the allocation once more
     mi_heap_collect(heap, true /* force */);
     page = mi_find_page(heap, size, huge_alignment);
   }
+  mi_stat_latency(stats, MI_STAT_LATENCY_PAGE_SEARCH, start);
 
   if mi_unlikely(page == NULL) { // out of memory
     const size_t req_size = size - MI_PADDING_SIZE;  // correct for padding_size in case of an overflow on `size`
-    _mi_error_message(ENOMEM, "unable to allocate memory (%zu bytes)\n", req_size);
+    if (heap->limit_hard != 0 || heap->arena_id != _mi_arena_id_none()) {
+      errno = ENOMEM;  // a heap with a hard limit (or in an arena) is expected to run out: no error message
+    }
+    else {
+      _mi_error_message(ENOMEM, "unable to allocate memory (%zu bytes)\n", req_size);
+    }
     return NULL;
   }
 
@@ -911,3 +1064,28 @@ void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_al
     return _mi_page_malloc(heap, page, size, zero);
   }
 }
+
+// Generic allocation routine if the fast path (`alloc.c:mi_page_malloc`) does not succeed.
+// Note: in debug mode the size includes MI_PADDING_SIZE and might have overflowed.
+// The `huge_alignment` is normally 0 but is set to a multiple of MI_SEGMENT_SIZE for
+// very large requested alignments in which case we use a huge segment.
+void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+{
+  mi_assert_internal(heap != NULL);
+
+  // initialize if necessary
+  if mi_unlikely(!mi_heap_is_initialized(heap)) {
+    mi_thread_init(); // calls `_mi_heap_init` in turn
+    heap = mi_get_default_heap();
+    if mi_unlikely(!mi_heap_is_initialized(heap)) { return NULL; }
+  }
+
+  #if MI_STAT_LATENCY
+  const mi_nsecs_t start = mi_stat_latency_start();
+  void* p = mi_heap_malloc_generic(heap, size, zero, huge_alignment);
+  mi_stat_latency(mi_heap_stats(heap), MI_STAT_LATENCY_GENERIC, start);
+  return p;
+  #else
+  return mi_heap_malloc_generic(heap, size, zero, huge_alignment);
+  #endif
+}
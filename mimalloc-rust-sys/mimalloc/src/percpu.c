@@ -0,0 +1,156 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2021, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* -----------------------------------------------------------
+  Per-CPU heaps (MI_PERCPU)
+
+  Normally every thread allocates from its own heap, which costs a heap and tld
+  per thread and abandonment/reclaim of its segments when the thread exits.
+  With per-CPU heaps a thread instead allocates from the heap of the CPU it runs on,
+  so the number of heaps and segments scales with the cores rather than the threads.
+
+  The CPU id is read from the restartable sequences (rseq) area that glibc (2.35+)
+  registers for each thread. As we have no restartable critical sections (which would
+  need assembly around every free list operation), a per-CPU heap is held with a
+  try-lock for the duration of one operation; if the lock is taken (the holder was
+  preempted or another thread migrated onto the CPU), or rseq is not available, we
+  fall back to the thread-local default heap.
+
+  Per-CPU heaps are not owned by a thread: the heap and its segments have thread id 0
+  (`tld->segments.shared` is set), so a plain `mi_free` always takes the `xthread_free`
+  path, while `mi_percpu_free` frees locally if it can take the lock of the owning heap.
+  They never abandon their segments, nor do they reclaim abandoned segments.
+  Per-CPU heaps only serve the default sandbox.
+----------------------------------------------------------- */
+#include "mimalloc.h"
+#include "mimalloc-internal.h"
+#include "mimalloc-atomic.h"
+
+#include <stddef.h>  // offsetof
+
+#if MI_PERCPU && defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define MI_PERCPU_RSEQ 1
+#endif
+#endif
+
+#if MI_PERCPU_RSEQ
+
+typedef struct mi_percpu_s {
+  _Atomic(uintptr_t) lock;        // 0 if the heap is free, 1 while an operation uses it
+  mi_heap_t          heap;
+  mi_tld_t           tld;
+} mi_percpu_t;
+
+static _Atomic(mi_percpu_t*) mi_percpus[MI_PERCPU_MAX];
+
+// the CPU of the current thread as maintained by the kernel in the rseq area, or -1
+static inline int32_t mi_percpu_cpu_id(void) {
+  if mi_unlikely(__rseq_size == 0) return -1;  // rseq is not registered (e.g. disabled through a glibc tunable)
+  const struct rseq* const rs = (const struct rseq*)((uint8_t*)__builtin_thread_pointer() + __rseq_offset);
+  return (int32_t)(*(volatile const uint32_t*)&rs->cpu_id);
+}
+
+static mi_percpu_t* mi_percpu_init(size_t cpu) {
+  mi_thread_init();  // ensure the process is initialized
+  // use `_mi_os_alloc` to allocate directly from the OS (so it is zero initialized)
+  mi_percpu_t* pc = (mi_percpu_t*)_mi_os_alloc(sizeof(mi_percpu_t), &_mi_stats_main);
+  if (pc == NULL) return NULL;
+  mi_tld_t*  tld  = &pc->tld;
+  mi_heap_t* heap = &pc->heap;
+  _mi_memcpy_aligned(heap, &_mi_heap_empty, sizeof(*heap));
+  heap->thread_id = 0;
+  _mi_random_init(&heap->random);
+  heap->cookie  = _mi_heap_random_next(heap) | 1;
+  heap->keys[0] = _mi_heap_random_next(heap);
+  heap->keys[1] = _mi_heap_random_next(heap);
+  heap->tld = tld;
+  tld->heap_backing = heap;
+  tld->heaps = heap;
+  // count in the main statistics (atomically), the tld of a per-CPU heap is never merged as no thread owns it
+  tld->segments.stats = &_mi_stats_main;
+  tld->segments.os = &tld->os;
+  tld->segments.shared = true;
+  tld->os.stats = &_mi_stats_main;
+
+  mi_percpu_t* expected = NULL;
+  while (!mi_atomic_cas_ptr_weak_acq_rel(mi_percpu_t, &mi_percpus[cpu], &expected, pc)) {
+    if (expected != NULL) {
+      // another thread on this CPU initialized it first
+      _mi_os_free(pc, sizeof(mi_percpu_t), &_mi_stats_main);
+      return expected;
+    }
+  }
+  return pc;
+}
+
+// the per-CPU heap of the current CPU, or NULL if not (yet) available
+static inline mi_percpu_t* mi_percpu_current(bool create) {
+  if mi_unlikely(cur_pkey != DEFAULT_SANDBOX_PKEY) return NULL;
+  const int32_t cpu = mi_percpu_cpu_id();
+  if mi_unlikely(cpu < 0 || cpu >= MI_PERCPU_MAX) return NULL;
+  mi_percpu_t* pc = mi_atomic_load_ptr_acquire(mi_percpu_t, &mi_percpus[cpu]);
+  if mi_unlikely(pc == NULL && create) {
+    pc = mi_percpu_init((size_t)cpu);
+  }
+  return pc;
+}
+
+static inline bool mi_percpu_try_lock(mi_percpu_t* pc) {
+  uintptr_t expected = 0;
+  return (mi_atomic_load_relaxed(&pc->lock) == 0 && mi_atomic_cas_strong_acq_rel(&pc->lock, &expected, 1));
+}
+
+mi_heap_t* mi_percpu_heap_acquire(void) mi_attr_noexcept {
+  mi_percpu_t* const pc = mi_percpu_current(true);
+  if mi_likely(pc != NULL && mi_percpu_try_lock(pc)) {
+    return &pc->heap;
+  }
+  return mi_get_default_heap();
+}
+
+void mi_percpu_heap_release(mi_heap_t* heap) mi_attr_noexcept {
+  if (heap->tld == NULL || !heap->tld->segments.shared) return;  // the thread-local fallback heap
+  mi_percpu_t* const pc = (mi_percpu_t*)((uint8_t*)heap - offsetof(mi_percpu_t, heap));
+  mi_assert_internal(mi_atomic_load_relaxed(&pc->lock) == 1);
+  mi_atomic_store_release(&pc->lock, (uintptr_t)0);
+}
+
+void mi_percpu_free(void* p) mi_attr_noexcept {
+  if mi_unlikely(p == NULL) return;
+  mi_segment_t* const segment = _mi_ptr_segment(p);
+  if (mi_atomic_load_relaxed(&segment->thread_id) == 0) {
+    mi_percpu_t* const pc = mi_percpu_current(false);
+    if (pc != NULL) {
+      mi_page_t* const page = _mi_segment_page_of(segment, p);
+      // a live block stays in its page and pages of per-CPU heaps never move to another heap
+      if (mi_page_heap(page) == &pc->heap && mi_percpu_try_lock(pc)) {
+        _mi_free_generic(segment, page, true, p);
+        mi_atomic_store_release(&pc->lock, (uintptr_t)0);
+        return;
+      }
+    }
+  }
+  mi_free(p);
+}
+
+#else
+
+mi_heap_t* mi_percpu_heap_acquire(void) mi_attr_noexcept {
+  return mi_get_default_heap();
+}
+
+void mi_percpu_heap_release(mi_heap_t* heap) mi_attr_noexcept {
+  MI_UNUSED(heap);
+}
+
+void mi_percpu_free(void* p) mi_attr_noexcept {
+  mi_free(p);
+}
+
+#endif
@@ -0,0 +1,133 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2021, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* -----------------------------------------------------------
+  Background purge thread
+
+  Freed pages are reset (`madvise`, or decommitted with `mi_option_reset_decommits`)
+  after `mi_option_reset_delay` milli-seconds by `mi_reset_delayed` in `segment.c`,
+  which runs on the allocation paths; each reset is a system call on an allocating
+  thread. While the background thread runs, those paths only move the expired pages
+  to a global queue and this thread resets them every `mi_option_purge_interval`
+  milli-seconds.
+
+  The thread is started explicitly (`mi_purge_thread_start`) and does not allocate
+  from any heap. Once it is stopped, `mi_purge_thread_stop` resets what is still queued.
+----------------------------------------------------------- */
+#include "mimalloc.h"
+#include "mimalloc-internal.h"
+#include "mimalloc-atomic.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#define MI_PURGE_THREAD 1
+#elif defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <time.h>    // nanosleep
+#define MI_PURGE_THREAD 1
+#endif
+
+#define MI_PURGE_STOPPED   (0)
+#define MI_PURGE_RUNNING   (1)
+#define MI_PURGE_STOPPING  (2)
+
+static _Atomic(uintptr_t) mi_purge_state;  // = MI_PURGE_STOPPED
+
+bool _mi_purge_thread_is_active(void) {
+  return (mi_atomic_load_relaxed(&mi_purge_state) == MI_PURGE_RUNNING);
+}
+
+#if MI_PURGE_THREAD
+
+static void mi_purge_sleep(long msecs) {
+  #if defined(_WIN32)
+  Sleep((DWORD)msecs);
+  #else
+  struct timespec ts;
+  ts.tv_sec  = msecs / 1000;
+  ts.tv_nsec = (msecs % 1000) * 1000000L;
+  while (nanosleep(&ts, &ts) != 0) { /* interrupted: sleep the remaining time */ }
+  #endif
+}
+
+static void mi_purge_thread_loop(void) {
+  while (mi_atomic_load_acquire(&mi_purge_state) == MI_PURGE_RUNNING) {
+    mi_purge_sleep(mi_option_get_clamp(mi_option_purge_interval, 1, 1000));
+    _mi_segment_purge_run();
+  }
+}
+
+#if defined(_WIN32)
+static HANDLE mi_purge_thread;
+
+static DWORD WINAPI mi_purge_thread_main(LPVOID arg) {
+  MI_UNUSED(arg);
+  mi_purge_thread_loop();
+  return 0;
+}
+
+static bool mi_purge_thread_create(void) {
+  mi_purge_thread = CreateThread(NULL, 0, &mi_purge_thread_main, NULL, 0, NULL);
+  return (mi_purge_thread != NULL);
+}
+
+static void mi_purge_thread_join(void) {
+  WaitForSingleObject(mi_purge_thread, INFINITE);
+  CloseHandle(mi_purge_thread);
+  mi_purge_thread = NULL;
+}
+#else
+static pthread_t mi_purge_thread;
+
+static void* mi_purge_thread_main(void* arg) {
+  MI_UNUSED(arg);
+  mi_purge_thread_loop();
+  return NULL;
+}
+
+static bool mi_purge_thread_create(void) {
+  return (pthread_create(&mi_purge_thread, NULL, &mi_purge_thread_main, NULL) == 0);
+}
+
+static void mi_purge_thread_join(void) {
+  pthread_join(mi_purge_thread, NULL);
+}
+#endif
+
+bool mi_purge_thread_start(void) mi_attr_noexcept {
+  uintptr_t expected = MI_PURGE_STOPPED;
+  if (!mi_atomic_cas_strong_acq_rel(&mi_purge_state, &expected, (uintptr_t)MI_PURGE_RUNNING)) {
+    return (expected == MI_PURGE_RUNNING);  // already started (or still stopping)
+  }
+  if (!mi_purge_thread_create()) {
+    _mi_warning_message("unable to start the background purge thread\n");
+    mi_atomic_store_release(&mi_purge_state, (uintptr_t)MI_PURGE_STOPPED);
+    return false;
+  }
+  return true;
+}
+
+void mi_purge_thread_stop(void) mi_attr_noexcept {
+  uintptr_t expected = MI_PURGE_RUNNING;
+  if (!mi_atomic_cas_strong_acq_rel(&mi_purge_state, &expected, (uintptr_t)MI_PURGE_STOPPING)) return;
+  mi_purge_thread_join();
+  mi_atomic_store_release(&mi_purge_state, (uintptr_t)MI_PURGE_STOPPED);
+  // reset what was queued before the threads saw the state change (they check it under the queue lock,
+  // so a page is either queued before this last run or reset by its owner)
+  _mi_segment_purge_run();
+}
+
+#else
+
+bool mi_purge_thread_start(void) mi_attr_noexcept {
+  return false;
+}
+
+void mi_purge_thread_stop(void) mi_attr_noexcept {
+}
+
+#endif
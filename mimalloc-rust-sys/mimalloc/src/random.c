@@ -145,6 +145,18 @@ void _mi_random_split(mi_random_ctx_t* ctx, mi_random_ctx_t* ctx_new) {
   chacha_split(ctx, (uintptr_t)ctx_new /*nonce*/, ctx_new);
 }
 
+// Like `_mi_random_split` but only reads the key of `seed` (which must not change anymore), so
+// threads can derive from a shared seed concurrently; each `nonce` must be used only once.
+void _mi_random_derive(const mi_random_ctx_t* seed, uint64_t nonce, mi_random_ctx_t* ctx_new) {
+  mi_assert_internal(seed != ctx_new);
+  memset(ctx_new, 0, sizeof(*ctx_new));
+  _mi_memcpy(ctx_new->input, seed->input, 12*sizeof(uint32_t));  // constants and key
+  ctx_new->input[14] = (uint32_t)nonce;
+  ctx_new->input[15] = (uint32_t)(nonce >> 32);
+  ctx_new->weak = seed->weak;
+  chacha_block(ctx_new);
+}
+
 uintptr_t _mi_random_next(mi_random_ctx_t* ctx) {
   mi_assert_internal(mi_random_is_initialized(ctx));
   #if MI_INTPTR_SIZE <= 4
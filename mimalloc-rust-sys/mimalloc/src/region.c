@@ -51,9 +51,13 @@ bool    _mi_os_commit_unreset(void* addr, size_t size, bool* is_zero, mi_stats_t
 
 // arena.c
 mi_arena_id_t _mi_arena_id_none(void);
+bool    _mi_arena_memid_is_suitable(size_t arena_memid, mi_arena_id_t request_arena_id);
+bool    _mi_arena_memid_is_os(size_t arena_memid);
+bool    _mi_arena_contains(const void* p);
 void    _mi_arena_free(void* p, size_t size, size_t alignment, size_t align_offset, size_t memid, bool all_committed, mi_stats_t* stats);
 void*   _mi_arena_alloc(size_t size, bool* commit, bool* large, bool* is_pinned, bool* is_zero, mi_arena_id_t req_arena_id, size_t* memid, mi_os_tld_t* tld);
 void*   _mi_arena_alloc_aligned(size_t size, size_t alignment, size_t align_offset, bool* commit, bool* large, bool* is_pinned, bool* is_zero, mi_arena_id_t req_arena_id, size_t* memid, mi_os_tld_t* tld);
+void    _mi_arena_collect(mi_stats_t* stats);
 
 
 
@@ -130,7 +134,7 @@ mi_decl_nodiscard bool mi_is_in_heap_region(const void* p) mi_attr_noexcept {
     uint8_t* start = (uint8_t*)mi_atomic_load_ptr_relaxed(uint8_t, &regions[i].start);
     if (start != NULL && (uint8_t*)p >= start && (uint8_t*)p < start + MI_REGION_SIZE) return true;
   }
-  return false;
+  return _mi_arena_contains(p);  // segments of heaps in an arena are allocated there directly
 }
 
 
@@ -140,13 +144,6 @@ static void* mi_region_blocks_start(const mem_region_t* region, mi_bitmap_index_
   return (start + (bit_idx * MI_SEGMENT_SIZE));
 }
 
-static size_t mi_memid_create(mem_region_t* region, mi_bitmap_index_t bit_idx) {
-  mi_assert_internal(bit_idx < MI_BITMAP_FIELD_BITS);
-  size_t idx = region - regions;
-  mi_assert_internal(&regions[idx] == region);
-  return (idx*MI_BITMAP_FIELD_BITS + bit_idx)<<1;
-}
-
 static size_t mi_memid_create_from_arena(size_t arena_memid) {
   return (arena_memid << 1) | 1;
 }
@@ -166,6 +163,14 @@ static bool mi_memid_is_arena(size_t id, mem_region_t** region, mi_bitmap_index_
 }
 
 
+#if !MI_ARENA_BACKEND
+static size_t mi_memid_create(mem_region_t* region, mi_bitmap_index_t bit_idx) {
+  mi_assert_internal(bit_idx < MI_BITMAP_FIELD_BITS);
+  size_t idx = region - regions;
+  mi_assert_internal(&regions[idx] == region);
+  return (idx*MI_BITMAP_FIELD_BITS + bit_idx)<<1;
+}
+
 /* ----------------------------------------------------------------------------
   Allocate a region is allocated from the OS (or an arena)
 -----------------------------------------------------------------------------*/
@@ -342,6 +347,7 @@ static void* mi_region_try_alloc(size_t blocks, bool* commit, bool* large, bool*
   mi_assert_internal(p != NULL);
   return p;
 }
+#endif
 
 
 /* ----------------------------------------------------------------------------
@@ -350,7 +356,7 @@ static void* mi_region_try_alloc(size_t blocks, bool* commit, bool* large, bool*
 
 // Allocate `size` memory aligned at `alignment`. Return non NULL on success, with a given memory `id`.
 // (`id` is abstract, but `id = idx*MI_REGION_MAP_BITS + bitidx`)
-void* _mi_mem_alloc_aligned(size_t size, size_t alignment, size_t align_offset, bool* commit, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld)
+void* _mi_mem_alloc_aligned(size_t size, size_t alignment, size_t align_offset, mi_arena_id_t req_arena_id, bool* commit, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld)
 {
   mi_assert_internal(memid != NULL && tld != NULL);
   mi_assert_internal(size > 0);
@@ -365,16 +371,19 @@ void* _mi_mem_alloc_aligned(size_t size, size_t alignment, size_t align_offset,
   // allocate from regions if possible
   void* p = NULL;
   size_t arena_memid;
+  #if !MI_ARENA_BACKEND
   const size_t blocks = mi_region_block_count(size);
-  if (blocks <= MI_REGION_MAX_OBJ_BLOCKS && alignment <= MI_SEGMENT_ALIGN && align_offset == 0) {
+  if (blocks <= MI_REGION_MAX_OBJ_BLOCKS && alignment <= MI_SEGMENT_ALIGN && align_offset == 0 && req_arena_id == _mi_arena_id_none()) {
     p = mi_region_try_alloc(blocks, commit, large, is_pinned, is_zero, memid, tld);
     if (p == NULL) {
       _mi_warning_message("unable to allocate from region: size %zu\n", size);
     }
   }
+  #endif
   if (p == NULL) {
-    // and otherwise fall back to the OS
-    p = _mi_arena_alloc_aligned(size, alignment, align_offset, commit, large, is_pinned, is_zero, _mi_arena_id_none(),  & arena_memid, tld);
+    // and otherwise fall back to the OS (or allocate directly in the requested arena, or with
+    // `MI_ARENA_BACKEND` in any arena, reserving a new one when they are full)
+    p = _mi_arena_alloc_aligned(size, alignment, align_offset, commit, large, is_pinned, is_zero, req_arena_id, &arena_memid, tld);
     *memid = mi_memid_create_from_arena(arena_memid);
   }
 
@@ -389,6 +398,37 @@ void* _mi_mem_alloc_aligned(size_t size, size_t alignment, size_t align_offset,
 
 
 
+// Can a heap that allocates in `req_arena_id` use this memory? (regions are never in an exclusive arena)
+bool _mi_mem_is_suitable(size_t id, mi_arena_id_t req_arena_id) {
+  mem_region_t* region;
+  mi_bitmap_index_t bit_idx;
+  size_t arena_memid;
+  if (mi_memid_is_arena(id, &region, &bit_idx, &arena_memid)) {
+    return _mi_arena_memid_is_suitable(arena_memid, req_arena_id);
+  }
+  return (req_arena_id == _mi_arena_id_none());
+}
+
+// Is this memory direct from the OS (not in a region or arena)?
+bool _mi_mem_is_os(size_t id) {
+  mem_region_t* region;
+  mi_bitmap_index_t bit_idx;
+  size_t arena_memid;
+  return (mi_memid_is_arena(id, &region, &bit_idx, &arena_memid) && _mi_arena_memid_is_os(arena_memid));
+}
+
+// The arena of a direct arena allocation (0 for region or OS memory)
+mi_arena_id_t _mi_mem_arena_id(size_t id) {
+  mem_region_t* region;
+  mi_bitmap_index_t bit_idx;
+  size_t arena_memid;
+  if (mi_memid_is_arena(id, &region, &bit_idx, &arena_memid)) {
+    return _mi_arena_memid_arena_id(arena_memid);
+  }
+  return _mi_arena_id_none();
+}
+
+
 /* ----------------------------------------------------------------------------
 Free
 -----------------------------------------------------------------------------*/
@@ -432,7 +472,8 @@ void _mi_mem_free(void* p, size_t size, size_t alignment, size_t align_offset, s
     }
 
     // reset the blocks to reduce the working set.
-    if (!info.x.is_large && !info.x.is_pinned && mi_option_is_enabled(mi_option_segment_reset)
+    if (!info.x.is_large && !info.x.is_pinned &&
+        (mi_option_is_enabled(mi_option_segment_reset) || _mi_os_rss_pressure() >= MI_RSS_OVER)
        && (mi_option_is_enabled(mi_option_eager_commit) ||
            mi_option_is_enabled(mi_option_reset_decommits))) // cannot reset halfway committed segments, use only `option_page_reset` instead
     {
@@ -455,6 +496,10 @@ void _mi_mem_free(void* p, size_t size, size_t alignment, size_t align_offset, s
   collection
 -----------------------------------------------------------------------------*/
 void _mi_mem_collect(mi_os_tld_t* tld) {
+  #if MI_ARENA_BACKEND
+  // arenas are never released, but the free blocks of the grown ones are decommitted
+  _mi_arena_collect(tld->stats);
+  #endif
   // free every region that has no segments in use.
   size_t rcount = mi_atomic_load_relaxed(&regions_count);
   for (size_t i = 0; i < rcount; i++) {
@@ -0,0 +1,295 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2021, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* -----------------------------------------------------------
+  Sampling heap profiler (MI_SAMPLE)
+
+  Each thread counts down the bytes it allocates in `_mi_page_malloc` (one
+  thread-local subtraction); when the countdown crosses zero the allocated
+  block is sampled: its stack trace is recorded in a global table and the page
+  gets the `has_sampled` flag. The countdown is then reset to an exponentially
+  distributed number of bytes with mean `mi_option_sample_interval`, such that
+  every allocated byte has the same probability to be sampled (as pprof assumes
+  for `heap_v2` profiles).
+
+  The `has_sampled` flag is part of `full_aligned`, so frees in pages without
+  sampled blocks take the usual fast path; only frees in pages with sampled
+  blocks go through `_mi_free_generic` and look up the block in the table.
+  That lookup does not take the lock so unsampled blocks cost a few loads.
+
+  The table is open addressing with linear probing. Removed samples leave a
+  tombstone (so lock-free probe sequences stay intact) which becomes empty again
+  as soon as the probe sequence ends at the next slot anyway.
+----------------------------------------------------------- */
+#include "mimalloc.h"
+#include "mimalloc-internal.h"
+#include "mimalloc-atomic.h"
+
+#include <stdio.h>   // snprintf
+
+#if MI_SAMPLE
+#if defined(_WIN32)
+#include <windows.h>
+#define MI_SAMPLE_BACKTRACE 1
+#elif defined(__has_include)
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define MI_SAMPLE_BACKTRACE 1
+#endif
+#endif
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
+#if MI_SAMPLE
+
+typedef struct mi_sample_s {
+  size_t size;                        // requested size
+  size_t depth;                       // frames in `stack`
+  void*  stack[MI_SAMPLE_MAX_DEPTH];  // return addresses, innermost first
+} mi_sample_t;
+
+#define MI_SAMPLE_EMPTY     ((uintptr_t)0)   // never used, ends a probe sequence
+#define MI_SAMPLE_REMOVED   ((uintptr_t)1)   // tombstone of a removed sample
+#define MI_SAMPLE_MAX_USED  (MI_SAMPLE_SLOTS - MI_SAMPLE_SLOTS/4)
+
+typedef struct mi_samples_s {
+  _Atomic(uintptr_t) blocks[MI_SAMPLE_SLOTS];    // the sampled block, or one of the above
+  mi_sample_t        samples[MI_SAMPLE_SLOTS];
+} mi_samples_t;
+
+static _Atomic(mi_samples_t*) mi_samples;
+static _Atomic(uintptr_t)     mi_samples_lock;
+static size_t                 mi_samples_used;   // slots that are not empty (samples and tombstones), under the lock
+
+mi_decl_thread int64_t   _mi_sample_countdown;    // starts at 0 so the first allocation starts the countdown
+static mi_decl_thread bool mi_sample_started;
+static mi_decl_thread bool mi_sample_busy;        // recording or printing on this thread: do not sample
+
+// an exponentially distributed number of bytes with mean `mi_option_sample_interval`;
+// if sampling is off we check the option again after `MI_SAMPLE_RECHECK` bytes
+#define MI_SAMPLE_RECHECK  ((int64_t)64*MI_MiB)
+
+static int64_t mi_sample_next_countdown(mi_heap_t* heap) {
+  const long interval = mi_option_get(mi_option_sample_interval);
+  if (interval <= 0) return MI_SAMPLE_RECHECK;
+  // -ln(u) for a uniform `u` in (0,1], using a piecewise linear log2 (an absolute error below 0.09)
+  const uintptr_t r = (_mi_heap_random_next(heap) >> 1) | 1;
+  const size_t    e = mi_bsr(r);
+  const double    log2r = (double)e + ((double)r / (double)((uintptr_t)1 << e) - 1.0);
+  const double    bytes = ((double)(MI_INTPTR_BITS - 1) - log2r) * 0.6931471805599453 * (double)interval;
+  return (bytes >= (double)INT64_MAX ? INT64_MAX : (int64_t)bytes + 1);
+}
+
+static inline size_t mi_sample_slot(uintptr_t block) {
+  // blocks are pointer aligned; a fibonacci hash spreads consecutive blocks over the table
+  const uint64_t h = ((uint64_t)block >> 3) * 0x9E3779B97F4A7C15ULL;
+  return (size_t)(h >> (64 - MI_SAMPLE_SLOTS_SHIFT));
+}
+
+static void mi_samples_lock_enter(void) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_samples_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+}
+
+static void mi_samples_lock_exit(void) {
+  mi_atomic_store_release(&mi_samples_lock, (uintptr_t)0);
+}
+
+static mi_samples_t* mi_samples_get(bool create) {
+  mi_samples_t* samples = mi_atomic_load_ptr_acquire(mi_samples_t, &mi_samples);
+  if mi_unlikely(samples == NULL && create) {
+    // use `_mi_os_alloc` to allocate directly from the OS (so it is zero initialized, and only the used slots are touched)
+    mi_samples_t* fresh = (mi_samples_t*)_mi_os_alloc(sizeof(mi_samples_t), &_mi_stats_main);
+    if (fresh == NULL) return NULL;
+    if (!mi_atomic_cas_ptr_weak_acq_rel(mi_samples_t, &mi_samples, &samples, fresh)) {
+      _mi_os_free(fresh, sizeof(mi_samples_t), &_mi_stats_main);  // another thread created it first
+      return samples;
+    }
+    samples = fresh;
+  }
+  return samples;
+}
+
+// the slot of `block`, or `MI_SAMPLE_SLOTS` if it is not sampled (does not need the lock)
+static size_t mi_samples_find(mi_samples_t* samples, uintptr_t block) {
+  size_t i = mi_sample_slot(block);
+  for (size_t n = 0; n < MI_SAMPLE_SLOTS; n++, i = (i + 1) % MI_SAMPLE_SLOTS) {
+    const uintptr_t b = mi_atomic_load_acquire(&samples->blocks[i]);
+    if (b == block) return i;
+    if (b == MI_SAMPLE_EMPTY) break;
+  }
+  return MI_SAMPLE_SLOTS;
+}
+
+static bool mi_samples_insert(mi_samples_t* samples, uintptr_t block, const mi_sample_t* sample) {
+  bool inserted = false;
+  mi_samples_lock_enter();
+  size_t i = mi_sample_slot(block);
+  for (size_t n = 0; n < MI_SAMPLE_SLOTS; n++, i = (i + 1) % MI_SAMPLE_SLOTS) {
+    const uintptr_t b = mi_atomic_load_relaxed(&samples->blocks[i]);
+    if (b == MI_SAMPLE_REMOVED || (b == MI_SAMPLE_EMPTY && mi_samples_used < MI_SAMPLE_MAX_USED)) {
+      if (b == MI_SAMPLE_EMPTY) { mi_samples_used++; }
+      samples->samples[i] = *sample;
+      mi_atomic_store_release(&samples->blocks[i], block);
+      inserted = true;
+      break;
+    }
+    if (b == MI_SAMPLE_EMPTY) break;  // the table is full: drop the sample
+  }
+  mi_samples_lock_exit();
+  return inserted;
+}
+
+// remove the sample at slot `i` (under the lock)
+static void mi_samples_remove_at(mi_samples_t* samples, size_t i) {
+  if (mi_atomic_load_relaxed(&samples->blocks[(i + 1) % MI_SAMPLE_SLOTS]) != MI_SAMPLE_EMPTY) {
+    // other probe sequences may continue through this slot
+    mi_atomic_store_release(&samples->blocks[i], MI_SAMPLE_REMOVED);
+    return;
+  }
+  // no probe sequence continues past this slot: it becomes empty, and so do the tombstones before it
+  do {
+    mi_atomic_store_release(&samples->blocks[i], MI_SAMPLE_EMPTY);
+    mi_samples_used--;
+    i = (i + MI_SAMPLE_SLOTS - 1) % MI_SAMPLE_SLOTS;
+  } while (mi_atomic_load_relaxed(&samples->blocks[i]) == MI_SAMPLE_REMOVED);
+}
+
+static mi_decl_noinline size_t mi_sample_backtrace(void** stack) {
+#if defined(_WIN32)
+  return RtlCaptureStackBackTrace(2, MI_SAMPLE_MAX_DEPTH, stack, NULL);
+#elif MI_SAMPLE_BACKTRACE
+  // skip this function and `_mi_sample_record`
+  void* frames[MI_SAMPLE_MAX_DEPTH + 2];
+  const int n = backtrace(frames, MI_SAMPLE_MAX_DEPTH + 2);
+  if (n <= 2) return 0;
+  _mi_memcpy(stack, frames + 2, (size_t)(n - 2) * sizeof(void*));
+  return (size_t)(n - 2);
+#else
+  MI_UNUSED(stack);
+  return 0;
+#endif
+}
+
+void mi_decl_noinline _mi_sample_record(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size) mi_attr_noexcept {
+  _mi_sample_countdown = mi_sample_next_countdown(heap);
+  if mi_unlikely(!mi_sample_started) {
+    // the first allocation of a thread only starts the countdown
+    mi_sample_started = true;
+    return;
+  }
+  if (mi_sample_busy) return;
+  mi_sample_busy = true;  // `backtrace` may allocate
+  mi_samples_t* const samples = mi_samples_get(true);
+  if (samples != NULL) {
+    mi_sample_t sample;
+    sample.size  = size;
+    sample.depth = mi_sample_backtrace(sample.stack);
+    if (mi_samples_insert(samples, (uintptr_t)block, &sample)) {
+      mi_page_set_has_sampled(page, true);
+    }
+  }
+  mi_sample_busy = false;
+}
+
+void _mi_sample_free(const mi_block_t* block) mi_attr_noexcept {
+  mi_samples_t* const samples = mi_samples_get(false);
+  if (samples == NULL) return;
+  // most blocks of a page with sampled blocks are not sampled themselves
+  if (mi_samples_find(samples, (uintptr_t)block) == MI_SAMPLE_SLOTS) return;
+  mi_samples_lock_enter();
+  const size_t i = mi_samples_find(samples, (uintptr_t)block);
+  if (i < MI_SAMPLE_SLOTS) { mi_samples_remove_at(samples, i); }
+  mi_samples_lock_exit();
+}
+
+void _mi_sample_page_destroy(const mi_segment_t* segment, const mi_page_t* page) mi_attr_noexcept {
+  mi_samples_t* const samples = mi_samples_get(false);
+  if (samples == NULL) return;
+  size_t psize;
+  const uintptr_t start = (uintptr_t)_mi_page_start(segment, page, &psize);
+  mi_samples_lock_enter();
+  for (size_t i = 0; i < MI_SAMPLE_SLOTS; i++) {
+    const uintptr_t b = mi_atomic_load_relaxed(&samples->blocks[i]);
+    if (b >= start && b < start + psize) { mi_samples_remove_at(samples, i); }
+  }
+  mi_samples_lock_exit();
+}
+
+static void mi_sample_print(mi_output_fun* out, void* arg, const mi_sample_t* sample) {
+  char buf[64 + 20*MI_SAMPLE_MAX_DEPTH];
+  int n = snprintf(buf, sizeof(buf), "1: %zu [1: %zu] @", sample->size, sample->size);
+  for (size_t i = 0; i < sample->depth && n > 0 && (size_t)n < sizeof(buf); i++) {
+    n += snprintf(buf + n, sizeof(buf) - (size_t)n, " 0x%zx", (size_t)(uintptr_t)sample->stack[i]);
+  }
+  _mi_fputs(out, arg, NULL, buf);
+  _mi_fputs(out, arg, NULL, "\n");
+}
+
+static void mi_sample_print_maps(mi_output_fun* out, void* arg) {
+  _mi_fputs(out, arg, NULL, "\nMAPPED_LIBRARIES:\n");
+#if defined(__linux__)
+  // pprof needs the mappings to symbolize the addresses
+  const int fd = open("/proc/self/maps", O_RDONLY);
+  if (fd < 0) return;
+  char buf[512];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
+    buf[n] = 0;
+    _mi_fputs(out, arg, NULL, buf);
+  }
+  close(fd);
+#endif
+}
+
+void mi_sample_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  mi_samples_t* const samples = mi_samples_get(false);
+  const bool busy = mi_sample_busy;
+  mi_sample_busy = true;  // the output may allocate: do not sample that
+  // the header has the totals; the lock is never held while calling `out` (which may free sampled blocks)
+  size_t count = 0;
+  size_t total = 0;
+  if (samples != NULL) {
+    mi_samples_lock_enter();
+    for (size_t i = 0; i < MI_SAMPLE_SLOTS; i++) {
+      if (mi_atomic_load_relaxed(&samples->blocks[i]) > MI_SAMPLE_REMOVED) {
+        count++;
+        total += samples->samples[i].size;
+      }
+    }
+    mi_samples_lock_exit();
+  }
+  _mi_fprintf(out, arg, "heap profile: %zu: %zu [ %zu: %zu] @ heap_v2/%ld\n", count, total, count, total, mi_option_get(mi_option_sample_interval));
+  for (size_t i = 0; samples != NULL && i < MI_SAMPLE_SLOTS; i++) {
+    mi_sample_t sample;
+    bool live = false;
+    mi_samples_lock_enter();
+    if (mi_atomic_load_relaxed(&samples->blocks[i]) > MI_SAMPLE_REMOVED) {
+      sample = samples->samples[i];
+      live = true;
+    }
+    mi_samples_lock_exit();
+    if (live) { mi_sample_print(out, arg, &sample); }
+  }
+  mi_sample_print_maps(out, arg);
+  mi_sample_busy = busy;
+}
+
+#else
+
+void mi_sample_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  // an empty profile
+  _mi_fputs(out, arg, NULL, "heap profile: 0: 0 [ 0: 0] @ heap_v2/0\n");
+}
+
+#endif
@@ -14,6 +14,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #define MI_PAGE_HUGE_ALIGN  (256*1024)
 
 static uint8_t* mi_segment_raw_page_start(const mi_segment_t* segment, const mi_page_t* page, size_t* page_size);
+static void mi_purge_sync(mi_page_t* page);
 
 /* --------------------------------------------------------------------------------
   Segment allocation
@@ -54,10 +55,6 @@ static bool mi_segment_queue_contains(const mi_segment_queue_t* queue, const mi_
 }
 #endif
 
-static bool mi_segment_queue_is_empty(const mi_segment_queue_t* queue) {
-  return (queue->first == NULL);
-}
-
 static void mi_segment_queue_remove(mi_segment_queue_t* queue, mi_segment_t* segment) {
   mi_assert_expensive(mi_segment_queue_contains(queue, segment));
   if (segment->prev != NULL) segment->prev->next = segment->next;
@@ -110,7 +107,7 @@ static void mi_segment_insert_in_free_queue(mi_segment_t* segment, mi_segments_t
  Invariant checking
 ----------------------------------------------------------- */
 
-#if (MI_DEBUG >= 2) || (MI_SECURE >= 2)
+#if (MI_DEBUG >= 2) || (MI_SECURE_GUARD_PAGES >= 2)
 static size_t mi_segment_page_size(const mi_segment_t* segment) {
   if (segment->capacity > 1) {
     mi_assert_internal(segment->page_kind <= MI_PAGE_MEDIUM);
@@ -186,18 +183,18 @@ static void mi_segment_protect_range(void* p, size_t size, bool protect) {
 
 static void mi_segment_protect(mi_segment_t* segment, bool protect, mi_os_tld_t* tld) {
   // add/remove guard pages
-  if (MI_SECURE != 0) {
+  if (MI_SECURE_GUARD_PAGES != 0) {
     // in secure mode, we set up a protected page in between the segment info and the page data
     const size_t os_psize = _mi_os_page_size();
     mi_assert_internal((segment->segment_info_size - os_psize) >= (sizeof(mi_segment_t) + ((segment->capacity - 1) * sizeof(mi_page_t))));
     mi_assert_internal(((uintptr_t)segment + segment->segment_info_size) % os_psize == 0);
     mi_segment_protect_range((uint8_t*)segment + segment->segment_info_size - os_psize, os_psize, protect);
-    #if (MI_SECURE >= 2)
+    #if (MI_SECURE_GUARD_PAGES >= 2)
     if (segment->capacity == 1)
     #endif
     {
       // and protect the last (or only) page too
-      mi_assert_internal(MI_SECURE <= 1 || segment->page_kind >= MI_PAGE_LARGE);
+      mi_assert_internal(MI_SECURE_GUARD_PAGES <= 1 || segment->page_kind >= MI_PAGE_LARGE);
       uint8_t* start = (uint8_t*)segment + segment->segment_size - os_psize;
       if (protect && !segment->mem_is_committed) {
         if (protect) {
@@ -211,7 +208,7 @@ static void mi_segment_protect(mi_segment_t* segment, bool protect, mi_os_tld_t*
         mi_segment_protect_range(start, os_psize, protect);
       }
     }
-    #if (MI_SECURE >= 2)
+    #if (MI_SECURE_GUARD_PAGES >= 2)
     else {
       // or protect every page
       const size_t page_size = mi_segment_page_size(segment);
@@ -286,8 +283,10 @@ static void mi_pages_reset_add(mi_segment_t* segment, mi_page_t* page, mi_segmen
   mi_assert_internal(_mi_page_segment(page)==segment);
   if (!mi_option_is_enabled(mi_option_page_reset)) return;
   if (segment->mem_is_pinned || page->segment_in_use || !page->is_committed || page->is_reset) return;
+  if (segment->mem_is_thp && _mi_os_rss_pressure() < MI_RSS_OVER) return;  // do not split the huge OS pages
 
-  if (mi_option_get(mi_option_reset_delay) == 0) {
+  if (mi_option_get(mi_option_reset_delay) == 0 ||
+      (_mi_os_rss_pressure() >= MI_RSS_OVER && !_mi_purge_thread_is_active())) {
     // reset immediately?
     mi_page_reset(segment, page, 0, tld);
   }
@@ -328,6 +327,7 @@ static void mi_pages_reset_remove_all_in_segment(mi_segment_t* segment, bool for
   if (segment->mem_is_pinned) return; // never reset in huge OS pages
   for (size_t i = 0; i < segment->capacity; i++) {
     mi_page_t* page = &segment->pages[i];
+    if (page->is_purge_pending) { mi_purge_sync(page); }  // the segment is freed or abandoned
     if (!page->segment_in_use && page->is_committed && !page->is_reset) {
       mi_pages_reset_remove(page, tld);
       if (force_reset) {
@@ -340,19 +340,136 @@ static void mi_pages_reset_remove_all_in_segment(mi_segment_t* segment, bool for
   }
 }
 
-static void mi_reset_delayed(mi_segments_tld_t* tld) {
+/* -----------------------------------------------------------
+  Background page reset
+
+  With the background purge thread running (see `purge.c`) the expired pages of
+  `mi_reset_delayed` are not reset by the owning thread but handed over to a global
+  queue: the page is marked `is_reset` and `is_purge_pending` right away and the
+  background thread does the actual `madvise`/decommit later on.
+  The background thread only touches the `next`/`prev` fields of the queued pages
+  (under the lock) and the page memory itself; before the owner can reuse the page
+  (or free its segment) it has to `mi_purge_sync` it, which either takes it out of
+  the queue again or waits for the reset in progress.
+----------------------------------------------------------- */
+
+static _Atomic(uintptr_t) mi_purge_lock;
+static mi_page_queue_t    mi_purge_queue;    // pages waiting to be reset by the background thread (under the lock)
+static mi_page_t*         mi_purge_current;  // page the background thread is resetting right now (under the lock)
+static mi_os_tld_t        mi_purge_os_tld = { 0, &_mi_stats_main, 0, { NULL } };
+
+static void mi_purge_lock_enter(void) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_purge_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+}
+
+static void mi_purge_lock_exit(void) {
+  mi_atomic_store_release(&mi_purge_lock, (uintptr_t)0);
+}
+
+static bool mi_purge_queue_contains(const mi_page_t* page) {
+  return (page->next != NULL || page->prev != NULL || mi_purge_queue.first == page);
+}
+
+static void mi_purge_queue_remove(mi_page_t* page) {
+  if (page->prev != NULL) page->prev->next = page->next;
+  if (page->next != NULL) page->next->prev = page->prev;
+  if (page == mi_purge_queue.last)  mi_purge_queue.last = page->prev;
+  if (page == mi_purge_queue.first) mi_purge_queue.first = page->next;
+  page->next = page->prev = NULL;
+}
+
+// push an expired page on the queue of the background thread (under the lock)
+static void mi_purge_push(mi_page_t* page) {
+  mi_assert_internal(!page->segment_in_use && page->is_committed && !page->is_reset && !page->is_purge_pending);
+  page->is_reset = true;
+  page->is_purge_pending = true;
+  page->prev = NULL;
+  page->next = mi_purge_queue.first;
+  if (mi_purge_queue.first == NULL) {
+    mi_purge_queue.first = mi_purge_queue.last = page;
+  }
+  else {
+    mi_purge_queue.first->prev = page;
+    mi_purge_queue.first = page;
+  }
+}
+
+// called by the owner before it reuses a page that was handed to the background thread
+static void mi_purge_sync(mi_page_t* page) {
+  mi_assert_internal(page->is_purge_pending && page->is_reset);
+  mi_purge_lock_enter();
+  while (mi_purge_current == page) {
+    // being reset right now
+    mi_purge_lock_exit();
+    mi_atomic_yield();
+    mi_purge_lock_enter();
+  }
+  if (mi_purge_queue_contains(page)) {
+    // not reset yet: cancel it
+    mi_purge_queue_remove(page);
+    page->is_reset = false;
+  }
+  mi_purge_lock_exit();
+  page->is_purge_pending = false;
+}
+
+size_t _mi_segment_purge_run(void) {
+  size_t count = 0;
+  mi_purge_lock_enter();
+  mi_page_t* page;
+  while ((page = mi_purge_queue.last) != NULL) {
+    // oldest first
+    mi_purge_queue_remove(page);
+    mi_purge_current = page;
+    mi_purge_lock_exit();
+    size_t psize;
+    void* start = mi_segment_raw_page_start(_mi_page_segment(page), page, &psize);
+    if (psize > 0) {
+      _mi_mem_reset(start, psize, &mi_purge_os_tld);
+      _mi_stat_counter_increase(&_mi_stats_main.purge_resets, psize);
+    }
+    count++;
+    mi_purge_lock_enter();
+    mi_purge_current = NULL;
+  }
+  mi_purge_lock_exit();
+  return count;
+}
+
+static void mi_reset_delayed(mi_segments_tld_t* tld, bool force) {
   if (!mi_option_is_enabled(mi_option_page_reset)) return;
   mi_msecs_t now = _mi_clock_now();
   mi_page_queue_t* pq = &tld->pages_reset;
   // from oldest up to the first that has not expired yet
   mi_page_t* page = pq->last;
-  while (page != NULL && mi_page_reset_is_expired(page,now)) {
+  if (page == NULL) return;
+  const bool all = (force || _mi_os_rss_pressure() >= MI_RSS_OVER);  // over the RSS target: do not wait for the delay
+  if (!all && !mi_page_reset_is_expired(page,now)) return;
+  bool background = _mi_purge_thread_is_active();
+  if (background) {
+    mi_purge_lock_enter();
+    if (!_mi_purge_thread_is_active()) {  // stopped meanwhile: its last run may be over already
+      mi_purge_lock_exit();
+      background = false;
+    }
+  }
+  while (page != NULL && (all || mi_page_reset_is_expired(page,now))) {
     mi_page_t* const prev = page->prev; // save previous field
-    mi_page_reset(_mi_page_segment(page), page, 0, tld);
     page->used = 0;
     page->prev = page->next = NULL;
+    if (background) {
+      mi_purge_push(page);  // only enqueue: the background thread does the system call
+    }
+    else {
+      mi_page_reset(_mi_page_segment(page), page, 0, tld);
+    }
     page = prev;
   }
+  if (background) mi_purge_lock_exit();
   // discard the reset pages from the queue
   pq->last = page;
   if (page != NULL){
@@ -380,9 +497,9 @@ static uint8_t* mi_segment_raw_page_start(const mi_segment_t* segment, const mi_
     psize -= segment->segment_info_size;
   }
 
-#if (MI_SECURE > 1)  // every page has an os guard page
+#if (MI_SECURE_GUARD_PAGES > 1)  // every page has an os guard page
   psize -= _mi_os_page_size();
-#elif (MI_SECURE==1) // the last page has an os guard page at the end
+#elif (MI_SECURE_GUARD_PAGES==1) // the last page has an os guard page at the end
   if (page->segment_idx == segment->capacity - 1) {
     psize -= _mi_os_page_size();
   }
@@ -412,6 +529,20 @@ uint8_t* _mi_segment_page_start(const mi_segment_t* segment, const mi_page_t* pa
       mi_assert_internal((uintptr_t)p % block_size == 0);
     }
   }
+  #if MI_ALIGNED_PAGES
+  else if (block_size > 0 && segment->page_kind == MI_PAGE_LARGE) {
+    // align the start to the largest power of two dividing the block size, unless that costs a block;
+    // the segment is aligned and the tail of the page was unused anyway
+    const size_t align  = block_size & (~block_size + 1);
+    const size_t adjust = _mi_align_up((uintptr_t)p, align) - (uintptr_t)p;
+    if (adjust > 0 && adjust < psize && (psize - adjust) / block_size == psize / block_size) {
+      p += adjust;
+      psize -= adjust;
+      if (pre_size != NULL) *pre_size = adjust;
+      mi_assert_internal((uintptr_t)p % align == 0);
+    }
+  }
+  #endif
 
   if (page_size != NULL) *page_size = psize;
   mi_assert_internal(page->xblock_size==0 || _mi_ptr_page(p) == page);
@@ -425,7 +556,7 @@ static size_t mi_segment_size(size_t capacity, size_t required, size_t* pre_size
   size_t guardsize = 0;
   size_t isize     = 0;
 
-  if (MI_SECURE == 0) {
+  if (MI_SECURE_GUARD_PAGES == 0) {
     // normally no guard pages
     isize = _mi_align_up(minsize, 16 * MI_MAX_ALIGN_SIZE);
   }
@@ -448,6 +579,11 @@ static size_t mi_segment_size(size_t capacity, size_t required, size_t* pre_size
 Segment caches
 We keep a small segment cache per thread to increase local
 reuse and avoid setting/clearing guard pages in secure mode.
+
+The cache is a LIFO of up to `mi_option_segment_thread_cache` fully committed
+segments (of `MI_SEGMENT_SIZE`) in the `mi_os_tld_t`, so a thread that frees and
+allocates segments in a burst does not go through the shared region bitmaps.
+It is drained into the regions when the thread terminates (or collects).
 ------------------------------------------------------------------------------- */
 
 static void mi_segments_track_size(long segment_size, mi_segments_tld_t* tld) {
@@ -459,11 +595,76 @@ static void mi_segments_track_size(long segment_size, mi_segments_tld_t* tld) {
   if (tld->current_size > tld->peak_size) tld->peak_size = tld->current_size;
 }
 
+static bool mi_segment_cache_push(mi_segment_t* segment, size_t segment_size, bool fully_committed, mi_segments_tld_t* tld) {
+  if (segment_size != MI_SEGMENT_SIZE || !fully_committed || segment->mem_is_pinned || segment->mem_align_offset != 0) return false;
+  mi_os_tld_t* const os = tld->os;
+  const size_t max = (size_t)mi_option_get_clamp(mi_option_segment_thread_cache, 0, MI_SEGMENT_TLD_CACHE_MAX);
+  if (os->segment_cache_count >= max) return false;
+  if (_mi_os_rss_pressure() >= MI_RSS_OVER) return false;  // rather give it back
+  os->segment_cache[os->segment_cache_count++] = segment;
+  _mi_stat_increase(&tld->stats->segments_cache, 1);
+  return true;
+}
+
+// pop the most recent cached segment that is suitable for `req_arena_id`
+static mi_segment_t* mi_segment_cache_pop(size_t segment_size, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld) {
+  mi_os_tld_t* const os = tld->os;
+  if (segment_size != MI_SEGMENT_SIZE) return NULL;
+  for (size_t i = os->segment_cache_count; i > 0; i--) {
+    mi_segment_t* const segment = os->segment_cache[i-1];
+    if (_mi_mem_is_suitable(segment->memid, req_arena_id)) {
+      os->segment_cache_count--;
+      for (size_t j = i-1; j < os->segment_cache_count; j++) { os->segment_cache[j] = os->segment_cache[j+1]; }
+      _mi_stat_decrease(&tld->stats->segments_cache, 1);
+      return segment;
+    }
+  }
+  return NULL;
+}
+
+// release all cached segments to the regions
+static void mi_segment_cache_drain(mi_segments_tld_t* tld) {
+  mi_os_tld_t* const os = tld->os;
+  while (os->segment_cache_count > 0) {
+    mi_segment_t* const segment = os->segment_cache[--os->segment_cache_count];
+    _mi_stat_decrease(&tld->stats->segments_cache, 1);
+    _mi_mem_free(segment, MI_SEGMENT_SIZE, segment->mem_alignment, segment->mem_align_offset, segment->memid, true, false, os);
+  }
+}
+
+/* -----------------------------------------------------------
+  Per NUMA node statistics of the committed segment memory
+----------------------------------------------------------- */
+
+static mi_stat_count_t* mi_segment_node_stat(const mi_segment_t* segment, mi_segments_tld_t* tld) {
+  int node = segment->numa_node;
+  if (node < 0) node = 0;
+  if (node >= MI_STAT_NUMA_NODES) node = MI_STAT_NUMA_NODES - 1;
+  return &tld->stats->node_committed[node];
+}
+
+// the segment info and the committed pages (including their guard pages)
+static size_t mi_segment_committed_size(const mi_segment_t* segment) {
+  const size_t gsize = (MI_SECURE_GUARD_PAGES >= 2 ? _mi_os_page_size() : 0);
+  size_t committed = segment->segment_info_size;
+  for (size_t i = 0; i < segment->capacity; i++) {
+    const mi_page_t* page = &segment->pages[i];
+    if (page->is_committed) {
+      size_t psize;
+      mi_segment_raw_page_start(segment, page, &psize);
+      committed += psize + gsize;
+    }
+  }
+  return committed;
+}
+
 static void mi_segment_os_free(mi_segment_t* segment, size_t segment_size, mi_segments_tld_t* tld) {
   segment->thread_id = 0;
   mi_segments_track_size(-((long)segment_size),tld);
-  if (MI_SECURE != 0) {
-    mi_assert_internal(!segment->mem_is_pinned);
+  _mi_stat_decrease(mi_segment_node_stat(segment, tld), mi_segment_committed_size(segment));
+  if (segment->mem_is_thp) { _mi_stat_decrease(&tld->stats->segments_thp, 1); }
+  if (MI_SECURE_GUARD_PAGES != 0) {
+    // (pinned memory, as of an arena over a mapped file, is fully committed and has its guard pages as well)
     mi_segment_protect(segment, false, tld->os); // ensure no more guard pages are set
   }
 
@@ -477,12 +678,17 @@ static void mi_segment_os_free(mi_segment_t* segment, size_t segment_size, mi_se
   if (any_reset && mi_option_is_enabled(mi_option_reset_decommits)) {
     fully_committed = false;
   }
+  if (mi_segment_cache_push(segment, segment_size, fully_committed, tld)) return;
   _mi_mem_free(segment, segment_size, segment->mem_alignment, segment->mem_align_offset, segment->memid, fully_committed, any_reset, tld->os);
+  if (_mi_os_rss_pressure() >= MI_RSS_FAR_OVER) {
+    _mi_mem_collect(tld->os);  // far over the RSS target: release unused regions
+  }
 }
 
 // called by threads that are terminating to free cached segments
 void _mi_segment_thread_collect(mi_segments_tld_t* tld) {
-  MI_UNUSED_RELEASE(tld);
+  mi_reset_delayed(tld, true);  // reset the delayed pages now (a forced collect can run on any thread, not only at termination)
+  mi_segment_cache_drain(tld);
 #if MI_DEBUG>=2
   if (!_mi_is_main_thread()) {
     mi_assert_internal(tld->pages_reset.first == NULL);
@@ -496,11 +702,23 @@ void _mi_segment_thread_collect(mi_segments_tld_t* tld) {
    Segment allocation
 ----------------------------------------------------------- */
 
-static mi_segment_t* mi_segment_os_alloc(bool eager_delayed, size_t page_alignment, size_t pre_size, size_t info_size,
+static mi_segment_t* mi_segment_os_allocx(bool eager_delayed, size_t page_alignment, mi_arena_id_t req_arena_id, size_t pre_size, size_t info_size,
                                          size_t* segment_size, bool* is_zero, bool* commit, mi_segments_tld_t* tld, mi_os_tld_t* tld_os)
 {
+  if (page_alignment == 0) {
+    // try the thread-local cache first (the `mem` fields are still valid)
+    mi_segment_t* segment = mi_segment_cache_pop(*segment_size, req_arena_id, tld);
+    if (segment != NULL) {
+      mi_track_mem_undefined(segment, info_size);
+      *commit  = true;
+      *is_zero = false;
+      mi_segments_track_size((long)(*segment_size), tld);
+      return segment;
+    }
+  }
+
   size_t memid;
-  bool   mem_large = (!eager_delayed && (MI_SECURE == 0)); // only allow large OS pages once we are no longer lazy
+  bool   mem_large = (!eager_delayed && (MI_SECURE_GUARD_PAGES == 0)); // only allow large OS pages once we are no longer lazy
   bool   is_pinned = false;
   size_t align_offset = 0;
   size_t alignment = MI_SEGMENT_SIZE;
@@ -510,7 +728,7 @@ static mi_segment_t* mi_segment_os_alloc(bool eager_delayed, size_t page_alignme
     *segment_size = *segment_size + (align_offset - pre_size);
   }
 
-  mi_segment_t* segment = (mi_segment_t*)_mi_mem_alloc_aligned(*segment_size, alignment, align_offset, commit, &mem_large, &is_pinned, is_zero, &memid, tld_os);
+  mi_segment_t* segment = (mi_segment_t*)_mi_mem_alloc_aligned(*segment_size, alignment, align_offset, req_arena_id, commit, &mem_large, &is_pinned, is_zero, &memid, tld_os);
   if (segment == NULL) return NULL;  // failed to allocate
   if (!(*commit)) {
     // ensure the initial info is committed
@@ -531,12 +749,26 @@ static mi_segment_t* mi_segment_os_alloc(bool eager_delayed, size_t page_alignme
   segment->mem_is_committed = commit;
   segment->mem_alignment = alignment;
   segment->mem_align_offset = align_offset;
+  segment->numa_node = (int16_t)_mi_os_numa_node(tld_os);
   mi_segments_track_size((long)(*segment_size), tld);
   return segment;
 }
 
+static mi_segment_t* mi_segment_os_alloc(bool eager_delayed, size_t page_alignment, mi_arena_id_t req_arena_id, size_t pre_size, size_t info_size,
+                                         size_t* segment_size, bool* is_zero, bool* commit, mi_segments_tld_t* tld, mi_os_tld_t* tld_os)
+{
+  #if MI_STAT_LATENCY
+  const mi_nsecs_t start = mi_stat_latency_start();
+  mi_segment_t* segment = mi_segment_os_allocx(eager_delayed, page_alignment, req_arena_id, pre_size, info_size, segment_size, is_zero, commit, tld, tld_os);
+  mi_stat_latency(tld->stats, MI_STAT_LATENCY_SEGMENT_ALLOC, start);
+  return segment;
+  #else
+  return mi_segment_os_allocx(eager_delayed, page_alignment, req_arena_id, pre_size, info_size, segment_size, is_zero, commit, tld, tld_os);
+  #endif
+}
+
 // Allocate a segment from the OS aligned to `MI_SEGMENT_SIZE` .
-static mi_segment_t* mi_segment_alloc(size_t required, mi_page_kind_t page_kind, size_t page_shift, size_t page_alignment, mi_segments_tld_t* tld, mi_os_tld_t* os_tld)
+static mi_segment_t* mi_segment_alloc(size_t required, mi_page_kind_t page_kind, size_t page_shift, size_t page_alignment, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld, mi_os_tld_t* os_tld)
 {
   // required is only > 0 for huge page allocations
   mi_assert_internal((required > 0 && page_kind > MI_PAGE_LARGE)|| (required==0 && page_kind <= MI_PAGE_LARGE));
@@ -565,11 +797,12 @@ static mi_segment_t* mi_segment_alloc(size_t required, mi_page_kind_t page_kind,
                               _mi_current_thread_count() > 1 &&       // do not delay for the first N threads
                               tld->count < (size_t)mi_option_get(mi_option_eager_commit_delay));
   const bool eager  = !eager_delayed && mi_option_is_enabled(mi_option_eager_commit);
-  bool commit = eager; // || (page_kind >= MI_PAGE_LARGE);
+  const bool thp_aware = mi_option_is_enabled(mi_option_thp_aware);
+  bool commit = eager || (thp_aware && page_kind <= MI_PAGE_MEDIUM); // || (page_kind >= MI_PAGE_LARGE);
   bool is_zero = false;
 
   // Allocate the segment from the OS (segment_size can change due to alignment)
-  mi_segment_t* segment = mi_segment_os_alloc(eager_delayed, page_alignment, pre_size, info_size, &segment_size, &is_zero, &commit, tld, os_tld);
+  mi_segment_t* segment = mi_segment_os_alloc(eager_delayed, page_alignment, req_arena_id, pre_size, info_size, &segment_size, &is_zero, &commit, tld, os_tld);
   if (segment == NULL) return NULL;
   mi_assert_internal(segment != NULL && (uintptr_t)segment % MI_SEGMENT_SIZE == 0);
   mi_assert_internal(segment->mem_is_pinned ? segment->mem_is_committed : true);
@@ -595,9 +828,20 @@ static mi_segment_t* mi_segment_alloc(size_t required, mi_page_kind_t page_kind,
   segment->page_shift = page_shift;
   segment->segment_size = segment_size;
   segment->segment_info_size = pre_size;
-  segment->thread_id  = _mi_thread_id();
+  segment->thread_id  = (tld->shared ? 0 : _mi_thread_id());
   segment->cookie = _mi_ptr_cookie(segment);
+
+  // THP-aware: the dense small and medium page segments (fully committed above) go on transparent
+  // huge pages, while the sparse large and huge ones stay on small OS pages (the memory may be
+  // reused from a segment of another kind so we always advise)
+  segment->mem_is_thp = false;
+  if (thp_aware && !segment->mem_is_pinned) {
+    const bool huge = (page_kind <= MI_PAGE_MEDIUM);
+    segment->mem_is_thp = (_mi_os_thp_advise(segment, segment_size, huge) && huge);
+    if (segment->mem_is_thp) { _mi_stat_increase(&tld->stats->segments_thp, 1); }
+  }
   // _mi_stat_increase(&tld->stats->page_committed, segment->segment_info_size);
+  _mi_stat_increase(mi_segment_node_stat(segment, tld), mi_segment_committed_size(segment));
 
   // set protection
   mi_segment_protect(segment, true, tld->os);
@@ -615,6 +859,11 @@ static mi_segment_t* mi_segment_alloc(size_t required, mi_page_kind_t page_kind,
 static void mi_segment_free(mi_segment_t* segment, bool force, mi_segments_tld_t* tld) {
   MI_UNUSED(force);
   mi_assert(segment != NULL);
+  #if MI_REMOTE_FREE_BUFFER
+  // all its blocks are free, so a remaining count is a thread that just pushed its buffered frees
+  // and is about to decrement it: wait for that last access
+  while (mi_atomic_load_acquire(&segment->remote_buffered) != 0) { mi_atomic_yield(); }
+  #endif
   // note: don't reset pages even on abandon as the whole segment is freed? (and ready for reuse)
   bool force_reset = (force && mi_option_is_enabled(mi_option_abandoned_page_reset));
   mi_pages_reset_remove_all_in_segment(segment, force_reset, tld);
@@ -642,6 +891,7 @@ static bool mi_segment_has_free(const mi_segment_t* segment) {
 static bool mi_segment_page_claim(mi_segment_t* segment, mi_page_t* page, mi_segments_tld_t* tld) {
   mi_assert_internal(_mi_page_segment(page) == segment);
   mi_assert_internal(!page->segment_in_use);
+  if (page->is_purge_pending) { mi_purge_sync(page); }
   mi_pages_reset_remove(page, tld);
   // check commit
   if (!page->is_committed) {
@@ -650,12 +900,13 @@ static bool mi_segment_page_claim(mi_segment_t* segment, mi_page_t* page, mi_seg
     size_t psize;
     uint8_t* start = mi_segment_raw_page_start(segment, page, &psize);
     bool is_zero = false;
-    const size_t gsize = (MI_SECURE >= 2 ? _mi_os_page_size() : 0);
+    const size_t gsize = (MI_SECURE_GUARD_PAGES >= 2 ? _mi_os_page_size() : 0);
     bool ok = _mi_mem_commit(start, psize + gsize, &is_zero, tld->os);
     if (!ok) return false; // failed to commit!
     if (gsize > 0) { mi_segment_protect_range(start + psize, gsize, true); }
     if (is_zero) { page->is_zero_init = true; }
     page->is_committed = true;
+    _mi_stat_increase(mi_segment_node_stat(segment, tld), psize + gsize);
   }
   // set in-use before doing unreset to prevent delayed reset
   page->segment_in_use = true;
@@ -736,7 +987,7 @@ void _mi_segment_page_free(mi_page_t* page, bool force, mi_segments_tld_t* tld)
   mi_assert(page != NULL);
   mi_segment_t* segment = _mi_page_segment(page);
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
-  mi_reset_delayed(tld);
+  mi_reset_delayed(tld, false);
 
   // mark it as free now
   mi_segment_page_clear(segment, page, true, tld);
@@ -767,8 +1018,9 @@ live blocks (reached through other threads). Such segments
 are "abandoned" and will be reclaimed by other threads to
 reuse their pages and/or free them eventually
 
-We maintain a global list of abandoned segments that are
-reclaimed on demand. Since this is shared among threads
+We maintain global lists of abandoned segments (sharded by page
+kind and NUMA node) that are reclaimed on demand. Since these are
+shared among threads
 the implementation needs to avoid the A-B-A problem on
 popping abandoned segments: <https://en.wikipedia.org/wiki/ABA_problem>
 We use tagged pointers to avoid accidentially identifying
@@ -800,55 +1052,74 @@ static mi_tagged_segment_t mi_tagged_segment(mi_segment_t* segment, mi_tagged_se
   return ((uintptr_t)segment | tag);
 }
 
-// This is a list of visited abandoned pages that were full at the time.
-// this list migrates to `abandoned` when that becomes NULL. The use of
-// this list reduces contention and the rate at which segments are visited.
-static mi_decl_cache_align _Atomic(mi_segment_t*)       abandoned_visited; // = NULL
-
-// The abandoned page list (tagged as it supports pop)
-static mi_decl_cache_align _Atomic(mi_tagged_segment_t) abandoned;         // = NULL
-
-// Maintain these for debug purposes (these counts may be a bit off)
-static mi_decl_cache_align _Atomic(size_t)           abandoned_count;
-static mi_decl_cache_align _Atomic(size_t)           abandoned_visited_count;
+// The abandoned segments are sharded by page kind and NUMA node: threads that start and stop
+// (on different nodes, or with objects of different sizes) contend on separate lists, and a
+// reclaim first visits the segments that can serve the page kind it needs.
+#define MI_ABANDONED_NUMA_SHARDS  (4)   // higher nodes share the shards (modulo)
+#define MI_ABANDONED_SHARDS       ((MI_PAGE_HUGE+1) * MI_ABANDONED_NUMA_SHARDS)
+
+typedef struct mi_abandoned_shard_s {
+  // The abandoned segment list (tagged as it supports pop)
+  _Atomic(mi_tagged_segment_t) list;          // = NULL
+  // This is a list of visited abandoned segments that were full at the time.
+  // this list migrates to `list` when that becomes NULL. The use of
+  // this list reduces contention and the rate at which segments are visited.
+  _Atomic(mi_segment_t*)       visited;       // = NULL
+  // Maintain these for debug purposes (these counts may be a bit off)
+  _Atomic(size_t)              count;
+  _Atomic(size_t)              visited_count;
+  // We also maintain a count of current readers of the list
+  // in order to prevent resetting/decommitting segment memory if it might
+  // still be read.
+  _Atomic(size_t)              readers;       // = 0
+  uint8_t                      padding[MI_CACHE_LINE - 5*sizeof(uintptr_t)];  // a cache line per shard
+} mi_abandoned_shard_t;
+
+static mi_decl_cache_align mi_abandoned_shard_t abandoned_shards[MI_ABANDONED_SHARDS];
+
+static mi_abandoned_shard_t* mi_abandoned_shard(mi_page_kind_t page_kind, int numa_node) {
+  mi_assert_internal(page_kind <= MI_PAGE_HUGE);
+  const size_t numa_shard = (numa_node <= 0 ? 0 : (size_t)numa_node % MI_ABANDONED_NUMA_SHARDS);
+  return &abandoned_shards[(size_t)page_kind * MI_ABANDONED_NUMA_SHARDS + numa_shard];
+}
 
-// We also maintain a count of current readers of the abandoned list
-// in order to prevent resetting/decommitting segment memory if it might
-// still be read.
-static mi_decl_cache_align _Atomic(size_t)           abandoned_readers; // = 0
+static mi_abandoned_shard_t* mi_abandoned_shard_of(const mi_segment_t* segment) {
+  return mi_abandoned_shard(segment->page_kind, segment->numa_node);
+}
 
 // Push on the visited list
-static void mi_abandoned_visited_push(mi_segment_t* segment) {
+static void mi_abandoned_visited_push(mi_abandoned_shard_t* shard, mi_segment_t* segment) {
   mi_assert_internal(segment->thread_id == 0);
   mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_segment_t,&segment->abandoned_next) == NULL);
   mi_assert_internal(segment->next == NULL && segment->prev == NULL);
   mi_assert_internal(segment->used > 0);
-  mi_segment_t* anext = mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_visited);
+  mi_assert_internal(shard == mi_abandoned_shard_of(segment));
+  mi_segment_t* anext = mi_atomic_load_ptr_relaxed(mi_segment_t, &shard->visited);
   do {
     mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, anext);
-  } while (!mi_atomic_cas_ptr_weak_release(mi_segment_t, &abandoned_visited, &anext, segment));
-  mi_atomic_increment_relaxed(&abandoned_visited_count);
+  } while (!mi_atomic_cas_ptr_weak_release(mi_segment_t, &shard->visited, &anext, segment));
+  mi_atomic_increment_relaxed(&shard->visited_count);
 }
 
 // Move the visited list to the abandoned list.
-static bool mi_abandoned_visited_revisit(void)
+static bool mi_abandoned_visited_revisit(mi_abandoned_shard_t* shard)
 {
   // quick check if the visited list is empty
-  if (mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_visited) == NULL) return false;
+  if (mi_atomic_load_ptr_relaxed(mi_segment_t, &shard->visited) == NULL) return false;
 
   // grab the whole visited list
-  mi_segment_t* first = mi_atomic_exchange_ptr_acq_rel(mi_segment_t, &abandoned_visited, NULL);
+  mi_segment_t* first = mi_atomic_exchange_ptr_acq_rel(mi_segment_t, &shard->visited, NULL);
   if (first == NULL) return false;
 
   // first try to swap directly if the abandoned list happens to be NULL
   mi_tagged_segment_t afirst;
-  mi_tagged_segment_t ts = mi_atomic_load_relaxed(&abandoned);
+  mi_tagged_segment_t ts = mi_atomic_load_relaxed(&shard->list);
   if (mi_tagged_segment_ptr(ts)==NULL) {
-    size_t count = mi_atomic_load_relaxed(&abandoned_visited_count);
+    size_t count = mi_atomic_load_relaxed(&shard->visited_count);
     afirst = mi_tagged_segment(first, ts);
-    if (mi_atomic_cas_strong_acq_rel(&abandoned, &ts, afirst)) {
-      mi_atomic_add_relaxed(&abandoned_count, count);
-      mi_atomic_sub_relaxed(&abandoned_visited_count, count);
+    if (mi_atomic_cas_strong_acq_rel(&shard->list, &ts, afirst)) {
+      mi_atomic_add_relaxed(&shard->count, count);
+      mi_atomic_sub_relaxed(&shard->visited_count, count);
       return true;
     }
   }
@@ -862,50 +1133,53 @@ static bool mi_abandoned_visited_revisit(void)
 
   // and atomically prepend to the abandoned list
   // (no need to increase the readers as we don't access the abandoned segments)
-  mi_tagged_segment_t anext = mi_atomic_load_relaxed(&abandoned);
+  mi_tagged_segment_t anext = mi_atomic_load_relaxed(&shard->list);
   size_t count;
   do {
-    count = mi_atomic_load_relaxed(&abandoned_visited_count);
+    count = mi_atomic_load_relaxed(&shard->visited_count);
     mi_atomic_store_ptr_release(mi_segment_t, &last->abandoned_next, mi_tagged_segment_ptr(anext));
     afirst = mi_tagged_segment(first, anext);
-  } while (!mi_atomic_cas_weak_release(&abandoned, &anext, afirst));
-  mi_atomic_add_relaxed(&abandoned_count, count);
-  mi_atomic_sub_relaxed(&abandoned_visited_count, count);
+  } while (!mi_atomic_cas_weak_release(&shard->list, &anext, afirst));
+  mi_atomic_add_relaxed(&shard->count, count);
+  mi_atomic_sub_relaxed(&shard->visited_count, count);
   return true;
 }
 
-// Push on the abandoned list.
+// Push on the abandoned list of the shard of the segment.
 static void mi_abandoned_push(mi_segment_t* segment) {
   mi_assert_internal(segment->thread_id == 0);
   mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next) == NULL);
   mi_assert_internal(segment->next == NULL && segment->prev == NULL);
   mi_assert_internal(segment->used > 0);
+  mi_abandoned_shard_t* const shard = mi_abandoned_shard_of(segment);
   mi_tagged_segment_t next;
-  mi_tagged_segment_t ts = mi_atomic_load_relaxed(&abandoned);
+  mi_tagged_segment_t ts = mi_atomic_load_relaxed(&shard->list);
   do {
     mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, mi_tagged_segment_ptr(ts));
     next = mi_tagged_segment(segment, ts);
-  } while (!mi_atomic_cas_weak_release(&abandoned, &ts, next));
-  mi_atomic_increment_relaxed(&abandoned_count);
+  } while (!mi_atomic_cas_weak_release(&shard->list, &ts, next));
+  mi_atomic_increment_relaxed(&shard->count);
 }
 
-// Wait until there are no more pending reads on segments that used to be in the abandoned list
+// Wait until there are no more pending reads on segments that used to be in the abandoned lists
 void _mi_abandoned_await_readers(void) {
-  size_t n;
-  do {
-    n = mi_atomic_load_acquire(&abandoned_readers);
-    if (n != 0) mi_atomic_yield();
-  } while (n != 0);
+  for (size_t i = 0; i < MI_ABANDONED_SHARDS; i++) {
+    size_t n;
+    do {
+      n = mi_atomic_load_acquire(&abandoned_shards[i].readers);
+      if (n != 0) mi_atomic_yield();
+    } while (n != 0);
+  }
 }
 
-// Pop from the abandoned list
-static mi_segment_t* mi_abandoned_pop(void) {
+// Pop from the abandoned list of a shard
+static mi_segment_t* mi_abandoned_pop(mi_abandoned_shard_t* shard) {
   mi_segment_t* segment;
   // Check efficiently if it is empty (or if the visited list needs to be moved)
-  mi_tagged_segment_t ts = mi_atomic_load_relaxed(&abandoned);
+  mi_tagged_segment_t ts = mi_atomic_load_relaxed(&shard->list);
   segment = mi_tagged_segment_ptr(ts);
   if mi_likely(segment == NULL) {
-    if mi_likely(!mi_abandoned_visited_revisit()) { // try to swap in the visited list on NULL
+    if mi_likely(!mi_abandoned_visited_revisit(shard)) { // try to swap in the visited list on NULL
       return NULL;
     }
   }
@@ -914,20 +1188,20 @@ static mi_segment_t* mi_abandoned_pop(void) {
   // a segment to be decommitted while a read is still pending,
   // and a tagged pointer to prevent A-B-A link corruption.
   // (this is called from `region.c:_mi_mem_free` for example)
-  mi_atomic_increment_relaxed(&abandoned_readers);  // ensure no segment gets decommitted
+  mi_atomic_increment_relaxed(&shard->readers);  // ensure no segment gets decommitted
   mi_tagged_segment_t next = 0;
-  ts = mi_atomic_load_acquire(&abandoned);
+  ts = mi_atomic_load_acquire(&shard->list);
   do {
     segment = mi_tagged_segment_ptr(ts);
     if (segment != NULL) {
       mi_segment_t* anext = mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next);
       next = mi_tagged_segment(anext, ts); // note: reads the segment's `abandoned_next` field so should not be decommitted
     }
-  } while (segment != NULL && !mi_atomic_cas_weak_acq_rel(&abandoned, &ts, next));
-  mi_atomic_decrement_relaxed(&abandoned_readers);  // release reader lock
+  } while (segment != NULL && !mi_atomic_cas_weak_acq_rel(&shard->list, &ts, next));
+  mi_atomic_decrement_relaxed(&shard->readers);  // release reader lock
   if (segment != NULL) {
     mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, NULL);
-    mi_atomic_decrement_relaxed(&abandoned_count);
+    mi_atomic_decrement_relaxed(&shard->count);
   }
   return segment;
 }
@@ -943,7 +1217,7 @@ static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
   mi_assert_expensive(mi_segment_is_valid(segment, tld));
 
   // remove the segment from the free page queue if needed
-  mi_reset_delayed(tld);
+  mi_reset_delayed(tld, false);
   mi_pages_reset_remove_all_in_segment(segment, mi_option_is_enabled(mi_option_abandoned_page_reset), tld);
   mi_segment_remove_from_free_queue(segment, tld);
   mi_assert_internal(segment->next == NULL && segment->prev == NULL);
@@ -1077,17 +1351,46 @@ static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap,
 
 void _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld) {
   mi_segment_t* segment;
-  while ((segment = mi_abandoned_pop()) != NULL) {
-    mi_segment_reclaim(segment, heap, 0, NULL, tld);
+  for (size_t i = 0; i < MI_ABANDONED_SHARDS; i++) {
+    while ((segment = mi_abandoned_pop(&abandoned_shards[i])) != NULL) {
+      mi_segment_reclaim(segment, heap, 0, NULL, tld);
+    }
   }
 }
 
-static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t block_size, mi_page_kind_t page_kind, bool* reclaimed, mi_segments_tld_t* tld)
+// Move a segment of a movable heap (which has no owning thread) from its private `from` tld
+// to the current thread (see `mi_heap_absorb_movable`). Like reclaim, but the pages stay in use
+// by the heap and are transferred together with its page queues.
+void _mi_segment_transfer(mi_segment_t* segment, mi_segments_tld_t* from, mi_segments_tld_t* tld) {
+  mi_assert_internal(from->shared && !tld->shared);
+  mi_assert_internal(mi_atomic_load_relaxed(&segment->thread_id) == 0);
+  mi_assert_internal(segment->abandoned == 0);
+  // the pages in use are still in the page queues of the heap, so only remove the free ones from the delayed reset queue
+  for (size_t i = 0; i < segment->capacity; i++) {
+    mi_page_t* page = &segment->pages[i];
+    if (!page->segment_in_use) {
+      mi_pages_reset_remove(page, from);
+    }
+  }
+  mi_segment_remove_from_free_queue(segment, from);
+  mi_assert_internal(segment->next == NULL && segment->prev == NULL);
+  mi_segments_track_size(-((long)segment->segment_size), from);
+  mi_segments_track_size((long)segment->segment_size, tld);
+  mi_atomic_store_release(&segment->thread_id, _mi_thread_id());
+  if (segment->page_kind <= MI_PAGE_MEDIUM && mi_segment_has_free(segment)) {
+    mi_segment_insert_in_free_queue(segment, tld);
+  }
+}
+
+// Visit the abandoned segments of one shard, at most `*tries` of them. Returns `true` if it reclaimed a segment
+// with a free page of `page_kind` (or with a page of `block_size` that has free space) in `*reclaimed_segment`,
+// which is `NULL` if the segment was freed instead due to concurrent frees.
+static bool mi_segment_try_reclaim_in(mi_abandoned_shard_t* shard, mi_heap_t* heap, size_t block_size, mi_page_kind_t page_kind, int numa_node,
+                                      long* tries, mi_segment_t** reclaimed_segment, bool* reclaimed, mi_segments_tld_t* tld)
 {
-  *reclaimed = false;
   mi_segment_t* segment;
-  long max_tries = mi_option_get_clamp(mi_option_max_segment_reclaim, 8, 1024);     // limit the work to bound allocation times
-  while ((max_tries-- > 0) && ((segment = mi_abandoned_pop()) != NULL)) {
+  while ((*tries > 0) && ((segment = mi_abandoned_pop(shard)) != NULL)) {
+    (*tries)--;
     segment->abandoned_visits++;
     bool all_pages_free;
     bool has_page = mi_segment_check_free(segment,block_size,&all_pages_free); // try to free up pages (due to concurrent frees)
@@ -1099,11 +1402,20 @@ static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t block_size,
       // freeing but that would violate some invariants temporarily)
       mi_segment_reclaim(segment, heap, 0, NULL, tld);
     }
+    else if (numa_node >= 0 && segment->numa_node != numa_node) {
+      // NUMA-strict: leave it for a thread of its own node (but still free it above once all its pages are free)
+      mi_abandoned_visited_push(shard, segment);
+    }
+    else if (!_mi_mem_is_suitable(segment->memid, heap->arena_id)) {
+      // not in the arena of this heap (or in an exclusive arena of another one)
+      mi_abandoned_visited_push(shard, segment);
+    }
     else if (has_page && segment->page_kind == page_kind) {
       // found a free page of the right kind, or page of the right block_size with free space
       // we return the result of reclaim (which is usually `segment`) as it might free
       // the segment due to concurrent frees (in which case `NULL` is returned).
-      return mi_segment_reclaim(segment, heap, block_size, reclaimed, tld);
+      *reclaimed_segment = mi_segment_reclaim(segment, heap, block_size, reclaimed, tld);
+      return true;
     }
     else if (segment->abandoned_visits >= 3) {
       // always reclaim on 3rd visit to limit the list length.
@@ -1111,7 +1423,37 @@ static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t block_size,
     }
     else {
       // otherwise, push on the visited list so it gets not looked at too quickly again
-      mi_abandoned_visited_push(segment);
+      mi_abandoned_visited_push(shard, segment);
+    }
+  }
+  return false;
+}
+
+static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t block_size, mi_page_kind_t page_kind, bool* reclaimed, mi_segments_tld_t* tld)
+{
+  *reclaimed = false;
+  mi_segment_t* segment = NULL;
+  long tries = mi_option_get_clamp(mi_option_max_segment_reclaim, 8, 1024);     // limit the work to bound allocation times
+  const int  current_node = _mi_os_numa_node(tld->os);
+  const bool numa_strict  = mi_option_is_enabled(mi_option_numa_strict);
+  const int  numa_node    = (numa_strict ? current_node : -1);
+  // 1. the segments of `page_kind`, those of our own NUMA node first
+  //    (NUMA-strict only looks at our own node, that shard is shared with the higher nodes though)
+  const size_t numa_shards = (numa_strict ? 1 : MI_ABANDONED_NUMA_SHARDS);
+  for (size_t i = 0; i < numa_shards; i++) {
+    mi_abandoned_shard_t* const shard = mi_abandoned_shard(page_kind, current_node + (int)i);
+    if (mi_segment_try_reclaim_in(shard, heap, block_size, page_kind, numa_node, &tries, &segment, reclaimed, tld)) {
+      return segment;
+    }
+  }
+  // 2. none has a free page of the right kind: we are about to allocate a fresh segment so spend the
+  //    remaining tries on the other page kinds, which frees segments with only free pages left and
+  //    reclaims the ones visited thrice (this keeps those lists short)
+  for (size_t i = 0; i < numa_shards && tries > 0; i++) {
+    for (int kind = MI_PAGE_SMALL; kind <= MI_PAGE_HUGE && tries > 0; kind++) {
+      if (kind == (int)page_kind) continue;
+      mi_abandoned_shard_t* const shard = mi_abandoned_shard((mi_page_kind_t)kind, current_node + (int)i);
+      mi_segment_try_reclaim_in(shard, heap, block_size, page_kind, numa_node, &tries, &segment, reclaimed, tld);
     }
   }
   return NULL;
@@ -1127,9 +1469,15 @@ static mi_segment_t* mi_segment_reclaim_or_alloc(mi_heap_t* heap, size_t block_s
   mi_assert_internal(page_kind <= MI_PAGE_LARGE);
   mi_assert_internal(block_size < MI_HUGE_BLOCK_SIZE);
 
-  // 1. try to reclaim an abandoned segment
-  bool reclaimed;
-  mi_segment_t* segment = mi_segment_try_reclaim(heap, block_size, page_kind, &reclaimed, tld);
+  // 1. try to reclaim an abandoned segment (not into shared per-CPU heaps as those do not own segments by thread id,
+  //    nor into `no_reclaim` heaps as `mi_heap_destroy` would free the blocks of the reclaimed pages)
+  bool reclaimed = false;
+  mi_segment_t* segment = NULL;
+  if (!tld->shared && !heap->no_reclaim) {
+    const mi_nsecs_t start = mi_stat_latency_start();
+    segment = mi_segment_try_reclaim(heap, block_size, page_kind, &reclaimed, tld);
+    mi_stat_latency(tld->stats, MI_STAT_LATENCY_RECLAIM, start);
+  }
   if (reclaimed) {
     // reclaimed the right page right into the heap
     mi_assert_internal(segment != NULL && segment->page_kind == page_kind && page_kind <= MI_PAGE_LARGE);
@@ -1140,7 +1488,7 @@ static mi_segment_t* mi_segment_reclaim_or_alloc(mi_heap_t* heap, size_t block_s
     return segment;
   }
   // 2. otherwise allocate a fresh segment
-  return mi_segment_alloc(0, page_kind, page_shift, 0, tld, os_tld);
+  return mi_segment_alloc(0, page_kind, page_shift, 0, heap->arena_id, tld, os_tld);
 }
 
 
@@ -1168,19 +1516,29 @@ static mi_page_t* mi_segment_page_alloc_in(mi_segment_t* segment, mi_segments_tl
   return mi_segment_find_free(segment, tld);
 }
 
+// the first segment in the free queue that the heap can use (usually the first one, unless heaps of
+// this thread allocate in different arenas)
+static mi_segment_t* mi_segment_free_queue_find(mi_segment_queue_t* free_queue, mi_arena_id_t req_arena_id) {
+  mi_segment_t* segment = free_queue->first;
+  while (segment != NULL && !_mi_mem_is_suitable(segment->memid, req_arena_id)) {
+    segment = segment->next;
+  }
+  return segment;
+}
+
 static mi_page_t* mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, mi_page_kind_t kind, size_t page_shift, mi_segments_tld_t* tld, mi_os_tld_t* os_tld) {
   // find an available segment the segment free queue
   mi_segment_queue_t* const free_queue = mi_segment_free_queue_of_kind(kind, tld);
-  if (mi_segment_queue_is_empty(free_queue)) {
+  mi_segment_t* segment = mi_segment_free_queue_find(free_queue, heap->arena_id);
+  if (segment == NULL) {
     // possibly allocate or reclaim a fresh segment
-    mi_segment_t* const segment = mi_segment_reclaim_or_alloc(heap, block_size, kind, page_shift, tld, os_tld);
+    segment = mi_segment_reclaim_or_alloc(heap, block_size, kind, page_shift, tld, os_tld);
     if (segment == NULL) return NULL;  // return NULL if out-of-memory (or reclaimed)
-    mi_assert_internal(free_queue->first == segment);
+    mi_assert_expensive(mi_segment_queue_contains(free_queue, segment));
     mi_assert_internal(segment->page_kind==kind);
     mi_assert_internal(segment->used < segment->capacity);
   }
-  mi_assert_internal(free_queue->first != NULL);
-  mi_page_t* const page = mi_segment_page_alloc_in(free_queue->first, tld);
+  mi_page_t* const page = mi_segment_page_alloc_in(segment, tld);
   mi_assert_internal(page != NULL);
 #if MI_DEBUG>=2 && !MI_TRACK_ENABLED
   // verify it is committed
@@ -1212,11 +1570,11 @@ static mi_page_t* mi_segment_large_page_alloc(mi_heap_t* heap, size_t block_size
   return page;
 }
 
-static mi_page_t* mi_segment_huge_page_alloc(size_t size, size_t page_alignment, mi_segments_tld_t* tld, mi_os_tld_t* os_tld)
+static mi_page_t* mi_segment_huge_page_alloc(size_t size, size_t page_alignment, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld, mi_os_tld_t* os_tld)
 {
-  mi_segment_t* segment = mi_segment_alloc(size, MI_PAGE_HUGE, MI_SEGMENT_SHIFT + 1, page_alignment, tld, os_tld);
+  mi_segment_t* segment = mi_segment_alloc(size, MI_PAGE_HUGE, MI_SEGMENT_SHIFT + 1, page_alignment, req_arena_id, tld, os_tld);
   if (segment == NULL) return NULL;
-  mi_assert_internal(mi_segment_page_size(segment) - segment->segment_info_size - (2*(MI_SECURE == 0 ? 0 : _mi_os_page_size())) >= size);
+  mi_assert_internal(mi_segment_page_size(segment) - segment->segment_info_size - (2*(MI_SECURE_GUARD_PAGES == 0 ? 0 : _mi_os_page_size())) >= size);
   #if MI_HUGE_PAGE_ABANDON
   segment->thread_id = 0; // huge pages are immediately abandoned
   mi_segments_track_size(-(long)segment->segment_size, tld);
@@ -1287,6 +1645,48 @@ void _mi_segment_huge_page_reset(mi_segment_t* segment, mi_page_t* page, mi_bloc
 }
 #endif
 
+/* -----------------------------------------------------------
+   Huge page growth
+   A huge segment of direct OS memory grows without copying its block:
+   `_mi_os_remap` extends it in place when the address space after it
+   is free and otherwise moves its pages to a fresh aligned address.
+   Segments in regions or arenas, with large OS pages, guard pages, or
+   a large alignment stay as they are (and `mi_realloc` copies).
+----------------------------------------------------------- */
+
+mi_page_t* _mi_segment_huge_page_grow(mi_page_t* page, size_t block_size, mi_segments_tld_t* tld) {
+  #if MI_HUGE_PAGE_ABANDON || (MI_SECURE_GUARD_PAGES != 0)
+  MI_UNUSED(page); MI_UNUSED(block_size); MI_UNUSED(tld);
+  return NULL;
+  #else
+  mi_segment_t* segment = _mi_page_segment(page);
+  mi_assert_internal(segment->page_kind == MI_PAGE_HUGE && segment->used == 1);
+  if (segment->mem_is_pinned || !page->is_committed || page->is_reset) return NULL;
+  if (segment->mem_alignment != MI_SEGMENT_SIZE || segment->mem_align_offset != 0 || !_mi_mem_is_os(segment->memid)) return NULL;
+  const size_t segment_size = mi_segment_size(1, block_size, NULL, NULL);
+  if (segment_size <= segment->segment_size) return NULL;
+
+  const size_t delta = segment_size - segment->segment_size;
+  const size_t committed = mi_segment_committed_size(segment);
+  mi_segment_t* grown = (mi_segment_t*)_mi_os_remap(segment, _mi_os_good_alloc_size(segment->segment_size), _mi_os_good_alloc_size(segment_size), MI_SEGMENT_SIZE, tld->stats);
+  if (grown == NULL) return NULL;
+
+  // the segment info moved along; only the size and the address dependent cookie change
+  grown->segment_size = segment_size;
+  grown->cookie = _mi_ptr_cookie(grown);
+  _mi_stat_decrease(mi_segment_node_stat(grown, tld), committed);
+  _mi_stat_increase(mi_segment_node_stat(grown, tld), mi_segment_committed_size(grown));
+  tld->current_size += delta;
+  if (tld->current_size > tld->peak_size) tld->peak_size = tld->current_size;
+
+  page = &grown->pages[0];
+  size_t psize;
+  _mi_segment_page_start(grown, page, 0, &psize, NULL);
+  page->xblock_size = (psize > MI_HUGE_BLOCK_SIZE ? MI_HUGE_BLOCK_SIZE : (uint32_t)psize);
+  return page;
+  #endif
+}
+
 /* -----------------------------------------------------------
    Page allocation
 ----------------------------------------------------------- */
@@ -1298,7 +1698,7 @@ mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, size_t pag
     mi_assert_internal(page_alignment >= MI_SEGMENT_SIZE);
     //mi_assert_internal((MI_SEGMENT_SIZE % page_alignment) == 0);
     if (page_alignment < MI_SEGMENT_SIZE) { page_alignment = MI_SEGMENT_SIZE; }
-    page = mi_segment_huge_page_alloc(block_size, page_alignment, tld, os_tld);
+    page = mi_segment_huge_page_alloc(block_size, page_alignment, heap->arena_id, tld, os_tld);
   }
   else if (block_size <= MI_SMALL_OBJ_SIZE_MAX) {
     page = mi_segment_small_page_alloc(heap, block_size, tld, os_tld);
@@ -1310,11 +1710,11 @@ mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, size_t pag
     page = mi_segment_large_page_alloc(heap, block_size, tld, os_tld);
   }
   else {
-    page = mi_segment_huge_page_alloc(block_size, page_alignment, tld, os_tld);
+    page = mi_segment_huge_page_alloc(block_size, page_alignment, heap->arena_id, tld, os_tld);
   }
   mi_assert_expensive(page == NULL || mi_segment_is_valid(_mi_page_segment(page),tld));
-  mi_assert_internal(page == NULL || (mi_segment_page_size(_mi_page_segment(page)) - (MI_SECURE == 0 ? 0 : _mi_os_page_size())) >= block_size);
-  mi_reset_delayed(tld);
+  mi_assert_internal(page == NULL || (mi_segment_page_size(_mi_page_segment(page)) - (MI_SECURE_GUARD_PAGES == 0 ? 0 : _mi_os_page_size())) >= block_size);
+  mi_reset_delayed(tld, false);
   mi_assert_internal(page == NULL || mi_page_not_in_queue(page, tld));
   return page;
 }
@@ -7,6 +7,9 @@ terms of the MIT license. A copy of the license can be found in the file
 #ifndef _DEFAULT_SOURCE
 #define _DEFAULT_SOURCE
 #endif
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // `os.c` needs `pkey_mprotect` and `mremap` (and is not the first to include <sys/mman.h>)
+#endif
 #if defined(__sun)
 // same remarks as os.c for the static's context.
 #undef _XOPEN_SOURCE
@@ -32,6 +35,9 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "alloc.c"
 #include "alloc-aligned.c"
 #include "alloc-posix.c"
+#include "percpu.c"
+#include "sample.c"
+#include "purge.c"
 #if MI_OSX_ZONE
 #include "alloc-override-osx.c"
 #endif
@@ -62,6 +62,35 @@ void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount) {
   }
 }
 
+#if MI_STAT_LATENCY
+void _mi_stat_latency_record(mi_stats_t* stats, mi_stat_latency_t stage, mi_nsecs_t start) {
+  const mi_nsecs_t t = _mi_clock_ns() - start;
+  const uintptr_t ns = (t > 0 ? (uintptr_t)t : 0);
+  size_t bucket = (ns == 0 ? 0 : mi_bsr(ns) + 1);
+  if (bucket >= MI_STAT_LATENCY_BUCKETS) { bucket = MI_STAT_LATENCY_BUCKETS - 1; }
+  mi_stat_histogram_t* h = &stats->latency[stage];
+  if (mi_is_in_main(h)) {
+    mi_atomic_addi64_relaxed(&h->count, 1);
+    mi_atomic_addi64_relaxed(&h->total, (int64_t)ns);
+    mi_atomic_addi64_relaxed(&h->buckets[bucket], 1);
+  }
+  else {
+    h->count++;
+    h->total += (int64_t)ns;
+    h->buckets[bucket]++;
+  }
+}
+
+static void mi_stat_histogram_add(mi_stat_histogram_t* stat, const mi_stat_histogram_t* src) {
+  if (stat==src || src->count == 0) return;
+  mi_atomic_addi64_relaxed(&stat->count, src->count);
+  mi_atomic_addi64_relaxed(&stat->total, src->total);
+  for (size_t i = 0; i < MI_STAT_LATENCY_BUCKETS; i++) {
+    if (src->buckets[i] != 0) { mi_atomic_addi64_relaxed(&stat->buckets[i], src->buckets[i]); }
+  }
+}
+#endif
+
 void _mi_stat_increase(mi_stat_count_t* stat, size_t amount) {
   mi_stat_update(stat, (int64_t)amount);
 }
@@ -103,6 +132,7 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
 
   mi_stat_add(&stats->malloc, &src->malloc, 1);
   mi_stat_add(&stats->segments_cache, &src->segments_cache, 1);
+  mi_stat_add(&stats->segments_thp, &src->segments_thp, 1);
   mi_stat_add(&stats->normal, &src->normal, 1);
   mi_stat_add(&stats->huge, &src->huge, 1);
   mi_stat_add(&stats->giant, &src->giant, 1);
@@ -116,6 +146,15 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
   mi_stat_counter_add(&stats->normal_count, &src->normal_count, 1);
   mi_stat_counter_add(&stats->huge_count, &src->huge_count, 1);
   mi_stat_counter_add(&stats->giant_count, &src->giant_count, 1);
+  mi_stat_counter_add(&stats->purge_resets, &src->purge_resets, 1);
+  for (size_t i = 0; i < MI_STAT_NUMA_NODES; i++) {
+    mi_stat_add(&stats->node_committed[i], &src->node_committed[i], 1);
+  }
+#if MI_STAT_LATENCY
+  for (size_t i = 0; i < MI_STAT_LATENCY_STAGES; i++) {
+    mi_stat_histogram_add(&stats->latency[i], &src->latency[i]);
+  }
+#endif
 #if MI_STAT>1
   for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
     if (src->normal_bins[i].allocated > 0 || src->normal_bins[i].freed > 0) {
@@ -231,6 +270,24 @@ static void mi_stat_counter_print_avg(const mi_stat_counter_t* stat, const char*
   _mi_fprintf(out, arg, "%10s: %5ld.%ld avg\n", msg, avg_whole, avg_frac1);
 }
 
+#if MI_STAT_LATENCY
+// the upper bound of the bucket that holds the `q` quantile (in [0,1]) of the latencies
+static int64_t mi_stat_histogram_quantile(const mi_stat_histogram_t* stat, double q) {
+  const int64_t rank = (int64_t)((double)(stat->count - 1) * q);
+  int64_t seen = 0;
+  for (size_t i = 0; i < MI_STAT_LATENCY_BUCKETS; i++) {
+    seen += stat->buckets[i];
+    if (seen > rank) return ((int64_t)1 << i);
+  }
+  return ((int64_t)1 << (MI_STAT_LATENCY_BUCKETS - 1));
+}
+
+static void mi_stat_histogram_print(const mi_stat_histogram_t* stat, const char* msg, mi_output_fun* out, void* arg) {
+  if (stat->count == 0) return;
+  _mi_fprintf(out, arg, "%10s: %10lld calls, avg %lld ns, p50 < %lld ns, p99 < %lld ns\n", msg, (long long)stat->count,
+              (long long)(stat->total / stat->count), (long long)mi_stat_histogram_quantile(stat, 0.5), (long long)mi_stat_histogram_quantile(stat, 0.99));
+}
+#endif
 
 static void mi_print_header(mi_output_fun* out, void* arg ) {
   _mi_fprintf(out, arg, "%10s: %10s %10s %10s %10s %10s %10s\n", "heap stats", "peak   ", "total   ", "freed   ", "current   ", "unit   ", "count   ");
@@ -323,10 +380,12 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_print_ex(&stats->reserved, "reserved", 1, out, arg, "");
   mi_stat_print_ex(&stats->committed, "committed", 1, out, arg, "");
   mi_stat_print(&stats->reset, "reset", 1, out, arg);
+  if (stats->purge_resets.count > 0) { mi_stat_counter_print(&stats->purge_resets, "-purged", out, arg); }
   mi_stat_print(&stats->page_committed, "touched", 1, out, arg);
   mi_stat_print(&stats->segments, "segments", -1, out, arg);
   mi_stat_print(&stats->segments_abandoned, "-abandoned", -1, out, arg);
   mi_stat_print(&stats->segments_cache, "-cached", -1, out, arg);
+  if (stats->segments_thp.allocated > 0) { mi_stat_print(&stats->segments_thp, "-thp", -1, out, arg); }
   mi_stat_print(&stats->pages, "pages", -1, out, arg);
   mi_stat_print(&stats->pages_abandoned, "-abandoned", -1, out, arg);
   mi_stat_counter_print(&stats->pages_extended, "-extended", out, arg);
@@ -335,7 +394,21 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_counter_print(&stats->commit_calls, "commits", out, arg);
   mi_stat_print(&stats->threads, "threads", -1, out, arg);
   mi_stat_counter_print_avg(&stats->searches, "searches", out, arg);
-  _mi_fprintf(out, arg, "%10s: %7zu\n", "numa nodes", _mi_os_numa_node_count());
+  #if MI_STAT_LATENCY
+  static const char* const stage_names[MI_STAT_LATENCY_STAGES] = { "slow path", "-deferred", "-search", "-reclaim", "-segment", "commit" };
+  for (size_t i = 0; i < MI_STAT_LATENCY_STAGES; i++) {
+    mi_stat_histogram_print(&stats->latency[i], stage_names[i], out, arg);
+  }
+  #endif
+  const size_t numa_count = _mi_os_numa_node_count();
+  _mi_fprintf(out, arg, "%10s: %7zu\n", "numa nodes", numa_count);
+  if (numa_count > 1) {
+    for (size_t i = 0; i < numa_count && i < MI_STAT_NUMA_NODES; i++) {
+      char label[16];
+      snprintf(label, 16, "-node %lu%s", (unsigned long)i, (i + 1 == MI_STAT_NUMA_NODES && numa_count > MI_STAT_NUMA_NODES ? "+" : ""));
+      mi_stat_print(&stats->node_committed[i], label, 1, out, arg);
+    }
+  }
 
   mi_msecs_t elapsed;
   mi_msecs_t user_time;
@@ -400,6 +473,16 @@ void mi_thread_stats_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
   _mi_stats_print(mi_stats_get_default(), out, arg);
 }
 
+void mi_stats_get(size_t stats_size, mi_stats_t* stats) mi_attr_noexcept {
+  if (stats == NULL || stats_size == 0) return;
+  mi_stats_merge_from(mi_stats_get_default());
+  const size_t size = (stats_size < sizeof(mi_stats_t) ? stats_size : sizeof(mi_stats_t));
+  memcpy(stats, &_mi_stats_main, size);
+  if (stats_size > size) {
+    memset((uint8_t*)stats + size, 0, stats_size - size);
+  }
+}
+
 
 // ----------------------------------------------------------------
 // Basic timer for convenience; use milli-seconds to avoid doubles
@@ -442,6 +525,30 @@ mi_msecs_t _mi_clock_now(void) {
 #endif
 #endif
 
+// nanoseconds of the monotonic clock, for the latency histograms and `mi_clock_ns`
+#ifdef _WIN32
+mi_nsecs_t _mi_clock_ns(void) {
+  static LARGE_INTEGER mfreq; // = 0
+  if (mfreq.QuadPart == 0LL) { QueryPerformanceFrequency(&mfreq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (mi_nsecs_t)((double)t.QuadPart * 1.0e9 / (double)mfreq.QuadPart);
+}
+#elif defined(CLOCK_MONOTONIC)
+mi_nsecs_t _mi_clock_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((mi_nsecs_t)t.tv_sec * 1000000000) + (mi_nsecs_t)t.tv_nsec;
+}
+#else
+mi_nsecs_t _mi_clock_ns(void) {
+  return (_mi_clock_now() * 1000000);
+}
+#endif
+
+long long mi_clock_ns(void) mi_attr_noexcept {
+  return _mi_clock_ns();
+}
 
 static mi_msecs_t mi_clock_diff;
 
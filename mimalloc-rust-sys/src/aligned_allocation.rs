@@ -1,7 +1,14 @@
 use cty::c_void;
 
+use crate::extended_functions::MI_INTPTR_SIZE;
+
 //Doc: https://microsoft.github.io/mimalloc/group__aligned.html
 
+// `sizeof(max_align_t)`, alignments up to this can be served by the regular size classes
+pub const MI_MAX_ALIGN_SIZE: usize = 16;
+// Alignments over this are allocated in dedicated huge page segments
+pub const MI_ALIGNMENT_MAX: usize = (1 << (19 + MI_INTPTR_SIZE.trailing_zeros())) >> 1;
+
 extern "C" {
     pub fn mi_malloc_aligned(size: usize, alignment: usize) -> *mut c_void;
     pub fn mi_malloc_aligned_at(size: usize, alignment: usize, offset: usize) -> *mut c_void;
@@ -21,4 +28,6 @@ extern "C" {
         alignment: usize,
         offset: usize,
     ) -> *mut c_void;
+    pub fn mi_free_aligned(p: *mut c_void, alignment: usize);
+    pub fn mi_free_size_aligned(p: *mut c_void, size: usize, alignment: usize);
 }
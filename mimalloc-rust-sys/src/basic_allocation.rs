@@ -4,6 +4,8 @@ extern "C" {
     pub fn mi_calloc(count: usize, size: usize) -> *mut c_void;
     pub fn mi_expand(p: *mut c_void, size: usize) -> *mut c_void;
     pub fn mi_free(p: *mut c_void);
+    pub fn mi_free_size(p: *mut c_void, size: usize);
+    pub fn mi_free_batch(blocks: *const *mut c_void, count: usize);
     pub fn mi_malloc(size: usize) -> *mut c_void;
     pub fn mi_mallocn(count: usize, size: usize) -> *mut c_void;
     pub fn mi_realloc(p: *mut c_void, newsize: usize) -> *mut c_void;
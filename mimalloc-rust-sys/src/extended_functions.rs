@@ -1,15 +1,42 @@
-use cty::{c_char, c_int, c_ulonglong, c_void};
+use cty::{c_char, c_int, c_longlong, c_ulonglong, c_void};
+
+use crate::types::{mi_heap_t, mi_stats_t};
+
 // Doc: https://microsoft.github.io/mimalloc/group__malloc.html
-pub const MI_SMALL_SIZE_MAX: usize = 128 * core::mem::size_of::<*mut c_void>();
+pub const MI_SMALL_WSIZE_MAX: usize = 128;
+pub const MI_SMALL_SIZE_MAX: usize = MI_SMALL_WSIZE_MAX * core::mem::size_of::<*mut c_void>();
+pub const MI_INTPTR_SIZE: usize = core::mem::size_of::<usize>();
+// `MI_MEDIUM_PAGE_SIZE / 4`, i.e. 128KiB on 64-bit
+pub const MI_MEDIUM_OBJ_SIZE_MAX: usize = (1 << (16 + MI_INTPTR_SIZE.trailing_zeros())) / 4;
+// `MI_SEGMENT_SIZE` (4MiB on 64-bit), also the alignment of an arena and the size of the blocks of an exclusive arena
+pub const MI_SEGMENT_SIZE: usize = 1 << (19 + MI_INTPTR_SIZE.trailing_zeros());
+// `MI_ARENA_BLOCK_SIZE`, the size of the blocks of a shared arena
+pub const MI_ARENA_BLOCK_SIZE: usize = 4 * MI_SEGMENT_SIZE;
+// bytes of `mi_padding_t` appended to every block when the C side is built with `MI_PADDING`
+#[cfg(mi_padding)]
+pub const MI_PADDING_SIZE: usize = 8;
+#[cfg(not(mi_padding))]
+pub const MI_PADDING_SIZE: usize = 0;
 pub type mi_deferred_free_fun =
     Option<unsafe extern "C" fn(force: bool, heartbeat: c_ulonglong, arg: *mut c_void)>;
 pub type mi_output_fun = Option<unsafe extern "C" fn(msg: *const c_char, arg: *mut c_void)>;
 pub type mi_error_fun = Option<unsafe extern "C" fn(code: c_int, arg: *mut c_void)>;
+pub type mi_arena_id_t = c_int;
+pub type mi_limit_fun = Option<
+    unsafe extern "C" fn(
+        heap: *mut mi_heap_t,
+        arena_id: mi_arena_id_t,
+        used: usize,
+        limit: usize,
+        arg: *mut c_void,
+    ),
+>;
 extern "C" {
     pub fn mi_collect(force: bool);
     pub fn mi_good_size(size: usize) -> usize;
     pub fn mi_is_in_heap_region(p: *const c_void) -> bool;
     pub fn mi_malloc_small(size: usize) -> *mut c_void;
+    pub fn mi_malloc_small_wsize(wsize: usize) -> *mut c_void;
     pub fn mi_process_info(
         elapsed_msecs: *mut usize,
         user_msecs: *mut usize,
@@ -21,8 +48,34 @@ extern "C" {
         page_faults: *mut usize,
     );
     pub fn mi_register_deferred_free(out: mi_deferred_free_fun, arg: *mut c_void);
+    pub fn mi_clock_ns() -> c_longlong;
     pub fn mi_register_error(out: mi_error_fun, arg: *mut c_void);
     pub fn mi_register_output(out: mi_output_fun, arg: *mut c_void);
+    pub fn mi_register_limit_handler(fun: mi_limit_fun, arg: *mut c_void);
+    pub fn mi_arena_set_limit(
+        arena_id: mi_arena_id_t,
+        soft_limit: usize,
+        hard_limit: usize,
+    ) -> bool;
+    pub fn mi_arena_limit_used(arena_id: mi_arena_id_t) -> usize;
+    pub fn mi_arena_area(arena_id: mi_arena_id_t, size: *mut usize) -> *mut c_void;
+    pub fn mi_reserve_os_memory_ex(
+        size: usize,
+        commit: bool,
+        allow_large: bool,
+        exclusive: bool,
+        arena_id: *mut mi_arena_id_t,
+    ) -> c_int;
+    pub fn mi_manage_os_memory_ex(
+        start: *mut c_void,
+        size: usize,
+        is_committed: bool,
+        is_large: bool,
+        is_zero: bool,
+        numa_node: c_int,
+        exclusive: bool,
+        arena_id: *mut mi_arena_id_t,
+    ) -> bool;
     pub fn mi_reserve_huge_os_pages_at(
         pages: usize,
         numa_node: c_int,
@@ -37,8 +90,13 @@ extern "C" {
     pub fn mi_stats_print_out(out: mi_output_fun, arg: *mut c_void);
     pub fn mi_stats_reset();
     pub fn mi_stats_merge();
+    pub fn mi_stats_get(stats_size: usize, stats: *mut mi_stats_t);
+    pub fn mi_sample_print_out(out: mi_output_fun, arg: *mut c_void);
+    pub fn mi_purge_thread_start() -> bool;
+    pub fn mi_purge_thread_stop();
     pub fn mi_thread_init();
     pub fn mi_thread_done();
+    pub fn mi_thread_data_reserve(count: usize) -> usize;
     pub fn mi_thread_stats_print_out(out: mi_output_fun, arg: *mut c_void);
     pub fn mi_usable_size(p: *const c_void) -> usize;
     pub fn mi_zalloc_small(size: usize) -> *mut c_void;
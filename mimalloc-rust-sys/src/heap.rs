@@ -1,9 +1,12 @@
 use cty::{c_char, c_void};
 
-use crate::types::mi_heap_t;
+use crate::{extended_functions::mi_arena_id_t, types::mi_heap_t};
 
 // Doc: https://microsoft.github.io/mimalloc/group__heap.html
 
+/// number of heap tags per thread, including the untagged tag 0 (see `mi_heap_tagged`)
+pub const MI_HEAP_TAGS: usize = 8;
+
 #[repr(C)]
 #[derive(Debug, Clone, Copy)]
 pub struct mi_heap_area_t {
@@ -12,6 +15,29 @@ pub struct mi_heap_area_t {
     pub committed: usize,
     pub used: usize,
     pub block_size: usize,
+    pub full_block_size: usize,
+}
+
+/// position in the pages of a heap to resume a visit, starts zeroed
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct mi_heap_cursor_t {
+    pub bin: usize,
+    pub index: usize,
+    pub page: *const c_void,
+    pub removed: usize,
+}
+
+impl Default for mi_heap_cursor_t {
+    #[inline]
+    fn default() -> Self {
+        Self {
+            bin: 0,
+            index: 0,
+            page: core::ptr::null(),
+            removed: 0,
+        }
+    }
 }
 
 pub type mi_block_visit_fun = Option<
@@ -26,14 +52,33 @@ pub type mi_block_visit_fun = Option<
 
 extern "C" {
     pub fn mi_heap_new() -> *mut mi_heap_t;
+    pub fn mi_heap_new_in_arena(arena_id: mi_arena_id_t) -> *mut mi_heap_t;
+    pub fn mi_heap_tagged(tag: cty::c_int) -> *mut mi_heap_t;
+    pub fn mi_heap_get_tag(heap: *const mi_heap_t) -> cty::c_int;
+    pub fn mi_heap_set_limit(heap: *mut mi_heap_t, soft_limit: usize, hard_limit: usize);
+    pub fn mi_heap_limit_used(heap: *const mi_heap_t) -> usize;
     pub fn mi_heap_delete(heap: *mut mi_heap_t);
     pub fn mi_heap_destroy(heap: *mut mi_heap_t);
     pub fn mi_heap_set_default(heap: *mut mi_heap_t) -> *mut mi_heap_t;
     pub fn mi_heap_get_default() -> *mut mi_heap_t;
     pub fn mi_heap_get_backing() -> *mut mi_heap_t;
     pub fn mi_heap_collect(heap: *mut mi_heap_t, force: bool);
+    pub fn mi_heap_new_movable() -> *mut mi_heap_t;
+    pub fn mi_heap_detach(heap: *mut mi_heap_t) -> bool;
+    pub fn mi_heap_attach(heap: *mut mi_heap_t) -> bool;
+    pub fn mi_heap_absorb_movable(heap: *mut mi_heap_t, from: *mut mi_heap_t) -> bool;
     pub fn mi_heap_malloc(heap: *mut mi_heap_t, size: usize) -> *mut c_void;
     pub fn mi_heap_malloc_small(heap: *mut mi_heap_t, size: usize) -> *mut c_void;
+    pub fn mi_heap_malloc_small_wsize(heap: *mut mi_heap_t, wsize: usize) -> *mut c_void;
+    pub fn mi_heap_malloc_batch(
+        heap: *mut mi_heap_t,
+        size: usize,
+        blocks: *mut *mut c_void,
+        count: usize,
+    ) -> usize;
+    pub fn mi_percpu_heap_acquire() -> *mut mi_heap_t;
+    pub fn mi_percpu_heap_release(heap: *mut mi_heap_t);
+    pub fn mi_percpu_free(p: *mut c_void);
     pub fn mi_heap_zalloc(heap: *mut mi_heap_t, size: usize) -> *mut c_void;
     pub fn mi_heap_calloc(heap: *mut mi_heap_t, count: usize, size: usize) -> *mut c_void;
     pub fn mi_heap_mallocn(heap: *mut mi_heap_t, count: usize, size: usize) -> *mut c_void;
@@ -140,6 +185,41 @@ extern "C" {
         offset: usize,
     ) -> *mut c_void;
 
+    // Allocation that also returns the usable size of the block
+
+    pub fn mi_heap_malloc_usable(
+        heap: *mut mi_heap_t,
+        size: usize,
+        usable: *mut usize,
+    ) -> *mut c_void;
+    pub fn mi_heap_malloc_aligned_usable(
+        heap: *mut mi_heap_t,
+        size: usize,
+        alignment: usize,
+        usable: *mut usize,
+    ) -> *mut c_void;
+    pub fn mi_heap_zalloc_aligned_usable(
+        heap: *mut mi_heap_t,
+        size: usize,
+        alignment: usize,
+        usable: *mut usize,
+    ) -> *mut c_void;
+    pub fn mi_heap_realloc_aligned_usable(
+        heap: *mut mi_heap_t,
+        p: *mut c_void,
+        newsize: usize,
+        alignment: usize,
+        usable: *mut usize,
+    ) -> *mut c_void;
+    pub fn mi_heap_rezalloc_aligned_usable(
+        heap: *mut mi_heap_t,
+        p: *mut c_void,
+        oldsize: usize,
+        newsize: usize,
+        alignment: usize,
+        usable: *mut usize,
+    ) -> *mut c_void;
+
     // Heap Introspection
     // Doc: https://microsoft.github.io/mimalloc/group__analysis.html
 
@@ -152,4 +232,12 @@ extern "C" {
         visitor: mi_block_visit_fun,
         arg: *mut c_void,
     ) -> bool;
+    pub fn mi_heap_visit_blocks_from(
+        heap: *const mi_heap_t,
+        cursor: *mut mi_heap_cursor_t,
+        max_areas: usize,
+        visit_all_blocks: bool,
+        visitor: mi_block_visit_fun,
+        arg: *mut c_void,
+    ) -> bool;
 }
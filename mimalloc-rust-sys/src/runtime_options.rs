@@ -12,18 +12,33 @@ pub const mi_option_reset_decommits: mi_option_t = 5;
 // implies eager commit
 pub const mi_option_large_os_pages: mi_option_t = 6;
 pub const mi_option_reserve_huge_os_pages: mi_option_t = 7;
-pub const mi_option_reserve_os_memory: mi_option_t = 8;
-pub const mi_option_segment_cache: mi_option_t = 9;
-pub const mi_option_page_reset: mi_option_t = 10;
-pub const mi_option_abandoned_page_reset: mi_option_t = 11;
-pub const mi_option_segment_reset: mi_option_t = 12;
-pub const mi_option_eager_commit_delay: mi_option_t = 13;
-pub const mi_option_reset_delay: mi_option_t = 14;
-pub const mi_option_use_numa_nodes: mi_option_t = 15;
-pub const mi_option_limit_os_alloc: mi_option_t = 16;
-pub const mi_option_os_tag: mi_option_t = 17;
-pub const mi_option_max_errors: mi_option_t = 18;
-pub const mi_option_max_warnings: mi_option_t = 19;
+pub const mi_option_reserve_huge_os_pages_at: mi_option_t = 8;
+pub const mi_option_reserve_os_memory: mi_option_t = 9;
+pub const mi_option_segment_cache: mi_option_t = 10;
+pub const mi_option_page_reset: mi_option_t = 11;
+pub const mi_option_abandoned_page_reset: mi_option_t = 12;
+pub const mi_option_segment_reset: mi_option_t = 13;
+pub const mi_option_eager_commit_delay: mi_option_t = 14;
+pub const mi_option_reset_delay: mi_option_t = 15;
+pub const mi_option_use_numa_nodes: mi_option_t = 16;
+pub const mi_option_limit_os_alloc: mi_option_t = 17;
+pub const mi_option_os_tag: mi_option_t = 18;
+pub const mi_option_max_errors: mi_option_t = 19;
+pub const mi_option_max_warnings: mi_option_t = 20;
+pub const mi_option_max_segment_reclaim: mi_option_t = 21;
+pub const mi_option_destroy_on_exit: mi_option_t = 22;
+// mean bytes between sampled allocations (with the `sampling` feature), 0 = no sampling
+pub const mi_option_sample_interval: mi_option_t = 23;
+// only use arenas of the current NUMA node, and only reclaim abandoned segments of it
+pub const mi_option_numa_strict: mi_option_t = 24;
+// milli-seconds between the runs of the background purge thread
+pub const mi_option_purge_interval: mi_option_t = 25;
+// try to keep the resident set under N MiB by giving back free memory more eagerly, 0 = no target
+pub const mi_option_rss_target: mi_option_t = 26;
+// put small and medium page segments on transparent huge pages, and the others explicitly not
+pub const mi_option_thp_aware: mi_option_t = 27;
+// number of freed segments each thread keeps for reuse (at most 8)
+pub const mi_option_segment_thread_cache: mi_option_t = 28;
 
 extern "C" {
     pub fn mi_option_disable(option: mi_option_t);
@@ -1,4 +1,7 @@
-use crate::utils::BitField;
+use crate::{
+    extended_functions::{MI_INTPTR_SIZE, MI_PADDING_SIZE, MI_SMALL_WSIZE_MAX},
+    utils::BitField,
+};
 
 pub type mi_thread_free_t = usize;
 
@@ -76,11 +79,23 @@ impl mi_page_t {
         }
     }
     #[inline]
+    pub fn is_purge_pending(&self) -> u8 {
+        unsafe { ::core::mem::transmute(self._bitfield_1.get(4usize, 1u8) as u8) }
+    }
+    #[inline]
+    pub fn set_is_purge_pending(&mut self, val: u8) {
+        unsafe {
+            let val: u8 = ::core::mem::transmute(val);
+            self._bitfield_1.set(4usize, 1u8, val as u64)
+        }
+    }
+    #[inline]
     pub fn new_bitfield_1(
         segment_in_use: u8,
         is_reset: u8,
         is_committed: u8,
         is_zero_init: u8,
+        is_purge_pending: u8,
     ) -> BitField<[u8; 1usize]> {
         let mut _bitfield_unit: BitField<[u8; 1usize]> = Default::default();
         _bitfield_unit.set(0usize, 1u8, {
@@ -99,6 +114,10 @@ impl mi_page_t {
             let is_zero_init: u8 = unsafe { ::core::mem::transmute(is_zero_init) };
             is_zero_init as u64
         });
+        _bitfield_unit.set(4usize, 1u8, {
+            let is_purge_pending: u8 = unsafe { ::core::mem::transmute(is_purge_pending) };
+            is_purge_pending as u64
+        });
         _bitfield_unit
     }
     #[inline]
@@ -186,7 +205,18 @@ impl mi_page_flags_t_ty_1 {
         }
     }
     #[inline]
-    pub fn new_bitfield_1(in_full: u8, has_aligned: u8) -> BitField<[u8; 1usize]> {
+    pub fn has_sampled(&self) -> u8 {
+        unsafe { ::core::mem::transmute(self._bitfield_1.get(2usize, 1u8) as u8) }
+    }
+    #[inline]
+    pub fn set_has_sampled(&mut self, val: u8) {
+        unsafe {
+            let val: u8 = ::core::mem::transmute(val);
+            self._bitfield_1.set(2usize, 1u8, val as u64)
+        }
+    }
+    #[inline]
+    pub fn new_bitfield_1(in_full: u8, has_aligned: u8, has_sampled: u8) -> BitField<[u8; 1usize]> {
         let mut _bitfield_unit: BitField<[u8; 1usize]> = Default::default();
         _bitfield_unit.set(0usize, 1u8, {
             let in_full: u8 = unsafe { ::core::mem::transmute(in_full) };
@@ -196,6 +226,10 @@ impl mi_page_flags_t_ty_1 {
             let has_aligned: u8 = unsafe { ::core::mem::transmute(has_aligned) };
             has_aligned as u64
         });
+        _bitfield_unit.set(2usize, 1u8, {
+            let has_sampled: u8 = unsafe { ::core::mem::transmute(has_sampled) };
+            has_sampled as u64
+        });
         _bitfield_unit
     }
 }
@@ -206,12 +240,18 @@ pub struct mi_segment_t {
     pub memid: usize,
     pub mem_is_pinned: bool,
     pub mem_is_committed: bool,
+    pub numa_node: i16,
+    pub mem_is_thp: bool,
+    pub mem_alignment: usize,
+    pub mem_align_offset: usize,
     // atomic ptr
     pub abandoned_next: *mut mi_segment_t,
     pub next: *mut mi_segment_t,
     pub prev: *mut mi_segment_t,
     pub abandoned: usize,
     pub abandoned_visits: usize,
+    #[cfg(feature = "remote-free-buffer")]
+    pub remote_buffered: usize,
     pub used: usize,
     pub capacity: usize,
     pub segment_size: usize,
@@ -239,11 +279,15 @@ pub struct mi_random_ctx_t {
     pub output_available: cty::c_int,
 }
 
+// `MI_PAGES_DIRECT`, one entry longer for each word of padding (there is none in release builds)
+pub const MI_PAGES_DIRECT: usize =
+    MI_SMALL_WSIZE_MAX + (MI_PADDING_SIZE + MI_INTPTR_SIZE - 1) / MI_INTPTR_SIZE + 1;
+
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
 pub struct mi_heap_t {
     pub tld: *mut mi_tld_t,
-    pub pages_free_direct: [*mut mi_page_t; 130usize],
+    pub pages_free_direct: [*mut mi_page_t; MI_PAGES_DIRECT],
     pub pages: [mi_page_queue_t; 75usize],
     pub thread_delayed_free: mi_block_t,
     pub thread_id: usize,
@@ -251,10 +295,17 @@ pub struct mi_heap_t {
     pub keys: [usize; 2usize],
     pub random: mi_random_ctx_t,
     pub page_count: usize,
+    pub page_removed: usize,
     pub page_retired_min: usize,
     pub page_retired_max: usize,
     pub next: *mut mi_heap_t,
     pub no_reclaim: bool,
+    pub movable: bool,
+    pub arena_id: cty::c_int,
+    pub limit_used: usize,
+    pub limit_soft: usize,
+    pub limit_hard: usize,
+    pub tag: u8,
 }
 
 #[repr(C)]
@@ -273,6 +324,27 @@ pub struct mi_stat_counter_t {
     pub count: i64,
 }
 
+/// number of buckets of a latency histogram, bucket `i` counts the latencies in `[2^(i-1), 2^i)` nanoseconds
+pub const MI_STAT_LATENCY_BUCKETS: usize = 32;
+
+/// the stages of the allocation slow path with a latency histogram (`MI_STAT_LATENCY`)
+pub type mi_stat_latency_t = cty::c_int;
+pub const MI_STAT_LATENCY_GENERIC: mi_stat_latency_t = 0;
+pub const MI_STAT_LATENCY_DEFERRED_FREE: mi_stat_latency_t = 1;
+pub const MI_STAT_LATENCY_PAGE_SEARCH: mi_stat_latency_t = 2;
+pub const MI_STAT_LATENCY_RECLAIM: mi_stat_latency_t = 3;
+pub const MI_STAT_LATENCY_SEGMENT_ALLOC: mi_stat_latency_t = 4;
+pub const MI_STAT_LATENCY_OS_COMMIT: mi_stat_latency_t = 5;
+pub const MI_STAT_LATENCY_STAGES: usize = 6;
+
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct mi_stat_histogram_t {
+    pub count: i64,
+    pub total: i64,
+    pub buckets: [i64; MI_STAT_LATENCY_BUCKETS],
+}
+
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
 pub struct mi_stats_t {
@@ -290,6 +362,7 @@ pub struct mi_stats_t {
     pub giant: mi_stat_count_t,
     pub malloc: mi_stat_count_t,
     pub segments_cache: mi_stat_count_t,
+    pub segments_thp: mi_stat_count_t,
     pub pages_extended: mi_stat_counter_t,
     pub mmap_calls: mi_stat_counter_t,
     pub commit_calls: mi_stat_counter_t,
@@ -298,6 +371,10 @@ pub struct mi_stats_t {
     pub normal_count: mi_stat_counter_t,
     pub huge_count: mi_stat_counter_t,
     pub giant_count: mi_stat_counter_t,
+    pub purge_resets: mi_stat_counter_t,
+    pub node_committed: [mi_stat_count_t; 8usize],
+    #[cfg(feature = "latency-histograms")]
+    pub latency: [mi_stat_histogram_t; MI_STAT_LATENCY_STAGES],
     pub normal_bins: [mi_stat_count_t; 74usize],
 }
 
@@ -313,6 +390,8 @@ pub struct mi_segment_queue_t {
 pub struct mi_os_tld_t {
     pub region_idx: usize,
     pub stats: *mut mi_stats_t,
+    pub segment_cache_count: usize,
+    pub segment_cache: [*mut mi_segment_t; 8usize],
 }
 
 #[repr(C)]
@@ -325,11 +404,9 @@ pub struct mi_segments_tld_s {
     pub peak_count: usize,
     pub current_size: usize,
     pub peak_size: usize,
-    pub cache_count: usize,
-    pub cache_size: usize,
-    pub cache: *mut mi_segment_t,
     pub stats: *mut mi_stats_t,
     pub os: *mut mi_os_tld_t,
+    pub shared: bool,
 }
 pub type mi_segments_tld_t = mi_segments_tld_s;
 #[repr(C)]
@@ -342,4 +419,5 @@ pub struct mi_tld_t {
     pub segments: mi_segments_tld_t,
     pub os: mi_os_tld_t,
     pub stats: mi_stats_t,
+    pub heap_tagged: [*mut mi_heap_t; crate::heap::MI_HEAP_TAGS],
 }
@@ -0,0 +1,258 @@
+//! Arenas over externally supplied memory, e.g. a file on tmpfs, hugetlbfs or a DAX filesystem mapped
+//! into the process, registered with `mi_manage_os_memory_ex`.
+//!
+//! An arena is exclusive by default: only the heaps created in it ([`Arena::new_heap`]) allocate from it,
+//! and those heaps allocate nowhere else, so for instance each shard of a cache can get its own memory.
+//! mimalloc never releases an arena, the memory stays mapped until the process exits.
+use crate::{
+    heap::{MiMallocHeapOwned, OwnedHeap},
+    raw::extended_functions::{
+        mi_arena_area, mi_arena_id_t, mi_manage_os_memory_ex, mi_reserve_os_memory_ex,
+        MI_ARENA_BLOCK_SIZE, MI_SEGMENT_SIZE,
+    },
+    GlobalMiMalloc,
+};
+use core::ffi::{c_void, CStr};
+use libc::{
+    c_int, close, fstat, ftruncate, mmap, munmap, off_t, open, EINVAL, ENOMEM, MAP_ANONYMOUS,
+    MAP_FAILED, MAP_FIXED, MAP_PRIVATE, MAP_SHARED, O_CLOEXEC, O_CREAT, O_RDWR, PROT_NONE,
+    PROT_READ, PROT_WRITE, S_IFMT, S_IFREG,
+};
+
+#[inline]
+fn errno() -> c_int {
+    unsafe { *libc::__errno_location() }
+}
+
+/// How the memory of an arena is registered with mimalloc
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ArenaOptions {
+    /// the memory is on large or huge OS pages (hugetlbfs), it is never reset or decommitted
+    pub is_large: bool,
+    /// the memory is known to be zero, e.g. a new file, so fresh blocks need not be cleared by `mi_zalloc`
+    pub is_zero: bool,
+    /// the NUMA node of the memory, -1 for any; a heap of the arena allocates in it from any node
+    pub numa_node: c_int,
+    /// only heaps created in the arena allocate from it
+    pub exclusive: bool,
+    /// the page size of the mapping (0 for the small OS pages), which the start and size are aligned to
+    pub page_size: usize,
+}
+
+impl Default for ArenaOptions {
+    #[inline]
+    fn default() -> Self {
+        Self {
+            is_large: false,
+            is_zero: false,
+            numa_node: -1,
+            exclusive: true,
+            page_size: 0,
+        }
+    }
+}
+
+impl ArenaOptions {
+    /// the options of a file on hugetlbfs with pages of `page_size` bytes (e.g. 2MiB or 1GiB)
+    #[inline]
+    pub fn hugetlbfs(page_size: usize) -> Self {
+        Self {
+            is_large: true,
+            page_size,
+            ..Self::default()
+        }
+    }
+
+    /// the size and alignment of the mapping can be divided in arena blocks and in pages
+    #[inline]
+    fn unit(&self) -> usize {
+        let block_size = if self.exclusive {
+            MI_SEGMENT_SIZE
+        } else {
+            MI_ARENA_BLOCK_SIZE
+        };
+        self.page_size.max(block_size)
+    }
+}
+
+/// An arena of mimalloc, see the [module documentation](self).
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Arena {
+    id: mi_arena_id_t,
+    start: *mut u8,
+    size: usize,
+}
+
+unsafe impl Send for Arena {}
+unsafe impl Sync for Arena {}
+
+impl Arena {
+    /// reserve `size` bytes (rounded up to arena blocks) of anonymous OS memory as an arena
+    /// (`mi_reserve_os_memory_ex`), on large OS pages if `options.is_large` and these are available;
+    /// returns the `errno` on failure
+    pub fn reserve(size: usize, options: &ArenaOptions) -> Result<Self, c_int> {
+        let mut id = 0;
+        let err = unsafe {
+            mi_reserve_os_memory_ex(size, true, options.is_large, options.exclusive, &mut id)
+        };
+        if err != 0 {
+            return Err(err);
+        }
+        let (start, size) = GlobalMiMalloc::arena_area(id);
+        Ok(Self { id, start, size })
+    }
+
+    /// map `size` bytes of the file at `path` as an arena, creating the file or extending it with zeros
+    /// if it is shorter; the size is rounded down to arena blocks and pages. The file can be
+    /// closed (or unlinked) afterwards.
+    ///
+    /// # Safety
+    /// the file is not modified or truncated otherwise while the process runs, as this would change
+    /// or remove the memory of live blocks
+    pub unsafe fn map_file(
+        path: &CStr,
+        size: usize,
+        options: &ArenaOptions,
+    ) -> Result<Self, c_int> {
+        let fd = open(
+            path.as_ptr(),
+            O_RDWR | O_CREAT | O_CLOEXEC,
+            0o600 as libc::mode_t,
+        );
+        if fd < 0 {
+            return Err(errno());
+        }
+        let res = Self::map_fd(fd, size, options);
+        close(fd);
+        res
+    }
+
+    /// like [`Arena::map_file`] for an open file descriptor (of a file, a `memfd` or a DAX device),
+    /// which the caller can close afterwards
+    ///
+    /// # Safety
+    /// as for [`Arena::map_file`]
+    pub unsafe fn map_fd(fd: c_int, size: usize, options: &ArenaOptions) -> Result<Self, c_int> {
+        let unit = options.unit();
+        let size = size / unit * unit;
+        if size == 0 {
+            return Err(EINVAL);
+        }
+        // extend regular files, the size of a device stays as it is
+        let mut stat: libc::stat = core::mem::zeroed();
+        if fstat(fd, &mut stat) != 0 {
+            return Err(errno());
+        }
+        if stat.st_mode & S_IFMT == S_IFREG
+            && (stat.st_size as usize) < size
+            && ftruncate(fd, size as off_t) != 0
+        {
+            return Err(errno());
+        }
+        // segments must be aligned to their size: reserve enough address space to align the start,
+        // map the file over it and give back the parts around it
+        let reserved = size + unit;
+        let base = mmap(
+            core::ptr::null_mut(),
+            reserved,
+            PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0,
+        );
+        if base == MAP_FAILED {
+            return Err(errno());
+        }
+        let pre = (unit - base as usize % unit) % unit;
+        let start = (base as *mut u8).add(pre) as *mut c_void;
+        let p = mmap(
+            start,
+            size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED,
+            fd,
+            0,
+        );
+        if p == MAP_FAILED {
+            let err = errno();
+            munmap(base, reserved);
+            return Err(err);
+        }
+        if pre > 0 {
+            munmap(base, pre);
+        }
+        munmap(
+            (start as *mut u8).add(size) as *mut c_void,
+            reserved - pre - size,
+        );
+        Self::manage(start, size, true, options).map_err(|err| {
+            munmap(start, size);
+            err
+        })
+    }
+
+    /// register memory of the caller as an arena (`mi_manage_os_memory_ex`)
+    ///
+    /// # Safety
+    /// `start` is aligned to segments (4MiB) and points to `size` bytes of memory which is only used
+    /// by mimalloc from now on, until the process exits; uncommitted memory is committed by mimalloc
+    pub unsafe fn manage(
+        start: *mut c_void,
+        size: usize,
+        is_committed: bool,
+        options: &ArenaOptions,
+    ) -> Result<Self, c_int> {
+        if start as usize % MI_SEGMENT_SIZE != 0 {
+            return Err(EINVAL);
+        }
+        let mut id = 0;
+        if !mi_manage_os_memory_ex(
+            start,
+            size,
+            is_committed || options.is_large,
+            options.is_large,
+            options.is_zero,
+            options.numa_node,
+            options.exclusive,
+            &mut id,
+        ) {
+            return Err(ENOMEM);
+        }
+        let (start, size) = GlobalMiMalloc::arena_area(id);
+        Ok(Self { id, start, size })
+    }
+
+    /// the id of the arena, e.g. for [`GlobalMiMalloc::set_arena_limit`]
+    #[inline]
+    pub fn id(&self) -> mi_arena_id_t {
+        self.id
+    }
+
+    /// the start and size of the memory of the arena
+    #[inline]
+    pub fn area(&self) -> (*mut u8, usize) {
+        (self.start, self.size)
+    }
+
+    /// whether `p` points into the arena
+    #[inline]
+    pub fn contains(&self, p: *const u8) -> bool {
+        (p as usize).wrapping_sub(self.start as usize) < self.size
+    }
+
+    /// a new heap of the current thread that only allocates in this arena, `None` when out of memory
+    #[inline]
+    pub fn new_heap(&self) -> Option<MiMallocHeapOwned> {
+        OwnedHeap::try_new_in_arena(self.id).map(MiMallocHeapOwned::new)
+    }
+}
+
+impl GlobalMiMalloc {
+    /// the start and size of the memory of the arena `arena_id` (`mi_arena_area`), a null start if there is no such arena
+    #[inline]
+    pub fn arena_area(arena_id: mi_arena_id_t) -> (*mut u8, usize) {
+        let mut size = 0;
+        let start = unsafe { mi_arena_area(arena_id, &mut size) };
+        (start as *mut u8, size)
+    }
+}
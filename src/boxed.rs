@@ -0,0 +1,140 @@
+//! Typed allocation of single values, with the size class resolved at compile time.
+//!
+//! For a small `T` the word size of its block is a constant, so `alloc_typed::<T>()` goes straight
+//! to the direct page of that size class (`mi_malloc_small_wsize`) instead of computing it from
+//! the size on every call; larger or over-aligned types go through `mi_malloc_aligned`.
+use crate::{
+    is_naturally_aligned,
+    raw::{
+        aligned_allocation::mi_malloc_aligned,
+        basic_allocation::mi_free,
+        extended_functions::{mi_malloc_small_wsize, MI_INTPTR_SIZE, MI_SMALL_WSIZE_MAX},
+    },
+};
+use core::{
+    ffi::c_void,
+    fmt,
+    marker::PhantomData,
+    mem::{align_of, size_of},
+    ops::{Deref, DerefMut},
+    ptr::NonNull,
+};
+
+/// the word size of the size class of a small block of `size` bytes, the `wsize` argument
+/// of `mi_malloc_small_wsize`; zero sized blocks take one word
+#[inline(always)]
+pub const fn wsize_of(size: usize) -> usize {
+    if size == 0 {
+        1
+    } else {
+        (size + MI_INTPTR_SIZE - 1) / MI_INTPTR_SIZE
+    }
+}
+
+struct SizeClass<T>(PhantomData<T>);
+
+impl<T> SizeClass<T> {
+    const WSIZE: usize = wsize_of(size_of::<T>());
+    // a small block of `WSIZE` words is aligned enough for `T`
+    const DIRECT: bool = Self::WSIZE <= MI_SMALL_WSIZE_MAX
+        && is_naturally_aligned(Self::WSIZE * MI_INTPTR_SIZE, align_of::<T>());
+}
+
+/// allocate uninitialized memory for a `T` from the default heap, null when out of memory
+#[inline]
+pub fn alloc_typed<T>() -> *mut T {
+    unsafe {
+        if SizeClass::<T>::DIRECT {
+            mi_malloc_small_wsize(SizeClass::<T>::WSIZE) as *mut T
+        } else {
+            mi_malloc_aligned(size_of::<T>(), align_of::<T>()) as *mut T
+        }
+    }
+}
+
+/// An owned `T` in a block allocated by `alloc_typed`, freed with `mi_free` when dropped
+/// (from any thread).
+pub struct MiBox<T> {
+    ptr: NonNull<T>,
+    _marker: PhantomData<T>,
+}
+
+unsafe impl<T: Send> Send for MiBox<T> {}
+unsafe impl<T: Sync> Sync for MiBox<T> {}
+
+impl<T> MiBox<T> {
+    /// move `value` to the heap, `None` when out of memory
+    #[inline]
+    pub fn try_new(value: T) -> Option<Self> {
+        let ptr = NonNull::new(alloc_typed::<T>())?;
+        unsafe { ptr.as_ptr().write(value) };
+        Some(Self {
+            ptr,
+            _marker: PhantomData,
+        })
+    }
+
+    /// move `value` to the heap, panics when out of memory
+    #[inline]
+    pub fn new(value: T) -> Self {
+        match Self::try_new(value) {
+            Some(b) => b,
+            None => panic!(
+                "mimalloc: out of memory allocating {} bytes",
+                size_of::<T>()
+            ),
+        }
+    }
+
+    /// give up the ownership of the block, which the caller frees with `mi_free`
+    #[inline]
+    pub fn into_raw(b: Self) -> *mut T {
+        let ptr = b.ptr.as_ptr();
+        core::mem::forget(b);
+        ptr
+    }
+
+    /// take the ownership of a block of `into_raw` (or any initialized `T` allocated by mimalloc)
+    ///
+    /// # Safety
+    /// `ptr` points to an initialized `T` in a mimalloc block that is not owned elsewhere
+    #[inline]
+    pub unsafe fn from_raw(ptr: *mut T) -> Self {
+        Self {
+            ptr: NonNull::new_unchecked(ptr),
+            _marker: PhantomData,
+        }
+    }
+}
+
+impl<T> Deref for MiBox<T> {
+    type Target = T;
+
+    #[inline]
+    fn deref(&self) -> &T {
+        unsafe { self.ptr.as_ref() }
+    }
+}
+
+impl<T> DerefMut for MiBox<T> {
+    #[inline]
+    fn deref_mut(&mut self) -> &mut T {
+        unsafe { self.ptr.as_mut() }
+    }
+}
+
+impl<T> Drop for MiBox<T> {
+    #[inline]
+    fn drop(&mut self) {
+        unsafe {
+            self.ptr.as_ptr().drop_in_place();
+            mi_free(self.ptr.as_ptr() as *mut c_void);
+        }
+    }
+}
+
+impl<T: fmt::Debug> fmt::Debug for MiBox<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        fmt::Debug::fmt(&**self, f)
+    }
+}
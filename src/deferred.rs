@@ -0,0 +1,132 @@
+//! Hooks run from the heartbeat of the allocator (`mi_register_deferred_free`).
+//!
+//! mimalloc calls the deferred free function on the slow path of an allocation, i.e. about every time a
+//! thread runs out of free blocks in a page, and on `mi_collect`; so it is a cheap point to do periodic
+//! work such as advancing an epoch based reclamation (see [`crate::epoch`]) in the threads that allocate.
+//! Up to [`MAX_DEFERRED_HOOKS`] hooks can be registered, they run in turn until the time budget of the
+//! heartbeat ([`GlobalMiMalloc::set_deferred_free_budget`]) is spent, the next heartbeat continues
+//! with the hook after the last one that ran. A forced heartbeat (`mi_collect(true)`) runs all hooks.
+use crate::{
+    raw::extended_functions::{mi_clock_ns, mi_register_deferred_free},
+    GlobalMiMalloc,
+};
+use core::{
+    ffi::c_void,
+    sync::atomic::{AtomicBool, AtomicUsize, Ordering},
+};
+
+/// number of hooks that can be registered at the same time
+pub const MAX_DEFERRED_HOOKS: usize = 16;
+
+/// a hook of the heartbeat; it runs inside the allocator (which does not call the hooks again from
+/// within), it can allocate and free but must not panic
+pub type DeferredHook = fn(&Heartbeat);
+
+/// the heartbeat a hook runs in
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Heartbeat {
+    force: bool,
+    count: u64,
+    deadline_ns: i64,
+}
+
+impl Heartbeat {
+    /// a forced heartbeat without time budget, e.g. to collect outside of the allocator
+    #[inline]
+    pub fn forced() -> Self {
+        Self {
+            force: true,
+            count: 0,
+            deadline_ns: i64::MAX,
+        }
+    }
+
+    /// whether all deferred work should be done now (`mi_collect(true)`)
+    #[inline]
+    pub fn force(&self) -> bool {
+        self.force
+    }
+
+    /// the number of heartbeats of the current thread so far
+    #[inline]
+    pub fn count(&self) -> u64 {
+        self.count
+    }
+
+    /// whether the time budget of the heartbeat is spent, a hook with more work left should stop
+    /// and continue at a later heartbeat; never for a forced heartbeat
+    #[inline]
+    pub fn expired(&self) -> bool {
+        self.deadline_ns != i64::MAX && unsafe { mi_clock_ns() } >= self.deadline_ns
+    }
+}
+
+// a free slot, copied into each one of `HOOKS` (a `const` works as array repeat operand)
+#[allow(clippy::declare_interior_mutable_const)]
+const EMPTY_SLOT: AtomicUsize = AtomicUsize::new(0);
+static HOOKS: [AtomicUsize; MAX_DEFERRED_HOOKS] = [EMPTY_SLOT; MAX_DEFERRED_HOOKS];
+// the slot of the hook that runs first in the next heartbeat
+static NEXT_HOOK: AtomicUsize = AtomicUsize::new(0);
+static BUDGET_NS: AtomicUsize = AtomicUsize::new(20_000);
+static INSTALLED: AtomicBool = AtomicBool::new(false);
+
+unsafe extern "C" fn run_deferred_hooks(force: bool, heartbeat: u64, _arg: *mut c_void) {
+    let budget = BUDGET_NS.load(Ordering::Relaxed);
+    let deadline_ns = if force || budget == 0 {
+        i64::MAX
+    } else {
+        mi_clock_ns().saturating_add(budget as i64)
+    };
+    let beat = Heartbeat {
+        force,
+        count: heartbeat,
+        deadline_ns,
+    };
+    let first = if force {
+        0
+    } else {
+        NEXT_HOOK.load(Ordering::Relaxed)
+    };
+    for i in 0..MAX_DEFERRED_HOOKS {
+        let slot = (first + i) % MAX_DEFERRED_HOOKS;
+        let hook = HOOKS[slot].load(Ordering::Acquire);
+        if hook == 0 {
+            continue;
+        }
+        core::mem::transmute::<usize, DeferredHook>(hook)(&beat);
+        if beat.expired() {
+            NEXT_HOOK.store((slot + 1) % MAX_DEFERRED_HOOKS, Ordering::Relaxed);
+            return;
+        }
+    }
+}
+
+impl GlobalMiMalloc {
+    /// run `hook` from the heartbeats of the allocator; returns `false` if all slots are taken.
+    /// This replaces a deferred free function registered directly with `mi_register_deferred_free`.
+    pub fn register_deferred_free(hook: DeferredHook) -> bool {
+        if !INSTALLED.swap(true, Ordering::AcqRel) {
+            unsafe { mi_register_deferred_free(Some(run_deferred_hooks), core::ptr::null_mut()) };
+        }
+        HOOKS.iter().any(|slot| {
+            slot.compare_exchange(0, hook as usize, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+        })
+    }
+
+    /// stop running `hook` (once if it is registered several times), a heartbeat of another thread
+    /// that is already running it can still finish it; returns `false` if it is not registered
+    pub fn unregister_deferred_free(hook: DeferredHook) -> bool {
+        HOOKS.iter().any(|slot| {
+            slot.compare_exchange(hook as usize, 0, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+        })
+    }
+
+    /// set the time budget of the hooks in a heartbeat in nano-seconds (20µs by default), 0 for no limit;
+    /// the hook that spends it still runs to its end
+    #[inline]
+    pub fn set_deferred_free_budget(nsecs: usize) {
+        BUDGET_NS.store(nsecs, Ordering::Relaxed)
+    }
+}
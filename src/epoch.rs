@@ -0,0 +1,382 @@
+//! Epoch based reclamation in the style of `crossbeam-epoch`, collected from the allocator heartbeat.
+//!
+//! A thread that reads a lock-free structure pins its [`LocalHandle`] for the duration of the access;
+//! a block that is unlinked from the structure is retired with [`Guard::defer_free`] (or
+//! [`Guard::defer_drop`]) instead of freed, into a bag of the thread. Full bags are sealed with the
+//! global epoch and freed, a whole bag at a time, once the epoch advanced twice, when no pinned
+//! thread can still see their blocks. The collection runs in the heartbeat ([`crate::deferred`]), so
+//! in the slow path of a thread that needs memory anyway, within the time budget of the heartbeat.
+use crate::{
+    boxed::MiBox,
+    deferred::{DeferredHook, Heartbeat},
+    raw::basic_allocation::mi_free,
+    GlobalMiMalloc,
+};
+use core::{
+    cell::Cell,
+    ffi::c_void,
+    ptr,
+    sync::atomic::{fence, AtomicPtr, AtomicUsize, Ordering},
+};
+
+// retired blocks per bag, so that a bag fills a 1KiB block
+const BAG_CAPACITY: usize = 62;
+
+// the state of a participant: the epoch it is pinned in above the flags, 0 while no handle uses it
+const CLAIMED: usize = 1;
+const PINNED: usize = 2;
+const EPOCH_SHIFT: u32 = 2;
+
+#[inline]
+fn pinned_in(epoch: usize) -> usize {
+    (epoch << EPOCH_SHIFT) | PINNED | CLAIMED
+}
+
+// a participant of `Collector::participants`, used by the next handle once its handle is dropped
+struct Participant {
+    state: AtomicUsize,
+    next: *mut Participant,
+}
+
+#[derive(Clone, Copy)]
+struct Deferred {
+    ptr: *mut c_void,
+    free: unsafe fn(*mut c_void),
+}
+
+unsafe fn free_block(p: *mut c_void) {
+    mi_free(p)
+}
+
+unsafe fn drop_and_free<T>(p: *mut c_void) {
+    ptr::drop_in_place(p as *mut T);
+    mi_free(p)
+}
+
+struct Bag {
+    next: *mut Bag,
+    epoch: usize,
+    len: usize,
+    items: [Deferred; BAG_CAPACITY],
+}
+
+impl Bag {
+    fn new() -> *mut Bag {
+        MiBox::into_raw(MiBox::new(Bag {
+            next: ptr::null_mut(),
+            epoch: 0,
+            len: 0,
+            items: [Deferred {
+                ptr: ptr::null_mut(),
+                free: free_block,
+            }; BAG_CAPACITY],
+        }))
+    }
+}
+
+impl Drop for Bag {
+    fn drop(&mut self) {
+        for item in &self.items[..self.len] {
+            unsafe { (item.free)(item.ptr) };
+        }
+    }
+}
+
+/// The global state of the epoch based reclamation, usually a `static` (see [`default_collector`]).
+pub struct Collector {
+    epoch: AtomicUsize,
+    // the list of participants, it only grows (up to the most handles registered at the same time)
+    participants: AtomicPtr<Participant>,
+    // the sealed bags
+    garbage: AtomicPtr<Bag>,
+}
+
+impl Default for Collector {
+    #[inline]
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Collector {
+    #[inline]
+    pub const fn new() -> Self {
+        Self {
+            epoch: AtomicUsize::new(0),
+            participants: AtomicPtr::new(ptr::null_mut()),
+            garbage: AtomicPtr::new(ptr::null_mut()),
+        }
+    }
+
+    /// a handle of the calling thread, taking the participant of a dropped handle or adding one
+    pub fn register(&self) -> LocalHandle<'_> {
+        let participant = match self.participants().find(|participant| {
+            participant
+                .state
+                .compare_exchange(0, CLAIMED, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+        }) {
+            Some(participant) => participant,
+            None => self.add_participant(),
+        };
+        LocalHandle {
+            collector: self,
+            participant,
+            pins: Cell::new(0),
+            bag: Cell::new(ptr::null_mut()),
+        }
+    }
+
+    #[inline]
+    fn participants(&self) -> impl Iterator<Item = &Participant> {
+        let head = self.participants.load(Ordering::Acquire);
+        core::iter::successors(unsafe { head.as_ref() }, |participant| unsafe {
+            participant.next.as_ref()
+        })
+    }
+
+    fn add_participant(&self) -> &Participant {
+        let participant = MiBox::into_raw(MiBox::new(Participant {
+            state: AtomicUsize::new(CLAIMED),
+            next: ptr::null_mut(),
+        }));
+        let mut head = self.participants.load(Ordering::Relaxed);
+        loop {
+            unsafe { (*participant).next = head };
+            match self.participants.compare_exchange_weak(
+                head,
+                participant,
+                Ordering::Release,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return unsafe { &*participant },
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    /// the global epoch
+    #[inline]
+    pub fn epoch(&self) -> usize {
+        self.epoch.load(Ordering::Relaxed)
+    }
+
+    /// advance the epoch if all pinned participants are in the current one, returns the epoch
+    fn try_advance(&self) -> usize {
+        let epoch = self.epoch.load(Ordering::Relaxed);
+        fence(Ordering::SeqCst);
+        for participant in self.participants() {
+            let state = participant.state.load(Ordering::Relaxed);
+            if state & PINNED != 0 && state != pinned_in(epoch) {
+                return epoch;
+            }
+        }
+        fence(Ordering::Acquire);
+        match self.epoch.compare_exchange(
+            epoch,
+            epoch.wrapping_add(1),
+            Ordering::Release,
+            Ordering::Relaxed,
+        ) {
+            Ok(_) => epoch.wrapping_add(1),
+            Err(current) => current,
+        }
+    }
+
+    fn push_bag(&self, bag: *mut Bag) {
+        let mut head = self.garbage.load(Ordering::Relaxed);
+        loop {
+            unsafe { (*bag).next = head };
+            match self.garbage.compare_exchange_weak(
+                head,
+                bag,
+                Ordering::Release,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return,
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    fn seal(&self, bag: *mut Bag) {
+        fence(Ordering::SeqCst);
+        unsafe { (*bag).epoch = self.epoch.load(Ordering::Relaxed) };
+        self.push_bag(bag);
+    }
+
+    /// try to advance the epoch and free the bags that expired, until the heartbeat is spent
+    /// (but at least one bag); returns the number of blocks freed
+    pub fn collect(&self, heartbeat: &Heartbeat) -> usize {
+        let epoch = self.try_advance();
+        let mut bags = self.garbage.swap(ptr::null_mut(), Ordering::Acquire);
+        let mut freed = 0;
+        while !bags.is_null() {
+            let next = unsafe { (*bags).next };
+            let expired = epoch.wrapping_sub(unsafe { (*bags).epoch }) >= 2;
+            if expired && (freed == 0 || !heartbeat.expired()) {
+                freed += unsafe { (*bags).len };
+                drop(unsafe { MiBox::from_raw(bags) });
+            } else {
+                self.push_bag(bags);
+            }
+            bags = next;
+        }
+        freed
+    }
+}
+
+impl Drop for Collector {
+    fn drop(&mut self) {
+        // no handle is left, so nothing can be pinned
+        let mut bags = *self.garbage.get_mut();
+        while !bags.is_null() {
+            let next = unsafe { (*bags).next };
+            drop(unsafe { MiBox::from_raw(bags) });
+            bags = next;
+        }
+        let mut participants = *self.participants.get_mut();
+        while !participants.is_null() {
+            let next = unsafe { (*participants).next };
+            drop(unsafe { MiBox::from_raw(participants) });
+            participants = next;
+        }
+    }
+}
+
+/// A participant of a [`Collector`], used by one thread.
+pub struct LocalHandle<'a> {
+    collector: &'a Collector,
+    participant: &'a Participant,
+    pins: Cell<usize>,
+    // the bag being filled, allocated on the first retire
+    bag: Cell<*mut Bag>,
+}
+
+impl<'a> LocalHandle<'a> {
+    /// pin the participant in the current epoch until the guard is dropped, pins can be nested
+    #[inline]
+    pub fn pin(&self) -> Guard<'_, 'a> {
+        let pins = self.pins.get();
+        if pins == 0 {
+            let epoch = self.collector.epoch.load(Ordering::Relaxed);
+            self.participant
+                .state
+                .store(pinned_in(epoch), Ordering::Relaxed);
+            fence(Ordering::SeqCst);
+        }
+        self.pins.set(pins + 1);
+        Guard { handle: self }
+    }
+
+    /// whether the participant is pinned
+    #[inline]
+    pub fn is_pinned(&self) -> bool {
+        self.pins.get() > 0
+    }
+
+    /// seal the bag of the blocks retired so far and collect without the time budget
+    pub fn flush(&self) {
+        let bag = self.bag.replace(ptr::null_mut());
+        if !bag.is_null() {
+            self.collector.seal(bag);
+        }
+        self.collector.collect(&Heartbeat::forced());
+    }
+
+    #[inline]
+    fn defer(&self, item: Deferred) {
+        let mut bag = self.bag.get();
+        if bag.is_null() {
+            bag = Bag::new();
+            self.bag.set(bag);
+        }
+        let bag_ref = unsafe { &mut *bag };
+        bag_ref.items[bag_ref.len] = item;
+        bag_ref.len += 1;
+        if bag_ref.len == BAG_CAPACITY {
+            self.bag.set(ptr::null_mut());
+            self.collector.seal(bag);
+        }
+    }
+}
+
+impl Drop for LocalHandle<'_> {
+    fn drop(&mut self) {
+        let bag = self.bag.get();
+        if !bag.is_null() {
+            self.collector.seal(bag);
+        }
+        self.participant.state.store(0, Ordering::Release);
+    }
+}
+
+/// A pinned [`LocalHandle`].
+pub struct Guard<'h, 'a> {
+    handle: &'h LocalHandle<'a>,
+}
+
+impl Guard<'_, '_> {
+    /// free the mimalloc block `ptr` once no pinned thread can see it anymore
+    ///
+    /// # Safety
+    /// `ptr` is a block of mimalloc that is already unreachable for threads that pin from now on,
+    /// and is retired once
+    #[inline]
+    pub unsafe fn defer_free(&self, ptr: *mut u8) {
+        self.handle.defer(Deferred {
+            ptr: ptr as *mut c_void,
+            free: free_block,
+        })
+    }
+
+    /// drop the `T` at `ptr` and free its block (e.g. of [`MiBox::into_raw`]) once no pinned thread
+    /// can see it anymore; the drop runs in the heartbeat of some thread
+    ///
+    /// # Safety
+    /// as for [`Guard::defer_free`], and the `T` can be dropped on any thread
+    #[inline]
+    pub unsafe fn defer_drop<T>(&self, ptr: *mut T) {
+        self.handle.defer(Deferred {
+            ptr: ptr as *mut c_void,
+            free: drop_and_free::<T>,
+        })
+    }
+
+    /// see [`LocalHandle::flush`]
+    #[inline]
+    pub fn flush(&self) {
+        self.handle.flush()
+    }
+}
+
+impl Drop for Guard<'_, '_> {
+    #[inline]
+    fn drop(&mut self) {
+        let handle = self.handle;
+        let pins = handle.pins.get() - 1;
+        handle.pins.set(pins);
+        if pins == 0 {
+            handle.participant.state.store(CLAIMED, Ordering::Release);
+        }
+    }
+}
+
+static DEFAULT_COLLECTOR: Collector = Collector::new();
+
+/// the collector of [`register_heartbeat`]
+#[inline]
+pub fn default_collector() -> &'static Collector {
+    &DEFAULT_COLLECTOR
+}
+
+fn collect_default(heartbeat: &Heartbeat) {
+    DEFAULT_COLLECTOR.collect(heartbeat);
+}
+
+/// collect the [`default_collector`] in the heartbeats of the allocator, returns `false` if no hook
+/// slot is left; another `static` collector gets a hook of its own calling [`Collector::collect`]
+#[inline]
+pub fn register_heartbeat() -> bool {
+    GlobalMiMalloc::register_deferred_free(collect_default as DeferredHook)
+}
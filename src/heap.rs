@@ -1,15 +1,31 @@
 //! First-class heaps that can be destroyed in one go.
 //!
+//! With the `remote-free-buffer` feature, destroying a heap while other threads still hold frees into it
+//! in their buffers only deletes it: the buffered frees point into its pages, so the blocks in use stay
+//! allocated in the backing heap. Once those threads flushed their buffers (at their next allocation
+//! slow path, `mi_collect` or exit) the heap is destroyed as usual.
+//!
 //! [furthur documentation](https://microsoft.github.io/mimalloc/group__heap.html#details)
 #[cfg(feature = "unstable")]
-use crate::raw::basic_allocation::mi_free;
-use crate::raw::{heap::*, types::mi_heap_t};
+use crate::raw::{aligned_allocation::mi_free_size_aligned, basic_allocation::mi_free_size};
+use crate::{
+    is_naturally_aligned,
+    raw::{
+        basic_allocation::mi_free_batch,
+        extended_functions::{
+            mi_arena_id_t, mi_arena_limit_used, mi_arena_set_limit, mi_register_limit_handler,
+        },
+        heap::*,
+        types::mi_heap_t,
+    },
+    GlobalMiMalloc,
+};
+use core::{alloc::Layout, ffi::c_void, fmt::Debug, ops::Deref};
 #[cfg(feature = "unstable")]
 use core::{
     alloc::*,
     ptr::{slice_from_raw_parts_mut, NonNull},
 };
-use core::{ffi::c_void, fmt::Debug, ops::Deref};
 
 /// Heap type used for allocator API
 pub struct MiMallocHeap<T: Deref<Target = *mut mi_heap_t>> {
@@ -21,6 +37,100 @@ impl<T: Deref<Target = *mut mi_heap_t>> MiMallocHeap<T> {
     pub fn new(heap: T) -> Self {
         Self { heap }
     }
+
+    /// Allocate a block of `layout` for each entry of `blocks` in one go and return how many were
+    /// allocated, which is less than `blocks.len()` only when out of memory (the remaining entries are left untouched)
+    #[inline]
+    pub fn allocate_batch(&self, layout: Layout, blocks: &mut [*mut u8]) -> usize {
+        unsafe {
+            if is_naturally_aligned(layout.size(), layout.align()) {
+                mi_heap_malloc_batch(
+                    *self.heap.deref(),
+                    layout.size(),
+                    blocks.as_mut_ptr() as *mut *mut c_void,
+                    blocks.len(),
+                )
+            } else {
+                for (n, block) in blocks.iter_mut().enumerate() {
+                    let mem =
+                        mi_heap_malloc_aligned(*self.heap.deref(), layout.size(), layout.align());
+                    if mem.is_null() {
+                        return n;
+                    }
+                    *block = mem as *mut u8;
+                }
+                blocks.len()
+            }
+        }
+    }
+
+    /// Free all `blocks` in one go, null pointers are skipped
+    ///
+    /// # Safety
+    /// every non-null pointer in `blocks` must be a live allocation of mimalloc, and appear only once
+    #[inline]
+    pub unsafe fn deallocate_batch(&self, blocks: &[*mut u8]) {
+        mi_free_batch(blocks.as_ptr() as *const *mut c_void, blocks.len())
+    }
+
+    /// Limit the bytes of the pages of this heap (`mi_heap_set_limit`, 0 is no limit): a fresh page over
+    /// `soft_limit` calls the limit handler ([`GlobalMiMalloc::set_limit_handler`]) and over `hard_limit`
+    /// the allocation fails, so the `Allocator` returns `AllocError`
+    #[inline]
+    pub fn set_limit(&self, soft_limit: usize, hard_limit: usize) {
+        unsafe { mi_heap_set_limit(*self.heap.deref(), soft_limit, hard_limit) }
+    }
+
+    /// bytes of the pages owned by this heap, as counted against its limits
+    #[inline]
+    pub fn limit_used(&self) -> usize {
+        unsafe { mi_heap_limit_used(*self.heap.deref()) }
+    }
+}
+
+/// Called when a fresh page of `heap` goes over a soft limit, of the heap itself (`arena_id` is 0) or of
+/// the arena it allocates in; `used` includes the fresh page. It runs inside the allocation and may shed load
+/// or collect (`mi_heap_collect`), the allocation fails afterwards only if it is still over a hard limit.
+pub type LimitHandler =
+    fn(heap: *mut mi_heap_t, arena_id: mi_arena_id_t, used: usize, limit: usize);
+
+unsafe extern "C" fn limit_handler(
+    heap: *mut mi_heap_t,
+    arena_id: mi_arena_id_t,
+    used: usize,
+    limit: usize,
+    arg: *mut c_void,
+) {
+    let handler = core::mem::transmute::<*mut c_void, LimitHandler>(arg);
+    handler(heap, arena_id, used, limit)
+}
+
+impl GlobalMiMalloc {
+    /// set (or with `None` remove) the handler of the soft heap and arena limits (`mi_register_limit_handler`)
+    #[inline]
+    pub fn set_limit_handler(handler: Option<LimitHandler>) {
+        unsafe {
+            match handler {
+                Some(handler) => {
+                    mi_register_limit_handler(Some(limit_handler), handler as *mut c_void)
+                }
+                None => mi_register_limit_handler(None, core::ptr::null_mut()),
+            }
+        }
+    }
+
+    /// limit the bytes of the heap pages in an arena (`mi_arena_set_limit`, 0 is no limit) like
+    /// [`MiMallocHeap::set_limit`]; `false` if there is no such arena
+    #[inline]
+    pub fn set_arena_limit(arena_id: mi_arena_id_t, soft_limit: usize, hard_limit: usize) -> bool {
+        unsafe { mi_arena_set_limit(arena_id, soft_limit, hard_limit) }
+    }
+
+    /// bytes of the heap pages in an arena, as counted against its limits
+    #[inline]
+    pub fn arena_limit_used(arena_id: mi_arena_id_t) -> usize {
+        unsafe { mi_arena_limit_used(arena_id) }
+    }
 }
 
 impl<T> Debug for MiMallocHeap<T>
@@ -38,6 +148,19 @@ impl<T: Deref<Target = *mut mi_heap_t>> From<T> for MiMallocHeap<T> {
     }
 }
 
+/// the block as a slice of its usable size: collections like `Vec` then use the rounding up to the size class as capacity
+#[cfg(feature = "unstable")]
+#[inline(always)]
+unsafe fn usable_slice(mem: *mut c_void, usable: usize) -> Result<NonNull<[u8]>, AllocError> {
+    match NonNull::new(mem) {
+        Some(mem) => Ok(NonNull::new_unchecked(slice_from_raw_parts_mut(
+            mem.as_ptr() as *mut _,
+            usable,
+        ))),
+        None => Err(AllocError),
+    }
+}
+
 #[cfg(feature = "unstable")]
 unsafe impl<T: Deref<Target = *mut mi_heap_t>> Allocator for MiMallocHeap<T> {
     #[inline]
@@ -46,33 +169,37 @@ unsafe impl<T: Deref<Target = *mut mi_heap_t>> Allocator for MiMallocHeap<T> {
         layout: Layout,
     ) -> Result<core::ptr::NonNull<[u8]>, core::alloc::AllocError> {
         unsafe {
-            let mem = mi_heap_malloc_aligned(*self.heap.deref(), layout.size(), layout.align());
-            match NonNull::new(mem) {
-                Some(mem) => Ok(NonNull::new_unchecked(slice_from_raw_parts_mut(
-                    mem.as_ptr() as *mut _,
-                    layout.size(),
-                ))),
-                None => Err(AllocError),
-            }
+            let mut usable = 0;
+            let mem = mi_heap_malloc_aligned_usable(
+                *self.heap.deref(),
+                layout.size(),
+                layout.align(),
+                &mut usable,
+            );
+            usable_slice(mem, usable)
         }
     }
 
     #[inline]
-    unsafe fn deallocate(&self, ptr: core::ptr::NonNull<u8>, _layout: Layout) {
-        mi_free(ptr.as_ptr() as *mut _)
+    unsafe fn deallocate(&self, ptr: core::ptr::NonNull<u8>, layout: Layout) {
+        if is_naturally_aligned(layout.size(), layout.align()) {
+            mi_free_size(ptr.as_ptr() as *mut _, layout.size())
+        } else {
+            mi_free_size_aligned(ptr.as_ptr() as *mut _, layout.size(), layout.align())
+        }
     }
 
     #[inline]
     fn allocate_zeroed(&self, layout: Layout) -> Result<NonNull<[u8]>, core::alloc::AllocError> {
         unsafe {
-            let mem = mi_heap_zalloc_aligned(*self.heap.deref(), layout.size(), layout.align());
-            match NonNull::new(mem) {
-                Some(mem) => Ok(NonNull::new_unchecked(slice_from_raw_parts_mut(
-                    mem.as_ptr() as *mut _,
-                    layout.size(),
-                ))),
-                None => Err(AllocError),
-            }
+            let mut usable = 0;
+            let mem = mi_heap_zalloc_aligned_usable(
+                *self.heap.deref(),
+                layout.size(),
+                layout.align(),
+                &mut usable,
+            );
+            usable_slice(mem, usable)
         }
     }
 
@@ -88,19 +215,15 @@ unsafe impl<T: Deref<Target = *mut mi_heap_t>> Allocator for MiMallocHeap<T> {
             "`new_layout.size()` must be greater than or equal to `old_layout.size()`"
         );
 
-        let mem = mi_heap_realloc_aligned(
+        let mut usable = 0;
+        let mem = mi_heap_realloc_aligned_usable(
             *self.heap.deref(),
             ptr.as_ptr() as *mut _,
             new_layout.size(),
             new_layout.align(),
+            &mut usable,
         );
-        match NonNull::new(mem) {
-            Some(mem) => Ok(NonNull::new_unchecked(slice_from_raw_parts_mut(
-                mem.as_ptr() as *mut _,
-                new_layout.size(),
-            ))),
-            None => Err(AllocError),
-        }
+        usable_slice(mem, usable)
     }
 
     #[inline]
@@ -115,19 +238,16 @@ unsafe impl<T: Deref<Target = *mut mi_heap_t>> Allocator for MiMallocHeap<T> {
             "`new_layout.size()` must be greater than or equal to `old_layout.size()`"
         );
 
-        let mem = mi_heap_rezalloc_aligned(
+        let mut usable = 0;
+        let mem = mi_heap_rezalloc_aligned_usable(
             *self.heap.deref(),
             ptr.as_ptr() as *mut _,
+            old_layout.size(),
             new_layout.size(),
             new_layout.align(),
+            &mut usable,
         );
-        match NonNull::new(mem) {
-            Some(mem) => Ok(NonNull::new_unchecked(slice_from_raw_parts_mut(
-                mem.as_ptr() as *mut _,
-                new_layout.size(),
-            ))),
-            None => Err(AllocError),
-        }
+        usable_slice(mem, usable)
     }
 
     #[inline]
@@ -142,19 +262,15 @@ unsafe impl<T: Deref<Target = *mut mi_heap_t>> Allocator for MiMallocHeap<T> {
             "`new_layout.size()` must be smaller than or equal to `old_layout.size()`"
         );
 
-        let mem = mi_heap_realloc_aligned(
+        let mut usable = 0;
+        let mem = mi_heap_realloc_aligned_usable(
             *self.heap.deref(),
             ptr.as_ptr() as *mut _,
             new_layout.size(),
             new_layout.align(),
+            &mut usable,
         );
-        match NonNull::new(mem) {
-            Some(mem) => Ok(NonNull::new_unchecked(slice_from_raw_parts_mut(
-                mem.as_ptr() as *mut _,
-                new_layout.size(),
-            ))),
-            None => Err(AllocError),
-        }
+        usable_slice(mem, usable)
     }
 
     #[inline]
@@ -190,6 +306,120 @@ where
             );
         }
     }
+
+    /// Visit at most `max_areas` areas of the heap from `cursor` on, with their blocks if `visit_blocks`,
+    /// and return `true` once the whole heap was visited; call it again with the same cursor to resume.
+    fn visit_from(
+        &mut self,
+        heap: &MiMallocHeap<T>,
+        cursor: &mut mi_heap_cursor_t,
+        max_areas: usize,
+        visit_blocks: bool,
+    ) -> bool {
+        unsafe {
+            let heap: *mut mi_heap_t = *heap.heap.deref();
+            mi_heap_visit_blocks_from(
+                heap as *const mi_heap_t,
+                cursor,
+                max_areas,
+                visit_blocks,
+                Some(visit_handler::<VisitorName, T, Self>),
+                self as *mut Self as *mut c_void,
+            )
+        }
+    }
+}
+
+/// number of areas [`HeapAreas`] reads per call into mimalloc
+const AREA_BATCH: usize = 32;
+
+const AREA_EMPTY: mi_heap_area_t = mi_heap_area_t {
+    blocks: core::ptr::null_mut(),
+    reserved: 0,
+    committed: 0,
+    used: 0,
+    block_size: 0,
+    full_block_size: 0,
+};
+
+/// Iterator over the areas (pages) of a heap with their block size, used blocks and committed bytes,
+/// without visiting the blocks; see [`MiMallocHeap::areas`].
+///
+/// The areas are read in batches with a cursor, so the heap may be used in between;
+/// a page that changes its queue meanwhile may be skipped or returned twice.
+pub struct HeapAreas<'a, T: Deref<Target = *mut mi_heap_t>> {
+    heap: &'a MiMallocHeap<T>,
+    cursor: mi_heap_cursor_t,
+    areas: [mi_heap_area_t; AREA_BATCH],
+    len: usize,
+    pos: usize,
+    done: bool,
+}
+
+struct HeapAreasBatch<'a> {
+    areas: &'a mut [mi_heap_area_t; AREA_BATCH],
+    len: usize,
+}
+
+unsafe extern "C" fn push_area(
+    _heap: *const mi_heap_t,
+    area: *const mi_heap_area_t,
+    _block: *mut c_void,
+    _size: usize,
+    args: *mut c_void,
+) -> bool {
+    let areas = &mut *(args as *mut HeapAreasBatch);
+    areas.areas[areas.len] = *area;
+    areas.len += 1;
+    true
+}
+
+impl<'a, T: Deref<Target = *mut mi_heap_t>> Iterator for HeapAreas<'a, T> {
+    type Item = mi_heap_area_t;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.pos == self.len {
+            if self.done {
+                return None;
+            }
+            let mut batch = HeapAreasBatch {
+                areas: &mut self.areas,
+                len: 0,
+            };
+            self.done = unsafe {
+                mi_heap_visit_blocks_from(
+                    *self.heap.heap.deref() as *const mi_heap_t,
+                    &mut self.cursor,
+                    AREA_BATCH,
+                    false,
+                    Some(push_area),
+                    &mut batch as *mut HeapAreasBatch as *mut c_void,
+                )
+            };
+            self.len = batch.len;
+            self.pos = 0;
+            if self.len == 0 {
+                return None;
+            }
+        }
+        self.pos += 1;
+        Some(self.areas[self.pos - 1])
+    }
+}
+
+impl<T: Deref<Target = *mut mi_heap_t>> MiMallocHeap<T> {
+    /// the areas of the heap, one per page; only the thread owning the heap can iterate them
+    #[inline]
+    pub fn areas(&self) -> HeapAreas<'_, T> {
+        HeapAreas {
+            heap: self,
+            cursor: mi_heap_cursor_t::default(),
+            areas: [AREA_EMPTY; AREA_BATCH],
+            len: 0,
+            pos: 0,
+            done: false,
+        }
+    }
 }
 
 /// the default Global Heap Type
@@ -208,6 +438,341 @@ impl Deref for GlobalHeap {
 }
 /// the default Global Heap Type Alias
 pub type MiMallocHeapGlobal = MiMallocHeap<GlobalHeap>;
+/// Allocator over an owned heap
+pub type MiMallocHeapOwned = MiMallocHeap<OwnedHeap>;
+/// Allocator over a scoped heap, destroyed with all its blocks on drop
+pub type MiMallocHeapScoped = MiMallocHeap<ScopedHeap>;
+/// Allocator over a heap that can move between threads
+pub type MiMallocHeapMovable = MiMallocHeap<MovableHeap>;
+/// Allocator over the heap of a tag of the current thread
+pub type MiMallocHeapTagged = MiMallocHeap<TaggedHeap>;
+
+/// A heap created for and owned by the current thread.
+///
+/// On drop the heap is deleted (`mi_heap_delete`): blocks still alive migrate to the backing heap of the thread.
+/// Use [`OwnedHeap::destroy`] to free all of its blocks at once instead.
+#[derive(Debug, PartialEq, Eq)]
+pub struct OwnedHeap {
+    heap: *mut mi_heap_t,
+}
+
+impl OwnedHeap {
+    /// create a new heap, or `None` when out of memory
+    #[inline]
+    pub fn try_new() -> Option<Self> {
+        let heap = unsafe { mi_heap_new() };
+        (!heap.is_null()).then_some(Self { heap })
+    }
+
+    #[inline]
+    pub fn new() -> Self {
+        Self::try_new().expect("mi_heap_new: out of memory")
+    }
+
+    /// create a new heap that only allocates in the arena `arena_id` (`mi_heap_new_in_arena`),
+    /// or `None` when out of memory
+    #[inline]
+    pub fn try_new_in_arena(arena_id: mi_arena_id_t) -> Option<Self> {
+        let heap = unsafe { mi_heap_new_in_arena(arena_id) };
+        (!heap.is_null()).then_some(Self { heap })
+    }
+
+    /// free the heap together with all blocks allocated in it (`mi_heap_destroy`)
+    ///
+    /// # Safety
+    /// no block allocated in this heap is used (or freed) afterwards
+    #[inline]
+    pub unsafe fn destroy(self) {
+        let heap = self.heap;
+        core::mem::forget(self);
+        mi_heap_destroy(heap)
+    }
+}
+
+impl Default for OwnedHeap {
+    #[inline]
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Deref for OwnedHeap {
+    type Target = *mut mi_heap_t;
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.heap
+    }
+}
+
+impl Drop for OwnedHeap {
+    #[inline]
+    fn drop(&mut self) {
+        if !self.heap.is_null() {
+            unsafe { mi_heap_delete(self.heap) }
+        }
+    }
+}
+
+/// A heap whose blocks are all freed at once (`mi_heap_destroy`) when it goes out of scope,
+/// the region pattern for request scoped allocation.
+///
+/// Allocate through `&MiMallocHeapScoped` so that the borrow checker ensures no allocation outlives the heap;
+/// destructors of values still alive are not run.
+#[derive(Debug, PartialEq, Eq, Default)]
+pub struct ScopedHeap {
+    heap: OwnedHeap,
+}
+
+impl ScopedHeap {
+    /// create a new heap, or `None` when out of memory
+    #[inline]
+    pub fn try_new() -> Option<Self> {
+        OwnedHeap::try_new().map(|heap| Self { heap })
+    }
+
+    #[inline]
+    pub fn new() -> Self {
+        Self {
+            heap: OwnedHeap::new(),
+        }
+    }
+}
+
+impl Deref for ScopedHeap {
+    type Target = *mut mi_heap_t;
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.heap.heap
+    }
+}
+
+impl Drop for ScopedHeap {
+    #[inline]
+    fn drop(&mut self) {
+        let heap = core::mem::replace(&mut self.heap.heap, core::ptr::null_mut());
+        unsafe { mi_heap_destroy(heap) }
+    }
+}
+
+/// A heap that owns its segments, so that it can be handed over to another thread (`mi_heap_new_movable`).
+///
+/// The heap is attached to the thread that creates it; [`MovableHeap::detach`] turns it into a [`DetachedHeap`]
+/// which is `Send` and is attached again on the receiving thread. Blocks allocated in it stay valid across
+/// the handoff and can be freed from any thread.
+/// On drop the heap is deleted: blocks still alive migrate to the backing heap of the current thread.
+#[derive(Debug, PartialEq, Eq)]
+pub struct MovableHeap {
+    heap: *mut mi_heap_t,
+}
+
+impl MovableHeap {
+    /// create a new heap attached to the current thread, or `None` when out of memory
+    #[inline]
+    pub fn try_new() -> Option<Self> {
+        let heap = unsafe { mi_heap_new_movable() };
+        (!heap.is_null()).then_some(Self { heap })
+    }
+
+    #[inline]
+    pub fn new() -> Self {
+        Self::try_new().expect("mi_heap_new_movable: out of memory")
+    }
+
+    /// detach the heap from the current thread to move it to another one
+    #[inline]
+    pub fn detach(self) -> DetachedHeap {
+        let heap = self.heap;
+        core::mem::forget(self);
+        let detached = unsafe { mi_heap_detach(heap) };
+        debug_assert!(detached);
+        DetachedHeap { heap }
+    }
+
+    /// move the pages of this heap, with the blocks still alive, into a heap of the current thread,
+    /// or give the heap back if `heap` is not a thread local heap of the current thread
+    #[inline]
+    pub fn absorb_into<T: Deref<Target = *mut mi_heap_t>>(
+        self,
+        heap: &MiMallocHeap<T>,
+    ) -> Result<(), Self> {
+        if unsafe { mi_heap_absorb_movable(*heap.heap.deref(), self.heap) } {
+            core::mem::forget(self);
+            Ok(())
+        } else {
+            Err(self)
+        }
+    }
+
+    /// free the heap together with all blocks allocated in it (`mi_heap_destroy`)
+    ///
+    /// # Safety
+    /// no block allocated in this heap is used (or freed) afterwards
+    #[inline]
+    pub unsafe fn destroy(self) {
+        let heap = self.heap;
+        core::mem::forget(self);
+        mi_heap_destroy(heap)
+    }
+}
+
+impl Default for MovableHeap {
+    #[inline]
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Deref for MovableHeap {
+    type Target = *mut mi_heap_t;
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.heap
+    }
+}
+
+impl Drop for MovableHeap {
+    #[inline]
+    fn drop(&mut self) {
+        unsafe { mi_heap_delete(self.heap) }
+    }
+}
+
+/// A [`MovableHeap`] on its way to another thread.
+#[derive(Debug, PartialEq, Eq)]
+pub struct DetachedHeap {
+    heap: *mut mi_heap_t,
+}
+
+// no thread uses the heap until it is attached again
+unsafe impl Send for DetachedHeap {}
+
+impl DetachedHeap {
+    /// attach the heap to the current thread
+    #[inline]
+    pub fn attach(self) -> MovableHeap {
+        let heap = self.heap;
+        core::mem::forget(self);
+        let attached = unsafe { mi_heap_attach(heap) };
+        debug_assert!(attached);
+        MovableHeap { heap }
+    }
+}
+
+impl Drop for DetachedHeap {
+    #[inline]
+    fn drop(&mut self) {
+        unsafe {
+            mi_heap_attach(self.heap);
+            mi_heap_delete(self.heap)
+        }
+    }
+}
+
+/// The heap of a tag of the current thread (`mi_heap_tagged`), so that blocks of different tags never share
+/// a page: e.g. long-lived cache entries do not keep the pages of short-lived request buffers alive.
+///
+/// The heap belongs to the thread: it is created on first use of the tag and lives until the thread terminates,
+/// then its blocks still alive migrate to the backing heap like those of other heaps.
+#[derive(Debug, PartialEq, Eq)]
+pub struct TaggedHeap {
+    heap: *mut mi_heap_t,
+}
+
+impl TaggedHeap {
+    /// the heap of `tag` (below `MI_HEAP_TAGS`, 0 is the backing heap) of the current thread,
+    /// or `None` for an invalid tag or when out of memory
+    #[inline]
+    pub fn current(tag: u8) -> Option<Self> {
+        let heap = unsafe { mi_heap_tagged(tag as cty::c_int) };
+        (!heap.is_null()).then_some(Self { heap })
+    }
+
+    /// the tag of the heap
+    #[inline]
+    pub fn tag(&self) -> u8 {
+        unsafe { mi_heap_get_tag(self.heap) as u8 }
+    }
+}
+
+impl Deref for TaggedHeap {
+    type Target = *mut mi_heap_t;
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.heap
+    }
+}
+
+/// An allocator of blocks of tag `TAG` (below `MI_HEAP_TAGS`), in the [`TaggedHeap`] of the thread that allocates;
+/// unlike a [`MiMallocHeapTagged`] it can be used from any thread, and so by collections that are shared or sent.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct MiMallocTagged<const TAG: u8>;
+
+impl<const TAG: u8> MiMallocTagged<TAG> {
+    /// the heap of the tag of the current thread
+    #[inline]
+    pub fn heap() -> Option<MiMallocHeapTagged> {
+        TaggedHeap::current(TAG).map(MiMallocHeap::new)
+    }
+}
+
+#[cfg(feature = "unstable")]
+unsafe impl<const TAG: u8> Allocator for MiMallocTagged<TAG> {
+    #[inline]
+    fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        Self::heap().ok_or(AllocError)?.allocate(layout)
+    }
+
+    #[inline]
+    unsafe fn deallocate(&self, ptr: NonNull<u8>, layout: Layout) {
+        // any thread can free a block, whatever its heap
+        GlobalMiMalloc::get().deallocate(ptr, layout)
+    }
+
+    #[inline]
+    fn allocate_zeroed(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        Self::heap().ok_or(AllocError)?.allocate_zeroed(layout)
+    }
+
+    #[inline]
+    unsafe fn grow(
+        &self,
+        ptr: NonNull<u8>,
+        old_layout: Layout,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        Self::heap()
+            .ok_or(AllocError)?
+            .grow(ptr, old_layout, new_layout)
+    }
+
+    #[inline]
+    unsafe fn grow_zeroed(
+        &self,
+        ptr: NonNull<u8>,
+        old_layout: Layout,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        Self::heap()
+            .ok_or(AllocError)?
+            .grow_zeroed(ptr, old_layout, new_layout)
+    }
+
+    #[inline]
+    unsafe fn shrink(
+        &self,
+        ptr: NonNull<u8>,
+        old_layout: Layout,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        Self::heap()
+            .ok_or(AllocError)?
+            .shrink(ptr, old_layout, new_layout)
+    }
+}
 
 #[inline]
 unsafe extern "C" fn visit_handler<
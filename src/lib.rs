@@ -71,7 +71,15 @@
 #[cfg(test)]
 mod tests;
 
+#[cfg(target_os = "linux")]
+pub mod arena;
+pub mod boxed;
+pub mod deferred;
+pub mod epoch;
 pub mod heap;
+pub mod profile;
+pub mod purge;
+pub mod stats;
 use cty::c_long;
 use heap::*;
 // the hand writed native binding
@@ -85,7 +93,10 @@ use core::{
     ops::Deref,
 };
 
-use crate::raw::{aligned_allocation::*, basic_allocation::*, heap::*, runtime_options::*};
+use crate::raw::{
+    aligned_allocation::*, basic_allocation::*, extended_functions::*, heap::*,
+    runtime_options::*,
+};
 /// The global allocator
 pub struct GlobalMiMalloc;
 
@@ -158,26 +169,165 @@ impl GlobalMiMalloc {
     pub fn option_set_enabled_default(option: mi_option_t) {
         unsafe { mi_option_set_enabled_default(option) }
     }
+
+    /// only allocate from arenas of the NUMA node of the current thread (OS memory is bound
+    /// to the node instead) and do not reclaim the abandoned segments of other nodes
+    #[inline]
+    pub fn set_numa_strict(strict: bool) {
+        Self::option_set(mi_option_numa_strict, strict as c_long)
+    }
+
+    /// try to keep the resident set under `mib` MiB (0 for no target): the closer it gets, the more
+    /// eagerly free memory is given back, from `MADV_FREE` up to releasing unused regions
+    #[inline]
+    pub fn set_rss_target(mib: usize) {
+        Self::option_set(mi_option_rss_target, mib as c_long)
+    }
+
+    /// THP-aware segment placement: the (dense) small and medium page segments are fully committed
+    /// on transparent huge pages, the (sparse) large and huge ones explicitly on small OS pages
+    #[inline]
+    pub fn set_thp_aware(enable: bool) {
+        Self::option_set(mi_option_thp_aware, enable as c_long)
+    }
+
+    /// number of freed segments each thread keeps for its own reuse before they go back
+    /// to the shared regions (at most 8, 2 by default); they are released when the thread terminates
+    #[inline]
+    pub fn set_segment_thread_cache(segments: usize) {
+        Self::option_set(mi_option_segment_thread_cache, segments as c_long)
+    }
+
+    /// the usable size a block of `size` bytes is rounded up to (`mi_good_size`), e.g. to reserve
+    /// the capacity of a collection up to its size class since `Vec` does not use the slack itself
+    #[inline]
+    pub fn good_size(size: usize) -> usize {
+        unsafe { mi_good_size(size) }
+    }
+
+    /// pre-allocate the metadata of up to `threads` new threads (at most 8, 64 with the `lazy-init` feature)
+    /// ahead of a burst of thread creations; returns how many are cached now
+    #[inline]
+    pub fn reserve_thread_data(threads: usize) -> usize {
+        unsafe { mi_thread_data_reserve(threads) }
+    }
+}
+
+/// whether a plain `mi_malloc` of `size` bytes is already aligned to `align`,
+/// the same guarantee `alloc-aligned.c` checks before falling back to over-allocation
+#[inline(always)]
+pub(crate) const fn is_naturally_aligned(size: usize, align: usize) -> bool {
+    if align <= MI_INTPTR_SIZE {
+        return true;
+    }
+    let padsize = size + MI_PADDING_SIZE;
+    align <= MI_MAX_ALIGN_SIZE
+        && align <= padsize
+        && padsize <= MI_MEDIUM_OBJ_SIZE_MAX
+        && padsize & (align - 1) == 0
 }
 
 unsafe impl GlobalAlloc for GlobalMiMalloc {
     #[inline]
     unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
-        mi_malloc_aligned(layout.size(), layout.align()) as *mut u8
+        if is_naturally_aligned(layout.size(), layout.align()) {
+            if layout.size() <= MI_SMALL_SIZE_MAX {
+                mi_malloc_small(layout.size()) as *mut u8
+            } else {
+                mi_malloc(layout.size()) as *mut u8
+            }
+        } else {
+            mi_malloc_aligned(layout.size(), layout.align()) as *mut u8
+        }
+    }
+
+    #[inline]
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        if is_naturally_aligned(layout.size(), layout.align()) {
+            mi_free_size(ptr as *mut c_void, layout.size());
+        } else {
+            mi_free_size_aligned(ptr as *mut c_void, layout.size(), layout.align());
+        }
+    }
+
+    #[inline]
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        if is_naturally_aligned(layout.size(), layout.align()) {
+            if layout.size() <= MI_SMALL_SIZE_MAX {
+                mi_zalloc_small(layout.size()) as *mut u8
+            } else {
+                mi_zalloc(layout.size()) as *mut u8
+            }
+        } else {
+            mi_zalloc_aligned(layout.size(), layout.align()) as *mut u8
+        }
+    }
+
+    #[inline]
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        if is_naturally_aligned(new_size, layout.align()) {
+            mi_realloc(ptr as *mut c_void, new_size) as *mut u8
+        } else {
+            mi_realloc_aligned(ptr as *mut c_void, new_size, layout.align()) as *mut u8
+        }
+    }
+}
+
+/// A global allocator which allocates from a heap per CPU instead of per thread (Linux with rseq),
+/// so the number of heaps and segments scales with the cores rather than with the threads.
+/// Falls back to the thread-local heap while the heap of the current CPU is used by another thread.
+#[cfg(feature = "percpu")]
+pub struct GlobalMiMallocPerCpu;
+
+#[cfg(feature = "percpu")]
+impl GlobalMiMallocPerCpu {
+    #[inline(always)]
+    unsafe fn with_heap<R>(f: impl FnOnce(*mut mi_heap_t) -> R) -> R {
+        let heap = mi_percpu_heap_acquire();
+        let res = f(heap);
+        mi_percpu_heap_release(heap);
+        res
+    }
+}
+
+#[cfg(feature = "percpu")]
+unsafe impl GlobalAlloc for GlobalMiMallocPerCpu {
+    #[inline]
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        Self::with_heap(|heap| {
+            if is_naturally_aligned(layout.size(), layout.align()) {
+                mi_heap_malloc(heap, layout.size()) as *mut u8
+            } else {
+                mi_heap_malloc_aligned(heap, layout.size(), layout.align()) as *mut u8
+            }
+        })
     }
 
     #[inline]
     unsafe fn dealloc(&self, ptr: *mut u8, _layout: Layout) {
-        mi_free(ptr as *mut c_void);
+        mi_percpu_free(ptr as *mut c_void);
     }
 
     #[inline]
     unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
-        mi_zalloc_aligned(layout.size(), layout.align()) as *mut u8
+        Self::with_heap(|heap| {
+            if is_naturally_aligned(layout.size(), layout.align()) {
+                mi_heap_zalloc(heap, layout.size()) as *mut u8
+            } else {
+                mi_heap_zalloc_aligned(heap, layout.size(), layout.align()) as *mut u8
+            }
+        })
     }
 
     #[inline]
     unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
-        mi_realloc_aligned(ptr as *mut c_void, new_size, layout.align()) as *mut u8
+        Self::with_heap(|heap| {
+            if is_naturally_aligned(new_size, layout.align()) {
+                mi_heap_realloc(heap, ptr as *mut c_void, new_size) as *mut u8
+            } else {
+                mi_heap_realloc_aligned(heap, ptr as *mut c_void, new_size, layout.align())
+                    as *mut u8
+            }
+        })
     }
 }
@@ -0,0 +1,59 @@
+//! Heap profile of the sampled allocations, in the legacy text format (`heap_v2`) pprof reads:
+//! `pprof -http=: <binary> <profile>`.
+//!
+//! Sampling needs the `sampling` feature: about one allocation per `mi_option_sample_interval`
+//! bytes (512KiB by default) is sampled with its stack trace, and stays in the profile until it is freed.
+//! Without the feature the profile is empty.
+use crate::{
+    raw::{extended_functions::mi_sample_print_out, runtime_options::mi_option_sample_interval},
+    GlobalMiMalloc,
+};
+use core::{
+    ffi::{c_void, CStr},
+    fmt,
+};
+use cty::{c_char, c_long};
+
+struct ProfileWriter<'a, W: fmt::Write> {
+    w: &'a mut W,
+    res: fmt::Result,
+}
+
+unsafe extern "C" fn write_profile<W: fmt::Write>(msg: *const c_char, arg: *mut c_void) {
+    let writer = &mut *(arg as *mut ProfileWriter<W>);
+    if writer.res.is_err() {
+        return;
+    }
+    // the mappings may contain paths that are not valid UTF-8
+    for chunk in CStr::from_ptr(msg).to_bytes().utf8_chunks() {
+        writer.res = writer.w.write_str(chunk.valid());
+        if writer.res.is_ok() && !chunk.invalid().is_empty() {
+            writer.res = writer.w.write_char(char::REPLACEMENT_CHARACTER);
+        }
+        if writer.res.is_err() {
+            return;
+        }
+    }
+}
+
+impl GlobalMiMalloc {
+    /// write the live sampled blocks as a pprof heap profile (`mi_sample_print_out`);
+    /// allocations of `w` while writing are not sampled
+    pub fn write_heap_profile<W: fmt::Write>(w: &mut W) -> fmt::Result {
+        let mut writer = ProfileWriter { w, res: Ok(()) };
+        unsafe {
+            mi_sample_print_out(
+                Some(write_profile::<W>),
+                &mut writer as *mut ProfileWriter<W> as *mut c_void,
+            )
+        };
+        writer.res
+    }
+
+    /// set the mean number of bytes between sampled allocations, 0 turns sampling off;
+    /// each thread picks up the new interval at its next sample
+    #[inline]
+    pub fn set_sample_interval(bytes: usize) {
+        Self::option_set(mi_option_sample_interval, bytes as c_long)
+    }
+}
@@ -0,0 +1,34 @@
+//! Background purge thread: the delayed resets of freed pages (`madvise`, or decommit with
+//! `mi_option_reset_decommits`) are done by a maintenance thread instead of the allocating threads,
+//! which then only queue the expired pages.
+use crate::{
+    raw::{
+        extended_functions::{mi_purge_thread_start, mi_purge_thread_stop},
+        runtime_options::mi_option_purge_interval,
+    },
+    GlobalMiMalloc,
+};
+use cty::c_long;
+
+impl GlobalMiMalloc {
+    /// start the background purge thread (`mi_purge_thread_start`);
+    /// returns `false` if no thread could be created (or the platform has no threads)
+    #[inline]
+    pub fn start_purge_thread() -> bool {
+        unsafe { mi_purge_thread_start() }
+    }
+
+    /// stop the background purge thread after it reset the pages that are still queued,
+    /// from then on the allocating threads reset the pages themselves again
+    #[inline]
+    pub fn stop_purge_thread() {
+        unsafe { mi_purge_thread_stop() }
+    }
+
+    /// set the milli-seconds between the runs of the background purge thread (1 to 1000, 10 by default);
+    /// pages are only queued after `mi_option_reset_delay` anyway
+    #[inline]
+    pub fn set_purge_interval(msecs: usize) {
+        Self::option_set(mi_option_purge_interval, msecs as c_long)
+    }
+}
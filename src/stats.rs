@@ -0,0 +1,279 @@
+//! Typed snapshot of the allocator statistics, without going through the text output of `mi_stats_print_out`.
+//!
+//! In release builds mimalloc only maintains the statistics of the OS and segment level
+//! (`reserved`, `committed`, `reset`, `segments`, ...); the allocation statistics
+//! (`normal`, `huge`, `giant`, `malloc` and the per-bin counts) need a debug build or the `stats` feature.
+use crate::{
+    raw::{
+        extended_functions::{mi_process_info, mi_stats_get},
+        types::{mi_stat_count_t, mi_stat_counter_t, mi_stat_histogram_t, mi_stats_t},
+    },
+    GlobalMiMalloc,
+};
+use core::mem::{size_of, MaybeUninit};
+
+/// number of size classes (bins) of the small and medium objects, `MI_BIN_HUGE + 1`
+pub const MI_BIN_COUNT: usize = 74;
+
+/// number of NUMA nodes with their own statistics (`MI_STAT_NUMA_NODES`),
+/// the higher nodes are counted with the last one
+pub const MI_STAT_NUMA_NODES: usize = 8;
+
+/// an amount (of bytes or objects) that is allocated and freed over time
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct StatCount {
+    pub allocated: i64,
+    pub freed: i64,
+    pub peak: i64,
+    pub current: i64,
+}
+
+impl From<mi_stat_count_t> for StatCount {
+    #[inline]
+    fn from(stat: mi_stat_count_t) -> Self {
+        Self {
+            allocated: stat.allocated,
+            freed: stat.freed,
+            peak: stat.peak,
+            current: stat.current,
+        }
+    }
+}
+
+/// an event counter, with the sum of the amounts of all events
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct StatCounter {
+    pub total: i64,
+    pub count: i64,
+}
+
+impl From<mi_stat_counter_t> for StatCounter {
+    #[inline]
+    fn from(stat: mi_stat_counter_t) -> Self {
+        Self {
+            total: stat.total,
+            count: stat.count,
+        }
+    }
+}
+
+/// number of buckets of a [`LatencyHistogram`]
+pub use crate::raw::types::MI_STAT_LATENCY_BUCKETS;
+
+/// a log2 histogram of latencies in nanoseconds: bucket 0 counts the latencies below 1ns,
+/// bucket `i` those in `[2^(i-1), 2^i)` and the last bucket everything above
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LatencyHistogram {
+    pub count: i64,
+    pub total_ns: i64,
+    pub buckets: [i64; MI_STAT_LATENCY_BUCKETS],
+}
+
+impl From<mi_stat_histogram_t> for LatencyHistogram {
+    #[inline]
+    fn from(stat: mi_stat_histogram_t) -> Self {
+        Self {
+            count: stat.count,
+            total_ns: stat.total,
+            buckets: stat.buckets,
+        }
+    }
+}
+
+impl LatencyHistogram {
+    /// the mean latency in nanoseconds, 0 without samples
+    #[inline]
+    pub fn mean_ns(&self) -> i64 {
+        if self.count == 0 {
+            0
+        } else {
+            self.total_ns / self.count
+        }
+    }
+
+    /// an upper bound of the `q` quantile (`0.0 ..= 1.0`, e.g. 0.99) in nanoseconds, that is the end
+    /// of the bucket it falls in; 0 without samples
+    pub fn quantile_ns(&self, q: f64) -> i64 {
+        let total: i64 = self.buckets.iter().sum();
+        if total == 0 {
+            return 0;
+        }
+        // the rank of the quantile rounded up (without `f64::ceil`, which needs std)
+        let exact = q.clamp(0.0, 1.0) * total as f64;
+        let rank = ((exact as i64) + ((exact as i64 as f64) < exact) as i64).max(1);
+        let mut seen = 0;
+        for (i, &n) in self.buckets.iter().enumerate() {
+            seen += n;
+            if seen >= rank {
+                return 1i64 << i;
+            }
+        }
+        1i64 << (MI_STAT_LATENCY_BUCKETS - 1)
+    }
+}
+
+/// latencies of the allocation slow path (`_mi_malloc_generic`) and of its stages, recorded with the
+/// `latency-histograms` feature (and empty without it)
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Latency {
+    /// the whole slow path, i.e. every allocation that misses the free list of its page
+    pub generic: LatencyHistogram,
+    /// running the deferred free callback and the delayed frees of other threads
+    pub deferred_free: LatencyHistogram,
+    /// finding (or allocating) a page with free blocks
+    pub page_search: LatencyHistogram,
+    /// trying to reclaim an abandoned segment
+    pub reclaim: LatencyHistogram,
+    /// allocating a fresh segment from the OS or an arena
+    pub segment_alloc: LatencyHistogram,
+    /// committing OS memory
+    pub os_commit: LatencyHistogram,
+}
+
+#[cfg(feature = "latency-histograms")]
+use crate::raw::types::MI_STAT_LATENCY_STAGES;
+
+#[cfg(feature = "latency-histograms")]
+impl From<&[mi_stat_histogram_t; MI_STAT_LATENCY_STAGES]> for Latency {
+    #[inline]
+    fn from(stats: &[mi_stat_histogram_t; MI_STAT_LATENCY_STAGES]) -> Self {
+        use crate::raw::types::{
+            MI_STAT_LATENCY_DEFERRED_FREE, MI_STAT_LATENCY_GENERIC, MI_STAT_LATENCY_OS_COMMIT,
+            MI_STAT_LATENCY_PAGE_SEARCH, MI_STAT_LATENCY_RECLAIM, MI_STAT_LATENCY_SEGMENT_ALLOC,
+        };
+        Self {
+            generic: stats[MI_STAT_LATENCY_GENERIC as usize].into(),
+            deferred_free: stats[MI_STAT_LATENCY_DEFERRED_FREE as usize].into(),
+            page_search: stats[MI_STAT_LATENCY_PAGE_SEARCH as usize].into(),
+            reclaim: stats[MI_STAT_LATENCY_RECLAIM as usize].into(),
+            segment_alloc: stats[MI_STAT_LATENCY_SEGMENT_ALLOC as usize].into(),
+            os_commit: stats[MI_STAT_LATENCY_OS_COMMIT as usize].into(),
+        }
+    }
+}
+
+/// process information from the OS (`mi_process_info`)
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct ProcessInfo {
+    pub elapsed_msecs: usize,
+    pub user_msecs: usize,
+    pub system_msecs: usize,
+    pub current_rss: usize,
+    pub peak_rss: usize,
+    pub current_commit: usize,
+    pub peak_commit: usize,
+    pub page_faults: usize,
+}
+
+impl ProcessInfo {
+    #[inline]
+    pub fn get() -> Self {
+        let mut info = Self::default();
+        unsafe {
+            mi_process_info(
+                &mut info.elapsed_msecs,
+                &mut info.user_msecs,
+                &mut info.system_msecs,
+                &mut info.current_rss,
+                &mut info.peak_rss,
+                &mut info.current_commit,
+                &mut info.peak_commit,
+                &mut info.page_faults,
+            )
+        };
+        info
+    }
+}
+
+/// Snapshot of the statistics of the process; the statistics of other threads are
+/// included as soon as they merge them (`mi_stats_merge`) or terminate.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Stats {
+    pub segments: StatCount,
+    pub pages: StatCount,
+    pub reserved: StatCount,
+    pub committed: StatCount,
+    pub reset: StatCount,
+    /// committed memory of pages that were touched
+    pub page_committed: StatCount,
+    pub segments_abandoned: StatCount,
+    pub pages_abandoned: StatCount,
+    pub threads: StatCount,
+    pub normal: StatCount,
+    pub huge: StatCount,
+    pub giant: StatCount,
+    pub malloc: StatCount,
+    pub segments_cache: StatCount,
+    /// segments on transparent huge pages (with `mi_option_thp_aware`)
+    pub segments_thp: StatCount,
+    pub pages_extended: StatCounter,
+    pub mmap_calls: StatCounter,
+    pub commit_calls: StatCounter,
+    pub page_no_retire: StatCounter,
+    pub searches: StatCounter,
+    pub normal_count: StatCounter,
+    pub huge_count: StatCounter,
+    pub giant_count: StatCounter,
+    /// bytes reset by the background purge thread
+    pub purge_resets: StatCounter,
+    /// committed segment memory per NUMA node (also in release builds)
+    pub node_committed: [StatCount; MI_STAT_NUMA_NODES],
+    /// blocks of the small and medium objects per size class
+    pub bins: [StatCount; MI_BIN_COUNT],
+    pub latency: Latency,
+    pub process: ProcessInfo,
+}
+
+impl From<&mi_stats_t> for Stats {
+    fn from(stats: &mi_stats_t) -> Self {
+        Self {
+            segments: stats.segments.into(),
+            pages: stats.pages.into(),
+            reserved: stats.reserved.into(),
+            committed: stats.committed.into(),
+            reset: stats.reset.into(),
+            page_committed: stats.page_committed.into(),
+            segments_abandoned: stats.segments_abandoned.into(),
+            pages_abandoned: stats.pages_abandoned.into(),
+            threads: stats.threads.into(),
+            normal: stats.normal.into(),
+            huge: stats.huge.into(),
+            giant: stats.giant.into(),
+            malloc: stats.malloc.into(),
+            segments_cache: stats.segments_cache.into(),
+            segments_thp: stats.segments_thp.into(),
+            pages_extended: stats.pages_extended.into(),
+            mmap_calls: stats.mmap_calls.into(),
+            commit_calls: stats.commit_calls.into(),
+            page_no_retire: stats.page_no_retire.into(),
+            searches: stats.searches.into(),
+            normal_count: stats.normal_count.into(),
+            huge_count: stats.huge_count.into(),
+            giant_count: stats.giant_count.into(),
+            purge_resets: stats.purge_resets.into(),
+            node_committed: stats.node_committed.map(StatCount::from),
+            bins: stats.normal_bins.map(StatCount::from),
+            #[cfg(feature = "latency-histograms")]
+            latency: (&stats.latency).into(),
+            #[cfg(not(feature = "latency-histograms"))]
+            latency: Latency::default(),
+            process: ProcessInfo::default(),
+        }
+    }
+}
+
+impl GlobalMiMalloc {
+    /// a snapshot of the statistics (`mi_stats_get`) together with the process information;
+    /// this merges the statistics of the current thread into those of the process
+    pub fn stats() -> Stats {
+        let mut raw = MaybeUninit::<mi_stats_t>::uninit();
+        let raw = unsafe {
+            mi_stats_get(size_of::<mi_stats_t>(), raw.as_mut_ptr());
+            raw.assume_init()
+        };
+        Stats {
+            process: ProcessInfo::get(),
+            ..Stats::from(&raw)
+        }
+    }
+}
@@ -1,9 +1,13 @@
-use std::{ffi::c_void, mem::ManuallyDrop};
+use std::{alloc::Layout, ffi::c_void, mem::ManuallyDrop, thread};
 
 use crate::{
-    heap::{HeapVisitor, MiMallocHeap},
+    heap::{
+        HeapVisitor, MiMallocHeap, MiMallocHeapMovable, MiMallocHeapOwned, MiMallocHeapScoped,
+        MiMallocTagged, MovableHeap, OwnedHeap, ScopedHeap, TaggedHeap,
+    },
     raw::{
-        heap::{mi_heap_area_t, mi_heap_delete, mi_heap_new},
+        basic_allocation::mi_free_batch,
+        heap::{mi_heap_area_t, mi_heap_contains_block, mi_heap_delete, mi_heap_new, MI_HEAP_TAGS},
         types::mi_heap_t,
     },
     with_heap, GlobalMiMalloc,
@@ -66,6 +70,164 @@ impl HeapVisitor<General, TestHeap> for LeakDetector {
     }
 }
 
+#[test]
+fn test_batch() {
+    let heap = MiMallocHeap::new(TestHeap::new());
+    for (size, align) in [(16, 8), (48, 16), (1000, 8), (100000, 8), (64, 64)] {
+        let layout = Layout::from_size_align(size, align).unwrap();
+        let mut blocks = vec![std::ptr::null_mut::<u8>(); 3000];
+        assert_eq!(heap.allocate_batch(layout, &mut blocks), blocks.len());
+        for (i, &block) in blocks.iter().enumerate() {
+            assert_eq!(block as usize % align, 0);
+            unsafe { block.write_bytes(i as u8, size) };
+        }
+        let mut sorted = blocks.clone();
+        sorted.sort();
+        sorted.dedup();
+        assert_eq!(sorted.len(), blocks.len());
+        // free the odd blocks locally and the even ones from another thread
+        let (even, odd): (Vec<_>, Vec<_>) =
+            blocks.iter().enumerate().partition(|(i, _)| i % 2 == 0);
+        let odd: Vec<*mut u8> = odd.into_iter().map(|(_, &b)| b).collect();
+        let even: Vec<usize> = even.into_iter().map(|(_, &b)| b as usize).collect();
+        unsafe { heap.deallocate_batch(&odd) };
+        thread::spawn(move || unsafe {
+            mi_free_batch(even.as_ptr() as *const *mut c_void, even.len())
+        })
+        .join()
+        .unwrap();
+    }
+}
+
+#[derive(Default)]
+struct AreaCounter {
+    areas: usize,
+    blocks: usize,
+}
+
+impl HeapVisitor<General, TestHeap> for AreaCounter {
+    fn visitor(
+        &mut self,
+        _heap: &mi_heap_t,
+        _area: &mi_heap_area_t,
+        block: *mut c_void,
+        _size: usize,
+    ) -> bool {
+        if block.is_null() {
+            self.areas += 1;
+        } else {
+            self.blocks += 1;
+        }
+        true
+    }
+}
+
+#[test]
+fn test_heap_areas() {
+    let heap = MiMallocHeap::new(TestHeap::new());
+    let mut blocks = vec![std::ptr::null_mut::<u8>(); 1000];
+    let mut all = Vec::new();
+    for size in [16, 1000, 100000] {
+        let layout = Layout::from_size_align(size, 8).unwrap();
+        assert_eq!(heap.allocate_batch(layout, &mut blocks), blocks.len());
+        all.extend_from_slice(&blocks);
+    }
+    // the summary of the pages, read in batches
+    let areas: Vec<mi_heap_area_t> = heap.areas().collect();
+    assert!(areas.len() > 32);
+    assert_eq!(areas.iter().map(|a| a.used).sum::<usize>(), all.len());
+    for size in [16, 1000, 100000] {
+        let used: usize = areas
+            .iter()
+            .filter(|a| a.block_size >= size && a.block_size < size + size / 4 + 8)
+            .map(|a| a.used)
+            .sum();
+        assert_eq!(used, blocks.len());
+    }
+    assert!(areas
+        .iter()
+        .all(|a| a.used * a.full_block_size <= a.committed));
+    // a resumed visit sees the same areas and blocks
+    let mut counter = AreaCounter::default();
+    let mut cursor = Default::default();
+    let mut rounds = 0;
+    while !counter.visit_from(&heap, &mut cursor, 7, true) {
+        rounds += 1;
+    }
+    assert_eq!(rounds, (areas.len() - 1) / 7);
+    assert_eq!(counter.areas, areas.len());
+    assert_eq!(counter.blocks, all.len());
+    unsafe { mi_free_batch(all.as_ptr() as *const *mut c_void, all.len()) };
+}
+
+#[test]
+fn test_heap_areas_resume() {
+    use crate::raw::basic_allocation::mi_free;
+    use std::collections::HashSet;
+    let heap = MiMallocHeap::new(TestHeap::new());
+    // thousands of full small pages, all in the full queue
+    let layout = Layout::from_size_align(8000, 8).unwrap();
+    let mut blocks = vec![std::ptr::null_mut::<u8>(); 16384];
+    assert_eq!(heap.allocate_batch(layout, &mut blocks), blocks.len());
+    // freeing a block of a visited page moves it out of the full queue, ahead of where the
+    // iterator resumes; still every page is returned once
+    let mut pages = HashSet::new();
+    let mut freed = HashSet::new();
+    let mut used = 0;
+    for area in heap.areas() {
+        assert!(pages.insert(area.blocks as usize));
+        used += area.used;
+        if area.used == area.reserved / area.full_block_size {
+            unsafe { mi_free(area.blocks) };
+            freed.insert(area.blocks as usize);
+        }
+    }
+    assert!(pages.len() > 2000);
+    assert_eq!(used, blocks.len());
+    for p in blocks {
+        if !freed.contains(&(p as usize)) {
+            unsafe { mi_free(p as *mut c_void) };
+        }
+    }
+}
+
+// with guard pages a large page may not be aligned, the allocation then falls back to over-allocating
+#[cfg(all(feature = "aligned-pages", not(feature = "secure-guard-pages")))]
+#[test]
+fn test_aligned_pages() {
+    use crate::raw::{extended_functions::MI_PADDING_SIZE, heap::mi_heap_malloc_aligned};
+    let heap = MiMallocHeap::new(TestHeap::new());
+    let shapes = [
+        (60_000, 1 << 16),
+        (100_000, 1 << 16),
+        (250_000, 1 << 18),
+        (700_000, 1 << 18),
+        (1_000_000, 1 << 20),
+        (2_000_000, 1 << 21),
+    ];
+    let mut all = Vec::new();
+    for (size, align) in shapes {
+        for _ in 0..8 {
+            let p = unsafe { mi_heap_malloc_aligned(*heap.heap, size, align) };
+            assert!(!p.is_null() && p as usize % align == 0);
+            all.push(p);
+        }
+    }
+    // the blocks are the size rounded up to the alignment, not over-allocated by it
+    let areas: Vec<mi_heap_area_t> = heap.areas().collect();
+    for (size, align) in shapes {
+        let block_size = (size + MI_PADDING_SIZE + align - 1) / align * align;
+        let used: usize = areas
+            .iter()
+            .filter(|a| a.full_block_size == block_size)
+            .map(|a| a.used)
+            .sum();
+        assert_eq!(used, 8);
+    }
+    assert_eq!(areas.iter().map(|a| a.used).sum::<usize>(), all.len());
+    unsafe { mi_free_batch(all.as_ptr() as *const *mut c_void, all.len()) };
+}
+
 #[cfg(feature = "unstable")]
 #[test]
 fn test_allocator_api() {
@@ -77,6 +239,269 @@ fn test_allocator_api() {
     assert_eq!(b[1], 2);
 }
 
+#[cfg(feature = "unstable")]
+#[test]
+fn test_allocator_usable_size() {
+    use crate::raw::{extended_functions::mi_usable_size, heap::mi_heap_malloc_usable};
+    use std::{alloc::Allocator, ptr::NonNull};
+    let allocator = MiMallocHeap::new(TestHeap::new());
+    for size in [1, 100, 5000, 1 << 20] {
+        let mut usable = 0;
+        let p = unsafe { mi_heap_malloc_usable(*allocator.heap, size, &mut usable) };
+        assert!(usable >= size);
+        assert_eq!(usable, unsafe { mi_usable_size(p) });
+        unsafe { mi_free_batch(&p, 1) };
+    }
+    // the slices span the usable size of the block (which is exact with the padding of debug builds)
+    unsafe {
+        let usable = |b: NonNull<[u8]>| mi_usable_size(b.as_ptr() as *const c_void);
+        let layout = Layout::from_size_align(100, 8).unwrap();
+        let b = allocator.allocate_zeroed(layout).unwrap();
+        assert_eq!(b.len(), usable(b));
+        assert!(b.as_ref().iter().all(|x| *x == 0));
+        let grown = Layout::from_size_align(b.len() + 1, 8).unwrap();
+        let g = allocator.grow_zeroed(b.cast(), layout, grown).unwrap();
+        assert_eq!(g.len(), usable(g));
+        assert!(g.as_ref().iter().all(|x| *x == 0));
+        let s = allocator.shrink(g.cast(), grown, layout).unwrap();
+        assert!(s.len() >= 100 && s.len() == usable(s));
+        allocator.deallocate(s.cast(), Layout::from_size_align(s.len(), 8).unwrap());
+    }
+    // `Vec` ignores the slack, but can reserve up to the size class itself
+    let v: Vec<u8> = Vec::with_capacity(GlobalMiMalloc::good_size(100));
+    assert_eq!(v.capacity(), unsafe { mi_usable_size(v.as_ptr() as _) });
+}
+
+#[cfg(feature = "unstable")]
+#[test]
+fn test_grow_zeroed_slack() {
+    use std::alloc::Allocator;
+    let allocator = MiMallocHeap::new(TestHeap::new());
+    let layout = Layout::from_size_align(100, 8).unwrap();
+    // a grow within the block (in release builds) and one that moves it
+    for new_size in [101, 1000] {
+        unsafe {
+            let mut b = allocator.allocate(layout).unwrap();
+            // the caller may use the whole slice but only report the layout it asked for
+            b.as_mut().fill(0xFF);
+            let grown = Layout::from_size_align(new_size, 8).unwrap();
+            let g = allocator.grow_zeroed(b.cast(), layout, grown).unwrap();
+            assert!(g.as_ref()[..100].iter().all(|x| *x == 0xFF));
+            assert!(g.as_ref()[100..].iter().all(|x| *x == 0));
+            allocator.deallocate(g.cast(), grown);
+        }
+    }
+}
+
+#[cfg(feature = "unstable")]
+#[test]
+fn test_scoped_heap() {
+    let owned = MiMallocHeapOwned::new(OwnedHeap::new());
+    let kept: Vec<u8, &MiMallocHeapOwned> = {
+        let mut v = Vec::new_in(&owned);
+        v.extend_from_slice(b"kept");
+        v
+    };
+    for _ in 0..100 {
+        let scoped = MiMallocHeapScoped::new(ScopedHeap::new());
+        let mut nodes: Vec<Box<[u64; 4], &MiMallocHeapScoped>, _> = Vec::new_in(&scoped);
+        for i in 0..1000 {
+            nodes.push(Box::new_in([i; 4], &scoped));
+        }
+        assert_eq!(nodes[999][3], 999);
+        // everything is freed at once when `scoped` goes out of scope
+        core::mem::forget(nodes);
+    }
+    assert_eq!(&kept[..], b"kept");
+}
+
+#[test]
+fn test_owned_heap_destroy() {
+    let mut blocks = vec![std::ptr::null_mut::<u8>(); 100];
+    let layout = Layout::from_size_align(64, 8).unwrap();
+    let heap = MiMallocHeapOwned::new(OwnedHeap::new());
+    assert_eq!(heap.allocate_batch(layout, &mut blocks), 100);
+    unsafe { heap.heap.destroy() };
+    let scoped = MiMallocHeapScoped::new(ScopedHeap::new());
+    assert_eq!(scoped.allocate_batch(layout, &mut blocks), 100);
+}
+
+// the frees another thread still buffers for a destroyed heap do not end up in the reused memory
+#[cfg(feature = "remote-free-buffer")]
+#[test]
+fn test_destroy_with_buffered_frees() {
+    use crate::raw::{
+        basic_allocation::mi_free, extended_functions::mi_collect, heap::mi_heap_collect,
+    };
+    use std::sync::mpsc;
+    let layout = Layout::from_size_align(64, 8).unwrap();
+    let (send_blocks, blocks) = mpsc::channel::<Vec<usize>>();
+    let (send_freed, freed) = mpsc::channel();
+    let (send_destroyed, destroyed) = mpsc::channel();
+    let freer = thread::spawn(move || {
+        // fewer than a batch, so they stay in the buffer of this thread
+        for p in blocks.recv().unwrap() {
+            unsafe { mi_free(p as *mut c_void) };
+        }
+        send_freed.send(()).unwrap();
+        destroyed.recv().unwrap();
+        unsafe { mi_collect(false) };
+    });
+    let heap = MiMallocHeapOwned::new(OwnedHeap::new());
+    let mut blocks = vec![std::ptr::null_mut::<u8>(); 16];
+    assert_eq!(heap.allocate_batch(layout, &mut blocks), 16);
+    send_blocks
+        .send(blocks[..8].iter().map(|&p| p as usize).collect())
+        .unwrap();
+    freed.recv().unwrap();
+    unsafe { heap.heap.destroy() };
+    let other = MiMallocHeapOwned::new(OwnedHeap::new());
+    let mut kept = vec![std::ptr::null_mut::<u8>(); 1000];
+    assert_eq!(other.allocate_batch(layout, &mut kept), 1000);
+    for (i, &p) in kept.iter().enumerate() {
+        unsafe { p.write_bytes(i as u8, layout.size()) };
+    }
+    send_destroyed.send(()).unwrap();
+    freer.join().unwrap();
+    // (the frees pushed into the full pages are only seen by a collect)
+    unsafe { mi_heap_collect(*other.heap, false) };
+    let mut more = vec![std::ptr::null_mut::<u8>(); 1000];
+    assert_eq!(other.allocate_batch(layout, &mut more), 1000);
+    for &p in &more {
+        unsafe { p.write_bytes(0xFF, layout.size()) };
+    }
+    for (i, &p) in kept.iter().enumerate() {
+        assert_eq!(unsafe { *p.add(8) }, i as u8);
+    }
+    unsafe { other.heap.destroy() };
+}
+
+// once the other thread pushed its buffered frees, the heap is destroyed rather than absorbed
+#[cfg(feature = "remote-free-buffer")]
+#[test]
+fn test_destroy_after_drained_frees() {
+    use crate::raw::{
+        basic_allocation::mi_free, extended_functions::mi_collect, heap::mi_heap_get_default,
+    };
+    let layout = Layout::from_size_align(64, 8).unwrap();
+    thread::spawn(move || unsafe {
+        let heap = MiMallocHeapOwned::new(OwnedHeap::new());
+        let mut blocks = vec![std::ptr::null_mut::<u8>(); 16];
+        assert_eq!(heap.allocate_batch(layout, &mut blocks), 16);
+        let freed: Vec<usize> = blocks[..8].iter().map(|&p| p as usize).collect();
+        thread::spawn(move || {
+            for p in freed {
+                mi_free(p as *mut c_void);
+            }
+            // push the buffered frees
+            mi_collect(false);
+        })
+        .join()
+        .unwrap();
+        let default = mi_heap_get_default();
+        let page_count = (*default).page_count;
+        let pages = (*(*default).tld).stats.pages.current;
+        let heap_pages = (**heap.heap).page_count as i64;
+        assert!(heap_pages > 0);
+        heap.heap.destroy();
+        // no pages moved to the backing heap, and the pages of the heap are freed
+        assert_eq!((*default).page_count, page_count);
+        assert_eq!((*(*default).tld).stats.pages.current, pages - heap_pages);
+    })
+    .join()
+    .unwrap();
+}
+
+#[test]
+fn test_tagged_heap() {
+    thread::spawn(|| {
+        let layout = Layout::from_size_align(64, 8).unwrap();
+        let cache = MiMallocTagged::<1>::heap().unwrap();
+        let scratch = MiMallocTagged::<2>::heap().unwrap();
+        assert_eq!(cache.heap.tag(), 1);
+        assert_eq!(*cache.heap, *TaggedHeap::current(1).unwrap());
+        assert!(TaggedHeap::current(MI_HEAP_TAGS as u8).is_none());
+        let mut entries = vec![std::ptr::null_mut::<u8>(); 100];
+        let mut buffers = vec![std::ptr::null_mut::<u8>(); 100];
+        assert_eq!(cache.allocate_batch(layout, &mut entries), 100);
+        assert_eq!(scratch.allocate_batch(layout, &mut buffers), 100);
+        // blocks of the same size but different tags are in different pages
+        for &p in &entries {
+            unsafe {
+                assert!(mi_heap_contains_block(*cache.heap, p as *const c_void));
+                assert!(!mi_heap_contains_block(*scratch.heap, p as *const c_void));
+            }
+        }
+        unsafe {
+            scratch.deallocate_batch(&buffers);
+            cache.deallocate_batch(&entries);
+        }
+        #[cfg(feature = "unstable")]
+        {
+            let mut v: Vec<u64, MiMallocTagged<3>> = Vec::new_in(MiMallocTagged);
+            v.extend(0..1000);
+            // freed by another thread
+            thread::spawn(move || assert_eq!(v.iter().sum::<u64>(), 499500))
+                .join()
+                .unwrap();
+        }
+    })
+    .join()
+    .unwrap();
+}
+
+#[test]
+fn test_movable_heap() {
+    let layout = Layout::from_size_align(48, 8).unwrap();
+    for size in [48, 100000, 1 << 22] {
+        let layout = Layout::from_size_align(size, 8).unwrap();
+        let (heap, blocks) = thread::spawn(move || {
+            let heap = MiMallocHeapMovable::new(MovableHeap::new());
+            let mut blocks = vec![std::ptr::null_mut::<u8>(); 16];
+            assert_eq!(heap.allocate_batch(layout, &mut blocks), blocks.len());
+            for (i, &block) in blocks.iter().enumerate() {
+                unsafe { block.write_bytes(i as u8, size) };
+            }
+            let blocks: Vec<usize> = blocks.into_iter().map(|b| b as usize).collect();
+            (heap.heap.detach(), blocks)
+        })
+        .join()
+        .unwrap();
+        // continue on another thread and finally absorb the remaining blocks into a heap of that thread
+        thread::spawn(move || {
+            let heap = MiMallocHeap::new(heap.attach());
+            let (odd, even): (Vec<_>, Vec<_>) = blocks.iter().partition(|&&b| (b / 16) % 2 == 1);
+            for (i, &block) in blocks.iter().enumerate() {
+                assert!(
+                    unsafe { core::slice::from_raw_parts(block as *const u8, size) }
+                        .iter()
+                        .all(|&b| b == i as u8)
+                );
+            }
+            let odd: Vec<*mut u8> = odd.into_iter().map(|&b| b as *mut u8).collect();
+            unsafe { heap.deallocate_batch(&odd) };
+            let local = MiMallocHeap::new(TestHeap::new());
+            assert!(heap.heap.absorb_into(&local).is_ok());
+            let even: Vec<*mut u8> = even.into_iter().map(|&b| b as *mut u8).collect();
+            unsafe { local.deallocate_batch(&even) };
+        })
+        .join()
+        .unwrap();
+    }
+    // destroy on another thread
+    let heap = thread::spawn(move || {
+        let heap = MiMallocHeapMovable::new(MovableHeap::new());
+        let mut blocks = vec![std::ptr::null_mut::<u8>(); 1000];
+        assert_eq!(heap.allocate_batch(layout, &mut blocks), blocks.len());
+        heap.heap.detach()
+    })
+    .join()
+    .unwrap();
+    thread::spawn(move || unsafe { heap.attach().destroy() })
+        .join()
+        .unwrap();
+}
+
 #[test]
 #[should_panic]
 fn test_leak_detector() {
@@ -84,6 +509,7 @@ fn test_leak_detector() {
         let mut b: ManuallyDrop<Vec<u8>> = ManuallyDrop::new(vec![0; 114514]);
         let mut _leak1: ManuallyDrop<Vec<u8>> = ManuallyDrop::new(vec![0; 114514]);
         let mut _leak2: ManuallyDrop<Vec<u8>> = ManuallyDrop::new(vec![0; 1]);
+        std::hint::black_box((&_leak1, &_leak2));
         ManuallyDrop::drop(&mut b);
     });
     LeakDetector::default().visit(&heap);
@@ -1,15 +1,805 @@
 mod heap;
 
-use crate::raw::runtime_options::mi_option_show_stats;
+use crate::raw::{extended_functions::mi_collect, runtime_options::mi_option_show_stats};
 
 use crate::GlobalMiMalloc;
 
 #[global_allocator]
 static GLOBAL_MIMALLOC: GlobalMiMalloc = GlobalMiMalloc;
 
+// the tests that change process-wide options, or depend on their defaults, run one at a time
+static GLOBAL_OPTIONS: std::sync::Mutex<()> = std::sync::Mutex::new(());
+
+fn lock_global_options() -> std::sync::MutexGuard<'static, ()> {
+    // a failed test does not poison the others
+    GLOBAL_OPTIONS.lock().unwrap_or_else(|e| e.into_inner())
+}
+
 #[test]
 fn test_malloc() {
     GlobalMiMalloc::option_enable(mi_option_show_stats);
     let _vec: Vec<u8> = vec![0; 114514];
     println!("mimalloc: \n{:?}", GLOBAL_MIMALLOC);
 }
+
+// with encoded free lists a fresh block must not expose its (encoded) free list link
+#[cfg(any(
+    debug_assertions,
+    feature = "secure-encoded-freelist",
+    feature = "secure-double-free"
+))]
+#[test]
+fn test_fresh_block_hides_link() {
+    use crate::raw::basic_allocation::{mi_free, mi_malloc};
+    let debug_uninit = usize::from_ne_bytes([0xD0; core::mem::size_of::<usize>()]);
+    let alloc = || -> Vec<*mut usize> {
+        (0..256)
+            .map(|_| unsafe { mi_malloc(48) as *mut usize })
+            .collect()
+    };
+    let free = |blocks: &[*mut usize]| {
+        for &p in blocks {
+            unsafe { mi_free(p.cast()) };
+        }
+    };
+    let first = alloc();
+    free(&first);
+    // the blocks are reused from the free list of the page, each held the link to the next one
+    let again = alloc();
+    for &p in &again {
+        let word = unsafe { p.read() };
+        assert!(word == 0 || word == debug_uninit, "{word:#x}");
+    }
+    free(&again);
+}
+
+#[test]
+fn test_alloc_dispatch_alignment() {
+    use core::alloc::{GlobalAlloc, Layout};
+    for align in [1, 2, 4, 8, 16, 32, 64, 4096] {
+        for size in [1, 7, 8, 16, 24, 48, 100, 1024, 4000, 70000, 1 << 20] {
+            let layout = Layout::from_size_align(size, align).unwrap();
+            unsafe {
+                let p = GLOBAL_MIMALLOC.alloc(layout);
+                assert!(!p.is_null());
+                assert_eq!(p as usize % align, 0, "{:?}", layout);
+                let z = GLOBAL_MIMALLOC.alloc_zeroed(layout);
+                assert_eq!(z as usize % align, 0, "{:?}", layout);
+                assert!(core::slice::from_raw_parts(z, size).iter().all(|b| *b == 0));
+                let r = GLOBAL_MIMALLOC.realloc(p, layout, size * 3);
+                assert_eq!(r as usize % align, 0, "{:?}", layout);
+                GLOBAL_MIMALLOC.dealloc(r, Layout::from_size_align(size * 3, align).unwrap());
+                GLOBAL_MIMALLOC.dealloc(z, layout);
+            }
+        }
+    }
+}
+
+#[test]
+fn test_alloc_typed() {
+    use crate::{
+        boxed::{wsize_of, MiBox},
+        raw::extended_functions::mi_usable_size,
+    };
+    assert_eq!(wsize_of(0), 1);
+    assert_eq!(wsize_of(1), 1);
+    assert_eq!(wsize_of(9), 2);
+    #[repr(align(64))]
+    struct Aligned(u8);
+    let mut small = MiBox::new([7u32; 5]);
+    small[4] = 9;
+    assert_eq!(*small, [7, 7, 7, 7, 9]);
+    assert!(unsafe { mi_usable_size(&*small as *const _ as *const _) } >= 20);
+    let aligned = MiBox::new(Aligned(3));
+    assert_eq!(&*aligned as *const Aligned as usize % 64, 0);
+    assert_eq!(aligned.0, 3);
+    let large = MiBox::new([1u8; 4096]);
+    assert!(large.iter().all(|b| *b == 1));
+    let total: usize = (0..1000).map(|i| *MiBox::new(i)).sum();
+    assert_eq!(total, 499500);
+    // the boxed value is dropped
+    let rc = std::rc::Rc::new(());
+    drop(MiBox::new(rc.clone()));
+    assert_eq!(std::rc::Rc::strong_count(&rc), 1);
+}
+
+#[test]
+fn test_stats() {
+    let vec: Vec<u8> = vec![1; 1 << 20];
+    let stats = GlobalMiMalloc::stats();
+    assert!(stats.reserved.current > 0 && stats.committed.current > 0);
+    assert!(stats.segments.current > 0);
+    assert!(stats.node_committed.iter().any(|node| node.allocated > 0));
+    assert!(stats.process.current_rss > 0 && stats.process.peak_rss > 0);
+    if cfg!(debug_assertions) || cfg!(feature = "stats") {
+        // `current` also counts the frees merged by other (test) threads, `allocated` only grows
+        assert!(stats.normal.allocated >= vec.len() as i64);
+        assert!(stats.bins.iter().any(|bin| bin.current > 0));
+    }
+}
+
+#[cfg(feature = "latency-histograms")]
+#[test]
+fn test_latency_histograms() {
+    // a new thread starts with empty pages, so its allocations go through the slow path
+    std::thread::spawn(|| {
+        let blocks: Vec<Box<[u8; 48]>> = (0..10000).map(|_| Box::new([0; 48])).collect();
+        drop(blocks);
+    })
+    .join()
+    .unwrap();
+    let latency = GlobalMiMalloc::stats().latency;
+    assert!(latency.generic.count > 0 && latency.page_search.count > 0);
+    for stage in [latency.generic, latency.page_search, latency.segment_alloc] {
+        assert_eq!(stage.buckets.iter().sum::<i64>(), stage.count);
+        assert!(stage.quantile_ns(0.5) <= stage.quantile_ns(0.99));
+    }
+    assert!(latency.generic.total_ns >= latency.page_search.total_ns);
+}
+
+#[test]
+fn test_deferred_free_hooks() {
+    let _options = lock_global_options();
+    use crate::{deferred::Heartbeat, raw::extended_functions::mi_collect};
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    static FORCED: AtomicUsize = AtomicUsize::new(0);
+    fn hook(heartbeat: &Heartbeat) {
+        if heartbeat.force() {
+            FORCED.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+    assert!(GlobalMiMalloc::register_deferred_free(hook));
+    unsafe { mi_collect(true) };
+    assert!(FORCED.load(Ordering::Relaxed) > 0);
+    assert!(GlobalMiMalloc::unregister_deferred_free(hook));
+    assert!(!GlobalMiMalloc::unregister_deferred_free(hook));
+}
+
+#[test]
+fn test_epoch_collector() {
+    use crate::{boxed::MiBox, epoch::Collector};
+    use std::rc::Rc;
+    let collector = Collector::new();
+    let handle = collector.register();
+    let rc = Rc::new(());
+    let guard = handle.pin();
+    unsafe { guard.defer_drop(MiBox::into_raw(MiBox::new(rc.clone()))) };
+    // the block stays alive while the thread that retired it is pinned
+    guard.flush();
+    guard.flush();
+    assert_eq!(Rc::strong_count(&rc), 2);
+    drop(guard);
+    handle.flush();
+    handle.flush();
+    assert_eq!(Rc::strong_count(&rc), 1);
+    assert!(collector.epoch() >= 2);
+}
+
+#[test]
+fn test_epoch_participants() {
+    use crate::{boxed::MiBox, epoch::Collector};
+    use std::sync::{Arc, Barrier};
+    const THREADS: usize = 100;
+    let collector = Collector::new();
+    let barrier = Barrier::new(THREADS);
+    let arc = Arc::new(());
+    std::thread::scope(|scope| {
+        for _ in 0..THREADS {
+            scope.spawn(|| {
+                let handle = collector.register();
+                let guard = handle.pin();
+                unsafe { guard.defer_drop(MiBox::into_raw(MiBox::new(arc.clone()))) };
+                // all threads are pinned at once, so the epoch advances once at most
+                barrier.wait();
+                guard.flush();
+                barrier.wait();
+                assert_eq!(Arc::strong_count(&arc), THREADS + 1);
+            });
+        }
+    });
+    let handle = collector.register();
+    for _ in 0..3 {
+        handle.flush();
+    }
+    assert_eq!(Arc::strong_count(&arc), 1);
+}
+
+#[test]
+fn test_deferred_free_round_robin() {
+    let _options = lock_global_options();
+    use crate::deferred::Heartbeat;
+    use std::{
+        cell::Cell,
+        sync::atomic::{AtomicUsize, Ordering},
+    };
+    thread_local! {
+        // the hooks that ran in the current heartbeat of this thread
+        static RAN: Cell<usize> = Cell::new(0);
+    }
+    static RUNS_A: AtomicUsize = AtomicUsize::new(0);
+    static RUNS_B: AtomicUsize = AtomicUsize::new(0);
+    fn spend(heartbeat: &Heartbeat, runs: &AtomicUsize) {
+        if !heartbeat.force() {
+            RAN.with(|ran| ran.set(ran.get() + 1));
+            runs.fetch_add(1, Ordering::Relaxed);
+            while !heartbeat.expired() {}
+        }
+    }
+    fn hook_a(heartbeat: &Heartbeat) {
+        spend(heartbeat, &RUNS_A)
+    }
+    fn hook_b(heartbeat: &Heartbeat) {
+        spend(heartbeat, &RUNS_B)
+    }
+    assert!(GlobalMiMalloc::register_deferred_free(hook_a));
+    assert!(GlobalMiMalloc::register_deferred_free(hook_b));
+    // each hook spends the whole budget, so a heartbeat runs one of them and the next one resumes
+    // after it instead of starting over at the first slot
+    GlobalMiMalloc::set_deferred_free_budget(1);
+    for _ in 0..1000 {
+        RAN.with(|ran| ran.set(0));
+        unsafe { mi_collect(false) };
+        assert!(RAN.with(|ran| ran.get()) <= 1);
+        if RUNS_A.load(Ordering::Relaxed) > 1 && RUNS_B.load(Ordering::Relaxed) > 1 {
+            break;
+        }
+    }
+    GlobalMiMalloc::set_deferred_free_budget(20_000);
+    assert!(GlobalMiMalloc::unregister_deferred_free(hook_a));
+    assert!(GlobalMiMalloc::unregister_deferred_free(hook_b));
+    assert!(RUNS_A.load(Ordering::Relaxed) > 1 && RUNS_B.load(Ordering::Relaxed) > 1);
+}
+
+#[test]
+fn test_epoch_heartbeat() {
+    let _options = lock_global_options();
+    use crate::{
+        boxed::MiBox,
+        epoch::{default_collector, register_heartbeat},
+    };
+    use std::sync::Arc;
+    assert!(register_heartbeat());
+    GlobalMiMalloc::set_deferred_free_budget(1_000_000);
+    // the drops run in the heartbeat of whichever thread, hence `Arc`
+    let arc = Arc::new(());
+    {
+        let handle = default_collector().register();
+        let guard = handle.pin();
+        // several full bags, and a partial one that is sealed when the handle is dropped
+        for _ in 0..200 {
+            unsafe { guard.defer_drop(MiBox::into_raw(MiBox::new(arc.clone()))) };
+        }
+        assert_eq!(Arc::strong_count(&arc), 201);
+    }
+    // without a flush: the heartbeats advance the epoch, then free the expired bags
+    let mut heartbeats = 0;
+    while Arc::strong_count(&arc) > 1 && heartbeats < 100 {
+        unsafe { mi_collect(false) };
+        heartbeats += 1;
+    }
+    GlobalMiMalloc::set_deferred_free_budget(20_000);
+    assert_eq!(Arc::strong_count(&arc), 1);
+}
+
+#[test]
+fn test_purge_thread() {
+    let _options = lock_global_options();
+    use crate::raw::{
+        basic_allocation::mi_free,
+        heap::{mi_heap_collect, mi_heap_destroy, mi_heap_malloc, mi_heap_new},
+    };
+    assert!(GlobalMiMalloc::start_purge_thread());
+    GlobalMiMalloc::set_purge_interval(5);
+    let purged_bytes = || GlobalMiMalloc::stats().purge_resets.total;
+    let before = purged_bytes();
+    let mut purged = false;
+    unsafe {
+        // free all pages but one of a segment, they are reset after `mi_option_reset_delay`
+        let heap = mi_heap_new();
+        let blocks: Vec<_> = (0..2048).map(|_| mi_heap_malloc(heap, 1024)).collect();
+        for &p in &blocks[..blocks.len() - 1] {
+            mi_free(p);
+        }
+        mi_heap_collect(heap, false);
+        for _ in 0..100 {
+            std::thread::sleep(std::time::Duration::from_millis(20));
+            // a page allocation queues the expired pages
+            let other = mi_heap_new();
+            assert!(!mi_heap_malloc(other, 1024).is_null());
+            mi_heap_destroy(other);
+            std::thread::sleep(std::time::Duration::from_millis(20));
+            if purged_bytes() > before {
+                purged = true;
+                break;
+            }
+        }
+        mi_heap_destroy(heap);
+    }
+    GlobalMiMalloc::stop_purge_thread();
+    assert!(purged);
+}
+
+#[test]
+fn test_rss_target() {
+    let _options = lock_global_options();
+    use crate::raw::heap::{mi_heap_destroy, mi_heap_malloc, mi_heap_new};
+    // far over a target of 1MiB: freed pages are reset right away
+    GlobalMiMalloc::set_rss_target(1);
+    let before = GlobalMiMalloc::stats().reset.allocated;
+    unsafe {
+        let heap = mi_heap_new();
+        for _ in 0..4096 {
+            assert!(!mi_heap_malloc(heap, 1024).is_null());
+        }
+        mi_heap_destroy(heap);
+    }
+    let after = GlobalMiMalloc::stats().reset.allocated;
+    GlobalMiMalloc::set_rss_target(0);
+    assert!(after > before);
+}
+
+#[test]
+fn test_thp_aware() {
+    let _options = lock_global_options();
+    use crate::raw::heap::{mi_heap_destroy, mi_heap_malloc, mi_heap_new};
+    GlobalMiMalloc::set_thp_aware(true);
+    let before = GlobalMiMalloc::stats().segments_thp.allocated;
+    unsafe {
+        // more than a segment of small pages
+        let heap = mi_heap_new();
+        for _ in 0..8192 {
+            assert!(!mi_heap_malloc(heap, 1024).is_null());
+        }
+        let thp = GlobalMiMalloc::stats().segments_thp.allocated;
+        mi_heap_destroy(heap);
+        GlobalMiMalloc::set_thp_aware(false);
+        if std::path::Path::new("/sys/kernel/mm/transparent_hugepage").exists() {
+            assert!(thp > before);
+        }
+    }
+}
+
+#[test]
+fn test_segment_thread_cache() {
+    let _options = lock_global_options();
+    use crate::raw::heap::{
+        mi_heap_collect, mi_heap_destroy, mi_heap_get_default, mi_heap_malloc, mi_heap_new,
+    };
+    GlobalMiMalloc::set_segment_thread_cache(2);
+    std::thread::spawn(|| unsafe {
+        let cached = || (*(*mi_heap_get_default()).tld).os.segment_cache_count;
+        // heaps of `mi_heap_new` never reclaim abandoned segments of other threads, so only the
+        // segments of this thread go through its cache, which a forced collect empties first
+        let heap = mi_heap_new();
+        mi_heap_collect(heap, true);
+        assert_eq!(cached(), 0);
+        // a large object has a segment of its own
+        let p = mi_heap_malloc(heap, 1 << 20);
+        assert!(!p.is_null());
+        assert_eq!(cached(), 0);
+        mi_heap_destroy(heap);
+        assert_eq!(cached(), 1);
+        let heap = mi_heap_new();
+        let q = mi_heap_malloc(heap, 1 << 20);
+        assert_eq!(cached(), 0);
+        // the same segment (with `secure` the block within the page may differ)
+        let segment = |p: *mut core::ffi::c_void| p as usize & !((4 << 20) - 1);
+        assert_eq!(segment(p), segment(q));
+        mi_heap_destroy(heap);
+    })
+    .join()
+    .unwrap();
+}
+
+// huge blocks of OS memory grow without copying (guard pages are at the end of the segment,
+// and with the arena backend huge blocks are in arenas)
+#[cfg(all(
+    target_os = "linux",
+    not(feature = "secure-guard-pages"),
+    not(feature = "arena-backend")
+))]
+#[test]
+fn test_realloc_huge_grow() {
+    use crate::raw::heap::mi_heap_get_default;
+    use core::alloc::{GlobalAlloc, Layout};
+    std::thread::spawn(|| unsafe {
+        let segments = || (*(*mi_heap_get_default()).tld).stats.segments.allocated;
+        let mut size = 64 << 20;
+        let p = GlobalMiMalloc.alloc(Layout::from_size_align(size, 1).unwrap());
+        assert!(!p.is_null());
+        p.write_bytes(7, 4096);
+        p.add(size - 1).write(9);
+        let before = segments();
+        let mut q = p;
+        for _ in 0..3 {
+            q = GlobalMiMalloc.realloc(q, Layout::from_size_align(size, 1).unwrap(), size * 2);
+            assert!(!q.is_null());
+            assert_eq!(*q.add(4095), 7);
+            assert_eq!(*q.add((64 << 20) - 1), 9);
+            size *= 2;
+            q.add(size - 1).write(1);
+        }
+        // no new segment (and no copy) for any of the reallocations
+        assert_eq!(segments(), before);
+        GlobalMiMalloc.dealloc(q, Layout::from_size_align(size, 1).unwrap());
+    })
+    .join()
+    .unwrap();
+}
+
+#[test]
+fn test_heap_limit() {
+    let _options = lock_global_options();
+    use crate::{
+        heap::{MiMallocHeapOwned, OwnedHeap},
+        raw::{
+            extended_functions::{mi_arena_area, mi_arena_id_t, mi_reserve_os_memory_ex},
+            heap::mi_heap_malloc,
+            types::mi_heap_t,
+        },
+    };
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    static SOFT: AtomicUsize = AtomicUsize::new(0);
+    fn on_limit(_heap: *mut mi_heap_t, _arena_id: mi_arena_id_t, used: usize, limit: usize) {
+        assert!(used > limit);
+        SOFT.fetch_add(1, Ordering::Relaxed);
+    }
+    GlobalMiMalloc::set_limit_handler(Some(on_limit));
+    unsafe {
+        // a soft and a hard limit on a heap
+        let heap = MiMallocHeapOwned::new(OwnedHeap::new());
+        heap.set_limit(256 << 10, 1 << 20);
+        let mut blocks = 0;
+        while !mi_heap_malloc(*heap.heap, 1024).is_null() {
+            blocks += 1;
+        }
+        assert!(blocks >= 512 && heap.limit_used() <= 1 << 20);
+        assert!(SOFT.load(Ordering::Relaxed) > 0);
+        #[cfg(feature = "unstable")]
+        {
+            use core::alloc::{Allocator, Layout};
+            assert!(heap.allocate(Layout::new::<[u8; 1024]>()).is_err());
+            heap.set_limit(0, 0);
+            assert!(heap.allocate(Layout::new::<[u8; 1024]>()).is_ok());
+        }
+        heap.heap.destroy();
+
+        // a hard limit on an exclusive arena
+        let mut arena_id: mi_arena_id_t = 0;
+        assert_eq!(
+            mi_reserve_os_memory_ex(64 << 20, false, false, true, &mut arena_id),
+            0
+        );
+        let mut size = 0;
+        let start = mi_arena_area(arena_id, &mut size) as usize;
+        assert!(GlobalMiMalloc::set_arena_limit(arena_id, 0, 2 << 20));
+        let heap = MiMallocHeapOwned::new(OwnedHeap::try_new_in_arena(arena_id).unwrap());
+        loop {
+            let p = mi_heap_malloc(*heap.heap, 4096) as usize;
+            if p == 0 {
+                break;
+            }
+            assert!(p >= start && p < start + size);
+        }
+        assert!(GlobalMiMalloc::arena_limit_used(arena_id) <= 2 << 20);
+        assert_eq!(
+            GlobalMiMalloc::arena_limit_used(arena_id),
+            heap.limit_used()
+        );
+        heap.heap.destroy();
+        assert_eq!(GlobalMiMalloc::arena_limit_used(arena_id), 0);
+    }
+    GlobalMiMalloc::set_limit_handler(None);
+}
+
+#[cfg(feature = "sampling")]
+#[test]
+fn test_heap_profile() {
+    let _options = lock_global_options();
+    let samples = |profile: &str| profile.lines().filter(|l| l.starts_with("1: ")).count();
+    GlobalMiMalloc::set_sample_interval(4096);
+    // about 4000 samples (the countdown of the previous interval runs out first)
+    let kept: Vec<Box<[u8; 1000]>> = (0..16384).map(|_| Box::new([1; 1000])).collect();
+    let mut profile = String::new();
+    GlobalMiMalloc::write_heap_profile(&mut profile).unwrap();
+    assert!(profile.starts_with("heap profile: "), "{}", profile);
+    assert!(profile.contains("@ heap_v2/4096\n") && profile.contains("\nMAPPED_LIBRARIES:\n"));
+    assert!(profile
+        .lines()
+        .any(|l| l.starts_with("1: 1000 [1: 1000] @ 0x")));
+    let live = samples(&profile);
+    assert!(live > 1000, "{}", live);
+    drop(kept);
+    profile.clear();
+    GlobalMiMalloc::write_heap_profile(&mut profile).unwrap();
+    assert!(samples(&profile) < live / 2);
+    GlobalMiMalloc::set_sample_interval(512 * 1024);
+}
+
+#[test]
+fn test_cross_thread_free() {
+    use std::{sync::mpsc, thread};
+    let (tx, rx) = mpsc::channel::<Vec<Box<[u64; 8]>>>();
+    let consumer = thread::spawn(move || {
+        // drops every batch on this thread, i.e. frees into pages of the producer
+        for batch in rx {
+            assert!(batch.iter().enumerate().all(|(i, b)| b[0] == i as u64));
+        }
+        unsafe { mi_collect(false) };
+    });
+    for _ in 0..64 {
+        let batch: Vec<_> = (0..1000).map(|i| Box::new([i as u64; 8])).collect();
+        tx.send(batch).unwrap();
+    }
+    drop(tx);
+    consumer.join().unwrap();
+}
+
+// the abandoned segment lists are process-wide, so the test runs again in a process of its own
+// (the test binary with only this test) where they only hold the segments of this test
+#[test]
+fn test_abandoned_shards() {
+    use crate::raw::{
+        heap::mi_heap_get_default,
+        types::{
+            mi_heap_t, mi_page_kind_MI_PAGE_HUGE, mi_page_kind_MI_PAGE_LARGE,
+            mi_page_kind_MI_PAGE_MEDIUM, mi_page_kind_MI_PAGE_SMALL, mi_segment_t,
+            mi_segments_tld_t,
+        },
+    };
+    use core::alloc::{GlobalAlloc, Layout};
+    use std::{process::Command, thread};
+    extern "C" {
+        // (there is no public way to reclaim all abandoned segments other than on the main thread)
+        fn _mi_abandoned_reclaim_all(heap: *mut mi_heap_t, tld: *mut mi_segments_tld_t);
+    }
+    if std::env::var_os("MIMALLOC_TEST_ABANDONED_SHARDS").is_none() {
+        let status = Command::new(std::env::current_exe().unwrap())
+            .args([
+                "--exact",
+                "tests::test_abandoned_shards",
+                "--test-threads=1",
+            ])
+            .env("MIMALLOC_TEST_ABANDONED_SHARDS", "1")
+            .status()
+            .unwrap();
+        assert!(status.success());
+        return;
+    }
+    let segment = |p: usize| (p & !((4 << 20) - 1)) as *const mi_segment_t;
+    // a thread that exits with a block still allocated abandons its segment
+    let kinds = [
+        (64, mi_page_kind_MI_PAGE_SMALL),
+        (64 << 10, mi_page_kind_MI_PAGE_MEDIUM),
+        (1 << 20, mi_page_kind_MI_PAGE_LARGE),
+        (8 << 20, mi_page_kind_MI_PAGE_HUGE),
+    ];
+    let blocks: Vec<usize> = kinds
+        .iter()
+        .map(|&(size, kind)| {
+            let p = thread::spawn(move || unsafe {
+                GlobalMiMalloc.alloc(Layout::from_size_align(size, 8).unwrap()) as usize
+            })
+            .join()
+            .unwrap();
+            unsafe {
+                assert_eq!((*segment(p)).page_kind, kind);
+                assert_eq!((*segment(p)).thread_id, 0);
+            }
+            p
+        })
+        .collect();
+    // a small allocation of a new thread reclaims from the small segments, and does not visit the
+    // segments of the other page kinds (which were abandoned after it)
+    let small = blocks.clone();
+    thread::spawn(move || unsafe {
+        let layout = Layout::from_size_align(64, 8).unwrap();
+        let p = GlobalMiMalloc.alloc(layout);
+        let thread_id = (*mi_heap_get_default()).thread_id;
+        assert_eq!((*segment(small[0])).thread_id, thread_id);
+        for &q in &small[1..] {
+            assert_eq!((*segment(q)).thread_id, 0);
+            assert_eq!((*segment(q)).abandoned_visits, 0);
+        }
+        GlobalMiMalloc.dealloc(p, layout);
+    })
+    .join()
+    .unwrap();
+    // reclaiming all abandoned segments empties the lists of every page kind
+    thread::spawn(move || unsafe {
+        let heap = mi_heap_get_default();
+        _mi_abandoned_reclaim_all(heap, &mut (*(*heap).tld).segments);
+        for &p in &blocks {
+            assert_eq!((*segment(p)).thread_id, (*heap).thread_id);
+        }
+    })
+    .join()
+    .unwrap();
+}
+
+#[test]
+fn test_thread_burst() {
+    use std::thread;
+    assert!(GlobalMiMalloc::reserve_thread_data(16) > 0);
+    for _ in 0..4 {
+        let threads: Vec<_> = (0..32u64)
+            .map(|i| thread::spawn(move || (0..100).map(|j| *Box::new(i * j)).sum::<u64>()))
+            .collect();
+        let sums: Vec<u64> = threads.into_iter().map(|t| t.join().unwrap()).collect();
+        assert!(sums.iter().enumerate().all(|(i, s)| *s == i as u64 * 4950));
+    }
+}
+
+#[cfg(target_os = "linux")]
+#[test]
+fn test_file_arena() {
+    use crate::arena::{Arena, ArenaOptions};
+    use std::{alloc::Layout, ffi::CString};
+    let path = std::env::temp_dir().join(format!("mimalloc-arena-{}", std::process::id()));
+    let cpath = CString::new(path.to_str().unwrap()).unwrap();
+    let options = ArenaOptions {
+        is_zero: true,
+        ..ArenaOptions::default()
+    };
+    let arena = unsafe { Arena::map_file(&cpath, 33 << 20, &options) }.unwrap();
+    std::fs::remove_file(&path).unwrap();
+    let (start, size) = arena.area();
+    assert_eq!(size, 32 << 20);
+    assert_eq!(GlobalMiMalloc::arena_area(arena.id()), (start, size));
+    let heap = arena.new_heap().unwrap();
+    let mut blocks = vec![std::ptr::null_mut::<u8>(); 1000];
+    for (size, count) in [(16, 1000), (1000, 1000), (100000, 100)] {
+        let layout = Layout::from_size_align(size, 8).unwrap();
+        let blocks = &mut blocks[..count];
+        assert_eq!(heap.allocate_batch(layout, blocks), count);
+        assert!(blocks.iter().all(|&b| arena.contains(b)));
+        unsafe { heap.deallocate_batch(blocks) };
+    }
+    // the arena is exclusive, and a heap of it does not go elsewhere when it is full
+    let other = Box::new(0u64);
+    assert!(!arena.contains(&*other as *const u64 as *const u8));
+    let layout = Layout::from_size_align(1 << 20, 8).unwrap();
+    let mut big = vec![std::ptr::null_mut::<u8>(); 64];
+    let n = heap.allocate_batch(layout, &mut big);
+    assert!(n > 16 && n < 32);
+    assert!(big[..n].iter().all(|&b| arena.contains(b)));
+    unsafe { heap.deallocate_batch(&big[..n]) };
+    let anon = Arena::reserve(8 << 20, &ArenaOptions::default()).unwrap();
+    let heap = anon.new_heap().unwrap();
+    assert_eq!(heap.allocate_batch(layout, &mut big[..4]), 4);
+    assert!(big[..4].iter().all(|&b| anon.contains(b)));
+    unsafe { heap.deallocate_batch(&big[..4]) };
+    // exclusive arenas have blocks of one segment, shared ones keep the larger blocks of mimalloc
+    use crate::raw::extended_functions::{MI_ARENA_BLOCK_SIZE, MI_SEGMENT_SIZE};
+    let exclusive = Arena::reserve(MI_SEGMENT_SIZE + 1, &ArenaOptions::default()).unwrap();
+    assert_eq!(exclusive.area().1, 2 * MI_SEGMENT_SIZE);
+    let options = ArenaOptions {
+        exclusive: false,
+        ..ArenaOptions::default()
+    };
+    let shared = Arena::reserve(MI_SEGMENT_SIZE + 1, &options).unwrap();
+    assert_eq!(shared.area().1, MI_ARENA_BLOCK_SIZE);
+    // an open file is extended, and its offset stays where the caller left it
+    use std::{
+        io::{Seek, Write},
+        os::fd::AsRawFd,
+    };
+    let mut file = std::fs::OpenOptions::new()
+        .read(true)
+        .write(true)
+        .create(true)
+        .truncate(true)
+        .open(&path)
+        .unwrap();
+    std::fs::remove_file(&path).unwrap();
+    file.write_all(b"kept").unwrap();
+    let arena =
+        unsafe { Arena::map_fd(file.as_raw_fd(), 8 << 20, &ArenaOptions::default()) }.unwrap();
+    assert_eq!(file.stream_position().unwrap(), 4);
+    assert_eq!(file.metadata().unwrap().len(), 8 << 20);
+    assert_eq!(
+        unsafe { core::slice::from_raw_parts(arena.area().0, 4) },
+        b"kept"
+    );
+}
+
+// objects beyond the 64MiB of a region are reused as well, and the arenas commit on demand
+#[cfg(feature = "arena-backend")]
+#[test]
+fn test_arena_backend() {
+    let _options = lock_global_options();
+    use crate::raw::{extended_functions::mi_is_in_heap_region, heap::mi_heap_get_default};
+    use core::alloc::{GlobalAlloc, Layout};
+    std::thread::spawn(|| unsafe {
+        let stats = || &(*(*mi_heap_get_default()).tld).stats;
+        let layout = Layout::from_size_align(100 << 20, 8).unwrap();
+        let p = GlobalMiMalloc.alloc(layout);
+        assert!(mi_is_in_heap_region(p as *const _));
+        p.add(layout.size() - 1).write(1);
+        GlobalMiMalloc.dealloc(p, layout);
+        let mmap_calls = stats().mmap_calls.count;
+        for _ in 0..16 {
+            let p = GlobalMiMalloc.alloc(layout);
+            assert!(mi_is_in_heap_region(p as *const _));
+            p.add(layout.size() - 1).write(1);
+            GlobalMiMalloc.dealloc(p, layout);
+        }
+        assert_eq!(stats().mmap_calls.count, mmap_calls);
+    })
+    .join()
+    .unwrap();
+}
+
+// threads that find the arenas full at once grow them by one arena, not one each
+#[cfg(feature = "arena-backend")]
+#[test]
+fn test_arena_grow_burst() {
+    let _options = lock_global_options();
+    use core::alloc::{GlobalAlloc, Layout};
+    use std::sync::{Arc, Barrier};
+    let arenas = || {
+        (1..)
+            .take_while(|&id| !GlobalMiMalloc::arena_area(id).0.is_null())
+            .count()
+    };
+    let before = arenas();
+    // 1GiB in all, more than the free room of the arenas of this test process
+    let layout = Layout::from_size_align(32 << 20, 8).unwrap();
+    let barrier = Arc::new(Barrier::new(32));
+    let workers: Vec<_> = (0..32)
+        .map(|_| {
+            let barrier = barrier.clone();
+            std::thread::spawn(move || {
+                // the thread heap is set up before the burst
+                drop(Box::new(0u64));
+                barrier.wait();
+                unsafe { GlobalMiMalloc.alloc(layout) as usize }
+            })
+        })
+        .collect();
+    let blocks: Vec<usize> = workers.into_iter().map(|w| w.join().unwrap()).collect();
+    // arenas double in size from 256MiB on, so three more hold the burst
+    let grown = arenas() - before;
+    for p in blocks {
+        assert_ne!(p, 0);
+        unsafe { GlobalMiMalloc.dealloc(p as *mut u8, layout) };
+    }
+    assert!(grown <= 3, "{}", grown);
+}
+
+#[cfg(feature = "percpu")]
+#[test]
+fn test_percpu() {
+    use crate::GlobalMiMallocPerCpu;
+    use core::alloc::{GlobalAlloc, Layout};
+    use std::thread;
+    let workers: Vec<_> = (0..8)
+        .map(|t| {
+            thread::spawn(move || unsafe {
+                let mut kept = Vec::new();
+                for i in 0..10000usize {
+                    let layout = Layout::from_size_align(8 + (i % 300), 8 << (i % 4)).unwrap();
+                    let p = GlobalMiMallocPerCpu.alloc_zeroed(layout);
+                    assert!(!p.is_null() && p as usize % layout.align() == 0 && *p == 0);
+                    p.write_bytes(t as u8, layout.size());
+                    let p = GlobalMiMallocPerCpu.realloc(p, layout, layout.size() * 2);
+                    assert_eq!(*p, t as u8);
+                    let layout =
+                        Layout::from_size_align(layout.size() * 2, layout.align()).unwrap();
+                    if i % 2 == 0 {
+                        GlobalMiMallocPerCpu.dealloc(p, layout);
+                    } else {
+                        kept.push((p as usize, layout));
+                    }
+                }
+                kept
+            })
+        })
+        .collect();
+    // free the rest on another thread than the one that allocated it
+    for kept in workers.into_iter().map(|w| w.join().unwrap()) {
+        for (p, layout) in kept {
+            unsafe { GlobalMiMallocPerCpu.dealloc(p as *mut u8, layout) };
+        }
+    }
+}